@@ -0,0 +1,339 @@
+#include "cache.h"
+#include "blame-cache.h"
+#include "dir.h"
+#include "lockfile.h"
+#include "oidset.h"
+#include "quote.h"
+#include "repository.h"
+#include "strmap.h"
+
+/*
+ * The cache lives in $GIT_DIR/blame-cache.  Each (options, path) key gets
+ * a directory named after the hash of the two, holding one file per
+ * commit, named after the commit:
+ *
+ *	blob <blob-oid>
+ *	<lno> <num-lines> <s-lno> <flags> <commit> <previous>\t<path>\t<previous-path>
+ *	...
+ *
+ * Paths are C-quoted when needed; a suspect without a "previous" has the
+ * null oid and an empty path there.  Files are written with a lockfile
+ * and renamed into place, so readers never see a partial file.
+ */
+
+#define BLAME_CACHE_IGNORED	01
+#define BLAME_CACHE_UNBLAMABLE	02
+
+struct blame_cache {
+	struct repository *repo;
+	char *options_key;
+	/* path -> struct blame_cache_dir, read in as paths are asked about */
+	struct strmap dirs;
+};
+
+struct blame_cache_dir {
+	char *path;
+	struct oidset commits;
+};
+
+struct blame_cache *blame_cache_open(struct repository *r,
+				     const char *options_key)
+{
+	struct blame_cache *bc = xcalloc(1, sizeof(*bc));
+
+	bc->repo = r;
+	bc->options_key = xstrdup(options_key);
+	strmap_init(&bc->dirs);
+	return bc;
+}
+
+void blame_cache_close(struct blame_cache *bc)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	if (!bc)
+		return;
+	strmap_for_each_entry(&bc->dirs, &iter, e) {
+		struct blame_cache_dir *dir = e->value;
+		free(dir->path);
+		oidset_clear(&dir->commits);
+	}
+	strmap_clear(&bc->dirs, 1);
+	free(bc->options_key);
+	free(bc);
+}
+
+static struct blame_cache_dir *get_cache_dir(struct blame_cache *bc,
+					     const char *path)
+{
+	struct blame_cache_dir *dir = strmap_get(&bc->dirs, path);
+	git_hash_ctx ctx;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	DIR *d;
+	struct dirent *de;
+
+	if (dir)
+		return dir;
+
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, bc->options_key,
+				 strlen(bc->options_key) + 1);
+	the_hash_algo->update_fn(&ctx, path, strlen(path));
+	the_hash_algo->final_fn(hash, &ctx);
+
+	dir = xcalloc(1, sizeof(*dir));
+	dir->path = repo_git_path(bc->repo, "blame-cache/%s",
+				  hash_to_hex(hash));
+	oidset_init(&dir->commits, 0);
+
+	d = opendir(dir->path);
+	while (d && (de = readdir(d))) {
+		struct object_id oid;
+		const char *end;
+
+		if (!parse_oid_hex(de->d_name, &oid, &end) && !*end)
+			oidset_insert(&dir->commits, &oid);
+	}
+	if (d)
+		closedir(d);
+
+	strmap_put(&bc->dirs, path, dir);
+	return dir;
+}
+
+int blame_cache_has(struct blame_cache *bc,
+		    const struct object_id *commit, const char *path)
+{
+	return oidset_contains(&get_cache_dir(bc, path)->commits, commit);
+}
+
+static const char *parse_cached_path(const char *p, struct strbuf *out)
+{
+	const char *end;
+
+	strbuf_reset(out);
+	if (*p == '"') {
+		if (unquote_c_style(out, p, &end))
+			return NULL;
+		return end;
+	}
+	end = strchrnul(p, '\t');
+	strbuf_add(out, p, end - p);
+	return end;
+}
+
+static int parse_cache_entry(const char *line, struct blame_cache_entry *e)
+{
+	struct strbuf path = STRBUF_INIT;
+	unsigned int flags;
+	const char *p;
+	char *end;
+
+	memset(e, 0, sizeof(*e));
+	e->lno = strtol(line, &end, 10);
+	if (*end != ' ')
+		return -1;
+	e->num_lines = strtol(end + 1, &end, 10);
+	if (*end != ' ' || e->num_lines <= 0)
+		return -1;
+	e->s_lno = strtol(end + 1, &end, 10);
+	if (*end != ' ')
+		return -1;
+	flags = strtoul(end + 1, &end, 10);
+	if (*end != ' ')
+		return -1;
+	e->ignored = !!(flags & BLAME_CACHE_IGNORED);
+	e->unblamable = !!(flags & BLAME_CACHE_UNBLAMABLE);
+
+	if (parse_oid_hex(end + 1, &e->commit, &p) || *p != ' ' ||
+	    parse_oid_hex(p + 1, &e->previous, &p) || *p != '\t')
+		return -1;
+
+	if (!(p = parse_cached_path(p + 1, &path)) || *p != '\t' || !path.len)
+		return -1;
+	e->path = strbuf_detach(&path, NULL);
+	if (!(p = parse_cached_path(p + 1, &path)) || *p) {
+		strbuf_release(&path);
+		FREE_AND_NULL(e->path);
+		return -1;
+	}
+	e->previous_path = strbuf_detach(&path, NULL);
+	return 0;
+}
+
+int blame_cache_lookup(struct blame_cache *bc,
+		       const struct object_id *commit, const char *path,
+		       const struct object_id *blob,
+		       struct blame_cache_result *result)
+{
+	struct blame_cache_dir *dir = get_cache_dir(bc, path);
+	struct strbuf file = STRBUF_INIT, line = STRBUF_INIT;
+	struct object_id cached_blob;
+	const char *p;
+	FILE *fp;
+	int next_lno = 0, ret = -1;
+
+	memset(result, 0, sizeof(*result));
+	if (!oidset_contains(&dir->commits, commit))
+		return -1;
+
+	strbuf_addf(&file, "%s/%s", dir->path, oid_to_hex(commit));
+	fp = fopen(file.buf, "r");
+	strbuf_release(&file);
+	if (!fp)
+		return -1;
+
+	if (strbuf_getline_lf(&line, fp) ||
+	    !skip_prefix(line.buf, "blob ", &p) ||
+	    parse_oid_hex(p, &cached_blob, &p) || *p ||
+	    !oideq(&cached_blob, blob))
+		goto out;
+
+	while (!strbuf_getline_lf(&line, fp)) {
+		struct blame_cache_entry *e;
+
+		ALLOC_GROW(result->entry, result->nr + 1, result->alloc);
+		e = &result->entry[result->nr];
+		if (parse_cache_entry(line.buf, e))
+			goto out;
+		result->nr++;
+		if (e->lno != next_lno)
+			goto out;
+		next_lno += e->num_lines;
+	}
+	ret = 0;
+
+out:
+	if (ret)
+		blame_cache_result_release(result);
+	strbuf_release(&line);
+	fclose(fp);
+	return ret;
+}
+
+int blame_cache_store(struct blame_cache *bc,
+		      const struct object_id *commit, const char *path,
+		      const struct object_id *blob,
+		      const struct blame_cache_result *result)
+{
+	struct blame_cache_dir *dir = get_cache_dir(bc, path);
+	struct lock_file lk = LOCK_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	char *file;
+	int i, ret = 0;
+
+	file = xstrfmt("%s/%s", dir->path, oid_to_hex(commit));
+	if (safe_create_leading_directories(file) ||
+	    hold_lock_file_for_update(&lk, file, 0) < 0) {
+		free(file);
+		return -1;
+	}
+
+	strbuf_addf(&buf, "blob %s\n", oid_to_hex(blob));
+	for (i = 0; i < result->nr; i++) {
+		const struct blame_cache_entry *e = &result->entry[i];
+		unsigned int flags = 0;
+
+		if (e->ignored)
+			flags |= BLAME_CACHE_IGNORED;
+		if (e->unblamable)
+			flags |= BLAME_CACHE_UNBLAMABLE;
+		strbuf_addf(&buf, "%d %d %d %u %s", e->lno, e->num_lines,
+			    e->s_lno, flags, oid_to_hex(&e->commit));
+		strbuf_addf(&buf, " %s\t", oid_to_hex(&e->previous));
+		quote_c_style(e->path, &buf, NULL, 0);
+		strbuf_addch(&buf, '\t');
+		if (e->previous_path)
+			quote_c_style(e->previous_path, &buf, NULL, 0);
+		strbuf_addch(&buf, '\n');
+	}
+
+	if (write_in_full(get_lock_file_fd(&lk), buf.buf, buf.len) < 0 ||
+	    commit_lock_file(&lk) < 0) {
+		rollback_lock_file(&lk);
+		ret = -1;
+	} else
+		oidset_insert(&dir->commits, commit);
+
+	strbuf_release(&buf);
+	free(file);
+	return ret;
+}
+
+void blame_cache_result_release(struct blame_cache_result *result)
+{
+	int i;
+
+	for (i = 0; i < result->nr; i++) {
+		free(result->entry[i].path);
+		free(result->entry[i].previous_path);
+	}
+	FREE_AND_NULL(result->entry);
+	result->nr = result->alloc = 0;
+}
+
+void blame_cache_drop(struct blame_cache *bc,
+		      const struct object_id *commit, const char *path)
+{
+	struct blame_cache_dir *dir = get_cache_dir(bc, path);
+	char *file;
+
+	if (!oidset_remove(&dir->commits, commit))
+		return;
+	file = xstrfmt("%s/%s", dir->path, oid_to_hex(commit));
+	unlink_or_warn(file);
+	free(file);
+}
+
+void blame_cache_prune(struct repository *r, timestamp_t expire)
+{
+	struct strbuf path = STRBUF_INIT;
+	size_t toplen;
+	DIR *top;
+	struct dirent *de;
+
+	strbuf_repo_git_path(&path, r, "blame-cache");
+	top = opendir(path.buf);
+	if (!top)
+		goto out;
+	strbuf_addch(&path, '/');
+	toplen = path.len;
+
+	while ((de = readdir(top))) {
+		size_t dirlen;
+		struct dirent *fe;
+		DIR *d;
+
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		strbuf_setlen(&path, toplen);
+		strbuf_addstr(&path, de->d_name);
+		d = opendir(path.buf);
+		if (!d)
+			continue;
+		strbuf_addch(&path, '/');
+		dirlen = path.len;
+
+		while ((fe = readdir(d))) {
+			struct stat st;
+
+			if (is_dot_or_dotdot(fe->d_name))
+				continue;
+			strbuf_setlen(&path, dirlen);
+			strbuf_addstr(&path, fe->d_name);
+			if (!lstat(path.buf, &st) && S_ISREG(st.st_mode) &&
+			    st.st_mtime <= expire)
+				unlink_or_warn(path.buf);
+		}
+		closedir(d);
+
+		/* fails harmlessly if anything is left */
+		strbuf_setlen(&path, dirlen - 1);
+		rmdir(path.buf);
+	}
+	closedir(top);
+
+out:
+	strbuf_release(&path);
+}
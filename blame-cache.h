@@ -0,0 +1,90 @@
+#ifndef BLAME_CACHE_H
+#define BLAME_CACHE_H
+
+#include "cache.h"
+
+struct repository;
+
+/*
+ * An on-disk store of finished blames, so that blaming a file again, at
+ * the same commit or at a descendant of it, can stop digging where the
+ * earlier run already knows the answer.
+ *
+ * A result is stored for a (commit, path) pair, under a key that also
+ * covers the options that can change the result (see setup_blame_cache()
+ * in blame.c); it records the blob it was computed for, and for every
+ * line of that blob the commit, path and line number the line was
+ * blamed on.
+ */
+struct blame_cache;
+
+struct blame_cache_entry {
+	/* the lines [lno, lno + num_lines) of the cached blob ... */
+	int lno;
+	int num_lines;
+
+	/* ... are blamed on lines starting at s_lno of path in commit */
+	int s_lno;
+	struct object_id commit;
+	char *path;
+
+	/* the blame_origin "previous" of the suspect, if any */
+	struct object_id previous;
+	char *previous_path;
+
+	unsigned ignored:1,
+		 unblamable:1;
+};
+
+struct blame_cache_result {
+	struct blame_cache_entry *entry;
+	int nr, alloc;
+};
+
+/*
+ * Open the blame cache of the repository for blames run with the options
+ * summarized by `options_key`.
+ */
+struct blame_cache *blame_cache_open(struct repository *r,
+				     const char *options_key);
+void blame_cache_close(struct blame_cache *bc);
+
+/*
+ * Look up the blame of `path` in `commit`, which must have been computed
+ * for `blob`.  Returns 0 and fills `result` (sorted by lno, covering the
+ * whole blob) if found, and -1 otherwise.
+ */
+int blame_cache_lookup(struct blame_cache *bc,
+		       const struct object_id *commit, const char *path,
+		       const struct object_id *blob,
+		       struct blame_cache_result *result);
+
+/*
+ * Record `result` as the blame of `path` in `commit`; entries must be
+ * sorted by lno and cover all of `blob`.
+ */
+int blame_cache_store(struct blame_cache *bc,
+		      const struct object_id *commit, const char *path,
+		      const struct object_id *blob,
+		      const struct blame_cache_result *result);
+
+/* Do we have a result for `path` in `commit`, for whatever blob? */
+int blame_cache_has(struct blame_cache *bc,
+		    const struct object_id *commit, const char *path);
+
+/*
+ * Forget the result for `path` in `commit`, e.g. because it names
+ * commits that are no longer there.
+ */
+void blame_cache_drop(struct blame_cache *bc,
+		      const struct object_id *commit, const char *path);
+
+void blame_cache_result_release(struct blame_cache_result *result);
+
+/*
+ * Remove the results of the repository's blame cache that were recorded
+ * at or before `expire`, along with directories left empty.
+ */
+void blame_cache_prune(struct repository *r, timestamp_t expire);
+
+#endif /* BLAME_CACHE_H */
@@ -11,6 +11,13 @@
 #include "commit-slab.h"
 #include "bloom.h"
 #include "commit-graph.h"
+#include "blame-cache.h"
+#include "oid-array.h"
+#include "promisor-remote.h"
+#include "replace-object.h"
+#include "shallow.h"
+#include "userdiff.h"
+#include "thread-utils.h"
 
 define_commit_slab(blame_suspects, struct blame_origin *);
 static struct blame_suspects blame_suspects;
@@ -2083,42 +2090,196 @@ static int handle_split_cb(long start_a, long count_a,
 	return 0;
 }
 
+/*
+ * Prepare mmfile that contains only the lines in ent.
+ */
+static void entry_mmfile(struct blame_scoreboard *sb, struct blame_entry *ent,
+			 mmfile_t *file_o)
+{
+	const char *cp = blame_nth_line(sb, ent->lno);
+
+	file_o->ptr = (char *) cp;
+	file_o->size = blame_nth_line(sb, ent->lno + ent->num_lines) - cp;
+}
+
+/*
+ * The hunks of a diff between a parent blob and the lines of a blame
+ * entry, as found by a worker thread; see diff_entries().
+ */
+struct blame_hunk {
+	long start_a, count_a, start_b, count_b;
+};
+
+struct blame_hunks {
+	struct blame_hunk *hunk;
+	int nr, alloc;
+};
+
 /*
  * Find the lines from parent that are the same as ent so that
  * we can pass blames to it.  file_p has the blob contents for
- * the parent.
+ * the parent.  If hunks is not NULL, it has the diff between the
+ * two, already computed.
  */
 static void find_copy_in_blob(struct blame_scoreboard *sb,
 			      struct blame_entry *ent,
 			      struct blame_origin *parent,
 			      struct blame_entry *split,
-			      mmfile_t *file_p)
+			      mmfile_t *file_p,
+			      const struct blame_hunks *hunks)
 {
-	const char *cp;
 	mmfile_t file_o;
 	struct handle_split_cb_data d;
 
 	memset(&d, 0, sizeof(d));
 	d.sb = sb; d.ent = ent; d.parent = parent; d.split = split;
-	/*
-	 * Prepare mmfile that contains only the lines in ent.
-	 */
-	cp = blame_nth_line(sb, ent->lno);
-	file_o.ptr = (char *) cp;
-	file_o.size = blame_nth_line(sb, ent->lno + ent->num_lines) - cp;
+	entry_mmfile(sb, ent, &file_o);
 
 	/*
 	 * file_o is a part of final image we are annotating.
 	 * file_p partially may match that image.
 	 */
 	memset(split, 0, sizeof(struct blame_entry [3]));
-	if (diff_hunks(file_p, &file_o, handle_split_cb, &d, sb->xdl_opts))
+	if (hunks) {
+		int i;
+		for (i = 0; i < hunks->nr; i++)
+			handle_split_cb(hunks->hunk[i].start_a,
+					hunks->hunk[i].count_a,
+					hunks->hunk[i].start_b,
+					hunks->hunk[i].count_b, &d);
+	} else if (diff_hunks(file_p, &file_o, handle_split_cb, &d, sb->xdl_opts))
 		die("unable to generate diff (%s)",
 		    oid_to_hex(&parent->commit->object.oid));
 	/* remainder, if any, all match the preimage */
 	handle_split(sb, ent, d.tlno, d.plno, ent->num_lines, parent, split);
 }
 
+/*
+ * Looking for moved and copied lines diffs every unblamed entry against
+ * every candidate blob in the parent, which is where "blame -C" spends
+ * its time.  These diffs only read the blobs and the final image, so
+ * they can be run in worker threads ahead of time; what is done with
+ * them stays in the main thread and in the usual order, so the result
+ * does not depend on the number of threads.
+ */
+#define MIN_DIFFS_PER_THREAD 4
+#define DIFF_BATCH_FILES 32
+
+struct diff_entries_work {
+	struct blame_scoreboard *sb;
+	mmfile_t *files;
+	int nr_files;
+	struct blame_entry **ents;
+	int nr_ents;
+	/* result[f * nr_ents + e] is the diff of files[f] and ents[e] */
+	struct blame_hunks *result;
+	int next;
+	pthread_mutex_t lock;
+};
+
+static int record_hunk_cb(long start_a, long count_a,
+			  long start_b, long count_b, void *data)
+{
+	struct blame_hunks *hunks = data;
+	struct blame_hunk *h;
+
+	ALLOC_GROW(hunks->hunk, hunks->nr + 1, hunks->alloc);
+	h = &hunks->hunk[hunks->nr++];
+	h->start_a = start_a;
+	h->count_a = count_a;
+	h->start_b = start_b;
+	h->count_b = count_b;
+	return 0;
+}
+
+static void *diff_entries_thread(void *data)
+{
+	struct diff_entries_work *w = data;
+	int total = w->nr_files * w->nr_ents;
+
+	for (;;) {
+		int i;
+		mmfile_t file_o;
+
+		pthread_mutex_lock(&w->lock);
+		i = w->next++;
+		pthread_mutex_unlock(&w->lock);
+		if (i >= total)
+			break;
+
+		entry_mmfile(w->sb, w->ents[i % w->nr_ents], &file_o);
+		if (diff_hunks(&w->files[i / w->nr_ents], &file_o,
+			       record_hunk_cb, &w->result[i], w->sb->xdl_opts))
+			die("unable to generate diff");
+	}
+	return NULL;
+}
+
+static int blame_threads(struct blame_scoreboard *sb, int nr_diffs)
+{
+	int nr_threads = sb->threads;
+
+	if (!HAVE_THREADS)
+		return 1;
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	if (nr_diffs / MIN_DIFFS_PER_THREAD < nr_threads)
+		nr_threads = nr_diffs / MIN_DIFFS_PER_THREAD;
+	return nr_threads;
+}
+
+/*
+ * Diff each of ents[] against each of files[] in worker threads.
+ * Returns NULL when it is not worth it, in which case the caller
+ * should let find_copy_in_blob() diff them as it goes.
+ */
+static struct blame_hunks *diff_entries(struct blame_scoreboard *sb,
+					mmfile_t *files, int nr_files,
+					struct blame_entry **ents, int nr_ents)
+{
+	struct diff_entries_work w;
+	pthread_t *threads;
+	int nr_threads = blame_threads(sb, nr_files * nr_ents);
+	int i;
+
+	if (nr_threads < 2)
+		return NULL;
+
+	memset(&w, 0, sizeof(w));
+	w.sb = sb;
+	w.files = files;
+	w.nr_files = nr_files;
+	w.ents = ents;
+	w.nr_ents = nr_ents;
+	CALLOC_ARRAY(w.result, nr_files * nr_ents);
+	pthread_mutex_init(&w.lock, NULL);
+
+	ALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&threads[i], NULL,
+					 diff_entries_thread, &w);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	pthread_mutex_destroy(&w.lock);
+	return w.result;
+}
+
+static void free_blame_hunks(struct blame_hunks *hunks, int nr)
+{
+	int i;
+
+	if (!hunks)
+		return;
+	for (i = 0; i < nr; i++)
+		free(hunks[i].hunk);
+	free(hunks);
+}
+
 /* Move all blame entries from list *source that have a score smaller
  * than score_min to the front of list *small.
  * Returns a pointer to the link pointing to the old head of the small list.
@@ -2178,9 +2339,20 @@ static void find_move_in_parent(struct blame_scoreboard *sb,
 	do {
 		struct blame_entry **unblamedtail = &unblamed;
 		struct blame_entry *next;
-		for (e = unblamed; e; e = next) {
+		struct blame_entry **ents = NULL;
+		struct blame_hunks *hunks;
+		int nr_ents = 0, alloc_ents = 0, i;
+
+		for (e = unblamed; e; e = e->next) {
+			ALLOC_GROW(ents, nr_ents + 1, alloc_ents);
+			ents[nr_ents++] = e;
+		}
+		hunks = diff_entries(sb, &file_p, 1, ents, nr_ents);
+
+		for (e = unblamed, i = 0; e; e = next, i++) {
 			next = e->next;
-			find_copy_in_blob(sb, e, parent, split, &file_p);
+			find_copy_in_blob(sb, e, parent, split, &file_p,
+					  hunks ? &hunks[i] : NULL);
 			if (split[1].suspect &&
 			    sb->move_score < blame_entry_score(sb, &split[1])) {
 				split_blame(blamed, &unblamedtail, split, e);
@@ -2190,6 +2362,8 @@ static void find_move_in_parent(struct blame_scoreboard *sb,
 			}
 			decref_split(split);
 		}
+		free_blame_hunks(hunks, nr_ents);
+		free(ents);
 		*unblamedtail = NULL;
 		toosmall = filter_small(sb, toosmall, &unblamed, sb->move_score);
 	} while (unblamed);
@@ -2276,39 +2450,67 @@ static void find_copy_in_parent(struct blame_scoreboard *sb,
 
 	do {
 		struct blame_entry **unblamedtail = &unblamed;
-		blame_list = setup_blame_list(unblamed, &num_ents);
+		struct blame_entry **ents;
+		int batch;
 
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			struct diff_filepair *p = diff_queued_diff.queue[i];
-			struct blame_origin *norigin;
-			mmfile_t file_p;
-			struct blame_entry potential[3];
-
-			if (!DIFF_FILE_VALID(p->one))
-				continue; /* does not exist in parent */
-			if (S_ISGITLINK(p->one->mode))
-				continue; /* ignore git links */
-			if (porigin && !strcmp(p->one->path, porigin->path))
-				/* find_move already dealt with this path */
-				continue;
+		blame_list = setup_blame_list(unblamed, &num_ents);
+		ALLOC_ARRAY(ents, num_ents);
+		for (j = 0; j < num_ents; j++)
+			ents[j] = blame_list[j].ent;
 
-			norigin = get_origin(parent, p->one->path);
-			oidcpy(&norigin->blob_oid, &p->one->oid);
-			norigin->mode = p->one->mode;
-			fill_origin_blob(&sb->revs->diffopt, norigin, &file_p,
-					 &sb->num_read_blob, 0);
-			if (!file_p.ptr)
-				continue;
+		/*
+		 * Go through the candidates a batch at a time, so that
+		 * their diffs against the entries can be computed in
+		 * parallel; one at a time if we are not going to.
+		 */
+		batch = blame_threads(sb, num_ents * DIFF_BATCH_FILES) < 2 ?
+			1 : DIFF_BATCH_FILES;
+		for (i = 0; i < diff_queued_diff.nr; ) {
+			struct blame_origin *norigins[DIFF_BATCH_FILES];
+			mmfile_t files[DIFF_BATCH_FILES];
+			struct blame_hunks *hunks;
+			int nr = 0, k;
+
+			for (; nr < batch && i < diff_queued_diff.nr; i++) {
+				struct diff_filepair *p = diff_queued_diff.queue[i];
+				struct blame_origin *norigin;
+
+				if (!DIFF_FILE_VALID(p->one))
+					continue; /* does not exist in parent */
+				if (S_ISGITLINK(p->one->mode))
+					continue; /* ignore git links */
+				if (porigin && !strcmp(p->one->path, porigin->path))
+					/* find_move already dealt with this path */
+					continue;
 
-			for (j = 0; j < num_ents; j++) {
-				find_copy_in_blob(sb, blame_list[j].ent,
-						  norigin, potential, &file_p);
-				copy_split_if_better(sb, blame_list[j].split,
-						     potential);
-				decref_split(potential);
+				norigin = get_origin(parent, p->one->path);
+				oidcpy(&norigin->blob_oid, &p->one->oid);
+				norigin->mode = p->one->mode;
+				fill_origin_blob(&sb->revs->diffopt, norigin,
+						 &files[nr], &sb->num_read_blob, 0);
+				if (!files[nr].ptr)
+					continue;
+				norigins[nr++] = norigin;
+			}
+			hunks = diff_entries(sb, files, nr, ents, num_ents);
+
+			for (k = 0; k < nr; k++) {
+				for (j = 0; j < num_ents; j++) {
+					struct blame_entry potential[3];
+
+					find_copy_in_blob(sb, blame_list[j].ent,
+							  norigins[k], potential,
+							  &files[k],
+							  hunks ? &hunks[k * num_ents + j] : NULL);
+					copy_split_if_better(sb, blame_list[j].split,
+							     potential);
+					decref_split(potential);
+				}
+				blame_origin_decref(norigins[k]);
 			}
-			blame_origin_decref(norigin);
+			free_blame_hunks(hunks, nr * num_ents);
 		}
+		free(ents);
 
 		for (j = 0; j < num_ents; j++) {
 			struct blame_entry *split = blame_list[j].split;
@@ -2467,6 +2669,22 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 		}
 	}
 
+	if (has_promisor_remote()) {
+		/*
+		 * The blobs of all parents are compared with ours below;
+		 * fetch the missing ones with a single request.
+		 */
+		struct oid_array to_fetch = OID_ARRAY_INIT;
+
+		promisor_remote_prefetch_add(sb->repo, &to_fetch,
+					     &origin->blob_oid);
+		for (i = 0; i < num_sg; i++)
+			if (sg_origin[i])
+				promisor_remote_prefetch_add(sb->repo, &to_fetch,
+							     &sg_origin[i]->blob_oid);
+		promisor_remote_prefetch(sb->repo, &to_fetch);
+	}
+
 	sb->num_commits++;
 	for (i = 0, sg = first_scapegoat(revs, commit, sb->reverse);
 	     i < num_sg && sg;
@@ -2578,6 +2796,133 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 		free(sg_origin);
 }
 
+/*
+ * Can every commit a cached result names be used?  A result may outlive
+ * commits that were pruned since, or name ones we never had.
+ */
+static int cached_commits_usable(struct blame_scoreboard *sb,
+				 const struct blame_cache_result *res)
+{
+	int i;
+
+	for (i = 0; i < res->nr; i++) {
+		const struct blame_cache_entry *c = &res->entry[i];
+		struct commit *commit = lookup_commit(sb->repo, &c->commit);
+
+		if (!commit || repo_parse_commit_gently(sb->repo, commit, 1))
+			return 0;
+		if (is_null_oid(&c->previous))
+			continue;
+		commit = lookup_commit(sb->repo, &c->previous);
+		if (!commit || repo_parse_commit_gently(sb->repo, commit, 1))
+			return 0;
+	}
+	return 1;
+}
+
+/* The entry's commits must have passed cached_commits_usable() */
+static struct blame_origin *cached_suspect(struct blame_scoreboard *sb,
+					  const struct blame_cache_entry *c)
+{
+	struct commit *commit = lookup_commit(sb->repo, &c->commit);
+	struct blame_origin *o;
+
+	/* treat root commit as boundary, as assign_blame() would */
+	if (!commit->parents && !sb->show_root)
+		commit->object.flags |= UNINTERESTING;
+
+	o = get_origin(commit, c->path);
+	if (!o->previous && !is_null_oid(&c->previous))
+		o->previous = get_origin(lookup_commit(sb->repo, &c->previous),
+					 c->previous_path);
+	return o;
+}
+
+/*
+ * If the blame cache knows the blame for all of origin's blob, take the
+ * suspects of origin straight to their final owners instead of passing
+ * them down the history.  Returns 1 if it did so.
+ */
+static int use_cached_blame(struct blame_scoreboard *sb,
+			    struct blame_origin *origin)
+{
+	struct blame_cache_result res;
+	struct blame_entry *e, *next;
+	int num_lines;
+
+	if (!sb->cache ||
+	    (!sb->cache_ancestors && origin->commit != sb->final) ||
+	    is_null_oid(&origin->commit->object.oid) ||
+	    fill_blob_sha1_and_mode(sb->repo, origin) ||
+	    blame_cache_lookup(sb->cache, &origin->commit->object.oid,
+			       origin->path, &origin->blob_oid, &res))
+		return 0;
+
+	if (!cached_commits_usable(sb, &res)) {
+		blame_cache_drop(sb->cache, &origin->commit->object.oid,
+				 origin->path);
+		blame_cache_result_release(&res);
+		return 0;
+	}
+
+	num_lines = res.nr ? res.entry[res.nr - 1].lno +
+			     res.entry[res.nr - 1].num_lines : 0;
+	for (e = origin->suspects; e; e = e->next)
+		if (e->s_lno < 0 || num_lines < e->s_lno + e->num_lines) {
+			blame_cache_result_release(&res);
+			return 0;
+		}
+
+	for (e = origin->suspects; e; e = next) {
+		int lno = e->lno, s_lno = e->s_lno, left = e->num_lines;
+		int lo = 0, hi = res.nr;
+
+		/* find the cached entry holding s_lno */
+		while (hi - lo > 1) {
+			int mi = lo + (hi - lo) / 2;
+			if (res.entry[mi].lno <= s_lno)
+				lo = mi;
+			else
+				hi = mi;
+		}
+
+		while (left) {
+			const struct blame_cache_entry *c = &res.entry[lo++];
+			int off = s_lno - c->lno;
+			int len = c->num_lines - off;
+			struct blame_entry *n;
+
+			if (left < len)
+				len = left;
+			n = xcalloc(1, sizeof(*n));
+			n->lno = lno;
+			n->num_lines = len;
+			n->s_lno = c->s_lno + off;
+			n->suspect = cached_suspect(sb, c);
+			n->suspect->guilty = 1;
+			n->ignored = e->ignored || c->ignored;
+			n->unblamable = e->unblamable || c->unblamable;
+			if (sb->found_guilty_entry)
+				sb->found_guilty_entry(n, sb->found_guilty_entry_data);
+			n->next = sb->ent;
+			sb->ent = n;
+
+			lno += len;
+			s_lno += len;
+			left -= len;
+		}
+
+		next = e->next;
+		blame_origin_decref(e->suspect);
+		free(e);
+	}
+	origin->suspects = NULL;
+
+	blame_cache_result_release(&res);
+	sb->num_cache_hits++;
+	return 1;
+}
+
 /*
  * The main loop -- while we have blobs with lines whose true origin
  * is still unknown, pick one blob, and allow its lines to pass blames
@@ -2610,9 +2955,10 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 		parse_commit(commit);
 		if (sb->reverse ||
 		    (!(commit->object.flags & UNINTERESTING) &&
-		     !(revs->max_age != -1 && commit->date < revs->max_age)))
-			pass_blame(sb, suspect, opt);
-		else {
+		     !(revs->max_age != -1 && commit->date < revs->max_age))) {
+			if (!use_cached_blame(sb, suspect))
+				pass_blame(sb, suspect, opt);
+		} else {
 			commit->object.flags |= UNINTERESTING;
 			if (commit->object.parsed)
 				mark_parents_uninteresting(commit);
@@ -2911,8 +3257,142 @@ void setup_blame_bloom_data(struct blame_scoreboard *sb)
 	sb->bloom_data = bd;
 }
 
+static int history_is_rewritten(struct repository *r)
+{
+	if (read_replace_refs) {
+		prepare_replace_object(r);
+		if (hashmap_get_size(&r->objects->replace_map->map))
+			return 1;
+	}
+
+	prepare_commit_graft(r);
+	if (r->parsed_objects &&
+	    (r->parsed_objects->grafts_nr ||
+	     r->parsed_objects->substituted_parent))
+		return 1;
+	return is_repository_shallow(r);
+}
+
+/*
+ * Results can be reused only by blames that would have computed the same
+ * thing: the key covers every option that changes how blame is passed
+ * down, and we do not cache at all where the history walked is cut short
+ * (bottom commits, --since, --reverse), where the blamed contents
+ * depend on more than the blobs (textconv, which is configured outside
+ * the repository's history), or where the history itself is not what
+ * the commits say (a shallow repository, grafts, replace refs), since a
+ * result recorded then would not survive the history changing.
+ *
+ * With -M/-C or ignored revisions, how lines are blamed depends on how
+ * they are grouped into blame entries, which differs between an origin
+ * reached from a descendant and the same origin blamed on its own; so
+ * for those, only a result for the very commit and file being blamed is
+ * reused, and only for a blame of the whole file.
+ */
+void setup_blame_cache(struct blame_scoreboard *sb, int opt, int whole_file)
+{
+	struct rev_info *revs = sb->revs;
+	struct userdiff_driver *driver;
+	struct strbuf key = STRBUF_INIT;
+	struct oid_array ignored = OID_ARRAY_INIT;
+	struct oidset_iter iter;
+	const struct object_id *oid;
+	int i;
+
+	if (sb->reverse || revs->max_age != -1)
+		return;
+	for (i = 0; i < revs->cmdline.nr; i++)
+		if (revs->cmdline.rev[i].flags & UNINTERESTING)
+			return;
+	if (revs->diffopt.flags.allow_textconv &&
+	    (driver = userdiff_find_by_path(sb->repo->index, sb->path)) &&
+	    driver->textconv)
+		return;
+	if (history_is_rewritten(sb->repo))
+		return;
+
+	sb->cache_ancestors = !(opt & (PICKAXE_BLAME_MOVE | PICKAXE_BLAME_COPY)) &&
+			      !oidset_size(&sb->ignore_list);
+	if (!sb->cache_ancestors && !whole_file)
+		return;
+	sb->cache_store = whole_file && !is_null_oid(&sb->final->object.oid);
+
+	strbuf_addf(&key, "blame v1 xdl %d opt %d move %u copy %u",
+		    sb->xdl_opts, opt, sb->move_score, sb->copy_score);
+	strbuf_addf(&key, " first-parent %d no-rename %d textconv %d",
+		    revs->first_parent_only, sb->no_whole_file_rename,
+		    revs->diffopt.flags.allow_textconv);
+	oidset_iter_init(&sb->ignore_list, &iter);
+	while ((oid = oidset_iter_next(&iter)))
+		oid_array_append(&ignored, oid);
+	oid_array_sort(&ignored);
+	for (i = 0; i < ignored.nr; i++)
+		strbuf_addf(&key, " ignore %s", oid_to_hex(&ignored.oid[i]));
+	oid_array_clear(&ignored);
+
+	sb->cache = blame_cache_open(sb->repo, key.buf);
+	strbuf_release(&key);
+}
+
+/*
+ * Record the finished blame of the final commit in the blame cache.
+ * This sorts sb->ent.
+ */
+void store_blame_cache(struct blame_scoreboard *sb)
+{
+	struct blame_cache_result res = { NULL };
+	struct blame_origin *o;
+	struct blame_entry *e;
+	int lno = 0;
+
+	if (!sb->cache || !sb->cache_store ||
+	    blame_cache_has(sb->cache, &sb->final->object.oid, sb->path))
+		return;
+	for (o = get_blame_suspects(sb->final); o; o = o->next)
+		if (!strcmp(o->path, sb->path))
+			break;
+	if (!o || is_null_oid(&o->blob_oid))
+		return;
+
+	blame_sort_final(sb);
+	for (e = sb->ent; e; e = e->next) {
+		struct blame_cache_entry *c;
+
+		if (e->lno != lno)
+			goto out;
+		lno += e->num_lines;
+
+		ALLOC_GROW(res.entry, res.nr + 1, res.alloc);
+		c = &res.entry[res.nr++];
+		memset(c, 0, sizeof(*c));
+		c->lno = e->lno;
+		c->num_lines = e->num_lines;
+		c->s_lno = e->s_lno;
+		oidcpy(&c->commit, &e->suspect->commit->object.oid);
+		c->path = xstrdup(e->suspect->path);
+		if (e->suspect->previous) {
+			oidcpy(&c->previous, &e->suspect->previous->commit->object.oid);
+			c->previous_path = xstrdup(e->suspect->previous->path);
+		}
+		c->ignored = !!e->ignored;
+		c->unblamable = !!e->unblamable;
+	}
+	if (lno == sb->num_lines)
+		blame_cache_store(sb->cache, &sb->final->object.oid, sb->path,
+				  &o->blob_oid, &res);
+out:
+	blame_cache_result_release(&res);
+}
+
 void cleanup_scoreboard(struct blame_scoreboard *sb)
 {
+	if (sb->cache) {
+		trace2_data_intmax("blame", sb->repo, "cache/hits",
+				   sb->num_cache_hits);
+		blame_cache_close(sb->cache);
+		sb->cache = NULL;
+	}
+
 	if (sb->bloom_data) {
 		int i;
 		for (i = 0; i < sb->bloom_data->nr; i++) {
@@ -101,6 +101,7 @@ struct blame_entry {
 };
 
 struct blame_bloom_data;
+struct blame_cache;
 
 /*
  * The current state of the blame assignment.
@@ -143,6 +144,12 @@ struct blame_scoreboard {
 	unsigned move_score;
 	unsigned copy_score;
 
+	/*
+	 * threads to use for finding moved and copied lines; 0 means
+	 * as many as there are CPUs
+	 */
+	int threads;
+
 	/* use this file's contents as the final image */
 	const char *contents_from;
 
@@ -159,6 +166,17 @@ struct blame_scoreboard {
 
 	void *found_guilty_entry_data;
 	struct blame_bloom_data *bloom_data;
+
+	/*
+	 * Finished blames from earlier runs; see blame-cache.h.  When
+	 * cache_ancestors is not set, only a result for the final commit
+	 * itself may be reused; cache_store says whether to record the
+	 * result of this run.
+	 */
+	struct blame_cache *cache;
+	int cache_ancestors;
+	int cache_store;
+	int num_cache_hits;
 };
 
 /*
@@ -183,6 +201,8 @@ void init_scoreboard(struct blame_scoreboard *sb);
 void setup_scoreboard(struct blame_scoreboard *sb,
 		      struct blame_origin **orig);
 void setup_blame_bloom_data(struct blame_scoreboard *sb);
+void setup_blame_cache(struct blame_scoreboard *sb, int opt, int whole_file);
+void store_blame_cache(struct blame_scoreboard *sb);
 void cleanup_scoreboard(struct blame_scoreboard *sb);
 
 struct blame_entry *blame_entry_prepend(struct blame_entry *head,
@@ -1,11 +1,18 @@
 #include "git-compat-util.h"
 #include "bloom.h"
 #include "diff.h"
-#include "diffcore.h"
 #include "revision.h"
 #include "hashmap.h"
 #include "commit-graph.h"
 #include "commit.h"
+#include "progress.h"
+#include "thread-utils.h"
+
+/*
+ * Computing a filter costs a tree diff; below this many filters per
+ * thread, starting the threads is not worth it.
+ */
+#define MIN_FILTERS_PER_THREAD 16
 
 define_commit_slab(bloom_filter_slab, struct bloom_filter);
 
@@ -144,6 +151,46 @@ void clear_bloom_key(struct bloom_key *key)
 	FREE_AND_NULL(key->hashes);
 }
 
+struct bloom_keyvec *bloom_keyvec_new(const char *path, size_t len,
+				      const struct bloom_filter_settings *settings)
+{
+	struct bloom_keyvec *vec;
+	size_t count = 1, i;
+	const char *p;
+
+	/*
+	 * At this point, the path is normalized to use Unix-style path
+	 * separators, which is how the changed-path Bloom filters store
+	 * the paths.
+	 */
+	for (i = 0; i < len; i++)
+		if (path[i] == '/')
+			count++;
+
+	vec = xcalloc(1, st_add(sizeof(*vec),
+				st_mult(sizeof(struct bloom_key), count)));
+	vec->count = count;
+
+	fill_bloom_key(path, len, &vec->key[0], settings);
+	count = 1;
+	for (p = path + len - 1; p > path; p--)
+		if (*p == '/')
+			fill_bloom_key(path, p - path, &vec->key[count++],
+				       settings);
+	return vec;
+}
+
+void bloom_keyvec_free(struct bloom_keyvec *vec)
+{
+	size_t i;
+
+	if (!vec)
+		return;
+	for (i = 0; i < vec->count; i++)
+		clear_bloom_key(&vec->key[i]);
+	free(vec);
+}
+
 void add_key_to_filter(const struct bloom_key *key,
 		       struct bloom_filter *filter,
 		       const struct bloom_filter_settings *settings)
@@ -184,6 +231,157 @@ static void init_truncated_large_filter(struct bloom_filter *filter)
 	filter->len = 1;
 }
 
+struct changed_paths {
+	struct hashmap pathmap;
+	int nr, max;
+};
+
+static void add_changed_path(struct diff_options *opt, const char *fullpath)
+{
+	struct changed_paths *cp = opt->change_fn_data;
+	struct pathmap_hash_entry *e;
+	char *path;
+
+	if (++cp->nr > cp->max) {
+		/* the filter will be a truncated one; stop the tree walk */
+		opt->flags.has_changes = 1;
+		return;
+	}
+
+	/*
+	 * Add each leading directory of the changed file, i.e. for
+	 * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so
+	 * the Bloom filter could be used to speed up commands like
+	 * 'git log dir/subdir', too.
+	 *
+	 * Note that directories are added without the trailing '/'.
+	 */
+	path = xstrdup(fullpath);
+	do {
+		char *last_slash = strrchr(path, '/');
+
+		FLEX_ALLOC_STR(e, path, path);
+		hashmap_entry_init(&e->entry, strhash(path));
+
+		if (!hashmap_get(&cp->pathmap, &e->entry, NULL))
+			hashmap_add(&cp->pathmap, &e->entry);
+		else
+			free(e);
+
+		if (!last_slash)
+			last_slash = path;
+		*last_slash = '\0';
+
+	} while (*path);
+	free(path);
+}
+
+static void changed_path_add_remove(struct diff_options *opt,
+				    int addremove, unsigned mode,
+				    const struct object_id *oid,
+				    int oid_valid,
+				    const char *fullpath,
+				    unsigned dirty_submodule)
+{
+	add_changed_path(opt, fullpath);
+}
+
+static void changed_path_change(struct diff_options *opt,
+				unsigned old_mode, unsigned new_mode,
+				const struct object_id *old_oid,
+				const struct object_id *new_oid,
+				int old_oid_valid, int new_oid_valid,
+				const char *fullpath,
+				unsigned old_dirty_submodule,
+				unsigned new_dirty_submodule)
+{
+	add_changed_path(opt, fullpath);
+}
+
+static void setup_filter_diffopt(struct repository *r,
+				 struct diff_options *diffopt)
+{
+	repo_diff_setup(r, diffopt);
+	diffopt->flags.recursive = 1;
+	diffopt->detect_rename = 0;
+	/* lets add_changed_path() stop the walk early */
+	diffopt->flags.quick = 1;
+	diffopt->add_remove = changed_path_add_remove;
+	diffopt->change = changed_path_change;
+	diff_setup_done(diffopt);
+}
+
+/*
+ * Fill `filter` with the paths that differ between the two trees, using
+ * a copy of `tmpl` as set up by setup_filter_diffopt().  The changes are
+ * collected through our own callbacks rather than in the global diff
+ * queue, and only the object store is read, so that several threads can
+ * do this at once with enable_obj_read_lock() in effect.
+ */
+static enum bloom_filter_computed compute_filter(const struct diff_options *tmpl,
+						 const struct object_id *old_tree,
+						 const struct object_id *new_tree,
+						 struct bloom_filter *filter,
+						 const struct bloom_filter_settings *settings)
+{
+	enum bloom_filter_computed computed = BLOOM_COMPUTED;
+	struct changed_paths cp = {
+		.pathmap = HASHMAP_INIT(pathmap_cmp, NULL),
+		.max = settings->max_changed_paths,
+	};
+	struct pathmap_hash_entry *e;
+	struct hashmap_iter iter;
+	struct diff_options diffopt;
+
+	memcpy(&diffopt, tmpl, sizeof(diffopt));
+	diffopt.change_fn_data = &cp;
+
+	diff_tree_oid(old_tree, new_tree, "", &diffopt);
+
+	if (cp.nr > settings->max_changed_paths ||
+	    hashmap_get_size(&cp.pathmap) > settings->max_changed_paths) {
+		init_truncated_large_filter(filter);
+		computed |= BLOOM_TRUNC_LARGE;
+		goto cleanup;
+	}
+
+	filter->len = (hashmap_get_size(&cp.pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	if (!filter->len) {
+		computed |= BLOOM_TRUNC_EMPTY;
+		filter->len = 1;
+	}
+	CALLOC_ARRAY(filter->data, filter->len);
+
+	hashmap_for_each_entry(&cp.pathmap, &iter, e, entry) {
+		struct bloom_key key;
+		fill_bloom_key(e->path, strlen(e->path), &key, settings);
+		add_key_to_filter(&key, filter, settings);
+		clear_bloom_key(&key);
+	}
+
+cleanup:
+	hashmap_clear_and_free(&cp.pathmap, struct pathmap_hash_entry, entry);
+	return computed;
+}
+
+/*
+ * The trees to compare for the filter of `c`; parses `c` and its first
+ * parent as needed, so must be called from the main thread.
+ */
+static void get_filter_trees(struct repository *r, struct commit *c,
+			     const struct object_id **old_tree,
+			     const struct object_id **new_tree)
+{
+	/* ensure commit is parsed so we have parent information */
+	repo_parse_commit(r, c);
+	*new_tree = get_commit_tree_oid(c);
+	*old_tree = NULL;
+	if (c->parents) {
+		repo_parse_commit(r, c->parents->item);
+		*old_tree = get_commit_tree_oid(c->parents->item);
+	}
+}
+
 struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 struct commit *c,
 						 int compute_if_not_present,
@@ -191,7 +389,8 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 enum bloom_filter_computed *computed)
 {
 	struct bloom_filter *filter;
-	int i;
+	const struct object_id *old_tree, *new_tree;
+	enum bloom_filter_computed result;
 	struct diff_options diffopt;
 
 	if (computed)
@@ -213,96 +412,111 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 	if (!compute_if_not_present)
 		return NULL;
 
-	repo_diff_setup(r, &diffopt);
-	diffopt.flags.recursive = 1;
-	diffopt.detect_rename = 0;
-	diffopt.max_changes = settings->max_changed_paths;
-	diff_setup_done(&diffopt);
+	setup_filter_diffopt(r, &diffopt);
+	get_filter_trees(r, c, &old_tree, &new_tree);
+	result = compute_filter(&diffopt, old_tree, new_tree, filter, settings);
+	if (computed)
+		*computed = result;
 
-	/* ensure commit is parsed so we have parent information */
-	repo_parse_commit(r, c);
+	return filter;
+}
 
-	if (c->parents)
-		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
-	else
-		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
-	diffcore_std(&diffopt);
-
-	if (diff_queued_diff.nr <= settings->max_changed_paths) {
-		struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
-		struct pathmap_hash_entry *e;
-		struct hashmap_iter iter;
-
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			const char *path = diff_queued_diff.queue[i]->two->path;
-
-			/*
-			 * Add each leading directory of the changed file, i.e. for
-			 * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so
-			 * the Bloom filter could be used to speed up commands like
-			 * 'git log dir/subdir', too.
-			 *
-			 * Note that directories are added without the trailing '/'.
-			 */
-			do {
-				char *last_slash = strrchr(path, '/');
-
-				FLEX_ALLOC_STR(e, path, path);
-				hashmap_entry_init(&e->entry, strhash(path));
-
-				if (!hashmap_get(&pathmap, &e->entry, NULL))
-					hashmap_add(&pathmap, &e->entry);
-				else
-					free(e);
-
-				if (!last_slash)
-					last_slash = (char*)path;
-				*last_slash = '\0';
-
-			} while (*path);
-
-			diff_free_filepair(diff_queued_diff.queue[i]);
-		}
+struct compute_filters_work {
+	struct diff_options diffopt;
+	const struct bloom_filter_settings *settings;
+	const struct object_id **old_trees, **new_trees;
+	struct bloom_filter **filters;
+	enum bloom_filter_computed *computed;
+	int nr;
+	int next;
+	struct progress *progress;
+	uint64_t *progress_cnt;
+	pthread_mutex_t lock;
+};
 
-		if (hashmap_get_size(&pathmap) > settings->max_changed_paths) {
-			init_truncated_large_filter(filter);
-			if (computed)
-				*computed |= BLOOM_TRUNC_LARGE;
-			goto cleanup;
-		}
+static void *compute_filters_thread(void *data)
+{
+	struct compute_filters_work *w = data;
+	int i = -1;
+
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		if (i >= 0)
+			display_progress(w->progress, ++*w->progress_cnt);
+		i = w->next++;
+		pthread_mutex_unlock(&w->lock);
+		if (i >= w->nr)
+			break;
+
+		w->computed[i] = compute_filter(&w->diffopt, w->old_trees[i],
+						w->new_trees[i], w->filters[i],
+						w->settings);
+	}
+	return NULL;
+}
 
-		filter->len = (hashmap_get_size(&pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
-		if (!filter->len) {
-			if (computed)
-				*computed |= BLOOM_TRUNC_EMPTY;
-			filter->len = 1;
-		}
-		CALLOC_ARRAY(filter->data, filter->len);
+void batch_compute_bloom_filters(struct repository *r,
+				 struct commit **commits, int nr,
+				 const struct bloom_filter_settings *settings,
+				 int nr_threads,
+				 enum bloom_filter_computed *computed,
+				 struct progress *progress,
+				 uint64_t *progress_cnt)
+{
+	struct compute_filters_work w;
+	int i;
 
-		hashmap_for_each_entry(&pathmap, &iter, e, entry) {
-			struct bloom_key key;
-			fill_bloom_key(e->path, strlen(e->path), &key, settings);
-			add_key_to_filter(&key, filter, settings);
+	if (!HAVE_THREADS)
+		nr_threads = 1;
+	else if (!nr_threads)
+		nr_threads = online_cpus();
+	if (nr / MIN_FILTERS_PER_THREAD < nr_threads)
+		nr_threads = nr / MIN_FILTERS_PER_THREAD;
+
+	/*
+	 * Everything that touches the object hash or the filter slab is
+	 * done here, up front; the threads only read trees.
+	 */
+	memset(&w, 0, sizeof(w));
+	setup_filter_diffopt(r, &w.diffopt);
+	w.settings = settings;
+	w.nr = nr;
+	w.computed = computed;
+	w.progress = progress;
+	w.progress_cnt = progress_cnt;
+	ALLOC_ARRAY(w.old_trees, nr);
+	ALLOC_ARRAY(w.new_trees, nr);
+	ALLOC_ARRAY(w.filters, nr);
+	for (i = 0; i < nr; i++) {
+		get_filter_trees(r, commits[i], &w.old_trees[i], &w.new_trees[i]);
+		w.filters[i] = bloom_filter_slab_at(&bloom_filters, commits[i]);
+	}
+	pthread_mutex_init(&w.lock, NULL);
+
+	if (nr_threads < 2)
+		compute_filters_thread(&w);
+	else {
+		pthread_t *threads;
+
+		enable_obj_read_lock();
+		ALLOC_ARRAY(threads, nr_threads);
+		for (i = 0; i < nr_threads; i++) {
+			int err = pthread_create(&threads[i], NULL,
+						 compute_filters_thread, &w);
+			if (err)
+				die(_("unable to create thread: %s"),
+				    strerror(err));
 		}
-
-	cleanup:
-		hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
-	} else {
-		for (i = 0; i < diff_queued_diff.nr; i++)
-			diff_free_filepair(diff_queued_diff.queue[i]);
-		init_truncated_large_filter(filter);
-
-		if (computed)
-			*computed |= BLOOM_TRUNC_LARGE;
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(threads[i], NULL);
+		free(threads);
+		disable_obj_read_lock();
 	}
 
-	if (computed)
-		*computed |= BLOOM_COMPUTED;
-
-	free(diff_queued_diff.queue);
-	DIFF_QUEUE_CLEAR(&diff_queued_diff);
-
-	return filter;
+	pthread_mutex_destroy(&w.lock);
+	free(w.old_trees);
+	free(w.new_trees);
+	free(w.filters);
 }
 
 int bloom_filter_contains(const struct bloom_filter *filter,
@@ -324,3 +538,16 @@ int bloom_filter_contains(const struct bloom_filter *filter,
 
 	return 1;
 }
+
+int bloom_filter_contains_vec(const struct bloom_filter *filter,
+			      const struct bloom_keyvec *vec,
+			      const struct bloom_filter_settings *settings)
+{
+	int result = 1;
+	size_t i;
+
+	for (i = 0; result && i < vec->count; i++)
+		result = bloom_filter_contains(filter, &vec->key[i], settings);
+
+	return result;
+}
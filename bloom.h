@@ -3,6 +3,7 @@
 
 struct commit;
 struct repository;
+struct progress;
 
 struct bloom_filter_settings {
 	/*
@@ -68,6 +69,16 @@ struct bloom_key {
 	uint32_t *hashes;
 };
 
+/*
+ * The keys for a path and for each of its leading directories, longest
+ * first.  A commit can only have changed the path if its filter contains
+ * all of them, which rules out more commits than the path's key alone.
+ */
+struct bloom_keyvec {
+	size_t count;
+	struct bloom_key key[FLEX_ARRAY];
+};
+
 /*
  * Calculate the murmur3 32-bit hash value for the given data
  * using the given seed.
@@ -83,6 +94,14 @@ void fill_bloom_key(const char *data,
 		    const struct bloom_filter_settings *settings);
 void clear_bloom_key(struct bloom_key *key);
 
+/*
+ * Build the keys for the first `len` bytes of `path`, which must not
+ * have a trailing slash, and for each of its leading directories.
+ */
+struct bloom_keyvec *bloom_keyvec_new(const char *path, size_t len,
+				      const struct bloom_filter_settings *settings);
+void bloom_keyvec_free(struct bloom_keyvec *vec);
+
 void add_key_to_filter(const struct bloom_key *key,
 		       struct bloom_filter *filter,
 		       const struct bloom_filter_settings *settings);
@@ -105,8 +124,31 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 #define get_bloom_filter(r, c) get_or_compute_bloom_filter( \
 	(r), (c), 0, NULL, NULL)
 
+/*
+ * Compute the filters of the `nr` commits, none of which may have one
+ * yet, with up to `nr_threads` threads (0 meaning one per CPU).
+ * computed[i] gets what get_or_compute_bloom_filter() would have said
+ * for commits[i], and `progress` is advanced by one per commit from
+ * `*progress_cnt`.  The filters do not depend on the number of threads.
+ */
+void batch_compute_bloom_filters(struct repository *r,
+				 struct commit **commits, int nr,
+				 const struct bloom_filter_settings *settings,
+				 int nr_threads,
+				 enum bloom_filter_computed *computed,
+				 struct progress *progress,
+				 uint64_t *progress_cnt);
+
 int bloom_filter_contains(const struct bloom_filter *filter,
 			  const struct bloom_key *key,
 			  const struct bloom_filter_settings *settings);
 
+/*
+ * Returns 0 if `filter` is missing any of the keys in `vec`, and non-zero
+ * if the path the keys were built for may have changed.
+ */
+int bloom_filter_contains_vec(const struct bloom_filter *filter,
+			      const struct bloom_keyvec *vec,
+			      const struct bloom_filter_settings *settings);
+
 #endif
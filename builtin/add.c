@@ -21,6 +21,7 @@
 #include "strvec.h"
 #include "submodule.h"
 #include "add-interactive.h"
+#include "sparse-index.h"
 
 static const char * const builtin_add_usage[] = {
 	N_("git add [<options>] [--] <pathspec>..."),
@@ -454,6 +455,7 @@ int cmd_add(int argc, const char **argv, const char *prefix)
 
 	argc = parse_options(argc, argv, prefix, builtin_add_options,
 			  builtin_add_usage, PARSE_OPT_KEEP_ARGV0);
+
 	if (patch_interactive)
 		add_interactive = 1;
 	if (add_interactive) {
@@ -499,6 +501,9 @@ int cmd_add(int argc, const char **argv, const char *prefix)
 	add_new_files = !take_worktree_changes && !refresh_only && !add_renormalize;
 	require_pathspec = !(take_worktree_changes || (0 < addremove_explicit));
 
+	prepare_repo_settings(the_repository);
+	the_repository->settings.command_requires_full_index = 0;
+
 	hold_locked_index(&lock_file, LOCK_DIE_ON_ERROR);
 
 	/*
@@ -545,6 +550,11 @@ int cmd_add(int argc, const char **argv, const char *prefix)
 	if (read_cache_preload(&pathspec) < 0)
 		die(_("index file corrupt"));
 
+	if (chmod_arg)
+		ensure_full_index(&the_index);
+	else
+		ensure_full_index_for_pathspec(&the_index, &pathspec);
+
 	die_in_unpopulated_submodule(&the_index, prefix);
 	die_path_inside_submodule(&the_index, &pathspec);
 
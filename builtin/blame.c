@@ -56,6 +56,8 @@ static int coloring_mode;
 static struct string_list ignore_revs_file_list = STRING_LIST_INIT_NODUP;
 static int mark_unblamable_lines;
 static int mark_ignored_lines;
+static int use_blame_cache;
+static int blame_threads;
 
 static struct date_mode blame_date_mode = { DATE_ISO8601 };
 static size_t blame_date_width;
@@ -719,6 +721,17 @@ static int git_blame_config(const char *var, const char *value, void *cb)
 		mark_unblamable_lines = git_config_bool(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "blame.threads")) {
+		blame_threads = git_config_int(var, value);
+		if (blame_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    blame_threads, var);
+		return 0;
+	}
+	if (!strcmp(var, "blame.cache")) {
+		use_blame_cache = git_config_bool(var, value);
+		return 0;
+	}
 	if (!strcmp(var, "blame.markignoredlines")) {
 		mark_ignored_lines = git_config_bool(var, value);
 		return 0;
@@ -860,7 +873,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	struct string_list range_list = STRING_LIST_INIT_NODUP;
 	struct string_list ignore_rev_list = STRING_LIST_INIT_NODUP;
 	int output_option = 0, opt = 0;
-	int show_stats = 0;
+	int show_stats = 0, whole_file;
 	const char *revs_file = NULL;
 	const char *contents_from = NULL;
 	const struct option options[] = {
@@ -869,6 +882,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 		OPT_BOOL(0, "root", &show_root, N_("do not treat root commits as boundaries (Default: off)")),
 		OPT_BOOL(0, "show-stats", &show_stats, N_("show work cost statistics")),
 		OPT_BOOL(0, "progress", &show_progress, N_("force progress reporting")),
+		OPT_BOOL(0, "cache", &use_blame_cache, N_("reuse and record results in the blame cache")),
 		OPT_BIT(0, "score-debug", &output_option, N_("show output score for blame entries"), OUTPUT_SHOW_SCORE),
 		OPT_BIT('f', "show-name", &output_option, N_("show original filename (Default: auto)"), OUTPUT_SHOW_NAME),
 		OPT_BIT('n', "show-number", &output_option, N_("show original linenumber (Default: off)"), OUTPUT_SHOW_NUMBER),
@@ -889,6 +903,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 		OPT_STRING(0, "contents", &contents_from, N_("file"), N_("use <file>'s contents as the final image")),
 		OPT_CALLBACK_F('C', NULL, &opt, N_("score"), N_("find line copies within and across files"), PARSE_OPT_OPTARG, blame_copy_callback),
 		OPT_CALLBACK_F('M', NULL, &opt, N_("score"), N_("find line movements within and across files"), PARSE_OPT_OPTARG, blame_move_callback),
+		OPT_INTEGER(0, "threads", &blame_threads, N_("use <n> worker threads to find moved and copied lines")),
 		OPT_STRING_LIST('L', NULL, &range_list, N_("range"),
 				N_("process only line range <start>,<end> or function :<funcname>")),
 		OPT__ABBREV(&abbrev),
@@ -1095,6 +1110,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 		setup_blame_bloom_data(&sb);
 
 	lno = sb.num_lines;
+	whole_file = !range_list.nr;
 
 	if (lno && !range_list.nr)
 		string_list_append(&range_list, "1");
@@ -1148,6 +1164,12 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	sb.show_root = show_root;
 	sb.xdl_opts = xdl_opts;
 	sb.no_whole_file_rename = no_whole_file_rename;
+	if (blame_threads < 0)
+		die(_("invalid number of threads specified (%d)"), blame_threads);
+	sb.threads = blame_threads;
+
+	if (use_blame_cache && !revs_file)
+		setup_blame_cache(&sb, opt, whole_file);
 
 	read_mailmap(&mailmap);
 
@@ -1160,6 +1182,8 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 
 	stop_progress(&pi.progress);
 
+	store_blame_cache(&sb);
+
 	if (!incremental)
 		setup_pager();
 	else
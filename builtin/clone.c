@@ -32,6 +32,7 @@
 #include "connected.h"
 #include "packfile.h"
 #include "list-objects-filter-options.h"
+#include "bundle-uri.h"
 
 /*
  * Overall FIXMEs:
@@ -71,6 +72,7 @@ static struct string_list option_recurse_submodules = STRING_LIST_INIT_NODUP;
 static struct list_objects_filter_options filter_options;
 static struct string_list server_options = STRING_LIST_INIT_NODUP;
 static int option_remote_submodules;
+static const char *bundle_uri;
 
 static int recurse_submodules_cb(const struct option *opt,
 				 const char *arg, int unset)
@@ -141,6 +143,8 @@ static struct option builtin_clone_options[] = {
 			N_("set config inside the new repository")),
 	OPT_STRING_LIST(0, "server-option", &server_options,
 			N_("server-specific"), N_("option to transmit")),
+	OPT_STRING(0, "bundle-uri", &bundle_uri,
+		   N_("uri"), N_("a URI for downloading bundles before fetching from origin remote")),
 	OPT_SET_INT('4', "ipv4", &family, N_("use IPv4 addresses only"),
 			TRANSPORT_FAMILY_IPV4),
 	OPT_SET_INT('6', "ipv6", &family, N_("use IPv6 addresses only"),
@@ -762,6 +766,33 @@ static int git_sparse_checkout_init(const char *repo)
 	return result;
 }
 
+/*
+ * Unbundle the bundle given with --bundle-uri, or else the ones the
+ * server offers if transfer.bundleURI allows, so that the fetch that
+ * follows has less to get.
+ */
+static void fetch_bundles(struct transport *transport)
+{
+	struct string_list uris = STRING_LIST_INIT_DUP;
+	int i, enabled = 0;
+
+	if (bundle_uri) {
+		if (fetch_bundle_uri(the_repository, bundle_uri, 1))
+			warning(_("failed to fetch objects from bundle URI '%s'"),
+				bundle_uri);
+		return;
+	}
+
+	git_config_get_bool("transfer.bundleuri", &enabled);
+	if (!enabled || transport_get_remote_bundle_uri(transport, &uris))
+		return;
+	for (i = 0; i < uris.nr; i++)
+		if (fetch_bundle_uri(the_repository, uris.items[i].string, 0))
+			warning(_("failed to fetch objects from bundle URI '%s'"),
+				uris.items[i].string);
+	string_list_clear(&uris, 0);
+}
+
 static int checkout(int submodule_progress)
 {
 	struct object_id oid;
@@ -1141,7 +1172,7 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 	}
 
 	init_db(git_dir, real_git_dir, option_template, GIT_HASH_UNKNOWN, NULL,
-		INIT_DB_QUIET);
+		NULL, INIT_DB_QUIET);
 
 	if (real_git_dir)
 		git_dir = real_git_dir;
@@ -1217,6 +1248,8 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 			warning(_("--shallow-exclude is ignored in local clones; use file:// instead."));
 		if (filter_options.choice)
 			warning(_("--filter is ignored in local clones; use file:// instead."));
+		if (bundle_uri)
+			warning(_("--bundle-uri is ignored in local clones; use file:// instead."));
 		if (!access(mkpath("%s/shallow", path), F_OK)) {
 			if (option_local > 0)
 				warning(_("source repository is shallow, ignoring --local"));
@@ -1279,9 +1312,14 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 		 * Now that we know what algorithm the remote side is using,
 		 * let's set ours to the same thing.
 		 */
-		initialize_repository_version(hash_algo, 1);
+		initialize_repository_version(hash_algo,
+					      the_repository->ref_storage_format,
+					      1);
 		repo_set_hash_algo(the_repository, hash_algo);
 
+		if (!is_local)
+			fetch_bundles(transport);
+
 		mapped_refs = wanted_peer_refs(refs, &remote->fetch);
 		/*
 		 * transport_get_remote_refs() may return refs with null sha-1
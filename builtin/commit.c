@@ -36,6 +36,7 @@
 #include "help.h"
 #include "commit-reach.h"
 #include "commit-graph.h"
+#include "sparse-index.h"
 
 static const char * const builtin_commit_usage[] = {
 	N_("git commit [<options>] [--] <pathspec>..."),
@@ -363,6 +364,16 @@ static const char *prepare_index(const char **argv, const char *prefix,
 	if (read_cache_preload(&pathspec) < 0)
 		die(_("index file corrupt"));
 
+	/*
+	 * Committing all tracked changes only looks at entries that are
+	 * present in the working tree, which sparse directories are not.
+	 * A partial commit looks at individual paths of the index.
+	 */
+	if (all || also)
+		ensure_full_index_for_pathspec(&the_index, &pathspec);
+	else if (only || pathspec.nr)
+		ensure_full_index(&the_index);
+
 	if (interactive) {
 		char *old_index_env = NULL, *old_repo_index_file;
 		hold_locked_index(&index_lock, LOCK_DIE_ON_ERROR);
@@ -486,6 +497,7 @@ static const char *prepare_index(const char **argv, const char *prefix,
 	discard_cache();
 	if (read_cache() < 0)
 		die(_("cannot read the index"));
+	ensure_full_index(&the_index);
 
 	hold_locked_index(&index_lock, LOCK_DIE_ON_ERROR);
 	add_remove_files(&partial);
@@ -1413,6 +1425,10 @@ int cmd_status(int argc, const char **argv, const char *prefix)
 	argc = parse_options(argc, argv, prefix,
 			     builtin_status_options,
 			     builtin_status_usage, 0);
+
+	prepare_repo_settings(the_repository);
+	the_repository->settings.command_requires_full_index = 0;
+
 	finalize_colopts(&s.colopts, -1);
 	finalize_deferred_config(&s);
 
@@ -1589,6 +1605,7 @@ int cmd_commit(int argc, const char **argv, const char *prefix)
 
 	status_init_config(&s, git_commit_config);
 	s.commit_template = 1;
+
 	status_format = STATUS_FORMAT_NONE; /* Ignore status.short */
 	s.colopts = 0;
 
@@ -1606,6 +1623,11 @@ int cmd_commit(int argc, const char **argv, const char *prefix)
 	if (verbose == -1)
 		verbose = (config_commit_verbose < 0) ? 0 : config_commit_verbose;
 
+	/* "add -i" is run in-process and needs to see every path. */
+	prepare_repo_settings(the_repository);
+	if (!interactive)
+		the_repository->settings.command_requires_full_index = 0;
+
 	if (dry_run)
 		return dry_run_commit(argv, prefix, current_head, &s);
 	index_file = prepare_index(argv, prefix, current_head, 0);
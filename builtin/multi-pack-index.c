@@ -6,14 +6,16 @@
 #include "trace2.h"
 
 static char const * const builtin_multi_pack_index_usage[] = {
-	N_("git multi-pack-index [<options>] (write|verify|expire|repack --batch-size=<size>)"),
+	N_("git multi-pack-index [<options>] (write [--preferred-pack=<pack>] [--[no-]bitmap]|verify|expire|repack --batch-size=<size>)"),
 	NULL
 };
 
 static struct opts_multi_pack_index {
 	const char *object_dir;
+	const char *preferred_pack;
 	unsigned long batch_size;
 	int progress;
+	int bitmap;
 } opts;
 
 int cmd_multi_pack_index(int argc, const char **argv,
@@ -25,6 +27,10 @@ int cmd_multi_pack_index(int argc, const char **argv,
 		OPT_FILENAME(0, "object-dir", &opts.object_dir,
 		  N_("object directory containing set of packfile and pack-index pairs")),
 		OPT_BOOL(0, "progress", &opts.progress, N_("force progress reporting")),
+		OPT_STRING(0, "preferred-pack", &opts.preferred_pack,
+			   N_("preferred-pack"),
+			   N_("pack for reuse when computing a multi-pack bitmap")),
+		OPT_BOOL(0, "bitmap", &opts.bitmap, N_("write multi-pack bitmap")),
 		OPT_MAGNITUDE(0, "batch-size", &opts.batch_size,
 		  N_("during repack, collect pack-files of smaller size into a batch that is larger than this size")),
 		OPT_END(),
@@ -41,6 +47,8 @@ int cmd_multi_pack_index(int argc, const char **argv,
 		opts.object_dir = get_object_directory();
 	if (opts.progress)
 		flags |= MIDX_PROGRESS;
+	if (opts.bitmap)
+		flags |= MIDX_WRITE_BITMAP;
 
 	if (argc == 0)
 		usage_with_options(builtin_multi_pack_index_usage,
@@ -53,6 +61,9 @@ int cmd_multi_pack_index(int argc, const char **argv,
 
 	trace2_cmd_mode(argv[0]);
 
+	if (strcmp(argv[0], "write") && (opts.preferred_pack || opts.bitmap))
+		die(_("--preferred-pack and --bitmap options are only for 'write' subcommand"));
+
 	if (!strcmp(argv[0], "repack"))
 		return midx_repack(the_repository, opts.object_dir,
 			(size_t)opts.batch_size, flags);
@@ -60,7 +71,8 @@ int cmd_multi_pack_index(int argc, const char **argv,
 		die(_("--batch-size option is only for 'repack' subcommand"));
 
 	if (!strcmp(argv[0], "write"))
-		return write_midx_file(opts.object_dir, flags);
+		return write_midx_file(opts.object_dir, opts.preferred_pack,
+				       flags);
 	if (!strcmp(argv[0], "verify"))
 		return verify_midx_file(the_repository, opts.object_dir, flags);
 	if (!strcmp(argv[0], "expire"))
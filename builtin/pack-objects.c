@@ -1669,6 +1669,52 @@ static void cleanup_preferred_base(void)
 	done_pbase_paths_num = done_pbase_paths_alloc = 0;
 }
 
+/*
+ * check_object() may run in several threads at once (see
+ * ll_check_objects()). Each thread owns its entries, but pack windows,
+ * the reverse indexes and the rest of the object database are shared,
+ * so every access to them goes through to_pack's odb_lock.
+ */
+static unsigned char *use_pack_locked(struct packed_git *p,
+				      struct pack_window **w_curs,
+				      off_t offset, unsigned long *left)
+{
+	unsigned char *buf;
+
+	packing_data_lock(&to_pack);
+	buf = use_pack(p, w_curs, offset, left);
+	packing_data_unlock(&to_pack);
+	return buf;
+}
+
+static void unuse_pack_locked(struct pack_window **w_curs)
+{
+	packing_data_lock(&to_pack);
+	unuse_pack(w_curs);
+	packing_data_unlock(&to_pack);
+}
+
+static int bitmap_has_oid_in_uninteresting_locked(const struct object_id *oid)
+{
+	int ret;
+
+	packing_data_lock(&to_pack);
+	ret = bitmap_has_oid_in_uninteresting(bitmap_git, oid);
+	packing_data_unlock(&to_pack);
+	return ret;
+}
+
+static int object_info_locked(const struct object_id *oid,
+			      struct object_info *oi, unsigned flags)
+{
+	int ret;
+
+	packing_data_lock(&to_pack);
+	ret = oid_object_info_extended(the_repository, oid, oi, flags);
+	packing_data_unlock(&to_pack);
+	return ret;
+}
+
 /*
  * Return 1 iff the object specified by "delta" can be sent
  * literally as a delta against the base in "base_sha1". If
@@ -1703,7 +1749,7 @@ static int can_reuse_delta(const struct object_id *base_oid,
 	 * even if it was buried too deep in history to make it into the
 	 * packing list.
 	 */
-	if (thin && bitmap_has_oid_in_uninteresting(bitmap_git, base_oid)) {
+	if (thin && bitmap_has_oid_in_uninteresting_locked(base_oid)) {
 		if (use_delta_islands) {
 			if (!in_same_island(&delta->idx.oid, base_oid))
 				return 0;
@@ -1753,7 +1799,7 @@ static void check_object(struct object_entry *entry, uint32_t object_index)
 		enum object_type type;
 		unsigned long in_pack_size;
 
-		buf = use_pack(p, &w_curs, entry->in_pack_offset, &avail);
+		buf = use_pack_locked(p, &w_curs, entry->in_pack_offset, &avail);
 
 		/*
 		 * We want in_pack_type even if we do not reuse delta
@@ -1782,21 +1828,21 @@ static void check_object(struct object_entry *entry, uint32_t object_index)
 			entry->in_pack_header_size = used;
 			if (oe_type(entry) < OBJ_COMMIT || oe_type(entry) > OBJ_BLOB)
 				goto give_up;
-			unuse_pack(&w_curs);
+			unuse_pack_locked(&w_curs);
 			return;
 		case OBJ_REF_DELTA:
 			if (reuse_delta && !entry->preferred_base) {
 				oidread(&base_ref,
-					use_pack(p, &w_curs,
-						 entry->in_pack_offset + used,
-						 NULL));
+					use_pack_locked(p, &w_curs,
+							entry->in_pack_offset + used,
+							NULL));
 				have_base = 1;
 			}
 			entry->in_pack_header_size = used + the_hash_algo->rawsz;
 			break;
 		case OBJ_OFS_DELTA:
-			buf = use_pack(p, &w_curs,
-				       entry->in_pack_offset + used, NULL);
+			buf = use_pack_locked(p, &w_curs,
+					      entry->in_pack_offset + used, NULL);
 			used_0 = 0;
 			c = buf[used_0++];
 			ofs = c & 127;
@@ -1818,11 +1864,17 @@ static void check_object(struct object_entry *entry, uint32_t object_index)
 			}
 			if (reuse_delta && !entry->preferred_base) {
 				uint32_t pos;
-				if (offset_to_pack_pos(p, ofs, &pos) < 0)
-					goto give_up;
-				if (!nth_packed_object_id(&base_ref, p,
+				int ret;
+
+				packing_data_lock(&to_pack);
+				ret = offset_to_pack_pos(p, ofs, &pos);
+				if (!ret &&
+				    !nth_packed_object_id(&base_ref, p,
 							  pack_pos_to_index(p, pos)))
 					have_base = 1;
+				packing_data_unlock(&to_pack);
+				if (ret < 0)
+					goto give_up;
 			}
 			entry->in_pack_header_size = used + used_0;
 			break;
@@ -1834,15 +1886,20 @@ static void check_object(struct object_entry *entry, uint32_t object_index)
 			SET_SIZE(entry, in_pack_size); /* delta size */
 			SET_DELTA_SIZE(entry, in_pack_size);
 
+			/*
+			 * The base's delta_child list is linked up by
+			 * get_object_details() once all objects have been
+			 * checked, as base_entry may belong to another thread.
+			 */
 			if (base_entry) {
 				SET_DELTA(entry, base_entry);
-				entry->delta_sibling_idx = base_entry->delta_child_idx;
-				SET_DELTA_CHILD(base_entry, entry);
 			} else {
+				packing_data_lock(&to_pack);
 				SET_DELTA_EXT(entry, &base_ref);
+				packing_data_unlock(&to_pack);
 			}
 
-			unuse_pack(&w_curs);
+			unuse_pack_locked(&w_curs);
 			return;
 		}
 
@@ -1855,11 +1912,13 @@ static void check_object(struct object_entry *entry, uint32_t object_index)
 			 * object size from the delta header.
 			 */
 			delta_pos = entry->in_pack_offset + entry->in_pack_header_size;
+			packing_data_lock(&to_pack);
 			canonical_size = get_size_from_delta(p, &w_curs, delta_pos);
+			packing_data_unlock(&to_pack);
 			if (canonical_size == 0)
 				goto give_up;
 			SET_SIZE(entry, canonical_size);
-			unuse_pack(&w_curs);
+			unuse_pack_locked(&w_curs);
 			return;
 		}
 
@@ -1869,15 +1928,16 @@ static void check_object(struct object_entry *entry, uint32_t object_index)
 		 * at this point...
 		 */
 		give_up:
-		unuse_pack(&w_curs);
+		unuse_pack_locked(&w_curs);
 	}
 
-	if (oid_object_info_extended(the_repository, &entry->idx.oid, &oi,
-				     OBJECT_INFO_SKIP_FETCH_OBJECT | OBJECT_INFO_LOOKUP_REPLACE) < 0) {
+	if (object_info_locked(&entry->idx.oid, &oi,
+			       OBJECT_INFO_SKIP_FETCH_OBJECT | OBJECT_INFO_LOOKUP_REPLACE) < 0) {
 		if (has_promisor_remote()) {
+			/* only reached when checking objects single-threaded */
 			prefetch_to_pack(object_index);
-			if (oid_object_info_extended(the_repository, &entry->idx.oid, &oi,
-						     OBJECT_INFO_SKIP_FETCH_OBJECT | OBJECT_INFO_LOOKUP_REPLACE) < 0)
+			if (object_info_locked(&entry->idx.oid, &oi,
+					       OBJECT_INFO_SKIP_FETCH_OBJECT | OBJECT_INFO_LOOKUP_REPLACE) < 0)
 				type = -1;
 		} else {
 			type = -1;
@@ -2087,40 +2147,6 @@ static void break_delta_chains(struct object_entry *entry)
 	}
 }
 
-static void get_object_details(void)
-{
-	uint32_t i;
-	struct object_entry **sorted_by_offset;
-
-	if (progress)
-		progress_state = start_progress(_("Counting objects"),
-						to_pack.nr_objects);
-
-	CALLOC_ARRAY(sorted_by_offset, to_pack.nr_objects);
-	for (i = 0; i < to_pack.nr_objects; i++)
-		sorted_by_offset[i] = to_pack.objects + i;
-	QSORT(sorted_by_offset, to_pack.nr_objects, pack_offset_sort);
-
-	for (i = 0; i < to_pack.nr_objects; i++) {
-		struct object_entry *entry = sorted_by_offset[i];
-		check_object(entry, i);
-		if (entry->type_valid &&
-		    oe_size_greater_than(&to_pack, entry, big_file_threshold))
-			entry->no_try_delta = 1;
-		display_progress(progress_state, i + 1);
-	}
-	stop_progress(&progress_state);
-
-	/*
-	 * This must happen in a second pass, since we rely on the delta
-	 * information for the whole list being completed.
-	 */
-	for (i = 0; i < to_pack.nr_objects; i++)
-		break_delta_chains(&to_pack.objects[i]);
-
-	free(sorted_by_offset);
-}
-
 /*
  * We search for deltas in a list sorted by type, by filename hash, and then
  * by size, so that we see progressively smaller and smaller files.
@@ -2778,6 +2804,148 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 	free(p);
 }
 
+/*
+ * Checking an object costs little CPU but touches its pack data, so
+ * threads only pay off once each one has a decent range of objects.
+ */
+#define CHECK_OBJECTS_THREAD_COST 500
+
+struct check_objects_params {
+	pthread_t thread;
+	struct object_entry **list;
+	uint32_t start, nr;
+};
+
+static uint32_t nr_objects_checked;
+
+static void check_objects(struct object_entry **list, uint32_t start,
+			  uint32_t nr)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		struct object_entry *entry = list[start + i];
+
+		check_object(entry, start + i);
+		if (entry->type_valid &&
+		    oe_size_greater_than(&to_pack, entry, big_file_threshold))
+			entry->no_try_delta = 1;
+
+		progress_lock();
+		display_progress(progress_state, ++nr_objects_checked);
+		progress_unlock();
+	}
+}
+
+static void *threaded_check_objects(void *arg)
+{
+	struct check_objects_params *me = arg;
+
+	trace2_thread_start("check-objects");
+	check_objects(me->list, me->start, me->nr);
+	trace2_thread_exit();
+	return NULL;
+}
+
+/*
+ * Run check_object() over the list, which is sorted by pack offset.
+ * Each thread gets one contiguous range so that it reads its part of
+ * the packs sequentially.
+ */
+static void ll_check_objects(struct object_entry **list, uint32_t nr)
+{
+	struct check_objects_params *p;
+	int threads, i, ret;
+	uint32_t start = 0;
+
+	init_threaded_search();
+	nr_objects_checked = 0;
+
+	threads = nr / CHECK_OBJECTS_THREAD_COST;
+	if (nr > 1 && threads < 2 &&
+	    git_env_bool("GIT_TEST_PACK_CHECK_OBJECTS_THREADED", 0))
+		threads = 2;
+	if (threads > delta_search_threads)
+		threads = delta_search_threads;
+	/* fetching missing objects from a promisor remote is not thread-safe */
+	if (threads < 2 || has_promisor_remote()) {
+		trace2_data_intmax("pack-objects", the_repository,
+				   "check-objects/threads", 1);
+		check_objects(list, 0, nr);
+		cleanup_threaded_search();
+		return;
+	}
+
+	trace2_data_intmax("pack-objects", the_repository,
+			   "check-objects/threads", threads);
+	CALLOC_ARRAY(p, threads);
+	for (i = 0; i < threads; i++) {
+		p[i].list = list;
+		p[i].start = start;
+		p[i].nr = (nr - start) / (threads - i);
+		start += p[i].nr;
+
+		ret = pthread_create(&p[i].thread, NULL,
+				     threaded_check_objects, &p[i]);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(p[i].thread, NULL);
+
+	cleanup_threaded_search();
+	free(p);
+}
+
+static void get_object_details(void)
+{
+	uint32_t i;
+	struct object_entry **sorted_by_offset;
+
+	trace2_region_enter("pack-objects", "check-objects", the_repository);
+	if (progress)
+		progress_state = start_progress(_("Counting objects"),
+						to_pack.nr_objects);
+
+	CALLOC_ARRAY(sorted_by_offset, to_pack.nr_objects);
+	for (i = 0; i < to_pack.nr_objects; i++)
+		sorted_by_offset[i] = to_pack.objects + i;
+	QSORT(sorted_by_offset, to_pack.nr_objects, pack_offset_sort);
+
+	ll_check_objects(sorted_by_offset, to_pack.nr_objects);
+	stop_progress(&progress_state);
+
+	/*
+	 * Link reused deltas to their bases in offset order, so that
+	 * the delta_child lists come out the same no matter how the
+	 * checks were split between threads.
+	 */
+	for (i = 0; i < to_pack.nr_objects; i++) {
+		struct object_entry *entry = sorted_by_offset[i];
+		struct object_entry *base;
+
+		if (!entry->delta_idx || entry->ext_base)
+			continue;
+		base = DELTA(entry);
+		entry->delta_sibling_idx = base->delta_child_idx;
+		SET_DELTA_CHILD(base, entry);
+	}
+	trace2_region_leave("pack-objects", "check-objects", the_repository);
+
+	/*
+	 * This must happen in a second pass, since we rely on the delta
+	 * information for the whole list being completed.
+	 */
+	trace2_region_enter("pack-objects", "break-delta-chains",
+			    the_repository);
+	for (i = 0; i < to_pack.nr_objects; i++)
+		break_delta_chains(&to_pack.objects[i]);
+	trace2_region_leave("pack-objects", "break-delta-chains",
+			    the_repository);
+
+	free(sorted_by_offset);
+}
+
 static int obj_is_packed(const struct object_id *oid)
 {
 	return packlist_find(&to_pack, oid) ||
@@ -2891,7 +3059,11 @@ static void prepare_pack(int window, int depth)
 			progress_state = start_progress(_("Compressing objects"),
 							nr_deltas);
 		QSORT(delta_list, n, type_size_sort);
+		trace2_region_enter("pack-objects", "find-deltas",
+				    the_repository);
 		ll_find_deltas(delta_list, n, window+1, depth, &nr_done);
+		trace2_region_leave("pack-objects", "find-deltas",
+				    the_repository);
 		stop_progress(&progress_state);
 		if (nr_done != nr_deltas)
 			die(_("inconsistency with delta count"));
@@ -2927,6 +3099,12 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 		else
 			write_bitmap_options &= ~BITMAP_OPT_HASH_CACHE;
 	}
+	if (!strcmp(k, "pack.writebitmaplookuptable")) {
+		if (git_config_bool(k, v))
+			write_bitmap_options |= BITMAP_OPT_LOOKUP_TABLE;
+		else
+			write_bitmap_options &= ~BITMAP_OPT_LOOKUP_TABLE;
+	}
 	if (!strcmp(k, "pack.usebitmaps")) {
 		use_bitmap_index_default = git_config_bool(k, v);
 		return 0;
@@ -2986,6 +3164,186 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 	return git_default_config(k, v, cb);
 }
 
+static uint32_t stdin_packs_found_nr;
+static uint32_t stdin_packs_hints_nr;
+
+static int add_object_entry_from_pack(const struct object_id *oid,
+				      struct packed_git *p,
+				      uint32_t pos,
+				      void *_data)
+{
+	struct rev_info *revs = _data;
+	struct object_info oi = OBJECT_INFO_INIT;
+	off_t ofs;
+	enum object_type type;
+
+	display_progress(progress_state, ++nr_seen);
+
+	if (have_duplicate_entry(oid, 0))
+		return 0;
+
+	ofs = nth_packed_object_offset(p, pos);
+	if (!want_object_in_pack(oid, 0, &p, &ofs))
+		return 0;
+
+	oi.typep = &type;
+	if (packed_object_info(the_repository, p, ofs, &oi) < 0)
+		die(_("could not get type of object %s in pack %s"),
+		    oid_to_hex(oid), p->pack_name);
+	else if (type == OBJ_COMMIT) {
+		/*
+		 * commits in included packs are used as starting points
+		 * for the walk that fills in name hashes below
+		 */
+		add_pending_oid(revs, NULL, oid, 0);
+	}
+
+	stdin_packs_found_nr++;
+
+	create_object_entry(oid, type, 0, 0, 0, p, ofs);
+
+	return 0;
+}
+
+static void show_commit_pack_hint(struct commit *commit, void *_data)
+{
+	/* nothing to do; commits don't have a namehash */
+}
+
+static void show_object_pack_hint(struct object *object, const char *name,
+				  void *_data)
+{
+	struct object_entry *oe = packlist_find(&to_pack, &object->oid);
+	if (!oe)
+		return;
+
+	/*
+	 * Objects were added by iterating over the included packs, so
+	 * they have no name hash yet. Fill it in (and no_try_delta) as a
+	 * best effort, to help the delta search.
+	 */
+	oe->hash = pack_name_hash(name);
+	oe->no_try_delta = name && no_try_delta(name);
+
+	stdin_packs_hints_nr++;
+}
+
+static int pack_mtime_cmp(const void *_a, const void *_b)
+{
+	struct packed_git *a = ((const struct string_list_item*)_a)->util;
+	struct packed_git *b = ((const struct string_list_item*)_b)->util;
+
+	/*
+	 * order packs by descending mtime so that objects are laid out
+	 * roughly as newest-to-oldest
+	 */
+	if (a->mtime < b->mtime)
+		return 1;
+	else if (b->mtime < a->mtime)
+		return -1;
+	else
+		return 0;
+}
+
+/*
+ * Read a list of pack names from stdin, one per line. Pack all objects
+ * in the named packs, except those which are also found in a pack
+ * named with a leading '^'.
+ */
+static void read_packs_list_from_stdin(void)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct string_list include_packs = STRING_LIST_INIT_DUP;
+	struct string_list exclude_packs = STRING_LIST_INIT_DUP;
+	struct string_list_item *item = NULL;
+
+	struct packed_git *p;
+	struct rev_info revs;
+
+	repo_init_revisions(the_repository, &revs, NULL);
+	/*
+	 * Use a revision walk to fill in the namehash of objects in the
+	 * included packs. To save time, do not walk commits which are in
+	 * excluded packs; the hints are only an optimization, so missing
+	 * some of them is fine.
+	 */
+	revs.no_kept_objects = 1;
+	revs.kept_pack_flags = IN_CORE_KEEP_PACKS;
+	revs.blob_objects = 1;
+	revs.tree_objects = 1;
+	revs.tag_objects = 1;
+	revs.ignore_missing_links = 1;
+
+	while (strbuf_getline(&buf, stdin) != EOF) {
+		if (!buf.len)
+			continue;
+
+		if (*buf.buf == '^')
+			string_list_append(&exclude_packs, buf.buf + 1);
+		else
+			string_list_append(&include_packs, buf.buf);
+
+		strbuf_reset(&buf);
+	}
+
+	string_list_sort(&include_packs);
+	string_list_sort(&exclude_packs);
+
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		const char *pack_name = pack_basename(p);
+
+		item = string_list_lookup(&include_packs, pack_name);
+		if (!item)
+			item = string_list_lookup(&exclude_packs, pack_name);
+
+		if (item)
+			item->util = p;
+	}
+
+	/*
+	 * Mark the excluded packs as kept in-core first, so that objects
+	 * which are also found in them are not added below.
+	 */
+	for_each_string_list_item(item, &exclude_packs) {
+		struct packed_git *p = item->util;
+		if (!p)
+			die(_("could not find pack '%s'"), item->string);
+		p->pack_keep_in_core = 1;
+	}
+
+	/*
+	 * Use QSORT directly to get at the string_list_item's ->util
+	 * pointer, which string_list_sort() does not provide.
+	 */
+	QSORT(include_packs.items, include_packs.nr, pack_mtime_cmp);
+
+	for_each_string_list_item(item, &include_packs) {
+		struct packed_git *p = item->util;
+		if (!p)
+			die(_("could not find pack '%s'"), item->string);
+		for_each_object_in_pack(p,
+					add_object_entry_from_pack,
+					&revs,
+					FOR_EACH_OBJECT_PACK_ORDER);
+	}
+
+	if (prepare_revision_walk(&revs))
+		die(_("revision walk setup failed"));
+	traverse_commit_list(&revs,
+			     show_commit_pack_hint,
+			     show_object_pack_hint,
+			     NULL);
+
+	trace2_data_intmax("pack-objects", the_repository, "stdin_packs_found",
+			   stdin_packs_found_nr);
+	trace2_data_intmax("pack-objects", the_repository, "stdin_packs_hints",
+			   stdin_packs_hints_nr);
+
+	strbuf_release(&buf);
+	string_list_clear(&include_packs, 0);
+	string_list_clear(&exclude_packs, 0);
+}
+
 static void read_object_list_from_stdin(void)
 {
 	char line[GIT_MAX_HEXSZ + 1 + PATH_MAX + 2];
@@ -3489,6 +3847,7 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 	struct strvec rp = STRVEC_INIT;
 	int rev_list_unpacked = 0, rev_list_all = 0, rev_list_reflog = 0;
 	int rev_list_index = 0;
+	int stdin_packs = 0;
 	struct string_list keep_pack_list = STRING_LIST_INIT_NODUP;
 	struct option pack_objects_options[] = {
 		OPT_SET_INT('q', "quiet", &progress,
@@ -3527,6 +3886,8 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 			 N_("do not create an empty pack output")),
 		OPT_BOOL(0, "revs", &use_internal_rev_list,
 			 N_("read revision arguments from standard input")),
+		OPT_BOOL(0, "stdin-packs", &stdin_packs,
+			 N_("read packs from stdin")),
 		OPT_SET_INT_F(0, "unpacked", &rev_list_unpacked,
 			      N_("limit the objects to those that are not yet packed"),
 			      1, PARSE_OPT_NONEG),
@@ -3645,7 +4006,7 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 		use_internal_rev_list = 1;
 		strvec_push(&rp, "--indexed-objects");
 	}
-	if (rev_list_unpacked) {
+	if (rev_list_unpacked && !stdin_packs) {
 		use_internal_rev_list = 1;
 		strvec_push(&rp, "--unpacked");
 	}
@@ -3690,8 +4051,13 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 	if (filter_options.choice) {
 		if (!pack_to_stdout)
 			die(_("cannot use --filter without --stdout"));
+		if (stdin_packs)
+			die(_("cannot use --filter with --stdin-packs"));
 	}
 
+	if (stdin_packs && use_internal_rev_list)
+		die(_("cannot use internal rev list with --stdin-packs"));
+
 	/*
 	 * "soft" reasons not to use bitmaps - for on-disk repack by default we want
 	 *
@@ -3750,7 +4116,13 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 
 	if (progress)
 		progress_state = start_progress(_("Enumerating objects"), 0);
-	if (!use_internal_rev_list)
+	if (stdin_packs) {
+		/* avoids adding objects in excluded packs */
+		ignore_packed_keep_in_core = 1;
+		read_packs_list_from_stdin();
+		if (rev_list_unpacked)
+			add_unreachable_loose_objects();
+	} else if (!use_internal_rev_list)
 		read_object_list_from_stdin();
 	else {
 		get_object_list(rp.nr, rp.v);
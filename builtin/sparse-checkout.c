@@ -14,6 +14,7 @@
 #include "unpack-trees.h"
 #include "wt-status.h"
 #include "quote.h"
+#include "sparse-index.h"
 
 static const char *empty_base = "";
 
@@ -133,10 +134,17 @@ static int update_working_directory(struct pattern_list *pl)
 		 * files in the way or dirty entries that can't be removed.
 		 */
 		result = UPDATE_SPARSITY_SUCCESS;
+	/*
+	 * The new patterns are only written to the sparse-checkout file
+	 * after the working directory is updated, so hand them to the
+	 * sparse index conversion directly.
+	 */
+	r->index->sparse_checkout_patterns = pl;
 	if (result == UPDATE_SPARSITY_SUCCESS)
 		write_locked_index(r->index, &lock_file, COMMIT_LOCK);
 	else
 		rollback_lock_file(&lock_file);
+	r->index->sparse_checkout_patterns = NULL;
 
 	return result;
 }
@@ -280,12 +288,13 @@ static int set_config(enum sparse_checkout_mode mode)
 }
 
 static char const * const builtin_sparse_checkout_init_usage[] = {
-	N_("git sparse-checkout init [--cone]"),
+	N_("git sparse-checkout init [--cone] [--[no-]sparse-index]"),
 	NULL
 };
 
 static struct sparse_checkout_init_opts {
 	int cone_mode;
+	int sparse_index;
 } init_opts;
 
 static int sparse_checkout_init(int argc, const char **argv)
@@ -300,11 +309,15 @@ static int sparse_checkout_init(int argc, const char **argv)
 	static struct option builtin_sparse_checkout_init_options[] = {
 		OPT_BOOL(0, "cone", &init_opts.cone_mode,
 			 N_("initialize the sparse-checkout in cone mode")),
+		OPT_BOOL(0, "sparse-index", &init_opts.sparse_index,
+			 N_("toggle the use of a sparse index")),
 		OPT_END(),
 	};
 
 	repo_read_index(the_repository);
 
+	init_opts.sparse_index = -1;
+
 	argc = parse_options(argc, argv, NULL,
 			     builtin_sparse_checkout_init_options,
 			     builtin_sparse_checkout_init_usage, 0);
@@ -318,6 +331,14 @@ static int sparse_checkout_init(int argc, const char **argv)
 	if (set_config(mode))
 		return 1;
 
+	/*
+	 * The index is rewritten below when the working directory is
+	 * updated, which converts it to match the new setting.
+	 */
+	if (init_opts.sparse_index >= 0 &&
+	    set_sparse_index_config(the_repository, init_opts.sparse_index) < 0)
+		die(_("failed to modify sparse-index config"));
+
 	memset(&pl, 0, sizeof(pl));
 
 	sparse_filename = get_sparse_checkout_filename();
@@ -614,10 +635,15 @@ static int sparse_checkout_disable(int argc, const char **argv)
 	strbuf_addstr(&match_all, "/*");
 	add_pattern(strbuf_detach(&match_all, NULL), empty_base, 0, &pl, 0);
 
+	prepare_repo_settings(the_repository);
+	the_repository->settings.sparse_index = 0;
+
 	if (update_working_directory(&pl))
 		die(_("error while refreshing working directory"));
 
 	clear_pattern_list(&pl);
+	if (set_sparse_index_config(the_repository, 0) < 0)
+		die(_("failed to modify sparse-index config"));
 	return set_config(MODE_NO_PATTERNS);
 }
 
@@ -3,9 +3,7 @@
 #include "exec-cmd.h"
 #include "pkt-line.h"
 #include "parse-options.h"
-#include "protocol.h"
 #include "upload-pack.h"
-#include "serve.h"
 
 static const char * const upload_pack_usage[] = {
 	N_("git upload-pack [<options>] <dir>"),
@@ -15,9 +13,9 @@ static const char * const upload_pack_usage[] = {
 int cmd_upload_pack(int argc, const char **argv, const char *prefix)
 {
 	const char *dir;
+	const char *cache_key = NULL;
 	int strict = 0;
 	struct upload_pack_options opts = { 0 };
-	struct serve_options serve_opts = SERVE_OPTIONS_INIT;
 	struct option options[] = {
 		OPT_BOOL(0, "stateless-rpc", &opts.stateless_rpc,
 			 N_("quit after a single request/response exchange")),
@@ -27,6 +25,10 @@ int cmd_upload_pack(int argc, const char **argv, const char *prefix)
 			 N_("do not try <directory>/.git/ if <directory> is no Git directory")),
 		OPT_INTEGER(0, "timeout", &opts.timeout,
 			    N_("interrupt transfer after <n> seconds of inactivity")),
+		OPT_STRING_F(0, "pack-objects-cache-producer", &cache_key,
+			     N_("key"),
+			     N_("fill a pack-objects cache entry for another upload-pack"),
+			     PARSE_OPT_HIDDEN),
 		OPT_END()
 	};
 
@@ -35,7 +37,7 @@ int cmd_upload_pack(int argc, const char **argv, const char *prefix)
 
 	argc = parse_options(argc, argv, prefix, options, upload_pack_usage, 0);
 
-	if (argc != 1)
+	if (cache_key ? argc < 2 : argc != 1)
 		usage_with_options(upload_pack_usage, options);
 
 	if (opts.timeout)
@@ -48,27 +50,10 @@ int cmd_upload_pack(int argc, const char **argv, const char *prefix)
 	if (!enter_repo(dir, strict))
 		die("'%s' does not appear to be a git repository", dir);
 
-	switch (determine_protocol_version_server()) {
-	case protocol_v2:
-		serve_opts.advertise_capabilities = opts.advertise_refs;
-		serve_opts.stateless_rpc = opts.stateless_rpc;
-		serve(&serve_opts);
-		break;
-	case protocol_v1:
-		/*
-		 * v1 is just the original protocol with a version string,
-		 * so just fall through after writing the version string.
-		 */
-		if (opts.advertise_refs || !opts.stateless_rpc)
-			packet_write_fmt(1, "version 1\n");
+	if (cache_key)
+		return !!produce_pack_objects_cache_entry(cache_key, argv + 1);
 
-		/* fallthrough */
-	case protocol_v0:
-		upload_pack(&opts);
-		break;
-	case protocol_unknown_version:
-		BUG("unknown protocol version");
-	}
+	serve_upload_pack(&opts);
 
 	return 0;
 }
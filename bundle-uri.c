@@ -0,0 +1,188 @@
+#include "cache.h"
+#include "bundle.h"
+#include "bundle-uri.h"
+#include "config.h"
+#include "packfile.h"
+#include "pkt-line.h"
+#include "refs.h"
+#include "run-command.h"
+#include "strvec.h"
+#include "tempfile.h"
+#include "transport.h"
+
+/*
+ * Have the remote helper for `scheme` download `uri` to `file`, which
+ * must not exist yet.
+ */
+static int download_uri_to_file(const char *scheme, const char *uri,
+				const char *file)
+{
+	struct child_process cp = CHILD_PROCESS_INIT;
+	struct strbuf line = STRBUF_INIT;
+	FILE *child_in, *child_out;
+	int found_get = 0, ret = 0;
+
+	strvec_pushf(&cp.args, "remote-%s", scheme);
+	strvec_push(&cp.args, uri);
+	cp.git_cmd = 1;
+	cp.in = -1;
+	cp.out = -1;
+	if (start_command(&cp))
+		return error(_("unable to start a remote helper for '%s'"),
+			     scheme);
+
+	child_in = xfdopen(cp.in, "w");
+	child_out = xfdopen(cp.out, "r");
+
+	fprintf(child_in, "capabilities\n");
+	fflush(child_in);
+	while (!strbuf_getline_lf(&line, child_out) && line.len)
+		if (!strcmp(line.buf, "get"))
+			found_get = 1;
+
+	if (!found_get)
+		ret = error(_("remote helper for '%s' cannot download files"),
+			    scheme);
+	else {
+		fprintf(child_in, "get %s %s\n", uri, file);
+		fflush(child_in);
+		if (strbuf_getline_lf(&line, child_out) || line.len)
+			ret = error(_("unable to download '%s'"), uri);
+	}
+
+	/* an empty line ends the helper's session */
+	fprintf(child_in, "\n");
+	fclose(child_in);
+	fclose(child_out);
+	if (finish_command(&cp) && !ret)
+		ret = error(_("remote helper for '%s' failed"), scheme);
+	strbuf_release(&line);
+	return ret;
+}
+
+static void release_ref_list(struct ref_list *list)
+{
+	int i;
+
+	for (i = 0; i < list->nr; i++)
+		free(list->list[i].name);
+	free(list->list);
+}
+
+static int unbundle_from_file(struct repository *r, const char *file)
+{
+	struct bundle_header header;
+	struct strbuf bundle_ref = STRBUF_INIT;
+	int fd, i, ret = 0;
+
+	memset(&header, 0, sizeof(header));
+	fd = read_bundle_header(file, &header);
+	if (fd < 0)
+		return -1;
+
+	/* unbundle() leaves the file open if this fails */
+	if (verify_bundle(r, &header, 0)) {
+		close(fd);
+		ret = error(_("cannot use bundle '%s'"), file);
+		goto out;
+	}
+	if (unbundle(r, &header, fd, 0)) {
+		ret = -1;
+		goto out;
+	}
+	reprepare_packed_git(r);
+
+	for (i = 0; i < header.references.nr; i++) {
+		struct ref_list_entry *e = &header.references.list[i];
+		const char *name;
+
+		if (!skip_prefix(e->name, "refs/", &name))
+			continue;
+		strbuf_reset(&bundle_ref);
+		strbuf_addf(&bundle_ref, "refs/bundles/%s", name);
+		refs_update_ref(get_main_ref_store(r), "fetched bundle",
+				bundle_ref.buf, &e->oid, NULL, 0,
+				UPDATE_REFS_MSG_ON_ERR);
+	}
+
+out:
+	release_ref_list(&header.prerequisites);
+	release_ref_list(&header.references);
+	strbuf_release(&bundle_ref);
+	return ret;
+}
+
+int fetch_bundle_uri(struct repository *r, const char *uri, int from_user)
+{
+	struct tempfile *tmp = NULL;
+	const char *path = uri, *sep = NULL;
+	char *scheme = NULL;
+	int ret;
+
+	if (skip_prefix(uri, "file://", &path) || !(sep = strstr(uri, "://")))
+		scheme = xstrdup("file");
+	else
+		scheme = xstrndup(uri, sep - uri);
+
+	if (!is_transport_allowed(scheme, from_user)) {
+		ret = error(_("bundle URI '%s' is not allowed"), uri);
+		goto out;
+	}
+
+	trace2_region_enter("fetch", "bundle-uri", r);
+	if (strcmp(scheme, "file")) {
+		char *file = repo_git_path(r, "bundle-XXXXXX");
+
+		/* the helper wants a name that is not taken yet */
+		tmp = mks_tempfile(file);
+		free(file);
+		if (!tmp) {
+			ret = error_errno(_("unable to create temporary file"));
+			goto leave;
+		}
+		file = xstrdup(get_tempfile_path(tmp));
+		delete_tempfile(&tmp);
+		tmp = register_tempfile(file);
+		free(file);
+
+		path = get_tempfile_path(tmp);
+		ret = download_uri_to_file(scheme, uri, path);
+		if (ret) {
+			unlink(mkpath("%s.temp", path));
+			goto leave;
+		}
+	}
+	ret = unbundle_from_file(r, path);
+
+leave:
+	trace2_region_leave("fetch", "bundle-uri", r);
+out:
+	delete_tempfile(&tmp);
+	free(scheme);
+	return ret;
+}
+
+int bundle_uri_advertise(struct repository *r, struct strbuf *value)
+{
+	const struct string_list *uris =
+		repo_config_get_value_multi(r, "uploadpack.bundleuri");
+
+	return uris && uris->nr;
+}
+
+int bundle_uri_command(struct repository *r, struct strvec *keys,
+		       struct packet_reader *request)
+{
+	const struct string_list *uris;
+	int i;
+
+	if (packet_reader_read(request) != PACKET_READ_FLUSH)
+		die(_("bundle-uri: expected flush after arguments"));
+
+	uris = repo_config_get_value_multi(r, "uploadpack.bundleuri");
+	for (i = 0; uris && i < uris->nr; i++)
+		if (uris->items[i].string && *uris->items[i].string)
+			packet_write_fmt(1, "%s\n", uris->items[i].string);
+	packet_flush(1);
+	return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef BUNDLE_URI_H
+#define BUNDLE_URI_H
+
+struct packet_reader;
+struct repository;
+struct strbuf;
+struct strvec;
+
+/*
+ * Bundle URIs point at pre-built bundles of a repository that a client
+ * can download and unbundle before it fetches, so that the server only
+ * has to send what is newer than the bundles.
+ *
+ * After a bundle is unbundled, its refs are copied to refs/bundles/ (the
+ * "refs/" prefix being replaced), so that the fetch that follows tells
+ * the server about them.
+ */
+
+/*
+ * Download the bundle at `uri` and unbundle it into `r`.  The URI may be
+ * a path or a file:// URL, or use any other scheme a remote helper
+ * supporting "get" is installed for; whether it may be used at all
+ * follows the protocol.allow rules, with `from_user` telling whether the
+ * user gave it.  Returns 0 on success, and an error otherwise.
+ */
+int fetch_bundle_uri(struct repository *r, const char *uri, int from_user);
+
+/*
+ * The protocol v2 "bundle-uri" capability and command, which list the
+ * values of uploadpack.bundleURI for the client.
+ */
+int bundle_uri_advertise(struct repository *r, struct strbuf *value);
+int bundle_uri_command(struct repository *r, struct strvec *keys,
+		       struct packet_reader *request);
+
+#endif /* BUNDLE_URI_H */
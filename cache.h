@@ -245,10 +245,19 @@ static inline unsigned create_ce_flags(unsigned stage)
 #define ce_intent_to_add(ce) ((ce)->ce_flags & CE_INTENT_TO_ADD)
 
 #define ce_permissions(mode) (((mode) & 0100) ? 0755 : 0644)
+/*
+ * A sparse directory entry stands for a whole directory outside of
+ * the sparse-checkout cone; its name ends with a slash and its OID
+ * names the tree (see sparse-index.h).
+ */
+#define S_ISSPARSEDIR(m) ((m) == S_IFDIR)
+
 static inline unsigned int create_ce_mode(unsigned int mode)
 {
 	if (S_ISLNK(mode))
 		return S_IFLNK;
+	if (S_ISSPARSEDIR(mode))
+		return S_IFDIR;
 	if (S_ISDIR(mode) || S_ISGITLINK(mode))
 		return S_IFGITLINK;
 	return S_IFREG | ce_permissions(mode);
@@ -319,7 +328,14 @@ struct index_state {
 		 drop_cache_tree : 1,
 		 updated_workdir : 1,
 		 updated_skipworktree : 1,
-		 fsmonitor_has_run_once : 1;
+		 fsmonitor_has_run_once : 1,
+
+		 /*
+		  * sparse_index == 1 when sparse-directory
+		  * entries exist. Requires sparse-checkout
+		  * in cone mode.
+		  */
+		 sparse_index : 1;
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
 	struct object_id oid;
@@ -329,6 +345,12 @@ struct index_state {
 	struct mem_pool *ce_mem_pool;
 	struct progress *progress;
 	struct repository *repo;
+
+	/*
+	 * When set, convert_to_sparse() uses these patterns instead of
+	 * reading the sparse-checkout file; the caller keeps ownership.
+	 */
+	struct pattern_list *sparse_checkout_patterns;
 };
 
 /* Name hashing */
@@ -629,9 +651,10 @@ int path_inside_repo(const char *prefix, const char *path);
 #define INIT_DB_EXIST_OK 0x0002
 
 int init_db(const char *git_dir, const char *real_git_dir,
-	    const char *template_dir, int hash_algo,
+	    const char *template_dir, int hash_algo, const char *ref_format,
 	    const char *initial_branch, unsigned int flags);
-void initialize_repository_version(int hash_algo, int reinit);
+void initialize_repository_version(int hash_algo, const char *ref_format,
+				   int reinit);
 
 void sanitize_stdfds(void);
 int daemonize(void);
@@ -1044,6 +1067,7 @@ struct repository_format {
 	int worktree_config;
 	int is_bare;
 	int hash_algo;
+	char *ref_storage_format; /* value of extensions.refstorage */
 	char *work_tree;
 	struct string_list unknown_extensions;
 	struct string_list v1_only_extensions;
@@ -1640,6 +1664,15 @@ struct checkout {
 int checkout_entry(struct cache_entry *ce, const struct checkout *state, char *topath, int *nr_checkouts);
 void enable_delayed_checkout(struct checkout *state);
 int finish_delayed_checkout(struct checkout *state, int *nr_checkouts);
+
+/*
+ * Helpers shared with parallel-checkout.c, which writes regular files
+ * without going through checkout_entry().
+ */
+void *read_blob_entry(const struct cache_entry *ce, unsigned long *size);
+int fstat_checkout_output(int fd, const struct checkout *state, struct stat *st);
+void update_ce_after_write(const struct checkout *state, struct cache_entry *ce,
+			   struct stat *st);
 /*
  * Unlink the last component and schedule the leading directories for
  * removal, such that empty directories get removed.
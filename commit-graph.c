@@ -611,13 +611,7 @@ static void prepare_commit_graph_one(struct repository *r,
 	r->objects->commit_graph = read_commit_graph_one(r, odb);
 }
 
-/*
- * Return 1 if commit_graph is non-NULL, and 0 otherwise.
- *
- * On the first invocation, this function attempts to load the commit
- * graph if the_repository is configured to have one.
- */
-static int prepare_commit_graph(struct repository *r)
+int prepare_commit_graph(struct repository *r)
 {
 	struct object_directory *odb;
 
@@ -995,6 +989,7 @@ struct write_commit_graph_context {
 
 	int count_bloom_filter_computed;
 	int count_bloom_filter_not_computed;
+	int count_bloom_filter_reused;
 	int count_bloom_filter_trunc_empty;
 	int count_bloom_filter_trunc_large;
 };
@@ -1528,17 +1523,33 @@ static void trace2_bloom_filter_write_statistics(struct write_commit_graph_conte
 			   ctx->count_bloom_filter_computed);
 	trace2_data_intmax("commit-graph", ctx->r, "filter-not-computed",
 			   ctx->count_bloom_filter_not_computed);
+	trace2_data_intmax("commit-graph", ctx->r, "filter-reused",
+			   ctx->count_bloom_filter_reused);
 	trace2_data_intmax("commit-graph", ctx->r, "filter-trunc-empty",
 			   ctx->count_bloom_filter_trunc_empty);
 	trace2_data_intmax("commit-graph", ctx->r, "filter-trunc-large",
 			   ctx->count_bloom_filter_trunc_large);
 }
 
+static int bloom_filter_threads(struct write_commit_graph_context *ctx)
+{
+	int nr_threads;
+
+	if (repo_config_get_int(ctx->r, "commitgraph.threads", &nr_threads))
+		return 0;
+	if (nr_threads < 0)
+		die(_("invalid number of threads specified (%d) for %s"),
+		    nr_threads, "commitGraph.threads");
+	return nr_threads;
+}
+
 static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 {
-	int i;
+	int i, nr_todo = 0;
 	struct progress *progress = NULL;
-	struct commit **sorted_commits;
+	struct commit **sorted_commits, **todo;
+	enum bloom_filter_computed *computed;
+	uint64_t progress_cnt = 0;
 	int max_new_filters;
 
 	init_bloom_filters();
@@ -1559,31 +1570,50 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	max_new_filters = ctx->opts && ctx->opts->max_new_filters >= 0 ?
 		ctx->opts->max_new_filters : ctx->commits.nr;
 
+	/*
+	 * Commits that already have a filter in the commit-graph we are
+	 * replacing, including the layers being merged into this one, keep
+	 * it; the first max_new_filters of the others get one computed.
+	 */
+	ALLOC_ARRAY(todo, ctx->commits.nr);
 	for (i = 0; i < ctx->commits.nr; i++) {
-		enum bloom_filter_computed computed = 0;
 		struct commit *c = sorted_commits[i];
-		struct bloom_filter *filter = get_or_compute_bloom_filter(
-			ctx->r,
-			c,
-			ctx->count_bloom_filter_computed < max_new_filters,
-			ctx->bloom_settings,
-			&computed);
-		if (computed & BLOOM_COMPUTED) {
-			ctx->count_bloom_filter_computed++;
-			if (computed & BLOOM_TRUNC_EMPTY)
-				ctx->count_bloom_filter_trunc_empty++;
-			if (computed & BLOOM_TRUNC_LARGE)
-				ctx->count_bloom_filter_trunc_large++;
-		} else if (computed & BLOOM_NOT_COMPUTED)
-			ctx->count_bloom_filter_not_computed++;
+		struct bloom_filter *filter = get_bloom_filter(ctx->r, c);
+
+		if (filter) {
+			ctx->count_bloom_filter_reused++;
+			ctx->total_bloom_filter_data_size +=
+				sizeof(unsigned char) * filter->len;
+		} else if (nr_todo < max_new_filters) {
+			todo[nr_todo++] = c;
+			continue;
+		}
+		ctx->count_bloom_filter_not_computed++;
+		display_progress(progress, ++progress_cnt);
+	}
+
+	CALLOC_ARRAY(computed, nr_todo);
+	batch_compute_bloom_filters(ctx->r, todo, nr_todo, ctx->bloom_settings,
+				    bloom_filter_threads(ctx), computed,
+				    progress, &progress_cnt);
+
+	for (i = 0; i < nr_todo; i++) {
+		struct bloom_filter *filter = get_bloom_filter(ctx->r, todo[i]);
+
+		ctx->count_bloom_filter_computed++;
+		if (computed[i] & BLOOM_TRUNC_EMPTY)
+			ctx->count_bloom_filter_trunc_empty++;
+		if (computed[i] & BLOOM_TRUNC_LARGE)
+			ctx->count_bloom_filter_trunc_large++;
 		ctx->total_bloom_filter_data_size += filter
 			? sizeof(unsigned char) * filter->len : 0;
-		display_progress(progress, i + 1);
 	}
 
 	if (trace2_is_enabled())
 		trace2_bloom_filter_write_statistics(ctx);
 
+	free(computed);
+	free(todo);
 	free(sorted_commits);
 	stop_progress(&progress);
 }
@@ -229,6 +229,182 @@ static int remove_redundant_no_gen(struct repository *r,
 	return filled;
 }
 
+/*
+ * Painting down from each commit in turn, as remove_redundant_no_gen()
+ * does, costs one walk per commit; with many commits (think of every
+ * release branch at once), walking once from all of them is much cheaper.
+ */
+#define REMOVE_REDUNDANT_BATCH_MIN 16
+
+/*
+ * For each commit walked by remove_redundant_batched(), the set of input
+ * commits it is reachable from, one bit per position in the input, and
+ * for each input commit its position.
+ */
+define_commit_slab(reaching_inputs, uint64_t);
+define_commit_slab(input_position, int);
+
+#define INPUT_WORD(i) ((i) / 64)
+#define INPUT_BIT(i) ((uint64_t)1 << ((i) % 64))
+
+/*
+ * The walk may go through most of the history, so bound the size of the
+ * slab row it keeps for each commit; with more input than this, see
+ * remove_redundant_full_walk().
+ */
+#define REMOVE_REDUNDANT_BATCH_MAX 1024
+
+/*
+ * Mark everything reachable from the input through a parent STALE, which
+ * makes the redundant input STALE.  This walks all of the history of the
+ * input, but needs nothing beyond the object flags, and looks at the
+ * parents of each commit once (twice for input that turns out to be
+ * STALE), whatever the number of input commits.
+ */
+static int remove_redundant_full_walk(struct repository *r,
+				      struct commit **array, int cnt)
+{
+	struct commit **stack;
+	size_t nr = 0, alloc = cnt;
+	struct commit_list *parents;
+	int i, count_non_stale;
+
+	ALLOC_ARRAY(stack, alloc);
+	for (i = 0; i < cnt; i++) {
+		repo_parse_commit(r, array[i]);
+		if (array[i]->object.flags & RESULT)
+			continue;
+		array[i]->object.flags |= RESULT;
+		stack[nr++] = array[i];
+	}
+
+	while (nr) {
+		struct commit *c = stack[--nr];
+
+		for (parents = c->parents; parents; parents = parents->next) {
+			struct commit *p = parents->item;
+
+			if (p->object.flags & STALE)
+				continue;
+			repo_parse_commit(r, p);
+			p->object.flags |= STALE;
+			ALLOC_GROW(stack, nr + 1, alloc);
+			stack[nr++] = p;
+		}
+	}
+	free(stack);
+
+	for (i = 0; i < cnt; i++)
+		array[i]->object.flags &= ~RESULT;
+	for (i = count_non_stale = 0; i < cnt; i++) {
+		if (!(array[i]->object.flags & STALE))
+			array[count_non_stale++] = array[i];
+	}
+
+	/* everything we marked hangs off the parents of the input */
+	for (i = 0; i < count_non_stale; i++)
+		for (parents = array[i]->parents; parents; parents = parents->next)
+			clear_commit_marks(parents->item, STALE);
+	return count_non_stale;
+}
+
+/*
+ * Walk from all of the commits at once, marking everything reachable from
+ * one of them through a parent STALE; a commit is redundant if it ends up
+ * STALE.  Along the way, each commit records which of the input reach it.
+ * A commit that is reached by every input commit not known to be
+ * redundant yet cannot lead to any of them (it would be its own
+ * ancestor), so the walk does not go past it, much like
+ * paint_down_to_common() does not go past STALE commits.  Commits that
+ * are reached by more of the input later are walked again, so the result
+ * does not depend on the order of the walk, and on commit dates being
+ * right; the commit date order only makes walking commits again rare.
+ */
+static int remove_redundant_batched(struct repository *r,
+				    struct commit **array, int cnt)
+{
+	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
+	struct reaching_inputs reaching;
+	struct input_position position;
+	size_t nr_words = DIV_ROUND_UP(cnt, 64), w;
+	uint64_t *non_stale;
+	struct commit_list *parents;
+	struct commit *c;
+	int i, count_non_stale;
+
+	if (cnt > REMOVE_REDUNDANT_BATCH_MAX)
+		return remove_redundant_full_walk(r, array, cnt);
+
+	init_reaching_inputs_with_stride(&reaching, nr_words);
+	init_input_position(&position);
+	CALLOC_ARRAY(non_stale, nr_words);
+
+	for (i = 0; i < cnt; i++) {
+		repo_parse_commit(r, array[i]);
+		if (array[i]->object.flags & RESULT)
+			continue;
+		array[i]->object.flags |= RESULT;
+		*input_position_at(&position, array[i]) = i;
+		reaching_inputs_at(&reaching, array[i])[INPUT_WORD(i)] |=
+			INPUT_BIT(i);
+		non_stale[INPUT_WORD(i)] |= INPUT_BIT(i);
+		prio_queue_put(&queue, array[i]);
+	}
+
+	while ((c = prio_queue_get(&queue))) {
+		uint64_t *c_reaching = reaching_inputs_at(&reaching, c);
+
+		for (w = 0; w < nr_words; w++)
+			if (non_stale[w] & ~c_reaching[w])
+				break;
+		if (w == nr_words)
+			continue;
+
+		for (parents = c->parents; parents; parents = parents->next) {
+			struct commit *p = parents->item;
+			uint64_t *p_reaching;
+			int changed = 0;
+
+			if (!(p->object.flags & STALE)) {
+				repo_parse_commit(r, p);
+				p->object.flags |= STALE;
+				if (p->object.flags & RESULT) {
+					int pos = *input_position_at(&position, p);
+					non_stale[INPUT_WORD(pos)] &= ~INPUT_BIT(pos);
+				}
+				changed = 1;
+			}
+
+			p_reaching = reaching_inputs_at(&reaching, p);
+			for (w = 0; w < nr_words; w++) {
+				if (c_reaching[w] & ~p_reaching[w]) {
+					p_reaching[w] |= c_reaching[w];
+					changed = 1;
+				}
+			}
+			if (changed)
+				prio_queue_put(&queue, p);
+		}
+	}
+	clear_prio_queue(&queue);
+	clear_reaching_inputs(&reaching);
+	clear_input_position(&position);
+	free(non_stale);
+
+	for (i = 0; i < cnt; i++)
+		array[i]->object.flags &= ~RESULT;
+	for (i = count_non_stale = 0; i < cnt; i++) {
+		if (!(array[i]->object.flags & STALE))
+			array[count_non_stale++] = array[i];
+	}
+
+	/* everything we marked hangs off the parents of the input */
+	for (i = 0; i < count_non_stale; i++)
+		for (parents = array[i]->parents; parents; parents = parents->next)
+			clear_commit_marks(parents->item, STALE);
+	return count_non_stale;
+}
+
 static int remove_redundant_with_gen(struct repository *r,
 				     struct commit **array, int cnt)
 {
@@ -370,6 +546,8 @@ static int remove_redundant(struct repository *r, struct commit **array, int cnt
 		}
 	}
 
+	if (cnt >= REMOVE_REDUNDANT_BATCH_MIN)
+		return remove_redundant_batched(r, array, cnt);
 	return remove_redundant_no_gen(r, array, cnt);
 }
 
@@ -168,6 +168,13 @@ static inline uint64_t get_be64(const void *ptr)
 		(uint64_t)get_be32(&p[4]) <<  0;
 }
 
+static inline void put_be16(void *ptr, uint16_t value)
+{
+	unsigned char *p = ptr;
+	p[0] = value >> 8;
+	p[1] = value >> 0;
+}
+
 static inline void put_be32(void *ptr, uint32_t value)
 {
 	unsigned char *p = ptr;
@@ -0,0 +1,676 @@
+#include "cache.h"
+#include "fsmonitor.h"
+#include "fsmonitor-fs-listen.h"
+#include "fsmonitor--daemon.h"
+#include <sys/inotify.h>
+
+/*
+ * inotify(7) is not recursive, so we have to add a watch to every
+ * directory in the working directory ourselves and keep that set of
+ * watches up to date as directories are created, deleted, and renamed.
+ *
+ * We only watch the top-level of the <gitdir> (whether it is the
+ * "<worktree>/.git" directory or an external <gitdir>) because we only
+ * care about the cookie files that our client threads create there (and
+ * about the <gitdir> itself going away).
+ */
+#define WATCH_MASK_WORKTREE (IN_ATTRIB | IN_MODIFY | \
+			     IN_CREATE | IN_DELETE | \
+			     IN_MOVED_FROM | IN_MOVED_TO | \
+			     IN_DELETE_SELF | IN_MOVE_SELF | \
+			     IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+#define WATCH_MASK_GITDIR (IN_CREATE | IN_DELETE | \
+			   IN_MOVED_FROM | IN_MOVED_TO | \
+			   IN_DELETE_SELF | IN_MOVE_SELF | \
+			   IN_ONLYDIR | IN_DONT_FOLLOW)
+
+/*
+ * Large enough for several hundred events with typical path lengths.
+ * The kernel never splits an event across calls to read(2), so this
+ * must be at least `sizeof(struct inotify_event) + NAME_MAX + 1`.
+ */
+#define INOTIFY_BUF_SIZE (64 * 1024)
+
+struct one_watch {
+	struct hashmap_entry ent; /* key is `wd` */
+	int wd;
+	char *path; /* absolute pathname of the watched directory */
+};
+
+struct fsmonitor_daemon_backend_data
+{
+	int fd_inotify;
+
+	/*
+	 * The listener thread blocks in poll(2) on the inotify fd and on
+	 * the read end of this pipe.  `fsmonitor_fs_listen__stop_async()`
+	 * writes a byte to the other end to wake it up.
+	 */
+	int fd_shutdown[2];
+
+	struct hashmap watches;
+	int wd_worktree;
+	int wd_gitdir;
+
+	char *buf;
+};
+
+static int one_watch_cmp(const void *unused_cmp_data,
+			 const struct hashmap_entry *eptr,
+			 const struct hashmap_entry *entry_or_key,
+			 const void *unused_keydata)
+{
+	const struct one_watch *a, *b;
+
+	a = container_of(eptr, const struct one_watch, ent);
+	b = container_of(entry_or_key, const struct one_watch, ent);
+
+	return a->wd != b->wd;
+}
+
+static struct one_watch *find_watch(struct fsmonitor_daemon_backend_data *data,
+				    int wd)
+{
+	struct one_watch key;
+
+	hashmap_entry_init(&key.ent, memhash(&wd, sizeof(wd)));
+	key.wd = wd;
+
+	return hashmap_get_entry(&data->watches, &key, ent, NULL);
+}
+
+static void forget_watch(struct fsmonitor_daemon_backend_data *data,
+			 struct one_watch *w)
+{
+	hashmap_remove(&data->watches, &w->ent, NULL);
+	free(w->path);
+	free(w);
+}
+
+/*
+ * Add (or update) a single watch on the directory `path`.
+ *
+ * Returns the watch descriptor, -1 if the directory could not be watched
+ * because it has already gone away or is otherwise not accessible (which
+ * the caller can ignore), or -2 on a hard error (such as hitting the
+ * `fs.inotify.max_user_watches` limit) where we can no longer guarantee
+ * that we see every change.
+ */
+static int add_one_watch(struct fsmonitor_daemon_backend_data *data,
+			 const char *path, uint32_t mask)
+{
+	struct one_watch *w;
+	int wd;
+
+	wd = inotify_add_watch(data->fd_inotify, path, mask);
+	if (wd < 0) {
+		if (errno == ENOENT || errno == ENOTDIR || errno == EACCES) {
+			trace_printf_key(&trace_fsmonitor,
+					 "could not watch '%s': %s",
+					 path, strerror(errno));
+			return -1;
+		}
+		if (errno == ENOSPC)
+			error(_("could not watch '%s': inotify watch limit "
+				"reached (see /proc/sys/fs/inotify/max_user_watches)"),
+			      path);
+		else
+			error_errno(_("could not watch '%s'"), path);
+		return -2;
+	}
+
+	/*
+	 * inotify_add_watch() returns the existing descriptor if the
+	 * inode is already being watched (for example, when we see the
+	 * IN_CREATE for a directory after our recursive scan of its
+	 * parent already found it).  Just refresh the pathname.
+	 */
+	w = find_watch(data, wd);
+	if (w) {
+		if (strcmp(w->path, path)) {
+			free(w->path);
+			w->path = xstrdup(path);
+		}
+		return wd;
+	}
+
+	w = xcalloc(1, sizeof(*w));
+	hashmap_entry_init(&w->ent, memhash(&wd, sizeof(wd)));
+	w->wd = wd;
+	w->path = xstrdup(path);
+	hashmap_add(&data->watches, &w->ent);
+
+	return wd;
+}
+
+/*
+ * Stop watching `path` and everything below it.  This is used when a
+ * directory is renamed: the kernel keeps the existing watches, but the
+ * pathnames that we associated with them are now wrong.  If the
+ * directory was moved to another place within the worktree, we will
+ * see an IN_MOVED_TO for it and add fresh watches for the new pathnames.
+ */
+static void remove_watches_below(struct fsmonitor_daemon_backend_data *data,
+				 const char *path)
+{
+	struct hashmap_iter iter;
+	struct one_watch *w;
+	struct one_watch **doomed = NULL;
+	size_t nr = 0, alloc = 0, k;
+	size_t len = strlen(path);
+
+	hashmap_for_each_entry(&data->watches, &iter, w, ent) {
+		if (strncmp(w->path, path, len))
+			continue;
+		if (w->path[len] && w->path[len] != '/')
+			continue;
+		ALLOC_GROW(doomed, nr + 1, alloc);
+		doomed[nr++] = w;
+	}
+
+	for (k = 0; k < nr; k++) {
+		inotify_rm_watch(data->fd_inotify, doomed[k]->wd);
+		forget_watch(data, doomed[k]);
+	}
+
+	free(doomed);
+}
+
+static int is_dir_entry(struct dirent *de, const char *path)
+{
+	struct stat st;
+
+	if (DTYPE(de) != DT_UNKNOWN)
+		return DTYPE(de) == DT_DIR;
+	if (lstat(path, &st))
+		return 0;
+	return S_ISDIR(st.st_mode);
+}
+
+/*
+ * Recursively add watches to the directory `path` and all directories
+ * below it.
+ *
+ * If `batch` is given, also add the worktree-relative pathname of every
+ * file and directory that we find to it.  We need this when a directory
+ * is created (or moved into the worktree) after we start: the directory
+ * may already be populated by the time we get around to watching it, so
+ * we would not receive events for the files in it.  Since we add the
+ * watch before reading the directory, anything created after that point
+ * will generate an event and anything created before will be found by
+ * the scan (and some things might be reported twice, which is harmless).
+ *
+ * Returns 0 on success or -1 on a hard error.
+ */
+static int add_watches_recursive(struct fsmonitor_daemon_state *state,
+				 struct strbuf *path,
+				 struct fsmonitor_batch *batch)
+{
+	struct fsmonitor_daemon_backend_data *data = state->backend_data;
+	DIR *dir;
+	struct dirent *de;
+	size_t baselen = path->len;
+	int wd;
+	int ret = 0;
+
+	wd = add_one_watch(data, path->buf, WATCH_MASK_WORKTREE);
+	if (wd == -1)
+		return 0;
+	if (wd < 0)
+		return -1;
+
+	dir = opendir(path->buf);
+	if (!dir)
+		return 0;
+
+	while ((de = readdir(dir)) != NULL) {
+		int is_dir;
+
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+
+		strbuf_setlen(path, baselen);
+		strbuf_addch(path, '/');
+		strbuf_addstr(path, de->d_name);
+
+		/*
+		 * The "<worktree>/.git" directory has its own
+		 * (non-recursive) watch.
+		 */
+		if (!fspathcmp(path->buf, state->path_gitdir_watch.buf))
+			continue;
+
+		is_dir = is_dir_entry(de, path->buf);
+
+		if (batch) {
+			const char *rel = path->buf +
+				state->path_worktree_watch.len + 1;
+
+			if (is_dir) {
+				char *p = xstrfmt("%s/", rel);
+				fsmonitor_batch__add_path(batch, p);
+				free(p);
+			} else {
+				fsmonitor_batch__add_path(batch, rel);
+			}
+		}
+
+		if (is_dir && add_watches_recursive(state, path, batch)) {
+			ret = -1;
+			break;
+		}
+	}
+
+	closedir(dir);
+	strbuf_setlen(path, baselen);
+	return ret;
+}
+
+static int add_all_watches(struct fsmonitor_daemon_state *state)
+{
+	struct fsmonitor_daemon_backend_data *data = state->backend_data;
+	struct strbuf path = STRBUF_INIT;
+	int ret;
+
+	data->wd_gitdir = add_one_watch(data, state->path_gitdir_watch.buf,
+					WATCH_MASK_GITDIR);
+	if (data->wd_gitdir < 0) {
+		strbuf_release(&path);
+		return error(_("could not watch '%s'"),
+			     state->path_gitdir_watch.buf);
+	}
+
+	data->wd_worktree = add_one_watch(data, state->path_worktree_watch.buf,
+					  WATCH_MASK_WORKTREE);
+	if (data->wd_worktree < 0) {
+		strbuf_release(&path);
+		return error(_("could not watch '%s'"),
+			     state->path_worktree_watch.buf);
+	}
+
+	strbuf_addbuf(&path, &state->path_worktree_watch);
+	ret = add_watches_recursive(state, &path, NULL);
+	strbuf_release(&path);
+	if (ret)
+		return ret;
+
+	trace2_data_intmax("fsmonitor", NULL, "fsm-listen/watches",
+			   hashmap_get_size(&data->watches));
+	return 0;
+}
+
+static void log_mask_set(const char *path, uint32_t mask)
+{
+	struct strbuf msg = STRBUF_INIT;
+
+	if (mask & IN_ACCESS)
+		strbuf_addstr(&msg, "IN_ACCESS|");
+	if (mask & IN_MODIFY)
+		strbuf_addstr(&msg, "IN_MODIFY|");
+	if (mask & IN_ATTRIB)
+		strbuf_addstr(&msg, "IN_ATTRIB|");
+	if (mask & IN_CLOSE_WRITE)
+		strbuf_addstr(&msg, "IN_CLOSE_WRITE|");
+	if (mask & IN_CLOSE_NOWRITE)
+		strbuf_addstr(&msg, "IN_CLOSE_NOWRITE|");
+	if (mask & IN_OPEN)
+		strbuf_addstr(&msg, "IN_OPEN|");
+	if (mask & IN_MOVED_FROM)
+		strbuf_addstr(&msg, "IN_MOVED_FROM|");
+	if (mask & IN_MOVED_TO)
+		strbuf_addstr(&msg, "IN_MOVED_TO|");
+	if (mask & IN_CREATE)
+		strbuf_addstr(&msg, "IN_CREATE|");
+	if (mask & IN_DELETE)
+		strbuf_addstr(&msg, "IN_DELETE|");
+	if (mask & IN_DELETE_SELF)
+		strbuf_addstr(&msg, "IN_DELETE_SELF|");
+	if (mask & IN_MOVE_SELF)
+		strbuf_addstr(&msg, "IN_MOVE_SELF|");
+	if (mask & IN_UNMOUNT)
+		strbuf_addstr(&msg, "IN_UNMOUNT|");
+	if (mask & IN_Q_OVERFLOW)
+		strbuf_addstr(&msg, "IN_Q_OVERFLOW|");
+	if (mask & IN_IGNORED)
+		strbuf_addstr(&msg, "IN_IGNORED|");
+	if (mask & IN_ISDIR)
+		strbuf_addstr(&msg, "IN_ISDIR|");
+
+	trace_printf_key(&trace_fsmonitor, "inotify: '%s', mask=%#8.8x %s",
+			 path, mask, msg.buf);
+
+	strbuf_release(&msg);
+}
+
+enum process_result {
+	PROCESS_CONTINUE = 0,
+	PROCESS_SHUTDOWN,
+	PROCESS_ERROR,
+};
+
+/*
+ * The kernel event queue overflowed (see `/proc/sys/fs/inotify/
+ * max_queued_events`), so we have lost sync with the filesystem.
+ * Flush our cached data and start a new token so that clients fall
+ * back to a full scan.  We may also have missed the creation of new
+ * directories, so rescan the worktree for directories that we are
+ * not yet watching.
+ */
+static int handle_overflow(struct fsmonitor_daemon_state *state)
+{
+	struct strbuf path = STRBUF_INIT;
+	int ret;
+
+	trace2_data_string("fsmonitor", NULL, "fsm-listen/kernel", "overflow");
+
+	fsmonitor_force_resync(state);
+
+	strbuf_addbuf(&path, &state->path_worktree_watch);
+	ret = add_watches_recursive(state, &path, NULL);
+	strbuf_release(&path);
+
+	return ret;
+}
+
+static enum process_result process_events(struct fsmonitor_daemon_state *state,
+					  const char *buf, ssize_t len)
+{
+	struct fsmonitor_daemon_backend_data *data = state->backend_data;
+	struct fsmonitor_batch *batch = NULL;
+	struct string_list cookie_list = STRING_LIST_INIT_DUP;
+	struct strbuf path = STRBUF_INIT;
+	enum process_result result = PROCESS_CONTINUE;
+	const char *p;
+
+	for (p = buf; p < buf + len;
+	     p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+		const struct inotify_event *ev = (const struct inotify_event *)p;
+		struct one_watch *w;
+		const char *rel;
+
+		if (ev->mask & IN_Q_OVERFLOW) {
+			/*
+			 * Discard the batch that we were locally building
+			 * (since it is relative to the token that we are
+			 * about to flush).  We keep the cookies because
+			 * resyncing aborts all waiting clients anyway.
+			 */
+			if (fsmonitor_batch__free(batch))
+				BUG("batch should not have a next");
+			batch = NULL;
+
+			if (handle_overflow(state)) {
+				result = PROCESS_ERROR;
+				goto done;
+			}
+			continue;
+		}
+
+		w = find_watch(data, ev->wd);
+		if (!w) {
+			/*
+			 * Stale event for a watch that we have already
+			 * removed (such as the IN_IGNORED that follows our
+			 * own inotify_rm_watch()).
+			 */
+			continue;
+		}
+
+		strbuf_reset(&path);
+		strbuf_addstr(&path, w->path);
+		if (ev->len) {
+			strbuf_addch(&path, '/');
+			strbuf_addstr(&path, ev->name);
+		}
+
+		if (trace_pass_fl(&trace_fsmonitor))
+			log_mask_set(path.buf, ev->mask);
+
+		if (!ev->len) {
+			/*
+			 * Events on the watched directory itself.  Renames
+			 * and deletes of ordinary directories are handled
+			 * via the corresponding event on their parent, but
+			 * if the root of the worktree or the <gitdir> goes
+			 * away, we have to quit.
+			 */
+			if (ev->wd == data->wd_gitdir &&
+			    (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))) {
+				trace2_data_string("fsmonitor", NULL,
+						   "fsm-listen/gitdir",
+						   (ev->mask & IN_DELETE_SELF) ?
+						   "removed" : "renamed");
+				result = PROCESS_SHUTDOWN;
+				goto done;
+			}
+			if (ev->wd == data->wd_worktree &&
+			    (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF |
+					 IN_UNMOUNT))) {
+				trace2_data_string("fsmonitor", NULL,
+						   "fsm-listen/worktree",
+						   "removed");
+				result = PROCESS_SHUTDOWN;
+				goto done;
+			}
+			if (ev->mask & IN_IGNORED)
+				forget_watch(data, w);
+			continue;
+		}
+
+		switch (fsmonitor_classify_path_absolute(state, path.buf)) {
+
+		case IS_INSIDE_DOT_GIT_WITH_COOKIE_PREFIX:
+		case IS_INSIDE_GITDIR_WITH_COOKIE_PREFIX:
+			/* special case cookie files within .git or gitdir */
+
+			/* Use just the filename of the cookie file. */
+			string_list_append(&cookie_list, ev->name);
+			break;
+
+		case IS_INSIDE_DOT_GIT:
+		case IS_INSIDE_GITDIR:
+			/* ignore all other paths inside of .git or gitdir */
+			break;
+
+		case IS_DOT_GIT:
+		case IS_GITDIR:
+			/*
+			 * If .git directory is deleted or renamed away,
+			 * we have to quit.
+			 */
+			if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				trace2_data_string("fsmonitor", NULL,
+						   "fsm-listen/gitdir",
+						   (ev->mask & IN_DELETE) ?
+						   "removed" : "renamed");
+				result = PROCESS_SHUTDOWN;
+				goto done;
+			}
+			break;
+
+		case IS_WORKDIR_PATH:
+			/* try to queue normal pathnames */
+
+			rel = path.buf + state->path_worktree_watch.len + 1;
+
+			if (!batch)
+				batch = fsmonitor_batch__new();
+
+			if (!(ev->mask & IN_ISDIR)) {
+				fsmonitor_batch__add_path(batch, rel);
+				break;
+			}
+
+			/*
+			 * We do not care about attribute changes on
+			 * directories.
+			 */
+			if (!(ev->mask & (IN_CREATE | IN_DELETE |
+					  IN_MOVED_FROM | IN_MOVED_TO)))
+				break;
+
+			{
+				char *dir = xstrfmt("%s/", rel);
+				fsmonitor_batch__add_path(batch, dir);
+				free(dir);
+			}
+
+			if (ev->mask & IN_MOVED_FROM)
+				remove_watches_below(data, path.buf);
+
+			if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) &&
+			    add_watches_recursive(state, &path, batch)) {
+				result = PROCESS_ERROR;
+				goto done;
+			}
+			break;
+
+		case IS_OUTSIDE_CONE:
+		default:
+			trace_printf_key(&trace_fsmonitor,
+					 "ignoring '%s'", path.buf);
+			break;
+		}
+	}
+
+	fsmonitor_publish(state, batch, &cookie_list);
+	batch = NULL;
+
+done:
+	if (fsmonitor_batch__free(batch))
+		BUG("batch should not have a next");
+	string_list_clear(&cookie_list, 0);
+	strbuf_release(&path);
+	return result;
+}
+
+int fsmonitor_fs_listen__ctor(struct fsmonitor_daemon_state *state)
+{
+	struct fsmonitor_daemon_backend_data *data;
+
+	data = xcalloc(1, sizeof(*data));
+	data->fd_shutdown[0] = -1;
+	data->fd_shutdown[1] = -1;
+	data->wd_worktree = -1;
+	data->wd_gitdir = -1;
+	hashmap_init(&data->watches, one_watch_cmp, NULL, 0);
+	state->backend_data = data;
+
+	data->fd_inotify = inotify_init1(IN_CLOEXEC);
+	if (data->fd_inotify < 0) {
+		error_errno(_("could not initialize inotify"));
+		goto failed;
+	}
+
+	if (pipe(data->fd_shutdown) < 0) {
+		error_errno(_("could not create shutdown pipe"));
+		goto failed;
+	}
+
+	if (add_all_watches(state))
+		goto failed;
+
+	data->buf = xmalloc(INOTIFY_BUF_SIZE);
+	return 0;
+
+failed:
+	fsmonitor_fs_listen__dtor(state);
+	return -1;
+}
+
+void fsmonitor_fs_listen__dtor(struct fsmonitor_daemon_state *state)
+{
+	struct fsmonitor_daemon_backend_data *data;
+	struct hashmap_iter iter;
+	struct one_watch *w;
+
+	if (!state || !state->backend_data)
+		return;
+
+	data = state->backend_data;
+
+	hashmap_for_each_entry(&data->watches, &iter, w, ent)
+		free(w->path);
+	hashmap_clear_and_free(&data->watches, struct one_watch, ent);
+
+	if (data->fd_inotify >= 0)
+		close(data->fd_inotify);
+	if (data->fd_shutdown[0] >= 0)
+		close(data->fd_shutdown[0]);
+	if (data->fd_shutdown[1] >= 0)
+		close(data->fd_shutdown[1]);
+
+	free(data->buf);
+	FREE_AND_NULL(state->backend_data);
+}
+
+void fsmonitor_fs_listen__stop_async(struct fsmonitor_daemon_state *state)
+{
+	struct fsmonitor_daemon_backend_data *data;
+
+	data = state->backend_data;
+
+	if (write(data->fd_shutdown[1], "", 1) < 0)
+		error_errno(_("could not signal fsmonitor listener thread"));
+}
+
+void fsmonitor_fs_listen__loop(struct fsmonitor_daemon_state *state)
+{
+	struct fsmonitor_daemon_backend_data *data = state->backend_data;
+	struct pollfd pfd[2];
+	ssize_t len;
+
+	state->error_code = 0;
+
+	pfd[0].fd = data->fd_inotify;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = data->fd_shutdown[0];
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			error_errno(_("poll failed on inotify descriptor"));
+			goto force_error_stop;
+		}
+
+		if (pfd[1].revents)
+			return;
+
+		if (!(pfd[0].revents & POLLIN)) {
+			error(_("inotify descriptor is no longer readable"));
+			goto force_error_stop;
+		}
+
+		len = read(data->fd_inotify, data->buf, INOTIFY_BUF_SIZE);
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			error_errno(_("could not read inotify events"));
+			goto force_error_stop;
+		}
+
+		switch (process_events(state, data->buf, len)) {
+		case PROCESS_CONTINUE:
+			continue;
+		case PROCESS_SHUTDOWN:
+			goto force_shutdown;
+		case PROCESS_ERROR:
+		default:
+			goto force_error_stop;
+		}
+	}
+
+force_error_stop:
+	state->error_code = -1;
+
+force_shutdown:
+	/*
+	 * Tell the IPC thead pool to stop (which completes the await
+	 * in the main thread (which will also signal this thread (if
+	 * we are still alive))).
+	 */
+	ipc_server_stop_async(state->ipc_server_data);
+}
@@ -535,6 +535,36 @@ struct ref **get_remote_refs(int fd_out, struct packet_reader *reader,
 	return list;
 }
 
+void get_remote_bundle_uri(int fd_out, struct packet_reader *reader,
+			   struct string_list *uris,
+			   const struct string_list *server_options,
+			   int stateless_rpc)
+{
+	const char *hash_name;
+	int i;
+
+	packet_write_fmt(fd_out, "command=bundle-uri\n");
+	if (server_supports_v2("agent", 0))
+		packet_write_fmt(fd_out, "agent=%s", git_user_agent_sanitized());
+	if (server_feature_v2("object-format", &hash_name))
+		packet_write_fmt(fd_out, "object-format=%s", hash_name);
+	if (server_options && server_options->nr &&
+	    server_supports_v2("server-option", 1))
+		for (i = 0; i < server_options->nr; i++)
+			packet_write_fmt(fd_out, "server-option=%s",
+					 server_options->items[i].string);
+	packet_flush(fd_out);
+
+	while (packet_reader_read(reader) == PACKET_READ_NORMAL)
+		string_list_append(uris, reader->line);
+
+	if (reader->status != PACKET_READ_FLUSH)
+		die(_("expected flush after bundle URI listing"));
+
+	check_stateless_delimiter(stateless_rpc, reader,
+				  _("expected response end packet after bundle URI listing"));
+}
+
 const char *parse_feature_value(const char *feature_list, const char *feature, int *lenp, int *offset)
 {
 	int len;
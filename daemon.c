@@ -1,9 +1,15 @@
 #include "cache.h"
+#include "commit-graph.h"
 #include "config.h"
+#include "midx.h"
+#include "object-store.h"
+#include "packfile.h"
 #include "pkt-line.h"
 #include "run-command.h"
+#include "sigchain.h"
 #include "strbuf.h"
 #include "string-list.h"
+#include "upload-pack.h"
 
 #ifdef NO_INITGROUPS
 #define initgroups(x, y) (0) /* nothing */
@@ -31,6 +37,9 @@ static const char daemon_usage[] =
 "           [--inetd | [--listen=<host_or_ipaddr>] [--port=<n>]\n"
 "                      [--detach] [--user=<user> [--group=<group>]]\n"
 "           [--log-destination=(stderr|syslog|none)]\n"
+"           [--worker-pool=<n> [--worker-max-requests=<n>]\n"
+"                              [--worker-max-lifetime=<n>]\n"
+"                              [--worker-max-memory=<n>]]\n"
 "           [<directory>...]";
 
 /* List of acceptable pathname prefixes */
@@ -55,6 +64,18 @@ static const char *user_path;
 static unsigned int timeout;
 static unsigned int init_timeout;
 
+/*
+ * With --worker-pool, connections are accepted by that many pre-forked
+ * workers, which fork without exec'ing to serve each one (see
+ * worker_loop()).
+ */
+static int worker_pool;
+static unsigned int worker_max_requests;
+static unsigned int worker_max_lifetime;
+static unsigned long worker_max_memory;
+static int pool_worker;
+static int pool_child;
+
 struct hostinfo {
 	struct strbuf hostname;
 	struct strbuf canon_hostname;
@@ -476,9 +497,264 @@ static int run_service_command(struct child_process *cld)
 	return finish_command(cld);
 }
 
-static int upload_pack(const struct strvec *env)
+static void set_env(const struct strvec *env)
+{
+	int i;
+
+	for (i = 0; i < env->nr; i++) {
+		const char *eq = strchr(env->v[i], '=');
+		char *name;
+
+		if (!eq)
+			continue;
+		name = xstrndup(env->v[i], eq - env->v[i]);
+		setenv(name, eq + 1, 1);
+		free(name);
+	}
+}
+
+/*
+ * A pool worker keeps the object stores of the repositories its
+ * connections asked for "warm": the packs are listed, and their indexes,
+ * the multi-pack-index and the commit-graph are mapped.  The process it
+ * forks for a connection inherits them, and uses the one for its
+ * repository instead of opening the object store itself, unless packs
+ * were added or removed, or the commit-graph was written, since.
+ *
+ * The forked processes tell the worker about the repositories that were
+ * not warm yet over the "warm_report" pipe, so that the connections the
+ * worker accepts later find them warm.
+ */
+/*
+ * Adding or removing a pack changes "pack"; writing a commit-graph
+ * renames a file into "info", or, for a chain, into "info/commit-graphs".
+ */
+static const char *warm_object_dirs[] = {
+	"pack",
+	"info",
+	"info/commit-graphs",
+};
+
+struct warm_repository {
+	char *gitdir;
+	struct repository repo;
+	struct stat_data object_dirs[ARRAY_SIZE(warm_object_dirs)];
+	size_t size;
+	unsigned long last_used;
+};
+
+static struct warm_repository **warm_repos;
+static int warm_repos_nr, warm_repos_alloc;
+static unsigned long warm_clock;
+static size_t warm_size;
+static int warm_report[2] = { -1, -1 };
+
+static int find_warm_repository(const char *gitdir)
+{
+	int i;
+
+	for (i = 0; i < warm_repos_nr; i++)
+		if (!strcmp(warm_repos[i]->gitdir, gitdir))
+			return i;
+	return -1;
+}
+
+/*
+ * A directory that does not exist gets all-zero stat data, so that it
+ * only counts as a change when it appears.
+ */
+static int stat_object_dir(struct repository *r, const char *dir,
+			   struct stat *st)
+{
+	struct strbuf path = STRBUF_INIT;
+	int ret;
+
+	strbuf_addf(&path, "%s/%s", r->objects->odb->path, dir);
+	ret = stat(path.buf, st);
+	if (ret && errno == ENOENT) {
+		memset(st, 0, sizeof(*st));
+		ret = 0;
+	}
+	strbuf_release(&path);
+	return ret;
+}
+
+static int warm_repository_changed(struct warm_repository *w)
+{
+	struct stat st;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(warm_object_dirs); i++)
+		if (stat_object_dir(&w->repo, warm_object_dirs[i], &st) ||
+		    match_stat_data(&w->object_dirs[i], &st))
+			return 1;
+	return 0;
+}
+
+static void drop_warm_repository(int i)
+{
+	struct warm_repository *w = warm_repos[i];
+
+	warm_size -= w->size;
+	repo_clear(&w->repo);
+	free(w->gitdir);
+	free(w);
+	MOVE_ARRAY(warm_repos + i, warm_repos + i + 1, warm_repos_nr - i - 1);
+	warm_repos_nr--;
+}
+
+static void drop_least_recently_used(void)
+{
+	int i, lru = 0;
+
+	for (i = 1; i < warm_repos_nr; i++)
+		if (warm_repos[i]->last_used < warm_repos[lru]->last_used)
+			lru = i;
+	drop_warm_repository(lru);
+}
+
+static void warm_up_repository(const char *gitdir)
+{
+	int i = find_warm_repository(gitdir);
+	struct warm_repository *w;
+	struct packed_git *p;
+	struct multi_pack_index *m;
+	struct commit_graph *g;
+	struct stat st;
+
+	if (i >= 0) {
+		if (!warm_repository_changed(warm_repos[i])) {
+			warm_repos[i]->last_used = ++warm_clock;
+			return;
+		}
+		drop_warm_repository(i);
+	}
+
+	CALLOC_ARRAY(w, 1);
+	if (repo_init(&w->repo, gitdir, NULL)) {
+		free(w);
+		return;
+	}
+	/*
+	 * Parts of the pack code still use the_hash_algo, which in the
+	 * worker is the default one.
+	 */
+	if (w->repo.hash_algo != the_hash_algo)
+		goto fail;
+
+	/* stat first, so that changes made while we look are noticed */
+	for (i = 0; i < ARRAY_SIZE(warm_object_dirs); i++) {
+		if (stat_object_dir(&w->repo, warm_object_dirs[i], &st))
+			goto fail;
+		fill_stat_data(&w->object_dirs[i], &st);
+	}
+
+	for (p = get_packed_git(&w->repo); p; p = p->next)
+		if (!open_pack_index(p))
+			w->size += p->index_size;
+	for (m = get_multi_pack_index(&w->repo); m; m = m->next)
+		w->size += m->data_len;
+	if (prepare_commit_graph(&w->repo))
+		for (g = w->repo.objects->commit_graph; g; g = g->base_graph)
+			w->size += g->data_len;
+
+	if (worker_max_memory && w->size > worker_max_memory)
+		goto fail;
+	while (worker_max_memory && warm_repos_nr &&
+	       warm_size + w->size > worker_max_memory)
+		drop_least_recently_used();
+
+	w->gitdir = xstrdup(gitdir);
+	w->last_used = ++warm_clock;
+	warm_size += w->size;
+	ALLOC_GROW(warm_repos, warm_repos_nr + 1, warm_repos_alloc);
+	warm_repos[warm_repos_nr++] = w;
+	return;
+
+fail:
+	repo_clear(&w->repo);
+	free(w);
+}
+
+static void read_warm_reports(void)
+{
+	static struct strbuf buf = STRBUF_INIT;
+	char *eol;
+
+	if (strbuf_read_once(&buf, warm_report[0], 0) <= 0)
+		return;
+	while ((eol = memchr(buf.buf, '\n', buf.len))) {
+		*eol = '\0';
+		warm_up_repository(buf.buf);
+		strbuf_remove(&buf, 0, eol - buf.buf + 1);
+	}
+}
+
+/*
+ * Called in the process forked for a connection, after it has entered
+ * the repository.
+ */
+static void use_warm_repository(void)
+{
+	char *gitdir = real_pathdup(get_git_dir(), 0);
+	struct warm_repository *w = NULL;
+	int i;
+
+	if (!gitdir)
+		return;
+	i = find_warm_repository(gitdir);
+	if (i >= 0)
+		w = warm_repos[i];
+	if (w && w->repo.hash_algo == the_hash_algo &&
+	    !warm_repository_changed(w)) {
+		raw_object_store_clear(the_repository->objects);
+		free(the_repository->objects);
+		the_repository->objects = w->repo.objects;
+		trace2_data_string("daemon", the_repository,
+				   "warm-repository", "hit");
+	} else {
+		struct strbuf report = STRBUF_INIT;
+
+		trace2_data_string("daemon", the_repository,
+				   "warm-repository", "miss");
+		/*
+		 * The write end is non-blocking, so a busy worker cannot
+		 * hold us up, and the worker may have retired already;
+		 * a report this small is written in one go or not at all.
+		 */
+		strbuf_addf(&report, "%s\n", gitdir);
+		if (report.len <= PIPE_BUF) {
+			sigchain_push(SIGPIPE, SIG_IGN);
+			xwrite(warm_report[1], report.buf, report.len);
+			sigchain_pop(SIGPIPE);
+		}
+		strbuf_release(&report);
+	}
+	free(gitdir);
+}
+
+static int upload_pack_in_process(const struct strvec *env)
+{
+	struct upload_pack_options opts = { 0 };
+
+	set_env(env);
+	use_warm_repository();
+
+	packet_trace_identity("upload-pack");
+	read_replace_refs = 0;
+	opts.timeout = timeout;
+	opts.daemon_mode = !!timeout;
+	serve_upload_pack(&opts);
+	return 0;
+}
+
+static int run_upload_pack(const struct strvec *env)
 {
 	struct child_process cld = CHILD_PROCESS_INIT;
+
+	if (pool_child)
+		return upload_pack_in_process(env);
+
 	strvec_pushl(&cld.args, "upload-pack", "--strict", NULL);
 	strvec_pushf(&cld.args, "--timeout=%u", timeout);
 
@@ -509,7 +785,7 @@ static int receive_pack(const struct strvec *env)
 
 static struct daemon_service daemon_service[] = {
 	{ "upload-archive", "uploadarch", upload_archive, 0, 1 },
-	{ "upload-pack", "uploadpack", upload_pack, 1, 1 },
+	{ "upload-pack", "uploadpack", run_upload_pack, 1, 1 },
 	{ "receive-pack", "receivepack", receive_pack, 0, 1 },
 };
 
@@ -893,6 +1169,48 @@ static void check_dead_children(void)
 			cradle = &blanket->next;
 }
 
+struct socketlist {
+	int *list;
+	size_t nr;
+	size_t alloc;
+};
+
+static struct socketlist *listen_sockets;
+
+/*
+ * Like start_command(), but instead of running "git daemon --serve",
+ * serve the connection in a forked copy of the current pool worker.
+ */
+static int fork_pool_child(struct child_process *cld)
+{
+	pid_t pid = fork();
+
+	if (!pid) {
+		int i;
+
+		pool_worker = 0;
+		pool_child = 1;
+		signal(SIGCHLD, SIG_DFL);
+		for (i = 0; i < listen_sockets->nr; i++)
+			close(listen_sockets->list[i]);
+		close(warm_report[0]);
+
+		dup2(cld->in, 0);
+		dup2(cld->out, 1);
+		close(cld->in);
+		close(cld->out);
+		set_env(&cld->env_array);
+		exit(execute());
+	}
+
+	close(cld->in);
+	close(cld->out);
+	if (pid < 0)
+		return -1;
+	cld->pid = pid;
+	return 0;
+}
+
 static struct strvec cld_argv = STRVEC_INIT;
 static void handle(int incoming, struct sockaddr *addr, socklen_t addrlen)
 {
@@ -931,7 +1249,7 @@ static void handle(int incoming, struct sockaddr *addr, socklen_t addrlen)
 	cld.in = incoming;
 	cld.out = dup(incoming);
 
-	if (start_command(&cld))
+	if (pool_worker ? fork_pool_child(&cld) : start_command(&cld))
 		logerror("unable to fork");
 	else
 		add_child(&cld, addr, addrlen);
@@ -957,12 +1275,6 @@ static int set_reuse_addr(int sockfd)
 			  &on, sizeof(on));
 }
 
-struct socketlist {
-	int *list;
-	size_t nr;
-	size_t alloc;
-};
-
 static const char *ip2str(int family, struct sockaddr *sin, socklen_t len)
 {
 #ifdef NO_IPV6
@@ -1143,7 +1455,36 @@ static void socksetup(struct string_list *listen_addr, int listen_port, struct s
 	}
 }
 
-static int service_loop(struct socketlist *socklist)
+/*
+ * Accept a connection on "sockfd" and hand it to handle().  Returns 0 if
+ * there was none to accept after all.
+ */
+static int accept_connection(int sockfd)
+{
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in sai;
+#ifndef NO_IPV6
+		struct sockaddr_in6 sai6;
+#endif
+	} ss;
+	socklen_t sslen = sizeof(ss);
+	int incoming = accept(sockfd, &ss.sa, &sslen);
+	if (incoming < 0) {
+		switch (errno) {
+		case EAGAIN:
+		case EINTR:
+		case ECONNABORTED:
+			return 0;
+		default:
+			die_errno("accept returned");
+		}
+	}
+	handle(incoming, &ss.sa, sslen);
+	return 1;
+}
+
+static void NORETURN service_loop(struct socketlist *socklist)
 {
 	struct pollfd *pfd;
 	int i;
@@ -1171,28 +1512,160 @@ static int service_loop(struct socketlist *socklist)
 			continue;
 		}
 
-		for (i = 0; i < socklist->nr; i++) {
-			if (pfd[i].revents & POLLIN) {
-				union {
-					struct sockaddr sa;
-					struct sockaddr_in sai;
-#ifndef NO_IPV6
-					struct sockaddr_in6 sai6;
-#endif
-				} ss;
-				socklen_t sslen = sizeof(ss);
-				int incoming = accept(pfd[i].fd, &ss.sa, &sslen);
-				if (incoming < 0) {
-					switch (errno) {
-					case EAGAIN:
-					case EINTR:
-					case ECONNABORTED:
-						continue;
-					default:
-						die_errno("accept returned");
-					}
-				}
-				handle(incoming, &ss.sa, sslen);
+		for (i = 0; i < socklist->nr; i++)
+			if (pfd[i].revents & POLLIN)
+				accept_connection(pfd[i].fd);
+	}
+}
+
+/*
+ * A pool worker accepts connections on the listening sockets it shares
+ * with the other workers and forks to serve each of them, until it has
+ * served --worker-max-requests of them or lived for
+ * --worker-max-lifetime seconds; the master then starts a new one.
+ */
+static void NORETURN worker_loop(struct socketlist *socklist)
+{
+	struct pollfd *pfd;
+	unsigned int requests = 0;
+	time_t deadline = 0;
+	int i, flags;
+
+	pool_worker = 1;
+	listen_sockets = socklist;
+	read_replace_refs = 0;
+
+	if (pipe(warm_report) < 0)
+		die_errno("unable to create pipe");
+	flags = fcntl(warm_report[1], F_GETFL, 0);
+	if (flags >= 0)
+		fcntl(warm_report[1], F_SETFL, flags | O_NONBLOCK);
+
+	CALLOC_ARRAY(pfd, socklist->nr + 1);
+	for (i = 0; i < socklist->nr; i++) {
+		pfd[i].fd = socklist->list[i];
+		pfd[i].events = POLLIN;
+	}
+	pfd[socklist->nr].fd = warm_report[0];
+	pfd[socklist->nr].events = POLLIN;
+
+	/* spread out the restarts of workers that were started together */
+	if (worker_max_lifetime)
+		deadline = time(NULL) + worker_max_lifetime +
+			getpid() % (worker_max_lifetime / 10 + 1);
+	if (max_connections)
+		max_connections = DIV_ROUND_UP(max_connections, worker_pool);
+
+	signal(SIGCHLD, child_handler);
+
+	while (!worker_max_requests || requests < worker_max_requests) {
+		int wait = -1;
+
+		check_dead_children();
+
+		if (deadline) {
+			time_t now = time(NULL);
+			if (now >= deadline)
+				break;
+			wait = (deadline - now) * 1000;
+		}
+
+		if (poll(pfd, socklist->nr + 1, wait) < 0) {
+			if (errno != EINTR) {
+				logerror("Poll failed, resuming: %s",
+				      strerror(errno));
+				sleep(1);
+			}
+			continue;
+		}
+
+		if (pfd[socklist->nr].revents & POLLIN)
+			read_warm_reports();
+		for (i = 0; i < socklist->nr; i++)
+			if (pfd[i].revents & POLLIN)
+				requests += accept_connection(pfd[i].fd);
+	}
+
+	loginfo("Worker retiring after %u requests", requests);
+	exit(0);
+}
+
+static pid_t *pool_pids;
+
+static void kill_pool_workers(void)
+{
+	int i;
+
+	for (i = 0; i < worker_pool; i++)
+		if (pool_pids[i] > 0)
+			kill(pool_pids[i], SIGTERM);
+}
+
+static void kill_pool_workers_on_signal(int signo)
+{
+	kill_pool_workers();
+	sigchain_pop(signo);
+	raise(signo);
+}
+
+static pid_t start_pool_worker(struct socketlist *socklist)
+{
+	pid_t pid = fork();
+
+	if (!pid) {
+		sigchain_pop_common();
+		worker_loop(socklist);
+	}
+	if (pid < 0)
+		logerror("unable to fork worker: %s", strerror(errno));
+	else
+		loginfo("Started worker %"PRIuMAX, (uintmax_t)pid);
+	return pid;
+}
+
+static void NORETURN pool_loop(struct socketlist *socklist)
+{
+	int i;
+
+	/*
+	 * All workers wait for the same sockets, and those which lose
+	 * the race for a connection must not block in accept().
+	 */
+	for (i = 0; i < socklist->nr; i++) {
+		int flags = fcntl(socklist->list[i], F_GETFL, 0);
+		if (flags >= 0)
+			fcntl(socklist->list[i], F_SETFL, flags | O_NONBLOCK);
+	}
+
+	CALLOC_ARRAY(pool_pids, worker_pool);
+	sigchain_push_common(kill_pool_workers_on_signal);
+
+	for (;;) {
+		int status;
+		pid_t pid;
+
+		for (i = 0; i < worker_pool; i++) {
+			if (pool_pids[i] > 0)
+				continue;
+			pool_pids[i] = start_pool_worker(socklist);
+			if (pool_pids[i] < 0)
+				sleep(1);
+		}
+
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno != EINTR)
+				sleep(1);
+			continue;
+		}
+		for (i = 0; i < worker_pool; i++) {
+			if (pool_pids[i] != pid)
+				continue;
+			pool_pids[i] = 0;
+			if (status) {
+				logerror("Worker %"PRIuMAX" died", (uintmax_t)pid);
+				/* do not restart crashing workers in a tight loop */
+				sleep(1);
 			}
 		}
 	}
@@ -1264,7 +1737,9 @@ static int serve(struct string_list *listen_addr, int listen_port,
 
 	loginfo("Ready to rumble");
 
-	return service_loop(&socklist);
+	if (worker_pool)
+		pool_loop(&socklist);
+	service_loop(&socklist);
 }
 
 int cmd_main(int argc, const char **argv)
@@ -1345,6 +1820,23 @@ int cmd_main(int argc, const char **argv)
 				max_connections = 0;	        /* unlimited */
 			continue;
 		}
+		if (skip_prefix(arg, "--worker-pool=", &v)) {
+			worker_pool = atoi(v);
+			if (worker_pool < 0)
+				worker_pool = 0;
+			continue;
+		}
+		if (skip_prefix(arg, "--worker-max-requests=", &v)) {
+			worker_max_requests = atoi(v);
+			continue;
+		}
+		if (skip_prefix(arg, "--worker-max-lifetime=", &v)) {
+			worker_max_lifetime = atoi(v);
+			continue;
+		}
+		if (skip_prefix(arg, "--worker-max-memory=", &v) &&
+		    git_parse_ulong(v, &worker_max_memory))
+			continue;
 		if (!strcmp(arg, "--strict-paths")) {
 			strict_paths = 1;
 			continue;
@@ -1449,6 +1941,13 @@ int cmd_main(int argc, const char **argv)
 	if (group_name && !user_name)
 		die("--group supplied without --user");
 
+	if (inetd_mode && worker_pool)
+		die("--worker-pool is incompatible with --inetd");
+#ifdef NO_POSIX_GOODIES
+	if (worker_pool)
+		die("--worker-pool not supported on this platform");
+#endif
+
 	if (user_name)
 		cred = prepare_credentials(user_name, group_name);
 
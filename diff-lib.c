@@ -393,6 +393,29 @@ static int show_modified(struct rev_info *revs,
  * also be multiple unmerged entries (in which case idx_pos/idx_nr will
  * give you the position and number of entries in the index).
  */
+/*
+ * A sparse directory entry on either side stands for a whole tree that
+ * is not expanded in the index; compare the trees directly instead of
+ * reporting the directory itself as a change.
+ */
+static void show_sparse_dir_diff(struct rev_info *revs,
+				 const struct cache_entry *idx,
+				 const struct cache_entry *tree)
+{
+	const struct cache_entry *ce = idx ? idx : tree;
+	const struct object_id *old_oid = tree ? &tree->oid : NULL;
+	const struct object_id *new_oid = idx ? &idx->oid : NULL;
+	unsigned int recursive = revs->diffopt.flags.recursive;
+
+	if (old_oid && new_oid && oideq(old_oid, new_oid) &&
+	    !revs->diffopt.flags.find_copies_harder)
+		return;
+
+	revs->diffopt.flags.recursive = 1;
+	diff_tree_oid(old_oid, new_oid, ce->name, &revs->diffopt);
+	revs->diffopt.flags.recursive = recursive;
+}
+
 static void do_oneway_diff(struct unpack_trees_options *o,
 			   const struct cache_entry *idx,
 			   const struct cache_entry *tree)
@@ -418,6 +441,30 @@ static void do_oneway_diff(struct unpack_trees_options *o,
 
 	match_missing = revs->match_missing;
 
+	/*
+	 * A sparse directory on one side and a file on the other: the
+	 * file is removed from (or added to) the tree and the sparse
+	 * directory contributes all of its paths.
+	 */
+	if (idx && tree &&
+	    S_ISSPARSEDIR(idx->ce_mode) != S_ISSPARSEDIR(tree->ce_mode)) {
+		if (S_ISSPARSEDIR(idx->ce_mode)) {
+			diff_index_show_file(revs, "-", tree, &tree->oid, 1,
+					     tree->ce_mode, 0);
+			show_sparse_dir_diff(revs, idx, NULL);
+		} else {
+			show_sparse_dir_diff(revs, NULL, tree);
+			show_new_file(revs, idx, cached, match_missing);
+		}
+		return;
+	}
+
+	if ((idx && S_ISSPARSEDIR(idx->ce_mode)) ||
+	    (tree && S_ISSPARSEDIR(tree->ce_mode))) {
+		show_sparse_dir_diff(revs, idx, tree);
+		return;
+	}
+
 	if (cached && idx && ce_stage(idx)) {
 		struct diff_filepair *pair;
 		pair = diff_unmerge(&revs->diffopt, idx->name);
@@ -479,7 +526,12 @@ static int oneway_diff(const struct cache_entry * const *src,
 	if (tree == o->df_conflict_entry)
 		tree = NULL;
 
-	if (ce_path_match(revs->diffopt.repo->index,
+	/*
+	 * The pathspec of a sparse directory is applied to the paths
+	 * inside of it when its trees are compared.
+	 */
+	if (S_ISSPARSEDIR((idx ? idx : tree)->ce_mode) ||
+	    ce_path_match(revs->diffopt.repo->index,
 			  idx ? idx : tree,
 			  &revs->prune_data, NULL)) {
 		do_oneway_diff(o, idx, tree);
@@ -517,6 +569,7 @@ static int diff_cache(struct rev_info *revs,
 	opts.dst_index = NULL;
 	opts.pathspec = &revs->diffopt.pathspec;
 	opts.pathspec->recursive = 1;
+	opts.sparse_directories = 1;
 
 	init_tree_desc(&t, tree->buffer, tree->size);
 	return unpack_trees(1, &t, &opts);
@@ -36,6 +36,7 @@
 static int diff_detect_rename_default;
 static int diff_indent_heuristic = 1;
 static int diff_rename_limit_default = 400;
+static int diff_rename_threads_default;
 static int diff_suppress_blank_empty;
 static int diff_use_color_default = -1;
 static int diff_color_moved_default;
@@ -434,6 +435,14 @@ int git_diff_basic_config(const char *var, const char *value, void *cb)
 		return 0;
 	}
 
+	if (!strcmp(var, "diff.renamethreads")) {
+		diff_rename_threads_default = git_config_int(var, value);
+		if (diff_rename_threads_default < 0)
+			return error(_("invalid number of threads specified (%d) for %s"),
+				     diff_rename_threads_default, var);
+		return 0;
+	}
+
 	if (userdiff_config(var, value) < 0)
 		return -1;
 
@@ -4572,6 +4581,7 @@ void repo_diff_setup(struct repository *r, struct diff_options *options)
 	options->line_termination = '\n';
 	options->break_opt = -1;
 	options->rename_limit = -1;
+	options->rename_threads = diff_rename_threads_default;
 	options->dirstat_permille = diff_dirstat_permille_default;
 	options->context = diff_context_default;
 	options->interhunkcontext = diff_interhunk_context_default;
@@ -6645,10 +6655,8 @@ void diff_add_if_missing(struct repository *r,
 			 const struct diff_filespec *filespec)
 {
 	if (filespec && filespec->oid_valid &&
-	    !S_ISGITLINK(filespec->mode) &&
-	    oid_object_info_extended(r, &filespec->oid, NULL,
-				     OBJECT_INFO_FOR_PREFETCH))
-		oid_array_append(to_fetch, &filespec->oid);
+	    !S_ISGITLINK(filespec->mode))
+		promisor_remote_prefetch_add(r, to_fetch, &filespec->oid);
 }
 
 void diff_queued_diff_prefetch(void *repository)
@@ -6664,12 +6672,7 @@ void diff_queued_diff_prefetch(void *repository)
 		diff_add_if_missing(repo, &to_fetch, p->two);
 	}
 
-	/*
-	 * NEEDSWORK: Consider deduplicating the OIDs sent.
-	 */
-	promisor_remote_get_direct(repo, to_fetch.oid, to_fetch.nr);
-
-	oid_array_clear(&to_fetch);
+	promisor_remote_prefetch(repo, &to_fetch);
 }
 
 void diffcore_std(struct diff_options *options)
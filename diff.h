@@ -311,6 +311,8 @@ struct diff_options {
 	 */
 	int rename_score;
 	int rename_limit;
+	/* threads for inexact rename detection; 0 means one per CPU */
+	int rename_threads;
 
 	int needed_rename_limit;
 	int degraded_cc_to_c;
@@ -40,6 +40,14 @@ struct spanhash {
 	unsigned int hashval;
 	unsigned int cnt;
 };
+
+/*
+ * While hash_chars() counts the spans, data[] is an open-addressed hash
+ * table of (1 << alloc_log2) slots.  Once it is done, the used slots are
+ * packed at the beginning of data[], sorted by hashval and followed by a
+ * slot with cnt == 0, and the table is shrunk to fit; that is the form
+ * diffcore_count_changes() walks, and the one kept in cnt_data.
+ */
 struct spanhash_top {
 	int alloc_log2;
 	int free;
@@ -107,18 +115,55 @@ static struct spanhash_top *add_spanhash(struct spanhash_top *top,
 	}
 }
 
-static int spanhash_cmp(const void *a_, const void *b_)
+/*
+ * hashval is below HASHBASE (< 2^17), so two passes of a radix sort on
+ * SPANHASH_RADIX_BITS bits each put the spans in order; that is a lot
+ * cheaper than qsort() for the thousands of spans in a typical file.
+ */
+#define SPANHASH_RADIX_BITS 9
+#define SPANHASH_RADIX_SIZE (1 << SPANHASH_RADIX_BITS)
+
+#define SPANHASH_DIGIT(h, shift) (((h) >> (shift)) & (SPANHASH_RADIX_SIZE - 1))
+
+static void spanhash_radix_pass(const struct spanhash *from,
+				struct spanhash *to,
+				unsigned int nr, int shift)
+{
+	unsigned int pos[SPANHASH_RADIX_SIZE];
+	unsigned int i, sum = 0;
+
+	memset(pos, 0, sizeof(pos));
+	for (i = 0; i < nr; i++)
+		pos[SPANHASH_DIGIT(from[i].hashval, shift)]++;
+	for (i = 0; i < SPANHASH_RADIX_SIZE; i++) {
+		unsigned int cnt = pos[i];
+		pos[i] = sum;
+		sum += cnt;
+	}
+	for (i = 0; i < nr; i++)
+		to[pos[SPANHASH_DIGIT(from[i].hashval, shift)]++] = from[i];
+}
+
+static struct spanhash_top *spanhash_pack(struct spanhash_top *hash)
 {
-	const struct spanhash *a = a_;
-	const struct spanhash *b = b_;
-
-	/* A count of zero compares at the end.. */
-	if (!a->cnt)
-		return !b->cnt ? 0 : 1;
-	if (!b->cnt)
-		return -1;
-	return a->hashval < b->hashval ? -1 :
-		a->hashval > b->hashval ? 1 : 0;
+	int sz = 1 << hash->alloc_log2;
+	int i, nr = 0;
+	struct spanhash *tmp;
+
+	for (i = 0; i < sz; i++)
+		if (hash->data[i].cnt)
+			hash->data[nr++] = hash->data[i];
+
+	ALLOC_ARRAY(tmp, nr);
+	spanhash_radix_pass(hash->data, tmp, nr, 0);
+	spanhash_radix_pass(tmp, hash->data, nr, SPANHASH_RADIX_BITS);
+	free(tmp);
+
+	/* There is always a free slot left for the terminator */
+	hash->data[nr].hashval = 0;
+	hash->data[nr].cnt = 0;
+	return xrealloc(hash, st_add(sizeof(*hash),
+				     st_mult(sizeof(struct spanhash), nr + 1)));
 }
 
 static struct spanhash_top *hash_chars(struct repository *r,
@@ -159,8 +204,14 @@ static struct spanhash_top *hash_chars(struct repository *r,
 		n = 0;
 		accum1 = accum2 = 0;
 	}
-	QSORT(hash->data, 1ul << hash->alloc_log2, spanhash_cmp);
-	return hash;
+	return spanhash_pack(hash);
+}
+
+void diffcore_prepare_count_changes(struct repository *r,
+				    struct diff_filespec *one)
+{
+	if (!one->cnt_data)
+		one->cnt_data = hash_chars(r, one);
 }
 
 int diffcore_count_changes(struct repository *r,
@@ -10,6 +10,7 @@
 #include "progress.h"
 #include "promisor-remote.h"
 #include "strmap.h"
+#include "thread-utils.h"
 
 /* Table of rename/copy destinations */
 
@@ -118,8 +119,52 @@ static void prefetch(void *prefetch_options)
 		diff_add_if_missing(options->repo, &to_fetch,
 				    rename_src[i].p->one);
 	}
-	promisor_remote_get_direct(options->repo, to_fetch.oid, to_fetch.nr);
-	oid_array_clear(&to_fetch);
+	promisor_remote_prefetch(options->repo, &to_fetch);
+}
+
+static int too_different_in_size(unsigned long src_size,
+				 unsigned long dst_size,
+				 int minimum_score)
+{
+	unsigned long max_size, delta_size, base_size;
+
+	max_size = ((src_size > dst_size) ? src_size : dst_size);
+	base_size = ((src_size < dst_size) ? src_size : dst_size);
+	delta_size = max_size - base_size;
+
+	/* We would not consider edits that change the file size so
+	 * drastically.  delta_size must be smaller than
+	 * (MAX_SCORE-minimum_score)/MAX_SCORE * min(src->size, dst->size).
+	 *
+	 * Note that base_size == 0 case is handled here already
+	 * and the final score computation in count_similarity() would
+	 * not have a divide-by-zero issue.
+	 */
+	return max_size * (MAX_SCORE-minimum_score) < delta_size * MAX_SCORE;
+}
+
+/*
+ * Score two populated (or already hashed) regular files whose sizes
+ * passed too_different_in_size().
+ */
+static int count_similarity(struct repository *r,
+			    struct diff_filespec *src,
+			    struct diff_filespec *dst)
+{
+	unsigned long max_size, src_copied, literal_added;
+
+	if (diffcore_count_changes(r, src, dst,
+				   &src->cnt_data, &dst->cnt_data,
+				   &src_copied, &literal_added))
+		return 0;
+
+	/* How similar are they?
+	 * what percentage of material in dst are from source?
+	 */
+	max_size = ((src->size > dst->size) ? src->size : dst->size);
+	if (!dst->size)
+		return 0; /* should not happen */
+	return (int)(src_copied * MAX_SCORE / max_size);
 }
 
 static int estimate_similarity(struct repository *r,
@@ -141,8 +186,6 @@ static int estimate_similarity(struct repository *r,
 	 * match than anything else; the destination does not even
 	 * call into this function in that case.
 	 */
-	unsigned long max_size, delta_size, base_size, src_copied, literal_added;
-	int score;
 	struct diff_populate_filespec_options dpf_options = {
 		.check_size_only = 1
 	};
@@ -176,19 +219,7 @@ static int estimate_similarity(struct repository *r,
 	    diff_populate_filespec(r, dst, &dpf_options))
 		return 0;
 
-	max_size = ((src->size > dst->size) ? src->size : dst->size);
-	base_size = ((src->size < dst->size) ? src->size : dst->size);
-	delta_size = max_size - base_size;
-
-	/* We would not consider edits that change the file size so
-	 * drastically.  delta_size must be smaller than
-	 * (MAX_SCORE-minimum_score)/MAX_SCORE * min(src->size, dst->size).
-	 *
-	 * Note that base_size == 0 case is handled here already
-	 * and the final score computation below would not have a
-	 * divide-by-zero issue.
-	 */
-	if (max_size * (MAX_SCORE-minimum_score) < delta_size * MAX_SCORE)
+	if (too_different_in_size(src->size, dst->size, minimum_score))
 		return 0;
 
 	dpf_options.check_size_only = 0;
@@ -198,19 +229,7 @@ static int estimate_similarity(struct repository *r,
 	if (!dst->cnt_data && diff_populate_filespec(r, dst, &dpf_options))
 		return 0;
 
-	if (diffcore_count_changes(r, src, dst,
-				   &src->cnt_data, &dst->cnt_data,
-				   &src_copied, &literal_added))
-		return 0;
-
-	/* How similar are they?
-	 * what percentage of material in dst are from source?
-	 */
-	if (!dst->size)
-		score = 0; /* should not happen */
-	else
-		score = (int)(src_copied * MAX_SCORE / max_size);
-	return score;
+	return count_similarity(r, src, dst);
 }
 
 static void record_rename_pair(int dst_index, int src_index, int score)
@@ -521,6 +540,297 @@ static void record_if_better(struct diff_score m[], struct diff_score *o)
 		m[worst] = *o;
 }
 
+/*
+ * Comparing every remaining destination with every remaining source is
+ * by far the most expensive part of rename detection, so it is done in
+ * parallel, in two phases: hashing the contents of each candidate (see
+ * diffcore_prepare_count_changes()), then scoring each destination
+ * against all sources.  Reading blobs and looking up attributes are not
+ * thread-safe, so prepare_similarity() does those serially, a batch at a
+ * time, before handing the batch to the hashing threads.
+ *
+ * Each destination's candidates are chosen by a single thread that looks
+ * at the sources in order, so the renames found do not depend on the
+ * number of threads.
+ */
+#define MIN_PAIRS_PER_THREAD 1024
+#define HASH_BATCH_PER_THREAD 64
+
+struct similarity_work {
+	struct repository *repo;
+	int minimum_score;
+	int skip_unmodified;
+	int want_copies;
+
+	/* filespecs to hash */
+	struct diff_filespec **specs;
+
+	/* rename_dst index of each destination to score, and its row in mx */
+	int *dst_index;
+	struct diff_score *mx;
+
+	struct progress *progress;
+	uint64_t progress_done;
+	pthread_mutex_t progress_lock;
+};
+
+typedef void (*similarity_fn)(struct similarity_work *, int start, int end);
+
+struct similarity_thread {
+	pthread_t thread;
+	similarity_fn fn;
+	struct similarity_work *work;
+	int start, end;
+};
+
+static void *run_similarity_thread(void *data)
+{
+	struct similarity_thread *t = data;
+
+	t->fn(t->work, t->start, t->end);
+	return NULL;
+}
+
+/* Call fn on items [0, nr) split into nr_threads contiguous ranges */
+static void run_similarity_threads(int nr_threads, int nr,
+				   similarity_fn fn,
+				   struct similarity_work *work)
+{
+	struct similarity_thread *threads;
+	int i;
+
+	if (nr_threads > nr)
+		nr_threads = nr;
+	if (nr_threads <= 1) {
+		fn(work, 0, nr);
+		return;
+	}
+
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		struct similarity_thread *t = &threads[i];
+		int err;
+
+		t->fn = fn;
+		t->work = work;
+		t->start = (int)((uint64_t)nr * i / nr_threads);
+		t->end = (int)((uint64_t)nr * (i + 1) / nr_threads);
+		err = pthread_create(&t->thread, NULL,
+				     run_similarity_thread, t);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i].thread, NULL);
+	free(threads);
+}
+
+static int rename_threads(struct diff_options *options,
+			  int num_destinations, int num_sources)
+{
+	uint64_t pairs = (uint64_t)num_destinations * num_sources;
+	int nr_threads = options->rename_threads;
+
+	if (!HAVE_THREADS)
+		return 1;
+	if (!nr_threads) {
+		nr_threads = online_cpus();
+		if (pairs / MIN_PAIRS_PER_THREAD < nr_threads)
+			nr_threads = pairs / MIN_PAIRS_PER_THREAD;
+	}
+	if (nr_threads > num_destinations)
+		nr_threads = num_destinations;
+	return nr_threads < 1 ? 1 : nr_threads;
+}
+
+static void hash_filespecs(struct similarity_work *work, int start, int end)
+{
+	int i;
+
+	for (i = start; i < end; i++)
+		diffcore_prepare_count_changes(work->repo, work->specs[i]);
+}
+
+static int filespec_ptr_cmp(const void *a_, const void *b_)
+{
+	const struct diff_filespec *a = *(const struct diff_filespec **)a_;
+	const struct diff_filespec *b = *(const struct diff_filespec **)b_;
+
+	return (a > b) - (a < b);
+}
+
+/*
+ * Hash the contents of every source and destination that might be
+ * compared in the inexact rename matrix, i.e. the regular files whose
+ * size is close enough to that of at least one file on the other side.
+ * Filespecs that cannot be read are left without cnt_data, which
+ * score_destinations() treats as not similar to anything.
+ */
+static void prepare_similarity(struct diff_options *options,
+			       struct similarity_work *work,
+			       int dst_cnt, int nr_threads)
+{
+	struct repository *r = options->repo;
+	struct diff_populate_filespec_options dpf_options = {
+		.check_size_only = 1
+	};
+	struct prefetch_options prefetch_options = {
+		r, work->skip_unmodified
+	};
+	struct diff_filespec **specs;
+	char *src_usable, *src_needed, *dst_usable, *dst_needed;
+	int i, j, nr = 0, batch;
+
+	if (r == the_repository && has_promisor_remote()) {
+		dpf_options.missing_object_cb = prefetch;
+		dpf_options.missing_object_data = &prefetch_options;
+	}
+
+	src_usable = xcalloc(rename_src_nr, 1);
+	src_needed = xcalloc(rename_src_nr, 1);
+	dst_usable = xcalloc(dst_cnt, 1);
+	dst_needed = xcalloc(dst_cnt, 1);
+
+	for (j = 0; j < rename_src_nr; j++) {
+		struct diff_filespec *one = rename_src[j].p->one;
+
+		if (work->skip_unmodified &&
+		    diff_unmodified_pair(rename_src[j].p))
+			continue;
+		src_usable[j] = S_ISREG(one->mode) &&
+			(one->cnt_data ||
+			 !diff_populate_filespec(r, one, &dpf_options));
+	}
+	for (i = 0; i < dst_cnt; i++) {
+		struct diff_filespec *two = rename_dst[work->dst_index[i]].p->two;
+
+		dst_usable[i] = S_ISREG(two->mode) &&
+			(two->cnt_data ||
+			 !diff_populate_filespec(r, two, &dpf_options));
+	}
+
+	for (i = 0; i < dst_cnt; i++) {
+		struct diff_filespec *two = rename_dst[work->dst_index[i]].p->two;
+
+		if (!dst_usable[i])
+			continue;
+		for (j = 0; j < rename_src_nr; j++) {
+			if (!src_usable[j] || (dst_needed[i] && src_needed[j]))
+				continue;
+			if (too_different_in_size(rename_src[j].p->one->size,
+						  two->size,
+						  work->minimum_score))
+				continue;
+			dst_needed[i] = src_needed[j] = 1;
+		}
+	}
+
+	/*
+	 * Checking the size may have read the whole file (if it needs
+	 * conversion); like estimate_similarity(), we do not keep the text.
+	 */
+	ALLOC_ARRAY(specs, st_add(rename_src_nr, dst_cnt));
+	for (j = 0; j < rename_src_nr; j++) {
+		struct diff_filespec *one = rename_src[j].p->one;
+
+		if (src_needed[j] && !one->cnt_data)
+			specs[nr++] = one;
+		else if (src_usable[j])
+			diff_free_filespec_blob(one);
+	}
+	for (i = 0; i < dst_cnt; i++) {
+		struct diff_filespec *two = rename_dst[work->dst_index[i]].p->two;
+
+		if (dst_needed[i] && !two->cnt_data)
+			specs[nr++] = two;
+		else if (dst_usable[i])
+			diff_free_filespec_blob(two);
+	}
+
+	/* The same filespec may be a source more than once (e.g. with -C) */
+	QSORT(specs, nr, filespec_ptr_cmp);
+	for (i = j = 0; i < nr; i++)
+		if (!j || specs[j - 1] != specs[i])
+			specs[j++] = specs[i];
+	nr = j;
+
+	dpf_options.check_size_only = 0;
+	batch = nr_threads * HASH_BATCH_PER_THREAD;
+	for (i = 0; i < nr; i += batch) {
+		int end = (i + batch < nr) ? i + batch : nr;
+		int batch_nr = 0;
+
+		for (j = i; j < end; j++) {
+			if (diff_populate_filespec(r, specs[j], &dpf_options)) {
+				diff_free_filespec_blob(specs[j]);
+				continue;
+			}
+			diff_filespec_is_binary(r, specs[j]);
+			specs[i + batch_nr++] = specs[j];
+		}
+
+		work->specs = specs + i;
+		run_similarity_threads(nr_threads, batch_nr,
+				       hash_filespecs, work);
+
+		for (j = i; j < i + batch_nr; j++)
+			diff_free_filespec_blob(specs[j]);
+	}
+
+	free(specs);
+	free(src_usable);
+	free(src_needed);
+	free(dst_usable);
+	free(dst_needed);
+}
+
+static void score_destinations(struct similarity_work *work,
+			       int start, int end)
+{
+	int i, j;
+
+	for (i = start; i < end; i++) {
+		int dst_index = work->dst_index[i];
+		struct diff_filespec *two = rename_dst[dst_index].p->two;
+		struct diff_score *m = &work->mx[i * NUM_CANDIDATE_PER_DST];
+
+		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+			m[j].dst = -1;
+
+		for (j = 0; j < rename_src_nr; j++) {
+			struct diff_filespec *one = rename_src[j].p->one;
+			struct diff_score this_src;
+
+			assert(!one->rename_used || work->want_copies ||
+			       break_idx);
+
+			if (work->skip_unmodified &&
+			    diff_unmodified_pair(rename_src[j].p))
+				continue;
+
+			if (!S_ISREG(one->mode) || !S_ISREG(two->mode) ||
+			    !one->cnt_data || !two->cnt_data ||
+			    too_different_in_size(one->size, two->size,
+						  work->minimum_score))
+				this_src.score = 0;
+			else
+				this_src.score = count_similarity(work->repo,
+								  one, two);
+			this_src.name_score = basename_same(one, two);
+			this_src.dst = dst_index;
+			this_src.src = j;
+			record_if_better(m, &this_src);
+		}
+
+		if (work->progress) {
+			pthread_mutex_lock(&work->progress_lock);
+			work->progress_done += rename_src_nr;
+			display_progress(work->progress, work->progress_done);
+			pthread_mutex_unlock(&work->progress_lock);
+		}
+	}
+}
+
 /*
  * Returns:
  * 0 if we are under the limit;
@@ -647,8 +957,9 @@ void diffcore_rename(struct diff_options *options)
 	struct diff_queue_struct *q = &diff_queued_diff;
 	struct diff_queue_struct outq;
 	struct diff_score *mx;
-	int i, j, rename_count, skip_unmodified = 0;
-	int num_destinations, dst_cnt;
+	struct similarity_work work;
+	int i, rename_count, skip_unmodified = 0;
+	int num_destinations, dst_cnt, nr_threads;
 	int num_sources, want_copies;
 	struct progress *progress = NULL;
 
@@ -787,48 +1098,32 @@ void diffcore_rename(struct diff_options *options)
 				(uint64_t)num_destinations * (uint64_t)num_sources);
 	}
 
-	CALLOC_ARRAY(mx, st_mult(NUM_CANDIDATE_PER_DST, num_destinations));
-	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
-		struct diff_filespec *two = rename_dst[i].p->two;
-		struct diff_score *m;
+	memset(&work, 0, sizeof(work));
+	work.repo = options->repo;
+	work.minimum_score = minimum_score;
+	work.skip_unmodified = skip_unmodified;
+	work.want_copies = want_copies;
+	work.progress = progress;
+	pthread_mutex_init(&work.progress_lock, NULL);
 
+	ALLOC_ARRAY(work.dst_index, num_destinations);
+	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
 		if (rename_dst[i].is_rename)
 			continue; /* exact or basename match already handled */
+		work.dst_index[dst_cnt++] = i;
+	}
 
-		m = &mx[dst_cnt * NUM_CANDIDATE_PER_DST];
-		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
-			m[j].dst = -1;
-
-		for (j = 0; j < rename_src_nr; j++) {
-			struct diff_filespec *one = rename_src[j].p->one;
-			struct diff_score this_src;
-
-			assert(!one->rename_used || want_copies || break_idx);
+	nr_threads = rename_threads(options, dst_cnt, num_sources);
+	trace2_data_intmax("diff", options->repo, "inexact_renames/threads",
+			   nr_threads);
+	prepare_similarity(options, &work, dst_cnt, nr_threads);
 
-			if (skip_unmodified &&
-			    diff_unmodified_pair(rename_src[j].p))
-				continue;
-
-			this_src.score = estimate_similarity(options->repo,
-							     one, two,
-							     minimum_score,
-							     skip_unmodified);
-			this_src.name_score = basename_same(one, two);
-			this_src.dst = i;
-			this_src.src = j;
-			record_if_better(m, &this_src);
-			/*
-			 * Once we run estimate_similarity,
-			 * We do not need the text anymore.
-			 */
-			diff_free_filespec_blob(one);
-			diff_free_filespec_blob(two);
-		}
-		dst_cnt++;
-		display_progress(progress,
-				 (uint64_t)dst_cnt * (uint64_t)num_sources);
-	}
+	CALLOC_ARRAY(mx, st_mult(NUM_CANDIDATE_PER_DST, num_destinations));
+	work.mx = mx;
+	run_similarity_threads(nr_threads, dst_cnt, score_destinations, &work);
 	stop_progress(&progress);
+	pthread_mutex_destroy(&work.progress_lock);
+	free(work.dst_index);
 
 	/* cost matrix sorted by most to least similar pair */
 	STABLE_QSORT(mx, dst_cnt * NUM_CANDIDATE_PER_DST, score_compare);
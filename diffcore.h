@@ -199,6 +199,15 @@ int diffcore_count_changes(struct repository *r,
 			   unsigned long *src_copied,
 			   unsigned long *literal_added);
 
+/*
+ * Compute and cache in one->cnt_data what diffcore_count_changes() needs to
+ * know about one.  The filespec must already be populated, and its
+ * is_binary known, so that this only reads one->data and is safe to call
+ * from several threads at once for different filespecs.
+ */
+void diffcore_prepare_count_changes(struct repository *r,
+				    struct diff_filespec *one);
+
 /*
  * If filespec contains an OID and if that object is missing from the given
  * repository, add that OID to to_fetch.
@@ -2209,6 +2209,13 @@ static enum path_treatment treat_path(struct dir_struct *dir,
 	/* Always exclude indexed files */
 	has_path_in_index = !!index_file_exists(istate, path->buf, path->len,
 						ignore_case);
+	/*
+	 * Paths hidden in a sparse directory entry are not in the name
+	 * hash; looking them up by position expands the index as needed.
+	 */
+	if (!has_path_in_index && istate->sparse_index)
+		has_path_in_index = index_name_pos(istate, path->buf,
+						   path->len) >= 0;
 	if (dtype != DT_DIR && has_path_in_index)
 		return path_none;
 
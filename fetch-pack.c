@@ -1237,28 +1237,24 @@ static int add_haves(struct fetch_negotiator *negotiator,
 	return ret;
 }
 
-static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
-			      struct fetch_pack_args *args,
-			      const struct ref *wants, struct oidset *common,
-			      int *haves_to_send, int *in_vain,
-			      int sideband_all, int seen_ack)
+static void write_command_and_capabilities(struct strbuf *req_buf,
+					   const char *command,
+					   const struct string_list *server_options)
 {
-	int ret = 0;
 	const char *hash_name;
-	struct strbuf req_buf = STRBUF_INIT;
 
-	if (server_supports_v2("fetch", 1))
-		packet_buf_write(&req_buf, "command=fetch");
+	if (server_supports_v2(command, 1))
+		packet_buf_write(req_buf, "command=%s", command);
 	if (server_supports_v2("agent", 0))
-		packet_buf_write(&req_buf, "agent=%s", git_user_agent_sanitized());
+		packet_buf_write(req_buf, "agent=%s", git_user_agent_sanitized());
 	if (advertise_sid && server_supports_v2("session-id", 0))
-		packet_buf_write(&req_buf, "session-id=%s", trace2_session_id());
-	if (args->server_options && args->server_options->nr &&
+		packet_buf_write(req_buf, "session-id=%s", trace2_session_id());
+	if (server_options && server_options->nr &&
 	    server_supports_v2("server-option", 1)) {
 		int i;
-		for (i = 0; i < args->server_options->nr; i++)
-			packet_buf_write(&req_buf, "server-option=%s",
-					 args->server_options->items[i].string);
+		for (i = 0; i < server_options->nr; i++)
+			packet_buf_write(req_buf, "server-option=%s",
+					 server_options->items[i].string);
 	}
 
 	if (server_feature_v2("object-format", &hash_name)) {
@@ -1266,11 +1262,23 @@ static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
 		if (hash_algo_by_ptr(the_hash_algo) != hash_algo)
 			die(_("mismatched algorithms: client %s; server %s"),
 			    the_hash_algo->name, hash_name);
-		packet_write_fmt(fd_out, "object-format=%s", the_hash_algo->name);
+		packet_buf_write(req_buf, "object-format=%s", the_hash_algo->name);
 	} else if (hash_algo_by_ptr(the_hash_algo) != GIT_HASH_SHA1) {
 		die(_("the server does not support algorithm '%s'"),
 		    the_hash_algo->name);
 	}
+}
+
+static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
+			      struct fetch_pack_args *args,
+			      const struct ref *wants, struct oidset *common,
+			      int *haves_to_send, int *in_vain,
+			      int sideband_all, int seen_ack)
+{
+	int ret = 0;
+	struct strbuf req_buf = STRBUF_INIT;
+
+	write_command_and_capabilities(&req_buf, "fetch", args->server_options);
 
 	packet_buf_delim(&req_buf);
 	if (args->use_thin_pack)
@@ -1998,6 +2006,82 @@ struct ref *fetch_pack(struct fetch_pack_args *args,
 	return ref_cpy;
 }
 
+void fetch_object_info(int fd_out, struct packet_reader *reader,
+		       const struct oid_array *oids,
+		       struct remote_object_info *info,
+		       const struct string_list *server_options,
+		       int stateless_rpc)
+{
+	struct strbuf req_buf = STRBUF_INIT;
+	struct string_list attrs = STRING_LIST_INIT_DUP;
+	struct string_list values = STRING_LIST_INIT_DUP;
+	int i, size_pos = -1, type_pos = -1;
+
+	write_command_and_capabilities(&req_buf, "object-info", server_options);
+	packet_buf_delim(&req_buf);
+	packet_buf_write(&req_buf, "size");
+	packet_buf_write(&req_buf, "type");
+	for (i = 0; i < oids->nr; i++)
+		packet_buf_write(&req_buf, "oid %s", oid_to_hex(&oids->oid[i]));
+	packet_buf_flush(&req_buf);
+	if (write_in_full(fd_out, req_buf.buf, req_buf.len) < 0)
+		die_errno(_("unable to write request to remote"));
+	strbuf_release(&req_buf);
+
+	/* the first line lists the attributes given for each object */
+	if (packet_reader_read(reader) != PACKET_READ_NORMAL)
+		die(_("error reading object-info response"));
+	string_list_split(&attrs, reader->line, ' ', -1);
+	for (i = 0; i < attrs.nr; i++) {
+		if (!strcmp(attrs.items[i].string, "size"))
+			size_pos = i + 1;
+		else if (!strcmp(attrs.items[i].string, "type"))
+			type_pos = i + 1;
+	}
+	if (size_pos < 0 || type_pos < 0)
+		die(_("object-info: server did not send sizes and types"));
+
+	for (i = 0; i < oids->nr; i++) {
+		struct object_id oid;
+
+		if (packet_reader_read(reader) != PACKET_READ_NORMAL)
+			die(_("object-info: response ended early"));
+		string_list_split(&values, reader->line, ' ', -1);
+		if (get_oid_hex(values.items[0].string, &oid) ||
+		    !oideq(&oid, &oids->oid[i]))
+			die(_("object-info: unexpected object '%s'"),
+			    values.items[0].string);
+
+		if (values.nr == 1) {
+			/* the server does not have it */
+			info[i].type = OBJ_BAD;
+			info[i].size = 0;
+		} else {
+			const char *size = "";
+			char *end = NULL;
+			int type = -1;
+
+			if (values.nr == attrs.nr + 1) {
+				size = values.items[size_pos].string;
+				type = type_from_string_gently(
+					values.items[type_pos].string, -1, 1);
+				info[i].size = strtoul(size, &end, 10);
+			}
+			if (type < 0 || !end || end == size || *end)
+				die(_("object-info: malformed line for '%s'"),
+				    oid_to_hex(&oid));
+			info[i].type = type;
+		}
+		string_list_clear(&values, 0);
+	}
+
+	if (packet_reader_read(reader) != PACKET_READ_FLUSH)
+		die(_("expected flush after object-info response"));
+	check_stateless_delimiter(stateless_rpc, reader,
+				  _("expected response end packet after object-info"));
+	string_list_clear(&attrs, 0);
+}
+
 int report_unmatched_refs(struct ref **sought, int nr_sought)
 {
 	int i, ret = 0;
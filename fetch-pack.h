@@ -7,6 +7,7 @@
 #include "list-objects-filter-options.h"
 
 struct oid_array;
+struct packet_reader;
 
 struct fetch_pack_args {
 	const char *uploadpack;
@@ -80,6 +81,22 @@ struct ref *fetch_pack(struct fetch_pack_args *args,
 		       struct string_list *pack_lockfiles,
 		       enum protocol_version version);
 
+struct remote_object_info {
+	enum object_type type;
+	unsigned long size;
+};
+
+/*
+ * Ask a protocol v2 server for the type and size of each object in
+ * "oids", without fetching them.  info[i] is filled in for oids->oid[i],
+ * with its type set to OBJ_BAD if the server does not have it.
+ */
+void fetch_object_info(int fd_out, struct packet_reader *reader,
+		       const struct oid_array *oids,
+		       struct remote_object_info *info,
+		       const struct string_list *server_options,
+		       int stateless_rpc);
+
 /*
  * Print an appropriate error message for each sought ref that wasn't
  * matched.  Return 0 if all sought refs were matched, otherwise 1.
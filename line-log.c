@@ -16,6 +16,7 @@
 #include "line-log.h"
 #include "strvec.h"
 #include "bloom.h"
+#include "strmap.h"
 
 static void range_set_grow(struct range_set *rs, size_t extra)
 {
@@ -1147,39 +1148,54 @@ int line_log_print(struct rev_info *rev, struct commit *commit)
 	return 1;
 }
 
+/* path -> struct bloom_keyvec, for every path the ranges have been in */
+static struct strmap bloom_keyvecs = STRMAP_INIT;
+
+static struct bloom_keyvec *get_bloom_keyvec(struct rev_info *rev,
+					     const char *path)
+{
+	struct bloom_keyvec *vec = strmap_get(&bloom_keyvecs, path);
+
+	if (!vec) {
+		vec = bloom_keyvec_new(path, strlen(path),
+				       rev->bloom_filter_settings);
+		strmap_put(&bloom_keyvecs, path, vec);
+	}
+	return vec;
+}
+
+/*
+ * Returns 0 if the Bloom filter of the commit says that none of the files
+ * in the range changed, 1 if some may have, and -1 if there is no filter
+ * to ask.
+ */
 static int bloom_filter_check(struct rev_info *rev,
 			      struct commit *commit,
 			      struct line_log_data *range)
 {
-	struct bloom_filter *filter;
-	struct bloom_key key;
-	int result = 0;
-
-	if (!commit->parents)
-		return 1;
+	struct bloom_keyvec **vecs;
+	struct line_log_data *r;
+	int nr = 0, result;
 
-	if (!rev->bloom_filter_settings ||
-	    !(filter = get_bloom_filter(rev->repo, commit)))
-		return 1;
+	if (!commit->parents || !rev->bloom_filter_settings)
+		return -1;
 
 	if (!range)
 		return 0;
 
-	while (!result && range) {
-		fill_bloom_key(range->path, strlen(range->path), &key, rev->bloom_filter_settings);
-
-		if (bloom_filter_contains(filter, &key, rev->bloom_filter_settings))
-			result = 1;
-
-		clear_bloom_key(&key);
-		range = range->next;
-	}
+	for (r = range; r; r = r->next)
+		nr++;
+	ALLOC_ARRAY(vecs, nr);
+	for (nr = 0, r = range; r; r = r->next)
+		vecs[nr++] = get_bloom_keyvec(rev, r->path);
 
+	result = bloom_filter_maybe_changed(rev, commit, vecs, nr);
+	free(vecs);
 	return result;
 }
 
 static int process_ranges_ordinary_commit(struct rev_info *rev, struct commit *commit,
-					  struct line_log_data *range)
+					  struct line_log_data *range, int bloom_maybe)
 {
 	struct commit *parent = NULL;
 	struct diff_queue_struct queue;
@@ -1190,6 +1206,8 @@ static int process_ranges_ordinary_commit(struct rev_info *rev, struct commit *c
 		parent = commit->parents->item;
 
 	queue_diffs(range, &rev->diffopt, &queue, commit, parent);
+	if (bloom_maybe)
+		count_bloom_filter_result(queue.nr);
 	changed = process_all_files(&parent_range, rev, &queue, range);
 
 	if (parent)
@@ -1199,7 +1217,7 @@ static int process_ranges_ordinary_commit(struct rev_info *rev, struct commit *c
 }
 
 static int process_ranges_merge_commit(struct rev_info *rev, struct commit *commit,
-				       struct line_log_data *range)
+				       struct line_log_data *range, int bloom_maybe)
 {
 	struct diff_queue_struct *diffqueues;
 	struct line_log_data **cand;
@@ -1221,6 +1239,9 @@ static int process_ranges_merge_commit(struct rev_info *rev, struct commit *comm
 		p = p->next;
 		queue_diffs(range, &rev->diffopt, &diffqueues[i], commit, parents[i]);
 	}
+	/* the filter is only about the first parent */
+	if (bloom_maybe)
+		count_bloom_filter_result(diffqueues[0].nr);
 
 	for (i = 0; i < nparents; i++) {
 		int changed;
@@ -1266,14 +1287,18 @@ int line_log_process_ranges_arbitrary_commit(struct rev_info *rev, struct commit
 	int changed = 0;
 
 	if (range) {
-		if (commit->parents && !bloom_filter_check(rev, commit, range)) {
+		int bloom_ret = bloom_filter_check(rev, commit, range);
+
+		if (!bloom_ret) {
 			struct line_log_data *prange = line_log_data_copy(range);
 			add_line_range(rev, commit->parents->item, prange);
 			clear_commit_line_range(rev, commit);
 		} else if (!commit->parents || !commit->parents->next)
-			changed = process_ranges_ordinary_commit(rev, commit, range);
+			changed = process_ranges_ordinary_commit(rev, commit, range,
+								 bloom_ret == 1);
 		else
-			changed = process_ranges_merge_commit(rev, commit, range);
+			changed = process_ranges_merge_commit(rev, commit, range,
+							      bloom_ret == 1);
 	}
 
 	if (!changed)
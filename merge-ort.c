@@ -70,6 +70,67 @@ struct rename_info {
 	 */
 	struct strset dirs_removed[3];
 
+	/*
+	 * possible_trivial_merges: directories we may not need to recurse into
+	 *
+	 * If a directory is unchanged on one side of history (or only exists
+	 * on one side), the other side's version of it is the merge result
+	 * unless something beneath it is involved in a rename that matters
+	 * to this merge.  collect_merge_info_callback() records such
+	 * directories in possible_trivial_merges[side], where side is the
+	 * side whose version would be taken, instead of recursing into
+	 * them; handle_deferred_entries() later either resolves them as a
+	 * whole or recurses into them after all.
+	 */
+	struct strset possible_trivial_merges[3];
+
+	/*
+	 * relevant_sources: deleted paths whose renames matter to this merge
+	 *
+	 * A path deleted on one side needs to be matched up with its rename
+	 * target only if the other side did not leave it alone; otherwise
+	 * taking the first side's version of both the source and the target
+	 * gives the right answer whether or not we know about the rename.
+	 */
+	struct strset relevant_sources[3];
+
+	/*
+	 * dir_renames_relevant: whether directory renames on a side matter
+	 *
+	 * Set when the other side added paths below a directory removed on
+	 * this side, in which case directory rename detection for this side
+	 * needs to see all of its renames.
+	 */
+	unsigned dir_renames_relevant[3];
+
+	/*
+	 * trivial_merges_done: whether any of possible_trivial_merges[side]
+	 * were resolved without recursing into them, meaning that some of
+	 * the renames on that side were never looked for.
+	 */
+	unsigned trivial_merges_done[3];
+
+	/*
+	 * redo_after_renames: redo collect_merge_info() once renames are known
+	 *
+	 * When handle_deferred_entries() had to recurse into deferred
+	 * directories only because it could not yet tell where the relevant
+	 * renames went, and that made the merge much bigger, it sets this
+	 * to 1.  detect_and_process_renames() then stops after finding the
+	 * renames (caching them and the directory rename counts) and sets
+	 * it to 2, upon which the merge starts over and the second pass of
+	 * handle_deferred_entries() can use what the first one learned.
+	 */
+	int redo_after_renames;
+
+	/*
+	 * renames_complete: whether the first pass of a redone merge found
+	 * all of the renames on a side, so that cached_pairs[side] and
+	 * dir_rename_count[side] can stand in for the ones below directories
+	 * the second pass does not recurse into.
+	 */
+	unsigned renames_complete[3];
+
 	/*
 	 * dir_rename_count: tracking where parts of a directory were renamed to
 	 *
@@ -96,6 +157,42 @@ struct rename_info {
 	 * this value remains 0.
 	 */
 	int needed_limit;
+
+	/*
+	 * cached_pairs: renames and deletes remembered from a previous merge
+	 *
+	 * When replaying a series of commits (rebase, cherry-pick of a
+	 * range), consecutive merges share the same "upstream" side and
+	 * thus the same renames on that side.  cached_pairs[side] maps an
+	 * old filename to either the new filename it was renamed to, or
+	 * to NULL if rename detection found the file to simply be deleted,
+	 * so that we need not run rename detection on those paths again.
+	 */
+	struct strmap cached_pairs[3];
+
+	/*
+	 * cached_target_names: the new filenames found in cached_pairs
+	 */
+	struct strset cached_target_names[3];
+
+	/*
+	 * cached_pairs_valid_side: which side's cached_pairs may be reused
+	 *
+	 * Set by merge_check_renames_reusable() before a merge starts;
+	 * the cached information for any other side is discarded.  -1
+	 * means both sides are valid, which is the case when a merge is
+	 * redone; see redo_after_renames.
+	 */
+	int cached_pairs_valid_side;
+
+	/*
+	 * merge_trees: the trees passed to the merge algorithm
+	 *
+	 * Used to check whether the next merge can reuse cached_pairs.  All
+	 * three are set to NULL when something happened during the merge
+	 * that makes the cache unsafe to reuse.
+	 */
+	struct tree *merge_trees[3];
 };
 
 struct merge_options_internal {
@@ -311,6 +408,32 @@ static void free_strmap_strings(struct strmap *map)
 	}
 }
 
+static void clear_or_reinit_output(struct merge_options_internal *opti,
+				   int reinitialize)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	/* Release and free each strbuf found in output */
+	strmap_for_each_entry(&opti->output, &iter, e) {
+		struct strbuf *sb = e->value;
+		strbuf_release(sb);
+		/*
+		 * While strictly speaking we don't need to free(sb)
+		 * here because we could pass free_values=1 when
+		 * calling strmap_clear() on opti->output, that would
+		 * require strmap_clear to do another
+		 * strmap_for_each_entry() loop, so we just free it
+		 * while we're iterating anyway.
+		 */
+		free(sb);
+	}
+	if (reinitialize)
+		strmap_partial_clear(&opti->output, 0);
+	else
+		strmap_clear(&opti->output, 0);
+}
+
 static void clear_or_reinit_internal_opts(struct merge_options_internal *opti,
 					  int reinitialize)
 {
@@ -355,37 +478,36 @@ static void clear_or_reinit_internal_opts(struct merge_options_internal *opti,
 		struct strmap_entry *entry;
 
 		strset_func(&renames->dirs_removed[i]);
-
-		strmap_for_each_entry(&renames->dir_rename_count[i],
-				      &iter, entry) {
-			struct strintmap *counts = entry->value;
-			strintmap_clear(counts);
+		strset_func(&renames->possible_trivial_merges[i]);
+		strset_func(&renames->relevant_sources[i]);
+		renames->dir_renames_relevant[i] = 0;
+		renames->trivial_merges_done[i] = 0;
+
+		/* Counts found by the first pass are reused by a redo */
+		if (!reinitialize || renames->redo_after_renames != 2 ||
+		    !renames->renames_complete[i]) {
+			renames->renames_complete[i] = 0;
+			strmap_for_each_entry(&renames->dir_rename_count[i],
+					      &iter, entry) {
+				struct strintmap *counts = entry->value;
+				strintmap_clear(counts);
+			}
+			strmap_func(&renames->dir_rename_count[i], 1);
 		}
-		strmap_func(&renames->dir_rename_count[i], 1);
 
 		strmap_func(&renames->dir_renames[i], 0);
-	}
-
-	if (!reinitialize) {
-		struct hashmap_iter iter;
-		struct strmap_entry *e;
 
-		/* Release and free each strbuf found in output */
-		strmap_for_each_entry(&opti->output, &iter, e) {
-			struct strbuf *sb = e->value;
-			strbuf_release(sb);
-			/*
-			 * While strictly speaking we don't need to free(sb)
-			 * here because we could pass free_values=1 when
-			 * calling strmap_clear() on opti->output, that would
-			 * require strmap_clear to do another
-			 * strmap_for_each_entry() loop, so we just free it
-			 * while we're iterating anyway.
-			 */
-			free(sb);
+		if (!reinitialize ||
+		    (renames->cached_pairs_valid_side != i &&
+		     renames->cached_pairs_valid_side != -1)) {
+			strmap_func(&renames->cached_pairs[i], 1);
+			strset_func(&renames->cached_target_names[i]);
 		}
-		strmap_clear(&opti->output, 0);
 	}
+	renames->cached_pairs_valid_side = 0;
+
+	if (!reinitialize)
+		clear_or_reinit_output(opti, 0);
 }
 
 static int err(struct merge_options *opt, const char *err, ...)
@@ -552,6 +674,31 @@ static void add_pair(struct merge_options *opt,
 	diff_queue(&renames->pairs[side], one, two);
 }
 
+static int want_directory_renames(struct merge_options *opt)
+{
+	return !opt->priv->call_depth &&
+	  (opt->detect_directory_renames == MERGE_DIRECTORY_RENAMES_TRUE ||
+	   opt->detect_directory_renames == MERGE_DIRECTORY_RENAMES_CONFLICT);
+}
+
+/* Is dir, or any directory containing it, in the given set? */
+static int dir_or_parent_in(struct strset *dirs, const char *dir)
+{
+	struct strbuf buf = STRBUF_INIT;
+	const char *slash;
+	int found = 0;
+
+	if (strset_empty(dirs) || !*dir)
+		return 0;
+
+	strbuf_addstr(&buf, dir);
+	while (!(found = strset_contains(dirs, buf.buf)) &&
+	       (slash = strrchr(buf.buf, '/')))
+		strbuf_setlen(&buf, slash - buf.buf);
+	strbuf_release(&buf);
+	return found;
+}
+
 static void collect_rename_info(struct merge_options *opt,
 				struct name_entry *names,
 				const char *dirname,
@@ -578,14 +725,30 @@ static void collect_rename_info(struct merge_options *opt,
 
 	for (side = MERGE_SIDE1; side <= MERGE_SIDE2; ++side) {
 		unsigned side_mask = (1 << side);
+		unsigned other_side = MERGE_SIDE1 + MERGE_SIDE2 - side;
 
 		/* Check for deletion on side */
-		if ((filemask & 1) && !(filemask & side_mask))
+		if ((filemask & 1) && !(filemask & side_mask)) {
 			add_pair(opt, names, fullname, side, 0 /* delete */);
+			/* Relevant unless the other side matches mbase */
+			if (match_mask != (1 | (1 << other_side)))
+				strset_add(&renames->relevant_sources[side],
+					   fullname);
+		}
 
 		/* Check for addition on side */
-		if (!(filemask & 1) && (filemask & side_mask))
+		if (!(filemask & 1) && (filemask & side_mask)) {
 			add_pair(opt, names, fullname, side, 1 /* add */);
+			/*
+			 * Adding below a directory the other side removed
+			 * means that side's directory renames may apply.
+			 */
+			if (!renames->dir_renames_relevant[other_side] &&
+			    want_directory_renames(opt) &&
+			    dir_or_parent_in(&renames->dirs_removed[other_side],
+					     dirname))
+				renames->dir_renames_relevant[other_side] = 1;
+		}
 	}
 }
 
@@ -706,6 +869,40 @@ static int collect_merge_info_callback(int n,
 	VERIFY_CI(ci);
 	ci->match_mask = match_mask;
 
+	/*
+	 * If one side left this directory alone, or it only exists on one
+	 * side, the other side's version of it may well be the answer.
+	 * Defer deciding whether we need to recurse into it; see
+	 * possible_trivial_merges.
+	 */
+	if (filemask == 0) {
+		unsigned side = 0;
+
+		if (match_mask == 3)
+			side = MERGE_SIDE2;
+		else if (match_mask == 5)
+			side = MERGE_SIDE1;
+		else if (dirmask == 2 || dirmask == 4) {
+			side = (dirmask == 2) ? MERGE_SIDE1 : MERGE_SIDE2;
+			/*
+			 * ...unless it is below a directory the other side
+			 * removed, as that side's directory renames might
+			 * then need to move things out of it.
+			 */
+			if (want_directory_renames(opt) &&
+			    dir_or_parent_in(&opti->renames.dirs_removed[
+						MERGE_SIDE1 + MERGE_SIDE2 - side],
+					     dirname))
+				side = 0;
+		}
+
+		if (side) {
+			strset_add(&opti->renames.possible_trivial_merges[side],
+				   pi.string);
+			return mask;
+		}
+	}
+
 	/* If dirmask, recurse into subdirectories */
 	if (dirmask) {
 		struct traverse_info newinfo;
@@ -762,6 +959,240 @@ static int collect_merge_info_callback(int n,
 	return mask;
 }
 
+/* Take side's version of a directory from possible_trivial_merges[side] */
+static void resolve_trivial_directory_merge(struct conflict_info *ci,
+					    unsigned side)
+{
+	VERIFY_CI(ci);
+	assert(ci->filemask == 0);
+	oidcpy(&ci->merged.result.oid, &ci->stages[side].oid);
+	ci->merged.result.mode = ci->stages[side].mode;
+	ci->merged.is_null = is_null_oid(&ci->stages[side].oid);
+	ci->match_mask = 0;
+	ci->merged.clean = 1;
+}
+
+/* Add all leading directories of path to dirs */
+static void add_leading_dirs(struct strset *dirs, const char *path)
+{
+	struct strbuf buf = STRBUF_INIT;
+	const char *slash;
+
+	strbuf_addstr(&buf, path);
+	while ((slash = strrchr(buf.buf, '/'))) {
+		strbuf_setlen(&buf, slash - buf.buf);
+		if (!strset_add(dirs, buf.buf))
+			break; /* its parents were added earlier */
+	}
+	strbuf_release(&buf);
+}
+
+/*
+ * Add to dirs the leading directories of every place where side's
+ * directory renames, as recorded in dir_rename_count, could move the
+ * other side's new file 'path' to.
+ */
+static void add_dir_rename_targets(struct strset *dirs,
+				   struct strmap *dir_rename_count,
+				   const char *path)
+{
+	struct strbuf dir = STRBUF_INIT;
+	struct strbuf new_path = STRBUF_INIT;
+	const char *slash;
+
+	strbuf_addstr(&dir, path);
+	while ((slash = strrchr(dir.buf, '/'))) {
+		struct strintmap *counts;
+		struct hashmap_iter iter;
+		struct strmap_entry *entry;
+
+		strbuf_setlen(&dir, slash - dir.buf);
+		counts = strmap_get(dir_rename_count, dir.buf);
+		if (!counts)
+			continue;
+		strintmap_for_each_entry(counts, &iter, entry) {
+			strbuf_reset(&new_path);
+			strbuf_addf(&new_path, "%s%s",
+				    entry->key, path + dir.len);
+			add_leading_dirs(dirs, new_path.buf);
+		}
+	}
+	strbuf_release(&new_path);
+	strbuf_release(&dir);
+}
+
+/*
+ * Recurse into a directory from possible_trivial_merges after all, the
+ * same way collect_merge_info_callback() would have done it.
+ */
+static int traverse_deferred_directory(struct merge_options *opt,
+				       struct traverse_info *toplevel,
+				       const char *path,
+				       struct conflict_info *ci)
+{
+	struct traverse_info newinfo;
+	struct tree_desc t[3];
+	void *buf[3] = {NULL, NULL, NULL};
+	unsigned dirmask = ci->dirmask;
+	int i, ret;
+
+	VERIFY_CI(ci);
+	newinfo = *toplevel;
+	newinfo.prev = NULL;
+	newinfo.name = path;
+	newinfo.namelen = strlen(path);
+	newinfo.pathlen = st_add(newinfo.namelen, 1);
+
+	for (i = MERGE_BASE; i <= MERGE_SIDE2; i++) {
+		if (i == 1 && ci->match_mask == 3)
+			t[1] = t[0];
+		else if (i == 2 && ci->match_mask == 5)
+			t[2] = t[0];
+		else {
+			const struct object_id *oid = NULL;
+			if (dirmask & 1)
+				oid = &ci->stages[i].oid;
+			buf[i] = fill_tree_descriptor(opt->repo, t + i, oid);
+		}
+		dirmask >>= 1;
+	}
+	ci->match_mask &= ci->filemask;
+
+	opt->priv->current_dir_name = path;
+	ret = traverse_trees(NULL, 3, t, &newinfo);
+	opt->priv->current_dir_name = opt->priv->toplevel_dir;
+
+	for (i = MERGE_BASE; i <= MERGE_SIDE2; i++)
+		free(buf[i]);
+
+	return ret;
+}
+
+/*
+ * Decide what to do with the directories in possible_trivial_merges.
+ *
+ * Nothing below such a directory can be a rename source that matters to
+ * this merge, but it may contain the target of one.  If the side has no
+ * relevant rename sources, or the renames cached from the previous merge
+ * tell us where all of them went, we only need to recurse into the
+ * directories leading to those targets and can take the side's version
+ * of every other directory as is.  Otherwise, recurse into all of them,
+ * and if that made the merge a lot bigger, ask for the merge to be redone
+ * once rename detection has filled the cache; see redo_after_renames.
+ */
+static int handle_deferred_entries(struct merge_options *opt,
+				   struct traverse_info *info)
+{
+	struct rename_info *renames = &opt->priv->renames;
+	unsigned side;
+	unsigned path_count_before = strmap_get_size(&opt->priv->paths);
+	const unsigned wanted_factor = 3;
+	int recursed_all = 0;
+	int ret = 0;
+
+	for (side = MERGE_SIDE1; side <= MERGE_SIDE2 && !ret; side++) {
+		struct strset target_dirs;
+		struct hashmap_iter iter;
+		struct strmap_entry *entry;
+		int optimization_okay = !renames->dir_renames_relevant[side] ||
+					renames->renames_complete[side];
+		int resolved = 0;
+
+		if (strset_empty(&renames->possible_trivial_merges[side]))
+			continue;
+
+		strset_init_with_options(&target_dirs, NULL, 1);
+		if (optimization_okay && renames->dir_renames_relevant[side]) {
+			/*
+			 * The directory renames found by the first pass may
+			 * move the other side's new files anywhere below
+			 * their targets; make sure we see what is there.
+			 */
+			unsigned other_side = MERGE_SIDE1 + MERGE_SIDE2 - side;
+			struct diff_queue_struct *pairs =
+				&renames->pairs[other_side];
+			int i;
+
+			for (i = 0; i < pairs->nr; i++)
+				if (!DIFF_FILE_VALID(pairs->queue[i]->one))
+					add_dir_rename_targets(&target_dirs,
+						&renames->dir_rename_count[side],
+						pairs->queue[i]->two->path);
+		}
+		strset_for_each_entry(&renames->relevant_sources[side],
+				      &iter, entry) {
+			struct strmap_entry *e;
+
+			if (!optimization_okay)
+				break;
+			e = strmap_get_entry(&renames->cached_pairs[side],
+					     entry->key);
+			if (!e)
+				optimization_okay = 0;
+			else if (e->value)
+				add_leading_dirs(&target_dirs, e->value);
+		}
+
+		/* Recursing may find more directories to defer; loop */
+		while (!ret &&
+		       !strset_empty(&renames->possible_trivial_merges[side])) {
+			struct strset deferred;
+			struct string_list paths = STRING_LIST_INIT_NODUP;
+			struct string_list_item *item;
+
+			deferred = renames->possible_trivial_merges[side];
+			strset_init_with_options(
+				&renames->possible_trivial_merges[side],
+				NULL, 0);
+
+			/* Visit them in a stable order */
+			strset_for_each_entry(&deferred, &iter, entry)
+				string_list_append(&paths, entry->key);
+			string_list_sort(&paths);
+
+			for_each_string_list_item(item, &paths) {
+				const char *path = item->string;
+				struct conflict_info *ci;
+
+				ci = strmap_get(&opt->priv->paths, path);
+				if (optimization_okay &&
+				    !strset_contains(&target_dirs, path)) {
+					resolve_trivial_directory_merge(ci,
+									side);
+					resolved++;
+					continue;
+				}
+				ret = traverse_deferred_directory(opt, info,
+								  path, ci);
+				if (ret < 0)
+					break;
+			}
+
+			string_list_clear(&paths, 0);
+			strset_clear(&deferred);
+		}
+		strset_clear(&target_dirs);
+
+		if (!optimization_okay)
+			recursed_all = 1;
+		if (resolved) {
+			renames->trivial_merges_done[side] = 1;
+			trace2_data_intmax("merge", opt->repo,
+					   "trivial_directory_merges", resolved);
+		}
+	}
+
+	if (!ret && recursed_all && !renames->redo_after_renames &&
+	    !opt->priv->call_depth &&
+	    strmap_get_size(&opt->priv->paths) >=
+	    wanted_factor * path_count_before) {
+		renames->redo_after_renames = 1;
+		renames->cached_pairs_valid_side = -1;
+	}
+
+	return ret;
+}
+
 static int collect_merge_info(struct merge_options *opt,
 			      struct tree *merge_base,
 			      struct tree *side1,
@@ -787,6 +1218,8 @@ static int collect_merge_info(struct merge_options *opt,
 
 	trace2_region_enter("merge", "traverse_trees", opt->repo);
 	ret = traverse_trees(NULL, 3, t, &info);
+	if (ret == 0)
+		ret = handle_deferred_entries(opt, &info);
 	trace2_region_leave("merge", "traverse_trees", opt->repo);
 
 	return ret;
@@ -1435,9 +1868,11 @@ static void get_provisional_directory_renames(struct merge_options *opt,
 	struct strmap_entry *entry;
 	struct rename_info *renames = &opt->priv->renames;
 
-	compute_rename_counts(&renames->pairs[side],
-			      &renames->dir_rename_count[side],
-			      &renames->dirs_removed[side]);
+	/* A redo kept the counts from the first pass, which saw everything */
+	if (!renames->renames_complete[side])
+		compute_rename_counts(&renames->pairs[side],
+				      &renames->dir_rename_count[side],
+				      &renames->dirs_removed[side]);
 	/*
 	 * Collapse
 	 *    dir_rename_count: old_directory -> {new_directory -> count}
@@ -1894,6 +2329,16 @@ static int process_renames(struct merge_options *opt,
 				base->merged.is_null = 1;
 				base->merged.clean = 1;
 
+				/*
+				 * The other side's copy of this rename will
+				 * not show up in the next merge of a series,
+				 * so the cached renames no longer describe
+				 * that merge; do not reuse them.
+				 */
+				opt->priv->renames.merge_trees[0] = NULL;
+				opt->priv->renames.merge_trees[1] = NULL;
+				opt->priv->renames.merge_trees[2] = NULL;
+
 				/* We handled both renames, i.e. i+1 handled */
 				i++;
 				/* Move to next rename */
@@ -2140,12 +2585,132 @@ static int compare_pairs(const void *a_, const void *b_)
 	return strcmp(a->one->path, b->one->path);
 }
 
+/*
+ * Move the deletions and additions on the given side that cached_pairs
+ * already explains out of renames->pairs[side] and into 'cached', turning
+ * them into the renames (or plain deletions) a previous merge found, so
+ * that diffcore_rename() does not have to look at them again.
+ *
+ * A cached rename is only used when both its source and its target show
+ * up on this side again; otherwise both are left for diffcore_rename().
+ * The exception is the second pass of a redone merge, where the target of
+ * a rename that does not matter to the merge may be in a directory we did
+ * not recurse into; the source is then simply taken as deleted.
+ * Returns the number of cached pairs used.
+ */
+static int use_cached_pairs(struct rename_info *renames, unsigned side,
+			    struct diff_queue_struct *cached)
+{
+	struct diff_queue_struct *pairs = &renames->pairs[side];
+	struct strmap adds;
+	int i, j, hits = 0;
+
+	if (strmap_empty(&renames->cached_pairs[side]))
+		return 0;
+
+	/* Find the additions that are targets of cached renames */
+	strmap_init_with_options(&adds, NULL, 0);
+	for (i = 0; i < pairs->nr; i++) {
+		struct diff_filepair *p = pairs->queue[i];
+
+		if (!DIFF_FILE_VALID(p->one) &&
+		    strset_contains(&renames->cached_target_names[side],
+				    p->two->path))
+			strmap_put(&adds, p->two->path, &pairs->queue[i]);
+	}
+
+	for (i = 0; i < pairs->nr; i++) {
+		struct diff_filepair *p = pairs->queue[i], *add, *rename;
+		struct diff_filepair **add_slot;
+		struct strmap_entry *e;
+
+		if (!p || DIFF_FILE_VALID(p->two))
+			continue;
+		e = strmap_get_entry(&renames->cached_pairs[side],
+				     p->one->path);
+		if (!e)
+			continue;
+
+		if (!e->value) {
+			/* Known to be a plain deletion */
+			diff_q(cached, p);
+			pairs->queue[i] = NULL;
+			hits++;
+			continue;
+		}
+
+		add_slot = strmap_get(&adds, e->value);
+		if (!add_slot || !*add_slot) {
+			if (renames->renames_complete[side] &&
+			    !strset_contains(&renames->relevant_sources[side],
+					     p->one->path)) {
+				diff_q(cached, p);
+				pairs->queue[i] = NULL;
+				hits++;
+			}
+			continue;
+		}
+		add = *add_slot;
+
+		rename = diff_queue(cached, p->one, add->two);
+		rename->renamed_pair = 1;
+		rename->score = MAX_SCORE;
+		p->one->count++;
+		add->two->count++;
+		diff_free_filepair(p);
+		diff_free_filepair(add);
+		pairs->queue[i] = NULL;
+		*add_slot = NULL;
+		hits++;
+	}
+	strmap_clear(&adds, 0);
+
+	for (i = j = 0; i < pairs->nr; i++)
+		if (pairs->queue[i])
+			pairs->queue[j++] = pairs->queue[i];
+	pairs->nr = j;
+
+	return hits;
+}
+
+/*
+ * Remember the renames and deletions that diffcore_rename() found in
+ * 'pairs', for use by the next merge; see rename_info.cached_pairs.
+ */
+static void cache_new_pairs(struct rename_info *renames, unsigned side,
+			    struct diff_queue_struct *pairs,
+			    int complete)
+{
+	int i;
+
+	for (i = 0; i < pairs->nr; i++) {
+		struct diff_filepair *p = pairs->queue[i];
+
+		if (p->status == DIFF_STATUS_RENAMED) {
+			free(strmap_put(&renames->cached_pairs[side],
+					p->one->path, xstrdup(p->two->path)));
+			strset_add(&renames->cached_target_names[side],
+				   p->two->path);
+		} else if (p->status == DIFF_STATUS_DELETED && complete) {
+			/*
+			 * If the rename limit kept us from looking for
+			 * inexact renames, we do not know that this is
+			 * not a rename; only remember it otherwise.
+			 */
+			free(strmap_put(&renames->cached_pairs[side],
+					p->one->path, NULL));
+		}
+	}
+}
+
 /* Call diffcore_rename() to compute which files have changed on given side */
 static void detect_regular_renames(struct merge_options *opt,
 				   unsigned side_index)
 {
 	struct diff_options diff_opts;
 	struct rename_info *renames = &opt->priv->renames;
+	struct diff_queue_struct cached;
+	int i, hits;
 
 	repo_diff_setup(opt->repo, &diff_opts);
 	diff_opts.flags.recursive = 1;
@@ -2159,6 +2724,12 @@ static void detect_regular_renames(struct merge_options *opt,
 	diff_opts.output_format = DIFF_FORMAT_NO_OUTPUT;
 	diff_setup_done(&diff_opts);
 
+	DIFF_QUEUE_CLEAR(&cached);
+	hits = use_cached_pairs(renames, side_index, &cached);
+	if (hits)
+		trace2_data_intmax("merge", opt->repo, "renames/cache_hits",
+				   hits);
+
 	diff_queued_diff = renames->pairs[side_index];
 	trace2_region_enter("diff", "diffcore_rename", opt->repo);
 	diffcore_rename(&diff_opts);
@@ -2168,6 +2739,24 @@ static void detect_regular_renames(struct merge_options *opt,
 	if (diff_opts.needed_rename_limit > renames->needed_limit)
 		renames->needed_limit = diff_opts.needed_rename_limit;
 
+	/*
+	 * If we skipped over directories on this side, the renames we found
+	 * were looked for without seeing all of the side's new files; do not
+	 * let a later merge rely on them.
+	 */
+	if (!opt->priv->call_depth && !renames->trivial_merges_done[side_index])
+		cache_new_pairs(renames, side_index, &diff_queued_diff,
+				!diff_opts.needed_rename_limit);
+	if (renames->redo_after_renames == 1 &&
+	    !renames->trivial_merges_done[side_index] &&
+	    !diff_opts.needed_rename_limit)
+		renames->renames_complete[side_index] = 1;
+
+	resolve_diffpair_statuses(&cached);
+	for (i = 0; i < cached.nr; i++)
+		diff_q(&diff_queued_diff, cached.queue[i]);
+	free(cached.queue);
+
 	renames->pairs[side_index] = diff_queued_diff;
 
 	diff_opts.output_format = DIFF_FORMAT_NO_OUTPUT;
@@ -2267,11 +2856,32 @@ static int detect_and_process_renames(struct merge_options *opt,
 	detect_regular_renames(opt, MERGE_SIDE2);
 	trace2_region_leave("merge", "regular renames", opt->repo);
 
+	need_dir_renames = want_directory_renames(opt);
+	if (renames->redo_after_renames == 1) {
+		if (renames->renames_complete[MERGE_SIDE1] ||
+		    renames->renames_complete[MERGE_SIDE2]) {
+			/*
+			 * Keep what the second pass needs and start over;
+			 * see redo_after_renames.
+			 */
+			for (s = MERGE_SIDE1; s <= MERGE_SIDE2; s++)
+				if (need_dir_renames &&
+				    renames->renames_complete[s])
+					compute_rename_counts(
+						&renames->pairs[s],
+						&renames->dir_rename_count[s],
+						&renames->dirs_removed[s]);
+			renames->redo_after_renames = 2;
+			goto cleanup;
+		}
+		/* Nothing learned that would make a second pass cheaper */
+		renames->redo_after_renames = 0;
+	} else if (renames->redo_after_renames == 2) {
+		/* This is the second pass */
+		renames->redo_after_renames = 0;
+	}
+
 	trace2_region_enter("merge", "directory renames", opt->repo);
-	need_dir_renames =
-	  !opt->priv->call_depth &&
-	  (opt->detect_directory_renames == MERGE_DIRECTORY_RENAMES_TRUE ||
-	   opt->detect_directory_renames == MERGE_DIRECTORY_RENAMES_CONFLICT);
 
 	if (need_dir_renames) {
 		get_provisional_directory_renames(opt, MERGE_SIDE1, &clean);
@@ -2295,6 +2905,7 @@ static int detect_and_process_renames(struct merge_options *opt,
 	clean &= process_renames(opt, &combined);
 	trace2_region_leave("merge", "process renames", opt->repo);
 
+cleanup:
 	/* Free memory for renames->pairs[] and combined */
 	for (s = MERGE_SIDE1; s <= MERGE_SIDE2; s++) {
 		free(renames->pairs[s].queue);
@@ -3194,7 +3805,7 @@ static int record_conflicted_index_entries(struct merge_options *opt,
 	return errs;
 }
 
-void merge_switch_to_result(struct merge_options *opt,
+static int switch_to_result(struct merge_options *opt,
 			    struct tree *head,
 			    struct merge_result *result,
 			    int update_worktree_and_index,
@@ -3208,7 +3819,7 @@ void merge_switch_to_result(struct merge_options *opt,
 		if (checkout(opt, head, result->tree)) {
 			/* failure to function */
 			result->clean = -1;
-			return;
+			return -1;
 		}
 		trace2_region_leave("merge", "checkout", opt->repo);
 
@@ -3218,7 +3829,7 @@ void merge_switch_to_result(struct merge_options *opt,
 						    &opti->conflicted)) {
 			/* failure to function */
 			result->clean = -1;
-			return;
+			return -1;
 		}
 		trace2_region_leave("merge", "record_conflicted", opt->repo);
 	}
@@ -3256,10 +3867,31 @@ void merge_switch_to_result(struct merge_options *opt,
 
 		trace2_region_leave("merge", "display messages", opt->repo);
 	}
+	return 0;
+}
 
+void merge_switch_to_result(struct merge_options *opt,
+			    struct tree *head,
+			    struct merge_result *result,
+			    int update_worktree_and_index,
+			    int display_update_msgs)
+{
+	if (switch_to_result(opt, head, result, update_worktree_and_index,
+			     display_update_msgs))
+		return;
 	merge_finalize(opt, result);
 }
 
+void merge_switch_to_result_keeping_renames(struct merge_options *opt,
+					    struct tree *head,
+					    struct merge_result *result,
+					    int update_worktree_and_index,
+					    int display_update_msgs)
+{
+	switch_to_result(opt, head, result, update_worktree_and_index,
+			 display_update_msgs);
+}
+
 void merge_finalize(struct merge_options *opt,
 		    struct merge_result *result)
 {
@@ -3344,6 +3976,11 @@ static void merge_start(struct merge_options *opt, struct merge_result *result)
 	trace2_region_enter("merge", "allocate/init", opt->repo);
 	if (opt->priv) {
 		clear_or_reinit_internal_opts(opt->priv, 1);
+		/*
+		 * Messages from the previous merge belong to that merge;
+		 * the caller already had its chance to display them.
+		 */
+		clear_or_reinit_output(opt->priv, 1);
 		trace2_region_leave("merge", "allocate/init", opt->repo);
 		return;
 	}
@@ -3354,10 +3991,18 @@ static void merge_start(struct merge_options *opt, struct merge_result *result)
 	for (i = MERGE_SIDE1; i <= MERGE_SIDE2; i++) {
 		strset_init_with_options(&renames->dirs_removed[i],
 					 NULL, 0);
+		strset_init_with_options(&renames->possible_trivial_merges[i],
+					 NULL, 0);
+		strset_init_with_options(&renames->relevant_sources[i],
+					 NULL, 0);
 		strmap_init_with_options(&renames->dir_rename_count[i],
 					 NULL, 1);
 		strmap_init_with_options(&renames->dir_renames[i],
 					 NULL, 0);
+		strmap_init_with_options(&renames->cached_pairs[i],
+					 NULL, 1);
+		strset_init_with_options(&renames->cached_target_names[i],
+					 NULL, 1);
 	}
 
 	/*
@@ -3383,6 +4028,45 @@ static void merge_start(struct merge_options *opt, struct merge_result *result)
 	trace2_region_leave("merge", "allocate/init", opt->repo);
 }
 
+/*
+ * Check whether the renames cached by the merge that produced 'result' can
+ * be reused for merging 'side1' and 'side2' using 'merge_base'.
+ *
+ * When replaying commits, the previous merge was of (P, H, C) giving R,
+ * and the current one is of (C, R, C'), where C is the parent of C'.  The
+ * renames on the "upstream" side (P -> H, now C -> R) are then the same,
+ * except for changes made by C itself, which already show up identically
+ * in both C and R.
+ */
+static void merge_check_renames_reusable(struct merge_options *opt,
+					 struct merge_result *result,
+					 struct tree *merge_base,
+					 struct tree *side1,
+					 struct tree *side2)
+{
+	struct merge_options_internal *opti = result->priv;
+	struct rename_info *renames;
+	struct tree **merge_trees;
+
+	if (!opti)
+		return;
+
+	renames = &opti->renames;
+	merge_trees = renames->merge_trees;
+	renames->cached_pairs_valid_side = 0; /* neither side valid */
+
+	/* The previous merge may have disabled the cache */
+	if (!merge_trees[0] || !result->tree)
+		return;
+
+	if (oideq(&merge_base->object.oid, &merge_trees[2]->object.oid) &&
+	    oideq(&side1->object.oid, &result->tree->object.oid))
+		renames->cached_pairs_valid_side = MERGE_SIDE1;
+	else if (oideq(&merge_base->object.oid, &merge_trees[1]->object.oid) &&
+		 oideq(&side2->object.oid, &result->tree->object.oid))
+		renames->cached_pairs_valid_side = MERGE_SIDE2;
+}
+
 /*** Function Grouping: merge_incore_*() and their internal variants ***/
 
 /*
@@ -3396,6 +4080,13 @@ static void merge_ort_nonrecursive_internal(struct merge_options *opt,
 {
 	struct object_id working_tree_oid;
 
+	if (!opt->priv->call_depth) {
+		opt->priv->renames.merge_trees[0] = merge_base;
+		opt->priv->renames.merge_trees[1] = side1;
+		opt->priv->renames.merge_trees[2] = side2;
+	}
+
+redo:
 	trace2_region_enter("merge", "collect_merge_info", opt->repo);
 	if (collect_merge_info(opt, merge_base, side1, side2) != 0) {
 		/*
@@ -3415,6 +4106,12 @@ static void merge_ort_nonrecursive_internal(struct merge_options *opt,
 	result->clean = detect_and_process_renames(opt, merge_base,
 						   side1, side2);
 	trace2_region_leave("merge", "renames", opt->repo);
+	if (opt->priv->renames.redo_after_renames == 2) {
+		trace2_region_enter("merge", "reset_maps", opt->repo);
+		clear_or_reinit_internal_opts(opt->priv, 1);
+		trace2_region_leave("merge", "reset_maps", opt->repo);
+		goto redo;
+	}
 
 	trace2_region_enter("merge", "process_entries", opt->repo);
 	process_entries(opt, &working_tree_oid);
@@ -3523,6 +4220,7 @@ void merge_incore_nonrecursive(struct merge_options *opt,
 
 	trace2_region_enter("merge", "merge_start", opt->repo);
 	assert(opt->ancestor != NULL);
+	merge_check_renames_reusable(opt, result, merge_base, side1, side2);
 	merge_start(opt, result);
 	trace2_region_leave("merge", "merge_start", opt->repo);
 
@@ -54,6 +54,12 @@ void merge_incore_recursive(struct merge_options *opt,
 /*
  * rename-detecting three-way merge, no recursion.
  * working tree and index are untouched.
+ *
+ * If 'result' still holds the outcome of a previous merge (see
+ * merge_switch_to_result_keeping_renames()), renames found by that merge
+ * are reused where possible: when replaying a series of commits, each
+ * merge's base is the previous commit of the series and one side is the
+ * previous result, so renames on that side need not be detected again.
  */
 void merge_incore_nonrecursive(struct merge_options *opt,
 			       struct tree *merge_base,
@@ -68,6 +74,17 @@ void merge_switch_to_result(struct merge_options *opt,
 			    int update_worktree_and_index,
 			    int display_update_msgs);
 
+/*
+ * Like merge_switch_to_result(), but keep the data in 'result' so that it
+ * can be passed to the next merge_incore_nonrecursive() call.  The caller
+ * must eventually call merge_finalize() (or merge_switch_to_result()).
+ */
+void merge_switch_to_result_keeping_renames(struct merge_options *opt,
+					    struct tree *head,
+					    struct merge_result *result,
+					    int update_worktree_and_index,
+					    int display_update_msgs);
+
 /* Do needed cleanup when not calling merge_switch_to_result() */
 void merge_finalize(struct merge_options *opt,
 		    struct merge_result *result);
@@ -12,6 +12,12 @@
 #include "run-command.h"
 #include "repository.h"
 #include "chunk-format.h"
+#include "pack.h"
+#include "pack-bitmap.h"
+#include "pack-objects.h"
+#include "revision.h"
+#include "list-objects.h"
+#include "refs.h"
 
 #define MIDX_SIGNATURE 0x4d494458 /* "MIDX" */
 #define MIDX_VERSION 1
@@ -28,6 +34,7 @@
 #define MIDX_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
 #define MIDX_CHUNKID_OBJECTOFFSETS 0x4f4f4646 /* "OOFF" */
 #define MIDX_CHUNKID_LARGEOFFSETS 0x4c4f4646 /* "LOFF" */
+#define MIDX_CHUNKID_REVINDEX 0x52494458 /* "RIDX" */
 #define MIDX_CHUNK_FANOUT_SIZE (sizeof(uint32_t) * 256)
 #define MIDX_CHUNK_OFFSET_WIDTH (2 * sizeof(uint32_t))
 #define MIDX_CHUNK_LARGE_OFFSET_WIDTH (sizeof(uint64_t))
@@ -52,6 +59,23 @@ static char *get_midx_filename(const char *object_dir)
 	return xstrfmt("%s/pack/multi-pack-index", object_dir);
 }
 
+const unsigned char *get_midx_checksum(struct multi_pack_index *m)
+{
+	return m->data + m->data_len - the_hash_algo->rawsz;
+}
+
+static char *midx_bitmap_filename(const char *object_dir,
+				  const unsigned char *hash)
+{
+	return xstrfmt("%s/pack/multi-pack-index-%s.bitmap",
+		       object_dir, hash_to_hex(hash));
+}
+
+char *get_midx_bitmap_filename(struct multi_pack_index *m)
+{
+	return midx_bitmap_filename(m->object_dir, get_midx_checksum(m));
+}
+
 static int midx_read_oid_fanout(const unsigned char *chunk_start,
 				size_t chunk_size, void *data)
 {
@@ -142,6 +166,7 @@ struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local
 		die(_("multi-pack-index missing required object offsets chunk"));
 
 	pair_chunk(cf, MIDX_CHUNKID_LARGEOFFSETS, &m->chunk_large_offsets);
+	pair_chunk(cf, MIDX_CHUNKID_REVINDEX, &m->chunk_revindex);
 
 	m->num_objects = ntohl(m->chunk_oid_fanout[255]);
 
@@ -239,7 +264,7 @@ struct object_id *nth_midxed_object_oid(struct object_id *oid,
 	return oid;
 }
 
-static off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
+off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
 {
 	const unsigned char *offset_data;
 	uint32_t offset32;
@@ -258,7 +283,7 @@ static off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
 	return offset32;
 }
 
-static uint32_t nth_midxed_pack_int_id(struct multi_pack_index *m, uint32_t pos)
+uint32_t nth_midxed_pack_int_id(struct multi_pack_index *m, uint32_t pos)
 {
 	return get_be32(m->chunk_object_offsets +
 			(off_t)pos * MIDX_CHUNK_OFFSET_WIDTH);
@@ -443,8 +468,11 @@ struct write_midx_context {
 	uint32_t entries_nr;
 
 	uint32_t *pack_perm;
+	uint32_t *pack_order;
 	unsigned large_offsets_needed:1;
 	uint32_t num_large_offsets;
+
+	int preferred_pack_idx;
 };
 
 static void add_pack_to_midx(const char *full_path, size_t full_path_len,
@@ -489,6 +517,7 @@ struct pack_midx_entry {
 	uint32_t pack_int_id;
 	time_t pack_mtime;
 	uint64_t offset;
+	unsigned preferred : 1;
 };
 
 static int midx_oid_compare(const void *_a, const void *_b)
@@ -500,6 +529,12 @@ static int midx_oid_compare(const void *_a, const void *_b)
 	if (cmp)
 		return cmp;
 
+	/* Sort objects in a preferred pack first when multiple copies exist. */
+	if (a->preferred > b->preferred)
+		return -1;
+	if (a->preferred < b->preferred)
+		return 1;
+
 	if (a->pack_mtime > b->pack_mtime)
 		return -1;
 	else if (a->pack_mtime < b->pack_mtime)
@@ -527,7 +562,8 @@ static int nth_midxed_pack_midx_entry(struct multi_pack_index *m,
 static void fill_pack_entry(uint32_t pack_int_id,
 			    struct packed_git *p,
 			    uint32_t cur_object,
-			    struct pack_midx_entry *entry)
+			    struct pack_midx_entry *entry,
+			    int preferred)
 {
 	if (nth_packed_object_id(&entry->oid, p, cur_object) < 0)
 		die(_("failed to locate object %d in packfile"), cur_object);
@@ -536,6 +572,27 @@ static void fill_pack_entry(uint32_t pack_int_id,
 	entry->pack_mtime = p->mtime;
 
 	entry->offset = nth_packed_object_offset(p, cur_object);
+	entry->preferred = !!preferred;
+}
+
+static void add_pack_fanout(struct pack_midx_entry **entries,
+			    uint32_t *nr, uint32_t *alloc,
+			    struct pack_info *info, uint32_t cur_pack,
+			    int preferred, uint32_t cur_fanout)
+{
+	struct packed_git *p = info[cur_pack].p;
+	uint32_t start = 0, end, cur_object;
+
+	if (cur_fanout)
+		start = get_pack_fanout(p, cur_fanout - 1);
+	end = get_pack_fanout(p, cur_fanout);
+
+	for (cur_object = start; cur_object < end; cur_object++) {
+		ALLOC_GROW(*entries, *nr + 1, *alloc);
+		fill_pack_entry(cur_pack, p, cur_object, &(*entries)[*nr],
+				preferred);
+		(*nr)++;
+	}
 }
 
 /*
@@ -546,13 +603,15 @@ static void fill_pack_entry(uint32_t pack_int_id,
  * group objects by the first byte of their object id. Use the IDX fanout
  * tables to group the data, copy to a local array, then sort.
  *
- * Copy only the de-duplicated entries (selected by most-recent modified time
- * of a packfile containing the object).
+ * Copy only the de-duplicated entries (selected by the preferred pack, if
+ * any, and then by most-recent modified time of a packfile containing the
+ * object).
  */
 static struct pack_midx_entry *get_sorted_entries(struct multi_pack_index *m,
 						  struct pack_info *info,
 						  uint32_t nr_packs,
-						  uint32_t *nr_objects)
+						  uint32_t *nr_objects,
+						  int preferred_pack)
 {
 	uint32_t cur_fanout, cur_pack, cur_object;
 	uint32_t alloc_fanout, alloc_objects, total_objects = 0;
@@ -589,23 +648,26 @@ static struct pack_midx_entry *get_sorted_entries(struct multi_pack_index *m,
 				nth_midxed_pack_midx_entry(m,
 							   &entries_by_fanout[nr_fanout],
 							   cur_object);
+				entries_by_fanout[nr_fanout].preferred =
+					entries_by_fanout[nr_fanout].pack_int_id == preferred_pack;
 				nr_fanout++;
 			}
 		}
 
-		for (cur_pack = start_pack; cur_pack < nr_packs; cur_pack++) {
-			uint32_t start = 0, end;
-
-			if (cur_fanout)
-				start = get_pack_fanout(info[cur_pack].p, cur_fanout - 1);
-			end = get_pack_fanout(info[cur_pack].p, cur_fanout);
+		for (cur_pack = start_pack; cur_pack < nr_packs; cur_pack++)
+			add_pack_fanout(&entries_by_fanout, &nr_fanout,
+					&alloc_fanout, info, cur_pack,
+					cur_pack == preferred_pack, cur_fanout);
 
-			for (cur_object = start; cur_object < end; cur_object++) {
-				ALLOC_GROW(entries_by_fanout, nr_fanout + 1, alloc_fanout);
-				fill_pack_entry(cur_pack, info[cur_pack].p, cur_object, &entries_by_fanout[nr_fanout]);
-				nr_fanout++;
-			}
-		}
+		/*
+		 * The existing MIDX may have resolved some duplicates away
+		 * from the preferred pack, so add all of its objects again
+		 * to let it win every tie.
+		 */
+		if (0 <= preferred_pack && preferred_pack < start_pack)
+			add_pack_fanout(&entries_by_fanout, &nr_fanout,
+					&alloc_fanout, info, preferred_pack,
+					1, cur_fanout);
 
 		QSORT(entries_by_fanout, nr_fanout, midx_oid_compare);
 
@@ -776,10 +838,290 @@ static int write_midx_large_offsets(struct hashfile *f,
 	return 0;
 }
 
+struct midx_pack_order_data {
+	uint32_t nr;
+	uint32_t pack;
+	off_t offset;
+};
+
+static int midx_pack_order_cmp(const void *va, const void *vb)
+{
+	const struct midx_pack_order_data *a = va, *b = vb;
+	if (a->pack < b->pack)
+		return -1;
+	else if (a->pack > b->pack)
+		return 1;
+	else if (a->offset < b->offset)
+		return -1;
+	else if (a->offset > b->offset)
+		return 1;
+	else
+		return 0;
+}
+
+/*
+ * Compute the "pseudo-pack" order of the objects in the MIDX: objects
+ * from the preferred pack come first, and then the objects of every
+ * other pack in pack-int-id order. Within a pack, objects are ordered
+ * by their offset. This is the order in which bits are assigned in a
+ * multi-pack bitmap.
+ *
+ * The result maps pseudo-pack positions to positions in the MIDX's
+ * lexicographic order.
+ */
+static uint32_t *midx_pack_order(struct write_midx_context *ctx)
+{
+	struct midx_pack_order_data *data;
+	uint32_t *pack_order;
+	uint32_t i;
+
+	ALLOC_ARRAY(data, ctx->entries_nr);
+	for (i = 0; i < ctx->entries_nr; i++) {
+		struct pack_midx_entry *e = &ctx->entries[i];
+		data[i].nr = i;
+		data[i].pack = ctx->pack_perm[e->pack_int_id];
+		if (!e->preferred)
+			data[i].pack |= (1U << 31);
+		data[i].offset = e->offset;
+	}
+
+	QSORT(data, ctx->entries_nr, midx_pack_order_cmp);
+
+	ALLOC_ARRAY(pack_order, ctx->entries_nr);
+	for (i = 0; i < ctx->entries_nr; i++)
+		pack_order[i] = data[i].nr;
+	free(data);
+
+	return pack_order;
+}
+
+static int write_midx_revindex(struct hashfile *f,
+			       void *data)
+{
+	struct write_midx_context *ctx = data;
+	uint32_t i;
+
+	for (i = 0; i < ctx->entries_nr; i++)
+		hashwrite_be32(f, ctx->pack_order[i]);
+
+	return 0;
+}
+
+static void prepare_midx_packing_data(struct packing_data *pdata,
+				      struct write_midx_context *ctx)
+{
+	uint32_t i;
+
+	memset(pdata, 0, sizeof(struct packing_data));
+	prepare_packing_data(the_repository, pdata);
+
+	for (i = 0; i < ctx->entries_nr; i++)
+		packlist_alloc(pdata, &ctx->entries[ctx->pack_order[i]].oid);
+}
+
+static int add_ref_to_pending(const char *refname,
+			      const struct object_id *oid,
+			      int flag, void *cb_data)
+{
+	struct rev_info *revs = (struct rev_info*)cb_data;
+	struct object *object;
+
+	if ((flag & REF_ISSYMREF) && (flag & REF_ISBROKEN)) {
+		warning("symbolic ref is dangling: %s", refname);
+		return 0;
+	}
+
+	object = parse_object_or_die(oid, refname);
+	if (object->type != OBJ_COMMIT)
+		return 0;
+
+	add_pending_object(revs, object, "");
+	return 0;
+}
+
+struct bitmap_commit_cb {
+	struct commit **commits;
+	size_t commits_nr, commits_alloc;
+
+	struct packing_data *to_pack;
+};
+
+static void bitmap_show_commit(struct commit *commit, void *_data)
+{
+	struct bitmap_commit_cb *data = _data;
+
+	if (!packlist_find(data->to_pack, &commit->object.oid))
+		return;
+
+	ALLOC_GROW(data->commits, data->commits_nr + 1, data->commits_alloc);
+	data->commits[data->commits_nr++] = commit;
+}
+
+/*
+ * Collect the commits reachable from any reference which are contained
+ * in the MIDX, as candidates for receiving a bitmap.
+ */
+static struct commit **find_commits_for_midx_bitmap(uint32_t *indexed_commits_nr_p,
+						    struct packing_data *to_pack)
+{
+	struct rev_info revs;
+	struct bitmap_commit_cb cb = { 0 };
+
+	cb.to_pack = to_pack;
+
+	repo_init_revisions(the_repository, &revs, NULL);
+	for_each_ref(add_ref_to_pending, &revs);
+
+	/*
+	 * Do not fetch missing promisor objects just to select commits;
+	 * if one of them is reachable from a bitmapped commit, building
+	 * the bitmap will complain about the missing closure instead.
+	 */
+	fetch_if_missing = 0;
+	revs.exclude_promisor_objects = 1;
+
+	if (prepare_revision_walk(&revs))
+		die(_("revision walk setup failed"));
+
+	traverse_commit_list(&revs, bitmap_show_commit, NULL, &cb);
+	if (indexed_commits_nr_p)
+		*indexed_commits_nr_p = cb.commits_nr;
+
+	return cb.commits;
+}
+
+static int write_midx_bitmap(const char *object_dir,
+			     const unsigned char *midx_hash,
+			     struct write_midx_context *ctx,
+			     unsigned flags)
+{
+	struct packing_data pdata;
+	struct pack_idx_entry **index;
+	struct commit **commits = NULL;
+	uint32_t i, commits_nr;
+	uint16_t options = 0;
+	int lookup_table = 0;
+	char *bitmap_name = midx_bitmap_filename(object_dir, midx_hash);
+
+	if (!git_config_get_bool("pack.writebitmaplookuptable", &lookup_table) &&
+	    lookup_table)
+		options |= BITMAP_OPT_LOOKUP_TABLE;
+
+	prepare_midx_packing_data(&pdata, ctx);
+
+	commits = find_commits_for_midx_bitmap(&commits_nr, &pdata);
+
+	/*
+	 * Build the type index over the pseudo-pack order, which is the
+	 * order the objects were added to 'pdata' in.
+	 */
+	ALLOC_ARRAY(index, pdata.nr_objects);
+	for (i = 0; i < pdata.nr_objects; i++)
+		index[i] = &pdata.objects[i].idx;
+
+	bitmap_writer_show_progress(flags & MIDX_PROGRESS);
+	bitmap_writer_build_type_index(&pdata, index, pdata.nr_objects);
+
+	/*
+	 * bitmap_writer_finish() expects the objects in lexicographic
+	 * order, which 'pack_order' gives us without re-sorting. The
+	 * single-pack code goes through the same re-ordering, as
+	 * write_idx_file() sorts the list between the two calls.
+	 */
+	for (i = 0; i < pdata.nr_objects; i++)
+		index[ctx->pack_order[i]] = &pdata.objects[i].idx;
+
+	bitmap_writer_select_commits(commits, commits_nr, -1);
+	bitmap_writer_build(&pdata);
+
+	bitmap_writer_set_checksum((unsigned char *)midx_hash);
+	bitmap_writer_finish(index, pdata.nr_objects, bitmap_name, options);
+
+	free(index);
+	free(commits);
+	free(bitmap_name);
+	clear_packing_data(&pdata);
+
+	return 0;
+}
+
+struct clear_midx_data {
+	char *keep;
+	const char *ext;
+};
+
+static void clear_midx_file_ext(const char *full_path, size_t full_path_len,
+				const char *file_name, void *_data)
+{
+	struct clear_midx_data *data = _data;
+
+	if (!(starts_with(file_name, "multi-pack-index-") &&
+	      ends_with(file_name, data->ext)))
+		return;
+	if (data->keep && !strcmp(data->keep, file_name))
+		return;
+
+	if (unlink(full_path))
+		die_errno(_("failed to remove %s"), full_path);
+}
+
+/*
+ * Remove every "multi-pack-index-<hash><ext>" file in the pack
+ * directory, except the one matching 'keep_hash' (if given).
+ */
+static void clear_midx_files_ext(const char *object_dir, const char *ext,
+				 const unsigned char *keep_hash)
+{
+	struct clear_midx_data data;
+	memset(&data, 0, sizeof(struct clear_midx_data));
+
+	if (keep_hash)
+		data.keep = xstrfmt("multi-pack-index-%s%s",
+				    hash_to_hex(keep_hash), ext);
+	data.ext = ext;
+
+	for_each_file_in_pack_dir(object_dir,
+				  clear_midx_file_ext,
+				  &data);
+
+	free(data.keep);
+}
+
+static int midx_bitmap_exists(struct multi_pack_index *m)
+{
+	char *bitmap_name = get_midx_bitmap_filename(m);
+	int ret = file_exists(bitmap_name);
+	free(bitmap_name);
+	return ret;
+}
+
+/*
+ * Make sure that 'info' has a packed_git for the pack it describes,
+ * which is not the case for packs carried over from an existing MIDX.
+ */
+static int open_pack_info(const char *object_dir, struct pack_info *info)
+{
+	struct strbuf pack_name = STRBUF_INIT;
+
+	if (info->p)
+		return 0;
+
+	strbuf_addf(&pack_name, "%s/pack/%s", object_dir, info->pack_name);
+	info->p = add_packed_git(pack_name.buf, pack_name.len, 0);
+	strbuf_release(&pack_name);
+
+	if (!info->p || open_pack_index(info->p))
+		return error(_("could not load pack %s"), info->pack_name);
+	return 0;
+}
+
 static int write_midx_internal(const char *object_dir, struct multi_pack_index *m,
-			       struct string_list *packs_to_drop, unsigned flags)
+			       struct string_list *packs_to_drop,
+			       const char *preferred_pack_name,
+			       unsigned flags)
 {
 	char *midx_name;
+	unsigned char midx_hash[GIT_MAX_RAWSZ];
 	uint32_t i;
 	struct hashfile *f = NULL;
 	struct lock_file lk;
@@ -825,10 +1167,67 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 	for_each_file_in_pack_dir(object_dir, add_pack_to_midx, &ctx);
 	stop_progress(&ctx.progress);
 
-	if (ctx.m && ctx.nr == ctx.m->num_packs && !packs_to_drop)
+	if (ctx.m && ctx.nr == ctx.m->num_packs && !packs_to_drop &&
+	    !preferred_pack_name &&
+	    (!(flags & MIDX_WRITE_BITMAP) || midx_bitmap_exists(ctx.m)))
 		goto cleanup;
 
-	ctx.entries = get_sorted_entries(ctx.m, ctx.info, ctx.nr, &ctx.entries_nr);
+	ctx.preferred_pack_idx = -1;
+	if (preferred_pack_name) {
+		for (i = 0; i < ctx.nr; i++) {
+			if (!cmp_idx_or_pack_name(preferred_pack_name,
+						  ctx.info[i].pack_name)) {
+				ctx.preferred_pack_idx = i;
+				break;
+			}
+		}
+
+		if (ctx.preferred_pack_idx == -1) {
+			error(_("unknown preferred pack: '%s'"),
+			      preferred_pack_name);
+			result = 1;
+			goto cleanup;
+		}
+	} else if (flags & MIDX_WRITE_BITMAP) {
+		/*
+		 * Without an explicit choice, prefer the oldest non-empty
+		 * pack, which is the most likely to contain the objects
+		 * that will be requested (and reused) the most.
+		 */
+		time_t oldest = 0;
+
+		for (i = 0; i < ctx.nr; i++) {
+			struct packed_git *p;
+
+			if (open_pack_info(object_dir, &ctx.info[i])) {
+				result = 1;
+				goto cleanup;
+			}
+			p = ctx.info[i].p;
+			if (!p->num_objects)
+				continue;
+			if (ctx.preferred_pack_idx == -1 || p->mtime < oldest) {
+				ctx.preferred_pack_idx = i;
+				oldest = p->mtime;
+			}
+		}
+	}
+
+	if (ctx.preferred_pack_idx >= 0) {
+		if (open_pack_info(object_dir, &ctx.info[ctx.preferred_pack_idx])) {
+			result = 1;
+			goto cleanup;
+		}
+		if (!ctx.info[ctx.preferred_pack_idx].p->num_objects) {
+			error(_("cannot select preferred pack %s with no objects"),
+			      ctx.info[ctx.preferred_pack_idx].pack_name);
+			result = 1;
+			goto cleanup;
+		}
+	}
+
+	ctx.entries = get_sorted_entries(ctx.m, ctx.info, ctx.nr, &ctx.entries_nr,
+					 ctx.preferred_pack_idx);
 
 	ctx.large_offsets_needed = 0;
 	for (i = 0; i < ctx.entries_nr; i++) {
@@ -889,6 +1288,13 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 			pack_name_concat_len += strlen(ctx.info[i].pack_name) + 1;
 	}
 
+	if (ctx.preferred_pack_idx >= 0 &&
+	    ctx.pack_perm[ctx.preferred_pack_idx] == PACK_EXPIRED) {
+		error(_("cannot drop the preferred pack %s"), preferred_pack_name);
+		result = 1;
+		goto cleanup;
+	}
+
 	if (pack_name_concat_len % MIDX_CHUNK_ALIGNMENT)
 		pack_name_concat_len += MIDX_CHUNK_ALIGNMENT -
 					(pack_name_concat_len % MIDX_CHUNK_ALIGNMENT);
@@ -924,13 +1330,32 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 			(size_t)ctx.num_large_offsets * MIDX_CHUNK_LARGE_OFFSET_WIDTH,
 			write_midx_large_offsets);
 
+	if (flags & MIDX_WRITE_BITMAP) {
+		ctx.pack_order = midx_pack_order(&ctx);
+		add_chunk(cf, MIDX_CHUNKID_REVINDEX,
+			  (size_t)ctx.entries_nr * sizeof(uint32_t),
+			  write_midx_revindex);
+	}
+
 	write_midx_header(f, get_num_chunks(cf), ctx.nr - dropped_packs);
 	write_chunkfile(cf, &ctx);
 
-	finalize_hashfile(f, NULL, CSUM_FSYNC | CSUM_HASH_IN_STREAM);
+	finalize_hashfile(f, midx_hash, CSUM_FSYNC | CSUM_HASH_IN_STREAM);
 	free_chunkfile(cf);
+
+	if ((flags & MIDX_WRITE_BITMAP) &&
+	    write_midx_bitmap(object_dir, midx_hash, &ctx, flags) < 0) {
+		error(_("could not write multi-pack bitmap"));
+		result = 1;
+		rollback_lock_file(&lk);
+		goto cleanup;
+	}
+
 	commit_lock_file(&lk);
 
+	clear_midx_files_ext(object_dir, ".bitmap",
+			     (flags & MIDX_WRITE_BITMAP) ? midx_hash : NULL);
+
 cleanup:
 	for (i = 0; i < ctx.nr; i++) {
 		if (ctx.info[i].p) {
@@ -943,13 +1368,17 @@ static int write_midx_internal(const char *object_dir, struct multi_pack_index *
 	free(ctx.info);
 	free(ctx.entries);
 	free(ctx.pack_perm);
+	free(ctx.pack_order);
 	free(midx_name);
 	return result;
 }
 
-int write_midx_file(const char *object_dir, unsigned flags)
+int write_midx_file(const char *object_dir,
+		    const char *preferred_pack_name,
+		    unsigned flags)
 {
-	return write_midx_internal(object_dir, NULL, NULL, flags);
+	return write_midx_internal(object_dir, NULL, NULL, preferred_pack_name,
+				   flags);
 }
 
 void clear_midx_file(struct repository *r)
@@ -964,6 +1393,8 @@ void clear_midx_file(struct repository *r)
 	if (remove_path(midx))
 		die(_("failed to clear multi-pack-index at %s"), midx);
 
+	clear_midx_files_ext(r->objects->odb->path, ".bitmap", NULL);
+
 	free(midx);
 }
 
@@ -1184,7 +1615,7 @@ int expire_midx_packs(struct repository *r, const char *object_dir, unsigned fla
 	free(count);
 
 	if (packs_to_drop.nr)
-		result = write_midx_internal(object_dir, m, &packs_to_drop, flags);
+		result = write_midx_internal(object_dir, m, &packs_to_drop, NULL, flags);
 
 	string_list_clear(&packs_to_drop, 0);
 	return result;
@@ -1373,7 +1804,7 @@ int midx_repack(struct repository *r, const char *object_dir, size_t batch_size,
 		goto cleanup;
 	}
 
-	result = write_midx_internal(object_dir, m, NULL, flags);
+	result = write_midx_internal(object_dir, m, NULL, NULL, flags);
 	m = NULL;
 
 cleanup:
@@ -110,7 +110,13 @@ static void hash_index_entry(struct index_state *istate, struct cache_entry *ce)
 		return;
 	ce->ce_flags |= CE_HASHED;
 	hashmap_entry_init(&ce->ent, memihash(ce->name, ce_namelen(ce)));
-	hashmap_add(&istate->name_hash, &ce->ent);
+
+	/*
+	 * Sparse directory entries are not paths that can be looked up
+	 * by name; they only contribute to the directory hash.
+	 */
+	if (!S_ISSPARSEDIR(ce->ce_mode))
+		hashmap_add(&istate->name_hash, &ce->ent);
 
 	if (ignore_case)
 		add_dir_entry(istate, ce);
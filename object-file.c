@@ -1087,19 +1087,20 @@ static int stat_loose_object(struct repository *r, const struct object_id *oid,
 
 /*
  * Like stat_loose_object(), but actually open the object and return the
- * descriptor. See the caveats on the "path" parameter above.
+ * descriptor. Unlike stat_loose_object(), the "path" is built in the
+ * caller-provided "buf", so that several threads may open loose objects
+ * at the same time (the alternates must already have been prepared).
  */
 static int open_loose_object(struct repository *r,
-			     const struct object_id *oid, const char **path)
+			     const struct object_id *oid,
+			     struct strbuf *buf, const char **path)
 {
 	int fd;
 	struct object_directory *odb;
 	int most_interesting_errno = ENOENT;
-	static struct strbuf buf = STRBUF_INIT;
 
-	prepare_alt_odb(r);
 	for (odb = r->objects->odb; odb; odb = odb->next) {
-		*path = odb_loose_path(odb, &buf, oid);
+		*path = odb_loose_path(odb, buf, oid);
 		fd = git_open(*path);
 		if (fd >= 0)
 			return fd;
@@ -1124,6 +1125,25 @@ static int quick_has_loose(struct repository *r,
 	return 0;
 }
 
+static void *map_fd(int fd, const char *path, unsigned long *size)
+{
+	void *map = NULL;
+	struct stat st;
+
+	if (!fstat(fd, &st)) {
+		*size = xsize_t(st.st_size);
+		if (!*size) {
+			/* mmap() is forbidden on empty files */
+			error(_("object file %s is empty"), path);
+			close(fd);
+			return NULL;
+		}
+		map = xmmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	return map;
+}
+
 /*
  * Map the loose object at "path" if it is not NULL, or the path found by
  * searching for a loose object named "oid".
@@ -1131,29 +1151,31 @@ static int quick_has_loose(struct repository *r,
 static void *map_loose_object_1(struct repository *r, const char *path,
 			     const struct object_id *oid, unsigned long *size)
 {
-	void *map;
+	struct strbuf buf = STRBUF_INIT;
+	void *map = NULL;
 	int fd;
 
-	if (path)
+	if (path) {
 		fd = git_open(path);
-	else
-		fd = open_loose_object(r, oid, &path);
-	map = NULL;
-	if (fd >= 0) {
-		struct stat st;
-
-		if (!fstat(fd, &st)) {
-			*size = xsize_t(st.st_size);
-			if (!*size) {
-				/* mmap() is forbidden on empty files */
-				error(_("object file %s is empty"), path);
-				close(fd);
-				return NULL;
-			}
-			map = xmmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
-		}
-		close(fd);
+		if (fd >= 0)
+			map = map_fd(fd, path, size);
+		return map;
 	}
+
+	prepare_alt_odb(r);
+
+	/*
+	 * Opening and mapping the file does not touch any shared state,
+	 * so let other threads read objects while we wait for the
+	 * filesystem.
+	 */
+	obj_read_unlock();
+	fd = open_loose_object(r, oid, &buf, &path);
+	if (fd >= 0)
+		map = map_fd(fd, path, size);
+	obj_read_lock();
+
+	strbuf_release(&buf);
 	return map;
 }
 
@@ -1453,6 +1475,7 @@ void enable_obj_read_lock(void)
 
 	obj_read_use_lock = 1;
 	init_recursive_mutex(&obj_read_mutex);
+	prepare_delta_base_cache();
 }
 
 void disable_obj_read_lock(void)
@@ -618,7 +618,8 @@ static const struct object_id *oid_access(size_t pos, const void *table)
 
 static void write_selected_commits_v1(struct hashfile *f,
 				      struct pack_idx_entry **index,
-				      uint32_t index_nr)
+				      uint32_t index_nr,
+				      off_t *offsets)
 {
 	int i;
 
@@ -630,6 +631,10 @@ static void write_selected_commits_v1(struct hashfile *f,
 
 		if (commit_pos < 0)
 			BUG("trying to write commit not in index");
+		stored->commit_pos = commit_pos;
+
+		if (offsets)
+			offsets[i] = hashfile_total(f);
 
 		hashwrite_be32(f, commit_pos);
 		hashwrite_u8(f, stored->xor_offset);
@@ -639,6 +644,58 @@ static void write_selected_commits_v1(struct hashfile *f,
 	}
 }
 
+static int table_cmp(const void *_va, const void *_vb)
+{
+	uint32_t a = writer.selected[*(uint32_t *)_va].commit_pos;
+	uint32_t b = writer.selected[*(uint32_t *)_vb].commit_pos;
+
+	if (a < b)
+		return -1;
+	if (a > b)
+		return 1;
+	return 0;
+}
+
+/*
+ * Write one (commit position, entry offset, xor row) triplet for each
+ * selected commit, sorted by commit position, so that readers can find
+ * the entry for a single commit without parsing all of the others.
+ */
+static void write_lookup_table(struct hashfile *f, off_t *offsets)
+{
+	uint32_t i;
+	uint32_t *table, *table_inv;
+
+	ALLOC_ARRAY(table, writer.selected_nr);
+	ALLOC_ARRAY(table_inv, writer.selected_nr);
+
+	for (i = 0; i < writer.selected_nr; i++)
+		table[i] = i;
+
+	QSORT(table, writer.selected_nr, table_cmp);
+
+	/* table_inv maps an index into writer.selected to its table row */
+	for (i = 0; i < writer.selected_nr; i++)
+		table_inv[table[i]] = i;
+
+	for (i = 0; i < writer.selected_nr; i++) {
+		struct bitmapped_commit *selected = &writer.selected[table[i]];
+		uint32_t xor_row;
+
+		if (selected->xor_offset)
+			xor_row = table_inv[table[i] - selected->xor_offset];
+		else
+			xor_row = 0xffffffff;
+
+		hashwrite_be32(f, selected->commit_pos);
+		hashwrite_be64(f, (uint64_t)offsets[table[i]]);
+		hashwrite_be32(f, xor_row);
+	}
+
+	free(table);
+	free(table_inv);
+}
+
 static void write_hash_cache(struct hashfile *f,
 			     struct pack_idx_entry **index,
 			     uint32_t index_nr)
@@ -665,6 +722,7 @@ void bitmap_writer_finish(struct pack_idx_entry **index,
 	static uint16_t flags = BITMAP_OPT_FULL_DAG;
 	struct strbuf tmp_file = STRBUF_INIT;
 	struct hashfile *f;
+	off_t *offsets = NULL;
 
 	struct bitmap_disk_header header;
 
@@ -683,7 +741,13 @@ void bitmap_writer_finish(struct pack_idx_entry **index,
 	dump_bitmap(f, writer.trees);
 	dump_bitmap(f, writer.blobs);
 	dump_bitmap(f, writer.tags);
-	write_selected_commits_v1(f, index, index_nr);
+	if (options & BITMAP_OPT_LOOKUP_TABLE)
+		CALLOC_ARRAY(offsets, writer.selected_nr);
+
+	write_selected_commits_v1(f, index, index_nr, offsets);
+
+	if (options & BITMAP_OPT_LOOKUP_TABLE)
+		write_lookup_table(f, offsets);
 
 	if (options & BITMAP_OPT_HASH_CACHE)
 		write_hash_cache(f, index, index_nr);
@@ -696,5 +760,6 @@ void bitmap_writer_finish(struct pack_idx_entry **index,
 	if (rename(tmp_file.buf, filename))
 		die_errno("unable to rename temporary bitmap file to '%s'", filename);
 
+	free(offsets);
 	strbuf_release(&tmp_file);
 }
@@ -13,6 +13,8 @@
 #include "repository.h"
 #include "object-store.h"
 #include "list-objects-filter-options.h"
+#include "midx.h"
+#include "config.h"
 
 /*
  * An entry on the bitmap index, representing the bitmap for a given
@@ -28,14 +30,22 @@ struct stored_bitmap {
 /*
  * The active bitmap index for a repository. By design, repositories only have
  * a single bitmap index available (the index for the biggest packfile in
- * the repository), since bitmap indexes need full closure.
+ * the repository, or the one for its multi-pack-index), since bitmap indexes
+ * need full closure.
  *
  * If there is more than one bitmap index available (e.g. because of alternates),
  * the active bitmap index is the largest one.
  */
 struct bitmap_index {
-	/* Packfile to which this bitmap index belongs to */
+	/*
+	 * The pack or multi-pack index (MIDX) that this bitmap index belongs
+	 * to.
+	 *
+	 * Exactly one of these must be non-NULL; this specifies the object
+	 * order used to interpret this bitmap.
+	 */
 	struct packed_git *pack;
+	struct multi_pack_index *midx;
 
 	/*
 	 * Mark the first `reuse_objects` in the packfile as reused:
@@ -44,6 +54,13 @@ struct bitmap_index {
 	 */
 	uint32_t reuse_objects;
 
+	/*
+	 * The pack from which objects may be reused verbatim: the bitmapped
+	 * pack itself, or the preferred pack of the MIDX, whose objects
+	 * occupy the first bits of a multi-pack bitmap.
+	 */
+	struct packed_git *reuse_pack;
+
 	/* mmapped buffer of the whole bitmap index */
 	unsigned char *map;
 	size_t map_size; /* size of the mmaped buffer */
@@ -70,12 +87,20 @@ struct bitmap_index {
 	/* If not NULL, this is a name-hash cache pointing into map. */
 	uint32_t *hashes;
 
+	/*
+	 * If not NULL, this points into map at the commit lookup table:
+	 * `entry_count` triplets sorted by commit position, which allow
+	 * the bitmap of a single commit to be loaded on demand.
+	 */
+	const unsigned char *table_lookup;
+
 	/*
 	 * Extended index.
 	 *
 	 * When trying to perform bitmap operations with objects that are not
-	 * packed in `pack`, these objects are added to this "fake index" and
-	 * are assumed to appear at the end of the packfile for all operations
+	 * packed in `pack` (or `midx`), these objects are added to this "fake
+	 * index" and are assumed to appear at the end of the packfile for all
+	 * operations
 	 */
 	struct eindex {
 		struct object **objects;
@@ -94,6 +119,13 @@ struct bitmap_index {
 	unsigned int version;
 };
 
+static uint32_t bitmap_num_objects(struct bitmap_index *index)
+{
+	if (index->midx)
+		return index->midx->num_objects;
+	return index->pack->num_objects;
+}
+
 static struct ewah_bitmap *lookup_stored_bitmap(struct stored_bitmap *st)
 {
 	struct ewah_bitmap *parent;
@@ -153,9 +185,11 @@ static int load_bitmap_header(struct bitmap_index *index)
 	/* Parse known bitmap format options */
 	{
 		uint32_t flags = ntohs(header->options);
-		size_t cache_size = st_mult(index->pack->num_objects, sizeof(uint32_t));
+		size_t cache_size = st_mult(bitmap_num_objects(index), sizeof(uint32_t));
 		unsigned char *index_end = index->map + index->map_size - the_hash_algo->rawsz;
 
+		index->entry_count = ntohl(header->entry_count);
+
 		if ((flags & BITMAP_OPT_FULL_DAG) == 0)
 			return error("Unsupported options for bitmap index file "
 				"(Git requires BITMAP_OPT_FULL_DAG)");
@@ -166,9 +200,22 @@ static int load_bitmap_header(struct bitmap_index *index)
 			index->hashes = (void *)(index_end - cache_size);
 			index_end -= cache_size;
 		}
+
+		if (flags & BITMAP_OPT_LOOKUP_TABLE) {
+			size_t table_size = st_mult(index->entry_count,
+						    BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH);
+			if (table_size > index_end - index->map - header_size)
+				return error("corrupted bitmap index file (too short to fit lookup table)");
+			if (git_env_bool("GIT_TEST_READ_COMMIT_TABLE", 1))
+				index->table_lookup = index_end - table_size;
+			index_end -= table_size;
+		}
 	}
 
-	index->entry_count = ntohl(header->entry_count);
+	if (index->midx &&
+	    !hasheq(header->checksum, get_midx_checksum(index->midx)))
+		return error("checksum doesn't match in MIDX and bitmap");
+
 	index->map_pos += header_size;
 	return 0;
 }
@@ -215,6 +262,17 @@ static inline uint8_t read_u8(const unsigned char *buffer, size_t *pos)
 	return buffer[(*pos)++];
 }
 
+static int nth_bitmap_commit_oid(struct bitmap_index *index,
+				 struct object_id *oid, uint32_t pos)
+{
+	if (index->midx) {
+		if (!nth_midxed_object_oid(oid, index->midx, pos))
+			return -1;
+		return 0;
+	}
+	return nth_packed_object_id(oid, index->pack, pos);
+}
+
 #define MAX_XOR_OFFSET 160
 
 static int load_bitmap_entries_v1(struct bitmap_index *index)
@@ -236,7 +294,7 @@ static int load_bitmap_entries_v1(struct bitmap_index *index)
 		xor_offset = read_u8(index->map, &index->map_pos);
 		flags = read_u8(index->map, &index->map_pos);
 
-		if (nth_packed_object_id(&oid, index->pack, commit_idx_pos) < 0)
+		if (nth_bitmap_commit_oid(index, &oid, commit_idx_pos) < 0)
 			return error("corrupt ewah bitmap: commit index %u out of range",
 				     (unsigned)commit_idx_pos);
 
@@ -270,6 +328,59 @@ static char *pack_bitmap_filename(struct packed_git *p)
 	return xstrfmt("%.*s.bitmap", (int)len, p->pack_name);
 }
 
+static int open_midx_bitmap_1(struct bitmap_index *bitmap_git,
+			      struct multi_pack_index *midx)
+{
+	struct stat st;
+	char *bitmap_name = get_midx_bitmap_filename(midx);
+	int fd = git_open(bitmap_name);
+
+	if (fd < 0) {
+		free(bitmap_name);
+		return -1;
+	}
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		free(bitmap_name);
+		return -1;
+	}
+
+	if (bitmap_git->pack || bitmap_git->midx) {
+		warning("ignoring extra bitmap file: %s", bitmap_name);
+		close(fd);
+		free(bitmap_name);
+		return -1;
+	}
+
+	if (load_midx_revindex(midx) < 0) {
+		warning("multi-pack bitmap is missing required reverse index");
+		close(fd);
+		free(bitmap_name);
+		return -1;
+	}
+
+	bitmap_git->midx = midx;
+	bitmap_git->map_size = xsize_t(st.st_size);
+	bitmap_git->map = xmmap(NULL, bitmap_git->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	bitmap_git->map_pos = 0;
+	close(fd);
+
+	if (load_bitmap_header(bitmap_git) < 0) {
+		munmap(bitmap_git->map, bitmap_git->map_size);
+		bitmap_git->map = NULL;
+		bitmap_git->map_size = 0;
+		bitmap_git->midx = NULL;
+		free(bitmap_name);
+		return -1;
+	}
+
+	trace2_data_string("bitmap", the_repository, "opened bitmap file",
+			   bitmap_name);
+	free(bitmap_name);
+	return 0;
+}
+
 static int open_pack_bitmap_1(struct bitmap_index *bitmap_git, struct packed_git *packfile)
 {
 	int fd;
@@ -291,7 +402,7 @@ static int open_pack_bitmap_1(struct bitmap_index *bitmap_git, struct packed_git
 		return -1;
 	}
 
-	if (bitmap_git->pack) {
+	if (bitmap_git->pack || bitmap_git->midx) {
 		warning("ignoring extra bitmap file: %s", packfile->pack_name);
 		close(fd);
 		return -1;
@@ -307,19 +418,62 @@ static int open_pack_bitmap_1(struct bitmap_index *bitmap_git, struct packed_git
 		munmap(bitmap_git->map, bitmap_git->map_size);
 		bitmap_git->map = NULL;
 		bitmap_git->map_size = 0;
+		bitmap_git->pack = NULL;
 		return -1;
 	}
 
+	trace2_data_string("bitmap", the_repository, "opened bitmap file",
+			   packfile->pack_name);
 	return 0;
 }
 
-static int load_pack_bitmap(struct bitmap_index *bitmap_git)
+static int load_reverse_index(struct bitmap_index *bitmap_git)
+{
+	if (bitmap_git->midx) {
+		uint32_t i;
+
+		if (load_midx_revindex(bitmap_git->midx) < 0)
+			return -1;
+
+		/*
+		 * Objects are reported by their pack and offset, so make
+		 * sure that every pack in the MIDX is available.
+		 */
+		for (i = 0; i < bitmap_git->midx->num_packs; i++) {
+			if (prepare_midx_pack(the_repository, bitmap_git->midx, i))
+				return error("could not open pack %s",
+					     bitmap_git->midx->pack_names[i]);
+		}
+
+		/*
+		 * The preferred pack owns the first object in pseudo-pack
+		 * order; only its objects can be reused verbatim.
+		 */
+		if (bitmap_git->midx->num_objects) {
+			uint32_t first = pack_pos_to_midx(bitmap_git->midx, 0);
+			struct packed_git *preferred = bitmap_git->midx->packs[
+				nth_midxed_pack_int_id(bitmap_git->midx, first)];
+
+			if (!open_pack_index(preferred) &&
+			    !load_pack_revindex(preferred))
+				bitmap_git->reuse_pack = preferred;
+		}
+		return 0;
+	}
+
+	if (load_pack_revindex(bitmap_git->pack))
+		return -1;
+	bitmap_git->reuse_pack = bitmap_git->pack;
+	return 0;
+}
+
+static int load_bitmap(struct bitmap_index *bitmap_git)
 {
 	assert(bitmap_git->map);
 
 	bitmap_git->bitmaps = kh_init_oid_map();
 	bitmap_git->ext_index.positions = kh_init_oid_pos();
-	if (load_pack_revindex(bitmap_git->pack))
+	if (load_reverse_index(bitmap_git))
 		goto failed;
 
 	if (!(bitmap_git->commits = read_bitmap_1(bitmap_git)) ||
@@ -328,7 +482,14 @@ static int load_pack_bitmap(struct bitmap_index *bitmap_git)
 		!(bitmap_git->tags = read_bitmap_1(bitmap_git)))
 		goto failed;
 
-	if (load_bitmap_entries_v1(bitmap_git) < 0)
+	/*
+	 * With a lookup table, the commit bitmaps are read on demand by
+	 * bitmap_for_commit() instead.
+	 */
+	if (bitmap_git->table_lookup)
+		trace2_data_intmax("bitmap", the_repository, "lookup_table_entries",
+				   bitmap_git->entry_count);
+	else if (load_bitmap_entries_v1(bitmap_git) < 0)
 		goto failed;
 
 	return 0;
@@ -363,11 +524,39 @@ static int open_pack_bitmap(struct repository *r,
 	return ret;
 }
 
+static int open_midx_bitmap(struct repository *r,
+			    struct bitmap_index *bitmap_git)
+{
+	struct multi_pack_index *midx;
+
+	assert(!bitmap_git->map);
+
+	for (midx = get_multi_pack_index(r); midx; midx = midx->next) {
+		if (!open_midx_bitmap_1(bitmap_git, midx))
+			return 0;
+	}
+	return -1;
+}
+
+/*
+ * Prefer a bitmap of the multi-pack-index over any single-pack bitmap, as
+ * it covers (at least) as many objects.
+ */
+static int open_bitmap(struct repository *r,
+		       struct bitmap_index *bitmap_git)
+{
+	assert(!bitmap_git->map);
+
+	if (!open_midx_bitmap(r, bitmap_git))
+		return 0;
+	return open_pack_bitmap(r, bitmap_git);
+}
+
 struct bitmap_index *prepare_bitmap_git(struct repository *r)
 {
 	struct bitmap_index *bitmap_git = xcalloc(1, sizeof(*bitmap_git));
 
-	if (!open_pack_bitmap(r, bitmap_git) && !load_pack_bitmap(bitmap_git))
+	if (!open_bitmap(r, bitmap_git) && !load_bitmap(bitmap_git))
 		return bitmap_git;
 
 	free_bitmap_index(bitmap_git);
@@ -380,13 +569,178 @@ struct include_data {
 	struct bitmap *seen;
 };
 
+struct bitmap_lookup_table_triplet {
+	uint32_t commit_pos;
+	uint64_t offset;
+	uint32_t xor_row;
+};
+
+static int bitmap_lookup_table_get_triplet(struct bitmap_index *bitmap_git,
+					   uint32_t row,
+					   struct bitmap_lookup_table_triplet *triplet)
+{
+	const unsigned char *p;
+
+	if (row >= bitmap_git->entry_count)
+		return error("corrupt bitmap lookup table: row %u out of range",
+			     (unsigned)row);
+
+	p = bitmap_git->table_lookup +
+		st_mult(row, BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH);
+	triplet->commit_pos = get_be32(p);
+	triplet->offset = get_be64(p + sizeof(uint32_t));
+	triplet->xor_row = get_be32(p + sizeof(uint32_t) + sizeof(uint64_t));
+	return 0;
+}
+
+/*
+ * Binary search the lookup table for the row of the commit at position
+ * `commit_pos` in the pack (or MIDX). Returns -1 if it has no bitmap.
+ */
+static int bitmap_lookup_table_find_row(struct bitmap_index *bitmap_git,
+					uint32_t commit_pos, uint32_t *row)
+{
+	uint32_t lo = 0, hi = bitmap_git->entry_count;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		uint32_t pos = get_be32(bitmap_git->table_lookup +
+					st_mult(mi, BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH));
+
+		if (pos == commit_pos) {
+			*row = mi;
+			return 0;
+		}
+		if (pos < commit_pos)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return -1;
+}
+
+struct lazy_bitmap_entry {
+	struct object_id oid;
+	struct bitmap_lookup_table_triplet triplet;
+};
+
+/*
+ * Load the bitmap of `commit` through the lookup table, along with any
+ * entries of its XOR chain that have not been loaded yet.
+ */
+static struct stored_bitmap *lazy_bitmap_for_commit(struct bitmap_index *bitmap_git,
+						    struct commit *commit)
+{
+	struct lazy_bitmap_entry *chain = NULL;
+	size_t chain_nr = 0, chain_alloc = 0;
+	struct stored_bitmap *xor_bitmap = NULL;
+	uint32_t commit_pos, row;
+	int found;
+
+	if (bitmap_git->midx)
+		found = bsearch_midx(&commit->object.oid, bitmap_git->midx,
+				     &commit_pos);
+	else
+		found = bsearch_pack(&commit->object.oid, bitmap_git->pack,
+				     &commit_pos);
+	if (!found ||
+	    bitmap_lookup_table_find_row(bitmap_git, commit_pos, &row) < 0)
+		return NULL;
+
+	/*
+	 * Walk down the XOR chain until we hit either its end or an entry
+	 * that has already been loaded, then load the entries in the
+	 * reverse order so that each one can refer to its base.
+	 */
+	for (;;) {
+		struct lazy_bitmap_entry *e;
+		khiter_t hash_pos;
+
+		if (chain_nr > bitmap_git->entry_count) {
+			error("corrupt bitmap lookup table: xor chain too long");
+			goto done;
+		}
+
+		ALLOC_GROW(chain, chain_nr + 1, chain_alloc);
+		e = &chain[chain_nr];
+
+		if (bitmap_lookup_table_get_triplet(bitmap_git, row, &e->triplet) < 0)
+			goto done;
+		if (nth_bitmap_commit_oid(bitmap_git, &e->oid,
+					  e->triplet.commit_pos) < 0) {
+			error("corrupt ewah bitmap: commit index %u out of range",
+			      (unsigned)e->triplet.commit_pos);
+			goto done;
+		}
+
+		hash_pos = kh_get_oid_map(bitmap_git->bitmaps, e->oid);
+		if (hash_pos < kh_end(bitmap_git->bitmaps)) {
+			xor_bitmap = kh_value(bitmap_git->bitmaps, hash_pos);
+			break;
+		}
+
+		chain_nr++;
+		if (e->triplet.xor_row == 0xffffffff)
+			break;
+		row = e->triplet.xor_row;
+	}
+
+	while (chain_nr) {
+		struct lazy_bitmap_entry *e = &chain[--chain_nr];
+		struct ewah_bitmap *bitmap;
+		int flags;
+
+		if (e->triplet.offset > bitmap_git->map_size ||
+		    bitmap_git->map_size - e->triplet.offset < 6) {
+			error("corrupt ewah bitmap: truncated header for bitmap of commit \"%s\"",
+			      oid_to_hex(&e->oid));
+			xor_bitmap = NULL;
+			goto done;
+		}
+
+		bitmap_git->map_pos = e->triplet.offset;
+		if (read_be32(bitmap_git->map, &bitmap_git->map_pos) != e->triplet.commit_pos) {
+			error("corrupt ewah bitmap: commit index mismatch for \"%s\"",
+			      oid_to_hex(&e->oid));
+			xor_bitmap = NULL;
+			goto done;
+		}
+		read_u8(bitmap_git->map, &bitmap_git->map_pos); /* xor_offset */
+		flags = read_u8(bitmap_git->map, &bitmap_git->map_pos);
+
+		bitmap = read_bitmap_1(bitmap_git);
+		if (!bitmap) {
+			xor_bitmap = NULL;
+			goto done;
+		}
+
+		xor_bitmap = store_bitmap(bitmap_git, bitmap, &e->oid,
+					  xor_bitmap, flags);
+		if (!xor_bitmap)
+			goto done;
+	}
+
+done:
+	free(chain);
+	return xor_bitmap;
+}
+
 struct ewah_bitmap *bitmap_for_commit(struct bitmap_index *bitmap_git,
 				      struct commit *commit)
 {
 	khiter_t hash_pos = kh_get_oid_map(bitmap_git->bitmaps,
 					   commit->object.oid);
-	if (hash_pos >= kh_end(bitmap_git->bitmaps))
-		return NULL;
+	if (hash_pos >= kh_end(bitmap_git->bitmaps)) {
+		struct stored_bitmap *bitmap;
+
+		if (!bitmap_git->table_lookup)
+			return NULL;
+
+		bitmap = lazy_bitmap_for_commit(bitmap_git, commit);
+		if (!bitmap)
+			return NULL;
+		return lookup_stored_bitmap(bitmap);
+	}
 	return lookup_stored_bitmap(kh_value(bitmap_git->bitmaps, hash_pos));
 }
 
@@ -398,7 +752,7 @@ static inline int bitmap_position_extended(struct bitmap_index *bitmap_git,
 
 	if (pos < kh_end(positions)) {
 		int bitmap_pos = kh_value(positions, pos);
-		return bitmap_pos + bitmap_git->pack->num_objects;
+		return bitmap_pos + bitmap_num_objects(bitmap_git);
 	}
 
 	return -1;
@@ -417,10 +771,26 @@ static inline int bitmap_position_packfile(struct bitmap_index *bitmap_git,
 	return pos;
 }
 
+static int bitmap_position_midx(struct bitmap_index *bitmap_git,
+				const struct object_id *oid)
+{
+	uint32_t want, got;
+	if (!bsearch_midx(oid, bitmap_git->midx, &want))
+		return -1;
+
+	if (midx_to_pack_pos(bitmap_git->midx, want, &got) < 0)
+		return -1;
+	return got;
+}
+
 static int bitmap_position(struct bitmap_index *bitmap_git,
 			   const struct object_id *oid)
 {
-	int pos = bitmap_position_packfile(bitmap_git, oid);
+	int pos;
+	if (bitmap_git->midx)
+		pos = bitmap_position_midx(bitmap_git, oid);
+	else
+		pos = bitmap_position_packfile(bitmap_git, oid);
 	return (pos >= 0) ? pos : bitmap_position_extended(bitmap_git, oid);
 }
 
@@ -450,7 +820,7 @@ static int ext_index_add_object(struct bitmap_index *bitmap_git,
 		bitmap_pos = kh_value(eindex->positions, hash_pos);
 	}
 
-	return bitmap_pos + bitmap_git->pack->num_objects;
+	return bitmap_pos + bitmap_num_objects(bitmap_git);
 }
 
 struct bitmap_show_data {
@@ -646,7 +1016,7 @@ static void show_extended_objects(struct bitmap_index *bitmap_git,
 	for (i = 0; i < eindex->count; ++i) {
 		struct object *obj;
 
-		if (!bitmap_get(objects, bitmap_git->pack->num_objects + i))
+		if (!bitmap_get(objects, bitmap_num_objects(bitmap_git) + i))
 			continue;
 
 		obj = eindex->objects[i];
@@ -710,6 +1080,7 @@ static void show_objects_for_type(
 			continue;
 
 		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
+			struct packed_git *pack;
 			struct object_id oid;
 			uint32_t hash = 0, index_pos;
 			off_t ofs;
@@ -719,14 +1090,25 @@ static void show_objects_for_type(
 
 			offset += ewah_bit_ctz64(word >> offset);
 
-			index_pos = pack_pos_to_index(bitmap_git->pack, pos + offset);
-			ofs = pack_pos_to_offset(bitmap_git->pack, pos + offset);
-			nth_packed_object_id(&oid, bitmap_git->pack, index_pos);
+			if (bitmap_git->midx) {
+				struct multi_pack_index *m = bitmap_git->midx;
+
+				index_pos = pack_pos_to_midx(m, pos + offset);
+				ofs = nth_midxed_offset(m, index_pos);
+				nth_midxed_object_oid(&oid, m, index_pos);
+				pack = m->packs[nth_midxed_pack_int_id(m, index_pos)];
+			} else {
+				pack = bitmap_git->pack;
+
+				index_pos = pack_pos_to_index(pack, pos + offset);
+				ofs = pack_pos_to_offset(pack, pos + offset);
+				nth_packed_object_id(&oid, pack, index_pos);
+			}
 
 			if (bitmap_git->hashes)
 				hash = get_be32(bitmap_git->hashes + index_pos);
 
-			show_reach(&oid, object_type, 0, hash, bitmap_git->pack, ofs);
+			show_reach(&oid, object_type, 0, hash, pack, ofs);
 		}
 	}
 }
@@ -738,7 +1120,10 @@ static int in_bitmapped_pack(struct bitmap_index *bitmap_git,
 		struct object *object = roots->item;
 		roots = roots->next;
 
-		if (find_pack_entry_one(object->oid.hash, bitmap_git->pack) > 0)
+		if (bitmap_git->midx) {
+			if (bsearch_midx(&object->oid, bitmap_git->midx, NULL))
+				return 1;
+		} else if (find_pack_entry_one(object->oid.hash, bitmap_git->pack) > 0)
 			return 1;
 	}
 
@@ -807,7 +1192,7 @@ static void filter_bitmap_exclude_type(struct bitmap_index *bitmap_git,
 	 * individually.
 	 */
 	for (i = 0; i < eindex->count; i++) {
-		uint32_t pos = i + bitmap_git->pack->num_objects;
+		uint32_t pos = i + bitmap_num_objects(bitmap_git);
 		if (eindex->objects[i]->type == type &&
 		    bitmap_get(to_filter, pos) &&
 		    !bitmap_get(tips, pos))
@@ -828,23 +1213,39 @@ static void filter_bitmap_blob_none(struct bitmap_index *bitmap_git,
 static unsigned long get_size_by_pos(struct bitmap_index *bitmap_git,
 				     uint32_t pos)
 {
-	struct packed_git *pack = bitmap_git->pack;
 	unsigned long size;
 	struct object_info oi = OBJECT_INFO_INIT;
 
 	oi.sizep = &size;
 
-	if (pos < pack->num_objects) {
-		off_t ofs = pack_pos_to_offset(pack, pos);
+	if (pos < bitmap_num_objects(bitmap_git)) {
+		struct packed_git *pack;
+		off_t ofs;
+
+		if (bitmap_git->midx) {
+			uint32_t midx_pos = pack_pos_to_midx(bitmap_git->midx, pos);
+			uint32_t pack_id = nth_midxed_pack_int_id(bitmap_git->midx, midx_pos);
+
+			pack = bitmap_git->midx->packs[pack_id];
+			ofs = nth_midxed_offset(bitmap_git->midx, midx_pos);
+		} else {
+			pack = bitmap_git->pack;
+			ofs = pack_pos_to_offset(pack, pos);
+		}
+
 		if (packed_object_info(the_repository, pack, ofs, &oi) < 0) {
 			struct object_id oid;
-			nth_packed_object_id(&oid, pack,
-					     pack_pos_to_index(pack, pos));
+			if (bitmap_git->midx)
+				nth_midxed_object_oid(&oid, bitmap_git->midx,
+						      pack_pos_to_midx(bitmap_git->midx, pos));
+			else
+				nth_packed_object_id(&oid, pack,
+						     pack_pos_to_index(pack, pos));
 			die(_("unable to get size of %s"), oid_to_hex(&oid));
 		}
 	} else {
 		struct eindex *eindex = &bitmap_git->ext_index;
-		struct object *obj = eindex->objects[pos - pack->num_objects];
+		struct object *obj = eindex->objects[pos - bitmap_num_objects(bitmap_git)];
 		if (oid_object_info_extended(the_repository, &obj->oid, &oi, 0) < 0)
 			die(_("unable to get size of %s"), oid_to_hex(&obj->oid));
 	}
@@ -886,7 +1287,7 @@ static void filter_bitmap_blob_limit(struct bitmap_index *bitmap_git,
 	}
 
 	for (i = 0; i < eindex->count; i++) {
-		uint32_t pos = i + bitmap_git->pack->num_objects;
+		uint32_t pos = i + bitmap_num_objects(bitmap_git);
 		if (eindex->objects[i]->type == OBJ_BLOB &&
 		    bitmap_get(to_filter, pos) &&
 		    !bitmap_get(tips, pos) &&
@@ -979,7 +1380,7 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs,
 	/* try to open a bitmapped pack, but don't parse it yet
 	 * because we may not need to use it */
 	CALLOC_ARRAY(bitmap_git, 1);
-	if (open_pack_bitmap(revs->repo, bitmap_git) < 0)
+	if (open_bitmap(revs->repo, bitmap_git) < 0)
 		goto cleanup;
 
 	for (i = 0; i < revs->pending.nr; ++i) {
@@ -1022,7 +1423,7 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs,
 	 * from disk. this is the point of no return; after this the rev_list
 	 * becomes invalidated and we must perform the revwalk through bitmaps
 	 */
-	if (load_pack_bitmap(bitmap_git) < 0)
+	if (load_bitmap(bitmap_git) < 0)
 		goto cleanup;
 
 	object_array_clear(&revs->pending);
@@ -1064,20 +1465,27 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs,
 	return NULL;
 }
 
+/*
+ * Bit positions below the number of objects in `reuse_pack` are also pack
+ * positions within it: for a multi-pack bitmap, the objects of the preferred
+ * pack come first in pseudo-pack order, and every one of them is selected
+ * from that pack by the MIDX.
+ */
 static void try_partial_reuse(struct bitmap_index *bitmap_git,
 			      size_t pos,
 			      struct bitmap *reuse,
 			      struct pack_window **w_curs)
 {
+	struct packed_git *pack = bitmap_git->reuse_pack;
 	off_t offset, header;
 	enum object_type type;
 	unsigned long size;
 
-	if (pos >= bitmap_git->pack->num_objects)
+	if (pos >= pack->num_objects)
 		return; /* not actually in the pack */
 
-	offset = header = pack_pos_to_offset(bitmap_git->pack, pos);
-	type = unpack_object_header(bitmap_git->pack, w_curs, &offset, &size);
+	offset = header = pack_pos_to_offset(pack, pos);
+	type = unpack_object_header(pack, w_curs, &offset, &size);
 	if (type < 0)
 		return; /* broken packfile, punt */
 
@@ -1093,11 +1501,11 @@ static void try_partial_reuse(struct bitmap_index *bitmap_git,
 		 * and the normal slow path will complain about it in
 		 * more detail.
 		 */
-		base_offset = get_delta_base(bitmap_git->pack, w_curs,
+		base_offset = get_delta_base(pack, w_curs,
 					     &offset, type, header);
 		if (!base_offset)
 			return;
-		if (offset_to_pack_pos(bitmap_git->pack, base_offset, &base_pos) < 0)
+		if (offset_to_pack_pos(pack, base_offset, &base_pos) < 0)
 			return;
 
 		/*
@@ -1143,12 +1551,15 @@ int reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
 
 	assert(result);
 
+	if (!bitmap_git->reuse_pack)
+		return -1;
+
 	while (i < result->word_alloc && result->words[i] == (eword_t)~0)
 		i++;
 
 	/* Don't mark objects not in the packfile */
-	if (i > bitmap_git->pack->num_objects / BITS_IN_EWORD)
-		i = bitmap_git->pack->num_objects / BITS_IN_EWORD;
+	if (i > bitmap_git->reuse_pack->num_objects / BITS_IN_EWORD)
+		i = bitmap_git->reuse_pack->num_objects / BITS_IN_EWORD;
 
 	reuse = bitmap_word_alloc(i);
 	memset(reuse->words, 0xFF, i * sizeof(eword_t));
@@ -1179,7 +1590,7 @@ int reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
 	 * need to be handled separately.
 	 */
 	bitmap_and_not(result, reuse);
-	*packfile_out = bitmap_git->pack;
+	*packfile_out = bitmap_git->reuse_pack;
 	*reuse_out = reuse;
 	return 0;
 }
@@ -1232,7 +1643,7 @@ static uint32_t count_object_type(struct bitmap_index *bitmap_git,
 
 	for (i = 0; i < eindex->count; ++i) {
 		if (eindex->objects[i]->type == type &&
-			bitmap_get(objects, bitmap_git->pack->num_objects + i))
+			bitmap_get(objects, bitmap_num_objects(bitmap_git) + i))
 			count++;
 	}
 
@@ -1387,15 +1798,19 @@ uint32_t *create_bitmap_mapping(struct bitmap_index *bitmap_git,
 	uint32_t i, num_objects;
 	uint32_t *reposition;
 
-	num_objects = bitmap_git->pack->num_objects;
+	num_objects = bitmap_num_objects(bitmap_git);
 	CALLOC_ARRAY(reposition, num_objects);
 
 	for (i = 0; i < num_objects; ++i) {
 		struct object_id oid;
 		struct object_entry *oe;
 
-		nth_packed_object_id(&oid, bitmap_git->pack,
-				     pack_pos_to_index(bitmap_git->pack, i));
+		if (bitmap_git->midx)
+			nth_midxed_object_oid(&oid, bitmap_git->midx,
+					      pack_pos_to_midx(bitmap_git->midx, i));
+		else
+			nth_packed_object_id(&oid, bitmap_git->pack,
+					     pack_pos_to_index(bitmap_git->pack, i));
 		oe = packlist_find(mapping, &oid);
 
 		if (oe)
@@ -1435,7 +1850,6 @@ static off_t get_disk_usage_for_type(struct bitmap_index *bitmap_git,
 				     enum object_type object_type)
 {
 	struct bitmap *result = bitmap_git->result;
-	struct packed_git *pack = bitmap_git->pack;
 	off_t total = 0;
 	struct ewah_iterator it;
 	eword_t filter;
@@ -1459,8 +1873,28 @@ static off_t get_disk_usage_for_type(struct bitmap_index *bitmap_git,
 
 			offset += ewah_bit_ctz64(word >> offset);
 			pos = base + offset;
-			total += pack_pos_to_offset(pack, pos + 1) -
-				 pack_pos_to_offset(pack, pos);
+
+			if (bitmap_git->midx) {
+				struct multi_pack_index *m = bitmap_git->midx;
+				struct packed_git *pack;
+				struct object_id oid;
+				uint32_t midx_pos = pack_pos_to_midx(m, pos);
+				uint32_t pack_pos;
+				off_t ofs = nth_midxed_offset(m, midx_pos);
+
+				pack = m->packs[nth_midxed_pack_int_id(m, midx_pos)];
+				if (offset_to_pack_pos(pack, ofs, &pack_pos) < 0)
+					die(_("could not find %s in pack %s at offset %"PRIuMAX),
+					    oid_to_hex(nth_midxed_object_oid(&oid, m, midx_pos)),
+					    pack->pack_name, (uintmax_t)ofs);
+
+				total += pack_pos_to_offset(pack, pack_pos + 1) - ofs;
+			} else {
+				struct packed_git *pack = bitmap_git->pack;
+
+				total += pack_pos_to_offset(pack, pos + 1) -
+					 pack_pos_to_offset(pack, pos);
+			}
 		}
 	}
 
@@ -1470,7 +1904,6 @@ static off_t get_disk_usage_for_type(struct bitmap_index *bitmap_git,
 static off_t get_disk_usage_for_extended(struct bitmap_index *bitmap_git)
 {
 	struct bitmap *result = bitmap_git->result;
-	struct packed_git *pack = bitmap_git->pack;
 	struct eindex *eindex = &bitmap_git->ext_index;
 	off_t total = 0;
 	struct object_info oi = OBJECT_INFO_INIT;
@@ -1482,7 +1915,7 @@ static off_t get_disk_usage_for_extended(struct bitmap_index *bitmap_git)
 	for (i = 0; i < eindex->count; i++) {
 		struct object *obj = eindex->objects[i];
 
-		if (!bitmap_get(result, pack->num_objects + i))
+		if (!bitmap_get(result, bitmap_num_objects(bitmap_git) + i))
 			continue;
 
 		if (oid_object_info_extended(the_repository, &obj->oid, &oi, 0) < 0)
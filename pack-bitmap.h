@@ -23,9 +23,16 @@ struct bitmap_disk_header {
 
 #define NEEDS_BITMAP (1u<<22)
 
+/*
+ * Width of an entry of the optional commit lookup table: a 4-byte commit
+ * position, an 8-byte offset of its bitmap entry and a 4-byte xor row.
+ */
+#define BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH (sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t))
+
 enum pack_bitmap_opts {
 	BITMAP_OPT_FULL_DAG = 1,
 	BITMAP_OPT_HASH_CACHE = 4,
+	BITMAP_OPT_LOOKUP_TABLE = 16,
 };
 
 enum pack_bitmap_flags {
@@ -0,0 +1,322 @@
+#include "cache.h"
+#include "dir.h"
+#include "pack-objects-cache.h"
+#include "repository.h"
+#include "run-command.h"
+#include "sigchain.h"
+#include "tempfile.h"
+
+/*
+ * A lock that has not been touched for this long belongs to a producer
+ * that is gone; a live one touches its lock at least every few seconds.
+ */
+#define STALE_LOCK_SECONDS 30
+#define TOUCH_INTERVAL_NS (5 * (uint64_t)1000000000)
+
+static int older_than(const struct stat *st, unsigned long seconds)
+{
+	time_t now = time(NULL);
+
+	return now > st->st_mtime &&
+	       (unsigned long)(now - st->st_mtime) > seconds;
+}
+
+static int same_file(const char *path, const struct stat *st)
+{
+	struct stat cur;
+
+	return !stat(path, &cur) &&
+	       cur.st_dev == st->st_dev && cur.st_ino == st->st_ino;
+}
+
+void pack_objects_cache_open(struct repository *r,
+			     const struct pack_objects_cache *cache,
+			     const char *key,
+			     struct pack_objects_cache_entry *e)
+{
+	int tries;
+
+	memset(e, 0, sizeof(*e));
+	e->fd = e->out = -1;
+	e->path = repo_git_path(r, "pack-objects-cache/%s", key);
+	e->lock_path = xstrfmt("%s.lock", e->path);
+
+	/*
+	 * Each round either settles the matter or removes whatever was
+	 * in the way; give up if others keep getting there first.
+	 */
+	for (tries = 0; tries < 3; tries++) {
+		struct stat st;
+		int fd = open(e->path, O_RDONLY);
+
+		if (fd >= 0) {
+			if (!fstat(fd, &st) && !older_than(&st, cache->max_age)) {
+				e->fd = fd;
+				e->state = PACK_OBJECTS_CACHE_HIT;
+				e->done = 1;
+				return;
+			}
+			close(fd);
+			unlink(e->path);
+		}
+
+		if (safe_create_leading_directories(e->path))
+			break;
+		/*
+		 * Not a lockfile: it is the producer's to remove, and we
+		 * must not do it for them when we exit.
+		 */
+		e->out = open(e->lock_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if (e->out >= 0) {
+			e->fd = open(e->lock_path, O_RDONLY);
+			if (e->fd < 0) {
+				close(e->out);
+				e->out = -1;
+				unlink(e->lock_path);
+				break;
+			}
+			e->state = PACK_OBJECTS_CACHE_PRODUCE;
+			return;
+		}
+		if (errno != EEXIST)
+			break;
+
+		/*
+		 * Someone else holds the lock, unless they have just
+		 * finished with it.
+		 */
+		fd = open(e->lock_path, O_RDONLY);
+		if (fd < 0)
+			continue;
+		if (!fstat(fd, &st) && !older_than(&st, STALE_LOCK_SECONDS)) {
+			e->fd = fd;
+			e->state = PACK_OBJECTS_CACHE_FOLLOW;
+			return;
+		}
+		close(fd);
+		unlink(e->lock_path);
+	}
+
+	e->state = PACK_OBJECTS_CACHE_UNUSED;
+}
+
+enum pack_objects_cache_poll pack_objects_cache_poll(struct pack_objects_cache_entry *e)
+{
+	struct stat st;
+	off_t pos;
+
+	if (fstat(e->fd, &st) < 0 || (pos = lseek(e->fd, 0, SEEK_CUR)) < 0)
+		return PACK_OBJECTS_CACHE_ABANDONED;
+	if (st.st_size > pos)
+		return PACK_OBJECTS_CACHE_DATA;
+	if (e->done)
+		return PACK_OBJECTS_CACHE_DONE;
+
+	/*
+	 * Look at the lock before the entry: once the lock is gone,
+	 * the entry is either in place or never will be.
+	 */
+	if (same_file(e->lock_path, &st))
+		return older_than(&st, STALE_LOCK_SECONDS) ?
+			PACK_OBJECTS_CACHE_ABANDONED : PACK_OBJECTS_CACHE_WAIT;
+	if (!same_file(e->path, &st))
+		return PACK_OBJECTS_CACHE_ABANDONED;
+
+	/* it may have grown since we looked */
+	e->done = 1;
+	return pack_objects_cache_poll(e);
+}
+
+struct cache_file {
+	char *name;
+	time_t mtime;
+	off_t size;
+};
+
+static int compare_by_mtime(const void *a_, const void *b_)
+{
+	const struct cache_file *a = a_, *b = b_;
+
+	if (a->mtime != b->mtime)
+		return a->mtime < b->mtime ? -1 : 1;
+	return strcmp(a->name, b->name);
+}
+
+/*
+ * Remove stale locks and entries that are too old, and then the oldest
+ * entries other than `keep` until the rest fit in max_size.
+ */
+static void trim_cache(const struct pack_objects_cache *cache,
+		       const char *dirname, const char *keep)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct cache_file *files = NULL;
+	size_t nr = 0, alloc = 0, i, dirlen;
+	uint64_t total = 0;
+	struct dirent *de;
+	DIR *dir;
+
+	dir = opendir(dirname);
+	if (!dir)
+		return;
+	strbuf_addf(&path, "%s/", dirname);
+	dirlen = path.len;
+
+	while ((de = readdir(dir))) {
+		struct stat st;
+
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, de->d_name);
+		if (lstat(path.buf, &st) || !S_ISREG(st.st_mode))
+			continue;
+
+		if (ends_with(de->d_name, ".lock")) {
+			if (older_than(&st, STALE_LOCK_SECONDS))
+				unlink(path.buf);
+			continue;
+		}
+		if (!strcmp(de->d_name, keep)) {
+			total += st.st_size;
+			continue;
+		}
+		if (older_than(&st, cache->max_age)) {
+			unlink(path.buf);
+			continue;
+		}
+
+		total += st.st_size;
+		ALLOC_GROW(files, nr + 1, alloc);
+		files[nr].name = xstrdup(de->d_name);
+		files[nr].mtime = st.st_mtime;
+		files[nr].size = st.st_size;
+		nr++;
+	}
+	closedir(dir);
+
+	QSORT(files, nr, compare_by_mtime);
+	for (i = 0; i < nr && total > cache->max_size; i++) {
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, files[i].name);
+		if (!unlink(path.buf))
+			total -= files[i].size;
+	}
+
+	for (i = 0; i < nr; i++)
+		free(files[i].name);
+	free(files);
+	strbuf_release(&path);
+}
+
+int pack_objects_cache_start_producer(struct pack_objects_cache_entry *e,
+				      struct child_process *producer)
+{
+	if (e->state != PACK_OBJECTS_CACHE_PRODUCE || e->out < 0)
+		BUG("starting a producer for a pack-objects cache entry we do not produce");
+
+	/* start_command() closes it for us, whether it succeeds or not */
+	producer->out = e->out;
+	e->out = -1;
+	producer->clean_on_exit = 0;
+	if (start_command(producer)) {
+		unlink(e->lock_path);
+		return -1;
+	}
+	return 0;
+}
+
+int pack_objects_cache_produce(struct repository *r,
+			       const struct pack_objects_cache *cache,
+			       const char *key,
+			       struct child_process *pack_objects)
+{
+	char *path = repo_git_path(r, "pack-objects-cache/%s", key);
+	char *lock_path = xstrfmt("%s.lock", path);
+	struct tempfile *lock = register_tempfile(lock_path);
+	struct strbuf input = STRBUF_INIT;
+	uint64_t last_touch;
+	char buf[128];
+	char *slash;
+	int ret = -1;
+
+	/*
+	 * A blank line ends the input of pack-objects --revs, so without
+	 * one the requester died while sending it, and what we did get
+	 * would make a pack with some of the objects missing.
+	 */
+	if (strbuf_read(&input, 0, 0) < 0 || !ends_with(input.buf, "\n\n")) {
+		error("incomplete input for the pack-objects cache");
+		goto out;
+	}
+
+	/* our standard output is the lock, and so is theirs */
+	pack_objects->in = -1;
+	pack_objects->err = -1;
+	if (start_command(pack_objects)) {
+		error("unable to start pack-objects for the pack-objects cache");
+		goto out;
+	}
+	write_in_full(pack_objects->in, input.buf, input.len);
+	close(pack_objects->in);
+
+	/* whoever started us may be gone; keep going regardless */
+	sigchain_push(SIGPIPE, SIG_IGN);
+	last_touch = getnanotime();
+	while (1) {
+		struct pollfd pfd;
+		uint64_t now;
+
+		pfd.fd = pack_objects->err;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 1000) > 0) {
+			ssize_t sz = xread(pack_objects->err, buf, sizeof(buf));
+
+			if (sz <= 0)
+				break;
+			xwrite(2, buf, sz);
+		}
+
+		now = getnanotime();
+		if (now - last_touch > TOUCH_INTERVAL_NS) {
+			utime(lock_path, NULL);
+			last_touch = now;
+		}
+	}
+	sigchain_pop(SIGPIPE);
+	close(pack_objects->err);
+
+	if (finish_command(pack_objects)) {
+		error("git-pack-objects died with error");
+		goto out;
+	}
+	if (rename_tempfile(&lock, path) < 0)
+		goto out;
+
+	slash = (char *)find_last_dir_sep(path);
+	*slash = '\0';
+	trim_cache(cache, path, slash + 1);
+	ret = 0;
+
+out:
+	delete_tempfile(&lock);
+	strbuf_release(&input);
+	free(lock_path);
+	free(path);
+	return ret;
+}
+
+void pack_objects_cache_entry_release(struct pack_objects_cache_entry *e)
+{
+	if (e->fd >= 0)
+		close(e->fd);
+	if (e->out >= 0) {
+		/* the producer was never started */
+		close(e->out);
+		unlink(e->lock_path);
+	}
+	free(e->path);
+	free(e->lock_path);
+	memset(e, 0, sizeof(*e));
+	e->fd = e->out = -1;
+}
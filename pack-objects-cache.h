@@ -0,0 +1,102 @@
+#ifndef PACK_OBJECTS_CACHE_H
+#define PACK_OBJECTS_CACHE_H
+
+struct child_process;
+struct repository;
+
+/*
+ * An on-disk cache of what pack-objects wrote for upload-pack, so that
+ * many clients asking for exactly the same thing (a fleet of CI runners
+ * cloning one commit, say) can share a single pack-objects run.
+ *
+ * Entries live in $GIT_DIR/pack-objects-cache, named after a key that
+ * the caller computes from everything that went into the pack.  While an
+ * entry is being produced it is "<key>.lock", and pack-objects writes
+ * straight into it; requests for the same key read that file as it grows
+ * instead of starting a pack-objects of their own, and take its rename to
+ * "<key>" to mean that it is complete.
+ *
+ * The request that finds neither creates the lock, but hands it to a
+ * producer process of its own and then reads the entry like any other.
+ * That way the entry is finished even if the client that asked for it
+ * first goes away.  The producer touches the lock now and then, so that
+ * one which has died without cleaning up is noticed.
+ */
+struct pack_objects_cache {
+	int enabled;
+	/* evict the oldest entries when they take more than this */
+	unsigned long max_size;
+	/* entries older than this many seconds are not used */
+	unsigned long max_age;
+};
+
+#define PACK_OBJECTS_CACHE_INIT { 0, 1024 * 1024 * 1024, 600 }
+
+enum pack_objects_cache_state {
+	/* the cache cannot be used for this request; do without it */
+	PACK_OBJECTS_CACHE_UNUSED,
+	/* a complete entry */
+	PACK_OBJECTS_CACHE_HIT,
+	/* an entry that another process is producing */
+	PACK_OBJECTS_CACHE_FOLLOW,
+	/* an entry that we are to have produced, by writing it to "out" */
+	PACK_OBJECTS_CACHE_PRODUCE,
+};
+
+struct pack_objects_cache_entry {
+	enum pack_objects_cache_state state;
+	/* the entry is read from here */
+	int fd;
+	/* PRODUCE only, until it is handed to the producer */
+	int out;
+
+	char *path;
+	char *lock_path;
+	unsigned done : 1;
+};
+
+/*
+ * Look up `key` in the cache of `r`, and set up `e` for reading it, or
+ * for producing it if there is no such entry yet.
+ */
+void pack_objects_cache_open(struct repository *r,
+			     const struct pack_objects_cache *cache,
+			     const char *key,
+			     struct pack_objects_cache_entry *e);
+
+enum pack_objects_cache_poll {
+	/* there is more to read from e->fd */
+	PACK_OBJECTS_CACHE_DATA,
+	/* there is nothing more to read yet */
+	PACK_OBJECTS_CACHE_WAIT,
+	/* the whole entry has been read */
+	PACK_OBJECTS_CACHE_DONE,
+	/* the producer went away before finishing the entry */
+	PACK_OBJECTS_CACHE_ABANDONED,
+};
+
+/* See whether there is anything more to read from e->fd; never blocks. */
+enum pack_objects_cache_poll pack_objects_cache_poll(struct pack_objects_cache_entry *e);
+
+/*
+ * PRODUCE only: start `producer`, with e->out as its standard output,
+ * to run pack_objects_cache_produce().  It is not killed when we exit.
+ * Returns -1, having removed the lock, if it could not be started.
+ */
+int pack_objects_cache_start_producer(struct pack_objects_cache_entry *e,
+				      struct child_process *producer);
+
+/*
+ * The producer's side: standard output is the lock of the entry `key`,
+ * and standard input is what to feed `pack_objects`.  Run it to fill the
+ * entry, passing its standard error on, and publish the entry and trim
+ * the cache if it succeeds; otherwise, remove the lock.
+ */
+int pack_objects_cache_produce(struct repository *r,
+			       const struct pack_objects_cache *cache,
+			       const char *key,
+			       struct child_process *pack_objects);
+
+void pack_objects_cache_entry_release(struct pack_objects_cache_entry *e);
+
+#endif /* PACK_OBJECTS_CACHE_H */
@@ -151,6 +151,23 @@ void prepare_packing_data(struct repository *r, struct packing_data *pdata)
 	init_recursive_mutex(&pdata->odb_lock);
 }
 
+void clear_packing_data(struct packing_data *pdata)
+{
+	if (!pdata)
+		return;
+
+	free(pdata->objects);
+	free(pdata->index);
+	free(pdata->in_pack_pos);
+	free(pdata->delta_size);
+	free(pdata->in_pack_by_idx);
+	free(pdata->in_pack);
+	free(pdata->ext_bases);
+	free(pdata->tree_depth);
+	free(pdata->layer);
+	pthread_mutex_destroy(&pdata->odb_lock);
+}
+
 struct object_entry *packlist_alloc(struct packing_data *pdata,
 				    const struct object_id *oid)
 {
@@ -3,6 +3,7 @@
 #include "object-store.h"
 #include "packfile.h"
 #include "config.h"
+#include "midx.h"
 
 struct revindex_entry {
 	off_t offset;
@@ -347,3 +348,76 @@ off_t pack_pos_to_offset(struct packed_git *p, uint32_t pos)
 	else
 		return nth_packed_object_offset(p, pack_pos_to_index(p, pos));
 }
+
+int load_midx_revindex(struct multi_pack_index *m)
+{
+	if (!m->chunk_revindex)
+		return -1;
+	return 0;
+}
+
+uint32_t pack_pos_to_midx(struct multi_pack_index *m, uint32_t pos)
+{
+	if (!m->chunk_revindex)
+		BUG("pack_pos_to_midx: reverse index not yet loaded");
+	if (m->num_objects <= pos)
+		BUG("pack_pos_to_midx: out-of-bounds object at %"PRIu32, pos);
+	return get_be32(m->chunk_revindex + st_mult(pos, sizeof(uint32_t)));
+}
+
+struct midx_pack_key {
+	uint32_t pack;
+	off_t offset;
+};
+
+static void midx_pack_key(struct multi_pack_index *m, uint32_t preferred_pack,
+			  uint32_t at, struct midx_pack_key *key)
+{
+	key->pack = nth_midxed_pack_int_id(m, at);
+	if (key->pack != preferred_pack)
+		key->pack |= (1U << 31);
+	key->offset = nth_midxed_offset(m, at);
+}
+
+static int midx_pack_key_cmp(const struct midx_pack_key *a,
+			     const struct midx_pack_key *b)
+{
+	if (a->pack != b->pack)
+		return a->pack < b->pack ? -1 : 1;
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+	return 0;
+}
+
+int midx_to_pack_pos(struct multi_pack_index *m, uint32_t at, uint32_t *pos)
+{
+	struct midx_pack_key key;
+	uint32_t preferred_pack, lo = 0, hi = m->num_objects;
+
+	if (load_midx_revindex(m) < 0)
+		return -1;
+	if (at >= m->num_objects)
+		return error(_("invalid MIDX object position, MIDX is likely corrupt"));
+
+	/* The preferred pack owns the first object in pseudo-pack order. */
+	preferred_pack = nth_midxed_pack_int_id(m, pack_pos_to_midx(m, 0));
+	midx_pack_key(m, preferred_pack, at, &key);
+
+	while (lo < hi) {
+		const uint32_t mi = lo + (hi - lo) / 2;
+		struct midx_pack_key got;
+		int cmp;
+
+		midx_pack_key(m, preferred_pack, pack_pos_to_midx(m, mi), &got);
+		cmp = midx_pack_key_cmp(&key, &got);
+		if (!cmp) {
+			*pos = mi;
+			return 0;
+		} else if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+
+	return error(_("bad MIDX position for revindex"));
+}
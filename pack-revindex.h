@@ -24,6 +24,7 @@
 #define GIT_TEST_REV_INDEX_DIE_IN_MEMORY "GIT_TEST_REV_INDEX_DIE_IN_MEMORY"
 
 struct packed_git;
+struct multi_pack_index;
 
 /*
  * load_pack_revindex populates the revindex's internal data-structures for the
@@ -71,4 +72,34 @@ uint32_t pack_pos_to_index(struct packed_git *p, uint32_t pos);
  */
 off_t pack_pos_to_offset(struct packed_git *p, uint32_t pos);
 
+/*
+ * A multi-pack-index may carry a reverse index of its own, describing the
+ * "pseudo-pack" order of its objects: the objects of the preferred pack
+ * come first, followed by the objects of every other pack in pack-int-id
+ * order, and each pack's objects are ordered by offset. This is the order
+ * used by multi-pack reachability bitmaps.
+ *
+ * load_midx_revindex returns zero if the MIDX has a reverse index, and a
+ * negative value otherwise.
+ */
+int load_midx_revindex(struct multi_pack_index *m);
+
+/*
+ * pack_pos_to_midx converts the object at pseudo-pack position 'pos' into
+ * its lexicographic position within the MIDX.
+ *
+ * This function runs in constant time.
+ */
+uint32_t pack_pos_to_midx(struct multi_pack_index *m, uint32_t pos);
+
+/*
+ * midx_to_pack_pos converts from the MIDX-relative position 'at' to the
+ * corresponding pseudo-pack position, returning zero on success and a
+ * negative value otherwise.
+ *
+ * This function runs in time O(log N) with the number of objects in the
+ * MIDX.
+ */
+int midx_to_pack_pos(struct multi_pack_index *m, uint32_t at, uint32_t *pos);
+
 #endif
@@ -17,6 +17,7 @@
 #include "midx.h"
 #include "commit-graph.h"
 #include "promisor-remote.h"
+#include "json-writer.h"
 
 char *odb_pack_name(struct strbuf *buf,
 		    const unsigned char *hash,
@@ -1349,10 +1350,17 @@ static enum object_type packed_to_object_type(struct repository *r,
 	goto out;
 }
 
-static struct hashmap delta_base_cache;
-static size_t delta_base_cached;
-
-static LIST_HEAD(delta_base_cache_lru);
+/*
+ * The delta base cache is split into shards, each with its own lock and
+ * LRU list. It can be used without holding obj_read_lock(), so that
+ * threads reading objects in parallel only contend when they hit the same
+ * shard. core.deltaBaseCacheLimit applies to all of the shards together,
+ * so that a single shard may hold bases as big as the old unsharded cache
+ * did. Entries are stamped with a global insertion tick, and going over
+ * the limit evicts from whichever shard holds the oldest entry, so that
+ * the cache as a whole still evicts in about the order it filled up.
+ */
+#define DELTA_BASE_CACHE_SHARDS 16
 
 struct delta_base_cache_key {
 	struct packed_git *p;
@@ -1366,31 +1374,79 @@ struct delta_base_cache_entry {
 	void *data;
 	unsigned long size;
 	enum object_type type;
+	size_t tick;
 };
 
-static unsigned int pack_entry_hash(struct packed_git *p, off_t base_offset)
+struct delta_base_cache_shard {
+	pthread_mutex_t mutex;
+	struct hashmap map;
+	struct list_head lru;
+	size_t oldest; /* tick of the head of "lru", or SIZE_MAX if empty */
+
+	/* statistics, reported through trace2 */
+	uintmax_t hits;
+	uintmax_t misses;
+	uintmax_t evictions;
+};
+
+static struct delta_base_cache_shard delta_base_cache[DELTA_BASE_CACHE_SHARDS];
+static int delta_base_cache_initialized;
+
+/*
+ * The size of all of the shards, and the next insertion tick. They are
+ * shared by all shards, so they are updated with atomic operations where
+ * the compiler has them. Otherwise they fall back to a mutex, which is
+ * taken last, while holding at most one shard's mutex.
+ */
+static size_t delta_base_cached;
+static size_t delta_base_cache_ticks;
+
+#ifdef __ATOMIC_RELAXED
+#define delta_base_cache_atomic_add(var, n) \
+	__atomic_add_fetch((var), (n), __ATOMIC_RELAXED)
+#define delta_base_cache_atomic_load(var) \
+	__atomic_load_n((var), __ATOMIC_RELAXED)
+#define delta_base_cache_atomic_store(var, n) \
+	__atomic_store_n((var), (n), __ATOMIC_RELAXED)
+#else
+static pthread_mutex_t delta_base_cache_atomic_mutex;
+
+static size_t delta_base_cache_atomic_add(size_t *var, size_t n)
 {
-	unsigned int hash;
+	size_t ret;
 
-	hash = (unsigned int)(intptr_t)p + (unsigned int)base_offset;
-	hash += (hash >> 8) + (hash >> 16);
-	return hash;
+	pthread_mutex_lock(&delta_base_cache_atomic_mutex);
+	ret = *var += n;
+	pthread_mutex_unlock(&delta_base_cache_atomic_mutex);
+	return ret;
 }
 
-static struct delta_base_cache_entry *
-get_delta_base_cache_entry(struct packed_git *p, off_t base_offset)
+static size_t delta_base_cache_atomic_load(size_t *var)
 {
-	struct hashmap_entry entry, *e;
-	struct delta_base_cache_key key;
+	return delta_base_cache_atomic_add(var, 0);
+}
 
-	if (!delta_base_cache.cmpfn)
-		return NULL;
+static void delta_base_cache_atomic_store(size_t *var, size_t n)
+{
+	pthread_mutex_lock(&delta_base_cache_atomic_mutex);
+	*var = n;
+	pthread_mutex_unlock(&delta_base_cache_atomic_mutex);
+}
+#endif
 
-	hashmap_entry_init(&entry, pack_entry_hash(p, base_offset));
-	key.p = p;
-	key.base_offset = base_offset;
-	e = hashmap_get(&delta_base_cache, &entry, &key);
-	return e ? container_of(e, struct delta_base_cache_entry, ent) : NULL;
+static int delta_base_cache_over_limit(void)
+{
+	return delta_base_cache_atomic_load(&delta_base_cached) >
+	       delta_base_cache_limit;
+}
+
+static unsigned int pack_entry_hash(struct packed_git *p, off_t base_offset)
+{
+	unsigned int hash;
+
+	hash = (unsigned int)(intptr_t)p + (unsigned int)base_offset;
+	hash += (hash >> 8) + (hash >> 16);
+	return hash;
 }
 
 static int delta_base_cache_key_eq(const struct delta_base_cache_key *a,
@@ -1416,82 +1472,275 @@ static int delta_base_cache_hash_cmp(const void *unused_cmp_data,
 		return !delta_base_cache_key_eq(&a->key, &b->key);
 }
 
+static void trace2_delta_base_cache_statistics_atexit(void)
+{
+	struct json_writer jw = JSON_WRITER_INIT;
+	uintmax_t hits = 0, misses = 0, evictions = 0;
+	int i;
+
+	for (i = 0; i < DELTA_BASE_CACHE_SHARDS; i++) {
+		hits += delta_base_cache[i].hits;
+		misses += delta_base_cache[i].misses;
+		evictions += delta_base_cache[i].evictions;
+	}
+
+	jw_object_begin(&jw, 0);
+	jw_object_intmax(&jw, "hits", hits);
+	jw_object_intmax(&jw, "misses", misses);
+	jw_object_intmax(&jw, "evictions", evictions);
+	jw_end(&jw);
+
+	trace2_data_json("delta_base_cache", the_repository, "statistics", &jw);
+
+	jw_release(&jw);
+}
+
+/*
+ * The cache is set up on first use. Threaded readers get here through
+ * enable_obj_read_lock() before any thread is started.
+ */
+void prepare_delta_base_cache(void)
+{
+	int i;
+
+	if (delta_base_cache_initialized)
+		return;
+
+#ifndef __ATOMIC_RELAXED
+	pthread_mutex_init(&delta_base_cache_atomic_mutex, NULL);
+#endif
+	for (i = 0; i < DELTA_BASE_CACHE_SHARDS; i++) {
+		struct delta_base_cache_shard *shard = &delta_base_cache[i];
+
+		pthread_mutex_init(&shard->mutex, NULL);
+		hashmap_init(&shard->map, delta_base_cache_hash_cmp, NULL, 0);
+		INIT_LIST_HEAD(&shard->lru);
+		shard->oldest = SIZE_MAX;
+	}
+	delta_base_cache_initialized = 1;
+
+	if (trace2_is_enabled())
+		atexit(trace2_delta_base_cache_statistics_atexit);
+}
+
+static struct delta_base_cache_shard *get_delta_base_cache_shard(unsigned int hash)
+{
+	prepare_delta_base_cache();
+
+	/*
+	 * Mix the hash before picking the shard, so that the entries of
+	 * a shard do not all share the low bits its hashmap buckets on.
+	 */
+	return &delta_base_cache[((hash * 2654435769u) >> 16) %
+				 DELTA_BASE_CACHE_SHARDS];
+}
+
+/* The caller must hold the shard's mutex. */
+static struct delta_base_cache_entry *
+get_delta_base_cache_entry(struct delta_base_cache_shard *shard,
+			   unsigned int hash,
+			   struct packed_git *p, off_t base_offset)
+{
+	struct hashmap_entry entry, *e;
+	struct delta_base_cache_key key;
+
+	hashmap_entry_init(&entry, hash);
+	key.p = p;
+	key.base_offset = base_offset;
+	e = hashmap_get(&shard->map, &entry, &key);
+	return e ? container_of(e, struct delta_base_cache_entry, ent) : NULL;
+}
+
 static int in_delta_base_cache(struct packed_git *p, off_t base_offset)
 {
-	return !!get_delta_base_cache_entry(p, base_offset);
+	unsigned int hash = pack_entry_hash(p, base_offset);
+	struct delta_base_cache_shard *shard = get_delta_base_cache_shard(hash);
+	int ret;
+
+	pthread_mutex_lock(&shard->mutex);
+	ret = !!get_delta_base_cache_entry(shard, hash, p, base_offset);
+	pthread_mutex_unlock(&shard->mutex);
+	return ret;
+}
+
+/*
+ * Publish the tick of the shard's oldest entry, which add_delta_base_cache()
+ * reads without taking the shard's mutex. The caller must hold it.
+ */
+static void update_delta_base_cache_oldest(struct delta_base_cache_shard *shard)
+{
+	size_t oldest = SIZE_MAX;
+
+	if (!list_empty(&shard->lru))
+		oldest = list_first_entry(&shard->lru,
+					  struct delta_base_cache_entry,
+					  lru)->tick;
+	delta_base_cache_atomic_store(&shard->oldest, oldest);
 }
 
 /*
  * Remove the entry from the cache, but do _not_ free the associated
  * entry data. The caller takes ownership of the "data" buffer, and
- * should copy out any fields it wants before detaching.
+ * should copy out any fields it wants before detaching. The caller
+ * must hold the shard's mutex.
  */
-static void detach_delta_base_cache_entry(struct delta_base_cache_entry *ent)
+static void detach_delta_base_cache_entry(struct delta_base_cache_shard *shard,
+					  struct delta_base_cache_entry *ent)
 {
-	hashmap_remove(&delta_base_cache, &ent->ent, &ent->key);
+	hashmap_remove(&shard->map, &ent->ent, &ent->key);
 	list_del(&ent->lru);
-	delta_base_cached -= ent->size;
+	update_delta_base_cache_oldest(shard);
+	delta_base_cache_atomic_add(&delta_base_cached, -(size_t)ent->size);
 	free(ent);
 }
 
-static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
-				   off_t base_offset, unsigned long *base_size,
-				   enum object_type *type)
+static inline void release_delta_base_cache(struct delta_base_cache_shard *shard,
+					    struct delta_base_cache_entry *ent)
 {
+	free(ent->data);
+	detach_delta_base_cache_entry(shard, ent);
+}
+
+/*
+ * Look up a delta base in the cache. If found, return a copy of its data
+ * (or, if "take" is set, remove it from the cache and return its data
+ * without copying). Return NULL if it is not cached.
+ */
+static void *lookup_delta_base_cache(struct packed_git *p, off_t base_offset,
+				     enum object_type *type,
+				     unsigned long *base_size, int take)
+{
+	unsigned int hash = pack_entry_hash(p, base_offset);
+	struct delta_base_cache_shard *shard = get_delta_base_cache_shard(hash);
 	struct delta_base_cache_entry *ent;
+	void *data = NULL;
 
-	ent = get_delta_base_cache_entry(p, base_offset);
-	if (!ent)
-		return unpack_entry(r, p, base_offset, type, base_size);
+	pthread_mutex_lock(&shard->mutex);
+	ent = get_delta_base_cache_entry(shard, hash, p, base_offset);
+	if (!ent) {
+		shard->misses++;
+		goto out;
+	}
+	shard->hits++;
 
 	if (type)
 		*type = ent->type;
 	if (base_size)
 		*base_size = ent->size;
-	return xmemdupz(ent->data, ent->size);
+	if (take) {
+		data = ent->data;
+		detach_delta_base_cache_entry(shard, ent);
+	} else {
+		data = xmemdupz(ent->data, ent->size);
+	}
+
+out:
+	pthread_mutex_unlock(&shard->mutex);
+	return data;
 }
 
-static inline void release_delta_base_cache(struct delta_base_cache_entry *ent)
+static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
+				   off_t base_offset, unsigned long *base_size,
+				   enum object_type *type)
 {
-	free(ent->data);
-	detach_delta_base_cache_entry(ent);
+	void *data;
+
+	data = lookup_delta_base_cache(p, base_offset, type, base_size, 0);
+	if (!data)
+		return unpack_entry(r, p, base_offset, type, base_size);
+	return data;
 }
 
 void clear_delta_base_cache(void)
 {
-	struct list_head *lru, *tmp;
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
-		struct delta_base_cache_entry *entry =
-			list_entry(lru, struct delta_base_cache_entry, lru);
-		release_delta_base_cache(entry);
+	int i;
+
+	if (!delta_base_cache_initialized)
+		return;
+
+	for (i = 0; i < DELTA_BASE_CACHE_SHARDS; i++) {
+		struct delta_base_cache_shard *shard = &delta_base_cache[i];
+		struct list_head *lru, *tmp;
+
+		pthread_mutex_lock(&shard->mutex);
+		list_for_each_safe(lru, tmp, &shard->lru) {
+			struct delta_base_cache_entry *entry =
+				list_entry(lru, struct delta_base_cache_entry, lru);
+			release_delta_base_cache(shard, entry);
+		}
+		pthread_mutex_unlock(&shard->mutex);
+	}
+}
+
+/*
+ * Evict the oldest entries of the whole cache, one at a time, until it is
+ * within core.deltaBaseCacheLimit again. Entries inserted at or after
+ * "tick" are kept, so that the base just added stays cached even if it is
+ * bigger than the limit on its own. The shard mutexes are taken one at a
+ * time, and the caller must not hold any of them.
+ */
+static void shrink_delta_base_cache(size_t tick)
+{
+	while (delta_base_cache_over_limit()) {
+		struct delta_base_cache_shard *victim = NULL;
+		size_t oldest = tick;
+		int i;
+
+		for (i = 0; i < DELTA_BASE_CACHE_SHARDS; i++) {
+			struct delta_base_cache_shard *shard = &delta_base_cache[i];
+			size_t t = delta_base_cache_atomic_load(&shard->oldest);
+
+			if (t < oldest) {
+				oldest = t;
+				victim = shard;
+			}
+		}
+		if (!victim)
+			break;
+
+		/*
+		 * The head we saw may have been taken or evicted by another
+		 * thread by now; if so, the next scan sees its new "oldest".
+		 */
+		pthread_mutex_lock(&victim->mutex);
+		if (!list_empty(&victim->lru) &&
+		    delta_base_cache_over_limit()) {
+			struct delta_base_cache_entry *f =
+				list_first_entry(&victim->lru,
+						 struct delta_base_cache_entry,
+						 lru);
+			if (f->tick < tick) {
+				release_delta_base_cache(victim, f);
+				victim->evictions++;
+			}
+		}
+		pthread_mutex_unlock(&victim->mutex);
 	}
 }
 
 static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 	void *base, unsigned long base_size, enum object_type type)
 {
+	unsigned int hash = pack_entry_hash(p, base_offset);
+	struct delta_base_cache_shard *shard = get_delta_base_cache_shard(hash);
 	struct delta_base_cache_entry *ent;
-	struct list_head *lru, *tmp;
+	size_t tick;
+
+	pthread_mutex_lock(&shard->mutex);
 
 	/*
 	 * Check required to avoid redundant entries when more than one thread
 	 * is unpacking the same object, in unpack_entry() (since its phases I
 	 * and III might run concurrently across multiple threads).
 	 */
-	if (in_delta_base_cache(p, base_offset)) {
+	if (get_delta_base_cache_entry(shard, hash, p, base_offset)) {
+		pthread_mutex_unlock(&shard->mutex);
 		free(base);
 		return;
 	}
 
-	delta_base_cached += base_size;
-
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
-		struct delta_base_cache_entry *f =
-			list_entry(lru, struct delta_base_cache_entry, lru);
-		if (delta_base_cached <= delta_base_cache_limit)
-			break;
-		release_delta_base_cache(f);
-	}
+	tick = delta_base_cache_atomic_add(&delta_base_cache_ticks, 1);
+	delta_base_cache_atomic_add(&delta_base_cached, base_size);
 
 	ent = xmalloc(sizeof(*ent));
 	ent->key.p = p;
@@ -1499,12 +1748,16 @@ static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 	ent->type = type;
 	ent->data = base;
 	ent->size = base_size;
-	list_add_tail(&ent->lru, &delta_base_cache_lru);
+	ent->tick = tick;
+	list_add_tail(&ent->lru, &shard->lru);
+	update_delta_base_cache_oldest(shard);
+
+	hashmap_entry_init(&ent->ent, hash);
+	hashmap_add(&shard->map, &ent->ent);
+
+	pthread_mutex_unlock(&shard->mutex);
 
-	if (!delta_base_cache.cmpfn)
-		hashmap_init(&delta_base_cache, delta_base_cache_hash_cmp, NULL, 0);
-	hashmap_entry_init(&ent->ent, pack_entry_hash(p, base_offset));
-	hashmap_add(&delta_base_cache, &ent->ent);
+	shrink_delta_base_cache(tick);
 }
 
 int packed_object_info(struct repository *r, struct packed_git *p,
@@ -1692,14 +1945,9 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 	for (;;) {
 		off_t base_offset;
 		int i;
-		struct delta_base_cache_entry *ent;
-
-		ent = get_delta_base_cache_entry(p, curpos);
-		if (ent) {
-			type = ent->type;
-			data = ent->data;
-			size = ent->size;
-			detach_delta_base_cache_entry(ent);
+
+		data = lookup_delta_base_cache(p, curpos, &type, &size, 1);
+		if (data) {
 			base_from_cache = 1;
 			break;
 		}
@@ -1827,6 +2075,13 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 
 		delta_data = unpack_compressed_entry(p, &w_curs, curpos, delta_size);
 
+		/*
+		 * From here on we only work on our own buffers and the
+		 * (separately locked) delta base cache, so let other
+		 * threads read objects in the meantime.
+		 */
+		obj_read_unlock();
+
 		if (!delta_data) {
 			error("failed to unpack compressed delta "
 			      "at offset %"PRIuMAX" from %s",
@@ -1851,17 +2106,18 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 
 		/*
 		 * We delay adding `base` to the cache until the end of the loop
-		 * because unpack_compressed_entry() momentarily releases the
-		 * obj_read_mutex, giving another thread the chance to access
-		 * the cache. Therefore, if `base` was already there, this other
-		 * thread could free() it (e.g. to make space for another entry)
-		 * before we are done using it.
+		 * because other threads may access the cache while we are
+		 * inflating and patching. Therefore, if `base` was already
+		 * there, another thread could free() it (e.g. to make space
+		 * for another entry) before we are done using it.
 		 */
 		if (!external_base)
 			add_delta_base_cache(p, base_obj_offset, base, base_size, type);
 
 		free(delta_data);
 		free(external_base);
+
+		obj_read_lock();
 	}
 
 	if (final_type)
@@ -2072,6 +2328,27 @@ int has_object_pack(const struct object_id *oid)
 	return find_pack_entry(the_repository, oid, &e);
 }
 
+int find_kept_pack_entry(struct repository *r, const struct object_id *oid,
+			 unsigned flags, struct pack_entry *e)
+{
+	struct packed_git *p;
+
+	for (p = get_all_packs(r); p; p = p->next) {
+		if (!(((flags & ON_DISK_KEEP_PACKS) && p->pack_keep) ||
+		      ((flags & IN_CORE_KEEP_PACKS) && p->pack_keep_in_core)))
+			continue;
+		if (fill_pack_entry(oid, e, p))
+			return 1;
+	}
+	return 0;
+}
+
+int has_object_kept_pack(const struct object_id *oid, unsigned flags)
+{
+	struct pack_entry e;
+	return find_kept_pack_entry(the_repository, oid, flags, &e);
+}
+
 int has_pack_index(const unsigned char *sha1)
 {
 	struct stat st;
@@ -94,6 +94,7 @@ void close_pack_revindex(struct packed_git *);
 void close_pack(struct packed_git *);
 void close_object_store(struct raw_object_store *o);
 void unuse_pack(struct pack_window **);
+void prepare_delta_base_cache(void);
 void clear_delta_base_cache(void);
 struct packed_git *add_packed_git(const char *path, size_t path_len, int local);
 
@@ -170,6 +171,19 @@ int find_pack_entry(struct repository *r, const struct object_id *oid, struct pa
 
 int has_object_pack(const struct object_id *oid);
 
+/* Which kinds of kept packs has_object_kept_pack() should look at. */
+#define ON_DISK_KEEP_PACKS (1 << 0)	/* packs with a ".keep" file */
+#define IN_CORE_KEEP_PACKS (1 << 1)	/* packs marked with --keep-pack */
+
+/*
+ * Iff one of the kept packs selected by "flags" contains the object
+ * named by oid, return true and store its location to e.
+ */
+int find_kept_pack_entry(struct repository *r, const struct object_id *oid,
+			 unsigned flags, struct pack_entry *e);
+
+int has_object_kept_pack(const struct object_id *oid, unsigned flags);
+
 int has_pack_index(const unsigned char *sha1);
 
 /*
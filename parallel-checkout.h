@@ -0,0 +1,124 @@
+#ifndef PARALLEL_CHECKOUT_H
+#define PARALLEL_CHECKOUT_H
+
+#include "convert.h"
+
+struct cache_entry;
+struct checkout;
+struct progress;
+
+/****************************************************************
+ * Users of parallel checkout
+ ****************************************************************/
+
+enum pc_status {
+	PC_UNINITIALIZED = 0,
+	PC_ACCEPTING_ENTRIES,
+	PC_RUNNING,
+};
+
+enum pc_status parallel_checkout_status(void);
+
+/*
+ * Read the `checkout.workers` and `checkout.thresholdForParallelism`
+ * settings.  A `checkout.workers` value below one means "use as many
+ * workers as there are logical cores".
+ */
+void get_parallel_checkout_configs(int *num_workers, int *threshold);
+
+/*
+ * Put parallel checkout into the PC_ACCEPTING_ENTRIES state.  This
+ * should only be called if parallel checkout is not already
+ * initialized.
+ */
+void init_parallel_checkout(void);
+
+/*
+ * Return -1 if parallel checkout is currently not accepting entries or
+ * if the entry is not eligible for parallel checkout (for example,
+ * because it needs a smudge filter).  Otherwise, enqueue the entry for
+ * later write and return 0.
+ */
+int enqueue_checkout(struct cache_entry *ce, const struct checkout *state);
+size_t pc_queue_size(void);
+
+/*
+ * Write all the queued entries, returning 0 on success.  If the number
+ * of entries is below the specified threshold, the operation is
+ * performed sequentially in this process.  Entries that could not be
+ * written in parallel (e.g. because of a path collision) are retried
+ * sequentially with checkout_entry().  If `progress` is not NULL,
+ * `*progress_cnt` is advanced as each entry is written.
+ */
+int run_parallel_checkout(struct checkout *state, int num_workers,
+			  int threshold, struct progress *progress,
+			  unsigned int *progress_cnt);
+
+/****************************************************************
+ * Interface with checkout--worker
+ ****************************************************************/
+
+enum pc_item_status {
+	PC_ITEM_PENDING = 0,
+	PC_ITEM_WRITTEN,
+	/*
+	 * The item could not be written because of a collision with
+	 * another item (or because one of its leading directories is no
+	 * longer a directory).  It will be retried sequentially.
+	 */
+	PC_ITEM_COLLIDED,
+	PC_ITEM_FAILED,
+};
+
+struct parallel_checkout_item {
+	/*
+	 * In the main process, this is a pointer to an `istate->cache[]`
+	 * entry that we do not own.  In a worker, it is a transient entry
+	 * built from the data received through the pipe.
+	 */
+	struct cache_entry *ce;
+	struct conv_attrs ca;
+	size_t id; /* position in the main process' item list */
+
+	/* Output fields, sent from workers. */
+	enum pc_item_status status;
+	struct stat st;
+};
+
+/*
+ * The fixed-size portion of `struct parallel_checkout_item` that is
+ * sent to the workers.  Following this will be two strings:
+ * `ca.working_tree_encoding` and `ce.name`.  These are NOT
+ * NUL-terminated since we provide the sizes in the fixed portion.
+ *
+ * Note that not all fields of conv_attrs and cache_entry are passed,
+ * only the ones that are needed to write an entry that is eligible for
+ * parallel checkout.
+ */
+struct pc_item_fixed_portion {
+	size_t id;
+	struct object_id oid;
+	unsigned int ce_mode;
+	enum crlf_action crlf_action;
+	int ident;
+	size_t working_tree_encoding_len;
+	size_t name_len;
+};
+
+/*
+ * The fields of `struct parallel_checkout_item` that are returned by
+ * the workers.  Note: `st` must be the last one, as it is omitted on
+ * error.
+ */
+struct pc_item_result {
+	size_t id;
+	enum pc_item_status status;
+	struct stat st;
+};
+
+#define PC_ITEM_RESULT_BASE_SIZE offsetof(struct pc_item_result, st)
+
+void write_pc_item(struct parallel_checkout_item *pc_item,
+		   struct checkout *state);
+
+#endif /* PARALLEL_CHECKOUT_H */
@@ -1,5 +1,6 @@
 #include "cache.h"
 #include "object-store.h"
+#include "oid-array.h"
 #include "promisor-remote.h"
 #include "config.h"
 #include "transport.h"
@@ -12,23 +13,27 @@ void set_repository_format_partial_clone(char *partial_clone)
 	repository_format_partial_clone = xstrdup_or_null(partial_clone);
 }
 
-static int fetch_objects(const char *remote_name,
-			 const struct object_id *oids,
-			 int oid_nr)
+static int fetch_batch_size;
+static int fetch_jobs = 1;
+
+static void start_fetch_objects(struct child_process *child,
+				const char *remote_name,
+				const struct object_id *oids,
+				int oid_nr)
 {
-	struct child_process child = CHILD_PROCESS_INIT;
 	int i;
 	FILE *child_in;
 
-	child.git_cmd = 1;
-	child.in = -1;
-	strvec_pushl(&child.args, "-c", "fetch.negotiationAlgorithm=noop",
+	child_process_init(child);
+	child->git_cmd = 1;
+	child->in = -1;
+	strvec_pushl(&child->args, "-c", "fetch.negotiationAlgorithm=noop",
 		     "fetch", remote_name, "--no-tags",
 		     "--no-write-fetch-head", "--recurse-submodules=no",
 		     "--filter=blob:none", "--stdin", NULL);
-	if (start_command(&child))
+	if (start_command(child))
 		die(_("promisor-remote: unable to fork off fetch subprocess"));
-	child_in = xfdopen(child.in, "w");
+	child_in = xfdopen(child->in, "w");
 
 	for (i = 0; i < oid_nr; i++) {
 		if (fputs(oid_to_hex(&oids[i]), child_in) < 0)
@@ -39,7 +44,49 @@ static int fetch_objects(const char *remote_name,
 
 	if (fclose(child_in) < 0)
 		die_errno(_("promisor-remote: could not close stdin to fetch subprocess"));
-	return finish_command(&child) ? -1 : 0;
+}
+
+/*
+ * Fetch the objects in batches of at most promisor.fetchBatchSize, with
+ * up to promisor.fetchJobs fetches running at the same time.  Fetch
+ * reads all of its standard input before it talks to the remote, so the
+ * fetches that are started do not wait for each other.
+ */
+static int fetch_objects(const char *remote_name,
+			 const struct object_id *oids,
+			 int oid_nr)
+{
+	struct child_process *children;
+	int batch_size = fetch_batch_size;
+	int nr_batches, nr_jobs, started = 0, finished = 0, ret = 0;
+
+	if (!batch_size)
+		batch_size = DIV_ROUND_UP(oid_nr, fetch_jobs);
+	nr_batches = DIV_ROUND_UP(oid_nr, batch_size);
+	nr_jobs = fetch_jobs < nr_batches ? fetch_jobs : nr_batches;
+	CALLOC_ARRAY(children, nr_jobs);
+
+	trace2_region_enter("promisor", "fetch_objects", the_repository);
+	trace2_data_intmax("promisor", the_repository, "fetch_objects/batches",
+			   nr_batches);
+	while (finished < nr_batches) {
+		while (started < nr_batches && started - finished < nr_jobs) {
+			int offset = started * batch_size;
+
+			start_fetch_objects(&children[started % nr_jobs],
+					    remote_name, oids + offset,
+					    oid_nr - offset < batch_size ?
+					    oid_nr - offset : batch_size);
+			started++;
+		}
+		if (finish_command(&children[finished % nr_jobs]))
+			ret = -1;
+		finished++;
+	}
+	trace2_region_leave("promisor", "fetch_objects", the_repository);
+
+	free(children);
+	return ret;
 }
 
 static struct promisor_remote *promisors;
@@ -99,6 +146,21 @@ static int promisor_remote_config(const char *var, const char *value, void *data
 	size_t namelen;
 	const char *subkey;
 
+	if (!strcmp(var, "promisor.fetchbatchsize")) {
+		fetch_batch_size = git_config_int(var, value);
+		if (fetch_batch_size < 0)
+			die(_("promisor.fetchBatchSize cannot be negative"));
+		return 0;
+	}
+	if (!strcmp(var, "promisor.fetchjobs")) {
+		fetch_jobs = git_config_int(var, value);
+		if (fetch_jobs < 0)
+			die(_("promisor.fetchJobs cannot be negative"));
+		if (!fetch_jobs)
+			fetch_jobs = online_cpus();
+		return 0;
+	}
+
 	if (parse_config_key(var, "remote", &name, &namelen, &subkey) < 0)
 		return 0;
 
@@ -159,6 +221,9 @@ static void promisor_remote_init(void)
 
 static void promisor_remote_clear(void)
 {
+	fetch_batch_size = 0;
+	fetch_jobs = 1;
+
 	while (promisors) {
 		struct promisor_remote *r = promisors;
 		promisors = promisors->next;
@@ -257,3 +322,29 @@ int promisor_remote_get_direct(struct repository *repo,
 
 	return res;
 }
+
+void promisor_remote_prefetch_add(struct repository *repo,
+				  struct oid_array *to_fetch,
+				  const struct object_id *oid)
+{
+	if (oid_object_info_extended(repo, oid, NULL,
+				     OBJECT_INFO_FOR_PREFETCH))
+		oid_array_append(to_fetch, oid);
+}
+
+int promisor_remote_prefetch(struct repository *repo,
+			     struct oid_array *to_fetch)
+{
+	size_t i, nr = 0;
+	int res;
+
+	/* the same blob is often wanted through several paths */
+	oid_array_sort(to_fetch);
+	for (i = 0; i < to_fetch->nr; i++)
+		if (!nr || !oideq(&to_fetch->oid[nr - 1], &to_fetch->oid[i]))
+			oidcpy(&to_fetch->oid[nr++], &to_fetch->oid[i]);
+
+	res = promisor_remote_get_direct(repo, to_fetch->oid, nr);
+	oid_array_clear(to_fetch);
+	return res;
+}
@@ -4,6 +4,7 @@
 #include "repository.h"
 
 struct object_id;
+struct oid_array;
 
 /*
  * Promisor remote linked list
@@ -26,12 +27,29 @@ int has_promisor_remote(void);
  * a time until all objects are fetched. Returns 0 upon success, and non-zero
  * otherwise.
  *
+ * The objects are split into batches of promisor.fetchBatchSize objects,
+ * which are fetched by up to promisor.fetchJobs concurrent fetches.
+ *
  * If oid_nr is 0, this function returns 0 (success) immediately.
  */
 int promisor_remote_get_direct(struct repository *repo,
 			       const struct object_id *oids,
 			       int oid_nr);
 
+/*
+ * Commands that know which objects they are about to read can collect
+ * them with promisor_remote_prefetch_add(), which only keeps the ones
+ * missing from the repository, and then fetch them all at once with
+ * promisor_remote_prefetch() instead of fetching them one by one as
+ * they are read.  The latter drops duplicates, empties `to_fetch`, and
+ * returns like promisor_remote_get_direct().
+ */
+void promisor_remote_prefetch_add(struct repository *repo,
+				  struct oid_array *to_fetch,
+				  const struct object_id *oid);
+int promisor_remote_prefetch(struct repository *repo,
+			     struct oid_array *to_fetch);
+
 /*
  * This should be used only once from setup.c to set the value we got
  * from the extensions.partialclone config option.
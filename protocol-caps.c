@@ -0,0 +1,106 @@
+#include "cache.h"
+#include "protocol-caps.h"
+#include "config.h"
+#include "object.h"
+#include "object-store.h"
+#include "pkt-line.h"
+#include "strvec.h"
+
+struct requested_info {
+	unsigned size : 1;
+	unsigned type : 1;
+};
+
+static void send_info(struct repository *r, struct packet_writer *writer,
+		      struct requested_info *info, struct oid_array *oids)
+{
+	struct strbuf send_buffer = STRBUF_INIT;
+	int i;
+
+	/* the first line names the attributes that follow each object */
+	if (info->size)
+		strbuf_addstr(&send_buffer, " size");
+	if (info->type)
+		strbuf_addstr(&send_buffer, " type");
+	packet_writer_write(writer, "%s\n",
+			    send_buffer.len ? send_buffer.buf + 1 : "");
+
+	for (i = 0; i < oids->nr; i++) {
+		struct object_info oi = OBJECT_INFO_INIT;
+		enum object_type type;
+		unsigned long size;
+
+		oi.sizep = &size;
+		oi.typep = &type;
+
+		strbuf_reset(&send_buffer);
+		strbuf_addstr(&send_buffer, oid_to_hex(&oids->oid[i]));
+
+		/* the line ends after the object name if we lack the object */
+		if (!oid_object_info_extended(r, &oids->oid[i], &oi,
+					      OBJECT_INFO_SKIP_FETCH_OBJECT)) {
+			if (info->size)
+				strbuf_addf(&send_buffer, " %lu", size);
+			if (info->type)
+				strbuf_addf(&send_buffer, " %s",
+					    type_name(type));
+		}
+
+		packet_writer_write(writer, "%s\n", send_buffer.buf);
+	}
+
+	strbuf_release(&send_buffer);
+}
+
+int cap_object_info(struct repository *r, struct strvec *keys,
+		    struct packet_reader *request)
+{
+	struct requested_info info = { 0 };
+	struct packet_writer writer;
+	struct oid_array oids = OID_ARRAY_INIT;
+
+	packet_writer_init(&writer, 1);
+
+	while (packet_reader_read(request) == PACKET_READ_NORMAL) {
+		const char *arg;
+		struct object_id oid;
+
+		if (!strcmp(request->line, "size")) {
+			info.size = 1;
+			continue;
+		}
+		if (!strcmp(request->line, "type")) {
+			info.type = 1;
+			continue;
+		}
+		if (skip_prefix(request->line, "oid ", &arg)) {
+			const char *end;
+
+			if (parse_oid_hex_algop(arg, &oid, &end, r->hash_algo) ||
+			    *end)
+				die(_("object-info: expected object name, got '%s'"),
+				    arg);
+			oid_array_append(&oids, &oid);
+			continue;
+		}
+
+		die(_("object-info: unexpected line: '%s'"), request->line);
+	}
+
+	if (request->status != PACKET_READ_FLUSH)
+		die(_("expected flush after object-info arguments"));
+
+	send_info(r, &writer, &info, &oids);
+	packet_writer_flush(&writer);
+
+	oid_array_clear(&oids);
+	return 0;
+}
+
+int cap_object_info_advertise(struct repository *r, struct strbuf *value)
+{
+	int advertise = 0;
+
+	repo_config_get_bool(r, "transfer.advertiseobjectinfo", &advertise);
+	return advertise;
+}
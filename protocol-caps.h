@@ -0,0 +1,17 @@
+#ifndef PROTOCOL_CAPS_H
+#define PROTOCOL_CAPS_H
+
+struct repository;
+struct strbuf;
+struct strvec;
+struct packet_reader;
+
+/*
+ * The protocol v2 "object-info" command, which tells the client about
+ * the type and size of the objects it lists without sending them.
+ */
+int cap_object_info(struct repository *r, struct strvec *keys,
+		    struct packet_reader *request);
+int cap_object_info_advertise(struct repository *r, struct strbuf *value);
+
+#endif /* PROTOCOL_CAPS_H */
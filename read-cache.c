@@ -23,6 +23,7 @@
 #include "split-index.h"
 #include "utf8.h"
 #include "fsmonitor.h"
+#include "sparse-index.h"
 #include "thread-utils.h"
 #include "progress.h"
 
@@ -47,6 +48,7 @@
 #define CACHE_EXT_FSMONITOR 0x46534D4E	  /* "FSMN" */
 #define CACHE_EXT_ENDOFINDEXENTRIES 0x454F4945	/* "EOIE" */
 #define CACHE_EXT_INDEXENTRYOFFSETTABLE 0x49454F54 /* "IEOT" */
+#define CACHE_EXT_SPARSE_DIRECTORIES 0x73646972 /* "sdir" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
 #define EXTMASK (RESOLVE_UNDO_CHANGED | CACHE_TREE_CHANGED | \
@@ -573,6 +575,29 @@ static int index_name_stage_pos(const struct index_state *istate, const char *na
 		}
 		first = next+1;
 	}
+
+	if (istate->sparse_index && first > 0) {
+		/* Note: first <= istate->cache_nr */
+		struct cache_entry *ce = istate->cache[first - 1];
+
+		/*
+		 * If we are in a sparse-index _and_ the entry before the
+		 * insertion position is a sparse-directory _and_ the path we
+		 * are looking for is within that sparse-directory, then we
+		 * need to expand the index and search again.
+		 *
+		 * Expanding only replaces the entries of the index and
+		 * keeps them sorted, so we allow ourselves to cast away
+		 * the const here.
+		 */
+		if (S_ISSPARSEDIR(ce->ce_mode) &&
+		    ce_namelen(ce) < namelen &&
+		    !strncmp(name, ce->name, ce_namelen(ce))) {
+			ensure_full_index((struct index_state *)istate);
+			return index_name_stage_pos(istate, name, namelen, stage);
+		}
+	}
+
 	return -first-1;
 }
 
@@ -1010,8 +1035,14 @@ int verify_path(const char *path, unsigned mode)
 
 			c = *path++;
 			if ((c == '.' && !verify_dotfile(path, mode)) ||
-			    is_dir_sep(c) || c == '\0')
+			    is_dir_sep(c))
 				return 0;
+			/*
+			 * allow terminating directory separators for
+			 * sparse directory entries.
+			 */
+			if (c == '\0')
+				return S_ISDIR(mode);
 		} else if (c == '\\' && protect_ntfs) {
 			if (is_ntfs_dotgit(path))
 				return 0;
@@ -1773,6 +1804,10 @@ static int read_index_extension(struct index_state *istate,
 	case CACHE_EXT_INDEXENTRYOFFSETTABLE:
 		/* already handled in do_read_index() */
 		break;
+	case CACHE_EXT_SPARSE_DIRECTORIES:
+		/* no content, only an indicator */
+		istate->sparse_index = 1;
+		break;
 	default:
 		if (*ext < 'A' || 'Z' < *ext)
 			return error(_("index uses %.4s extension, which we do not understand"),
@@ -1930,12 +1965,30 @@ static void tweak_split_index(struct index_state *istate)
 	}
 }
 
+/*
+ * Commands that have not been taught about sparse directory entries
+ * (and the split index, which cannot hold them) get a full index.
+ */
+static void expand_sparse_index_if_needed(struct index_state *istate)
+{
+	struct repository *r;
+
+	if (!istate->sparse_index)
+		return;
+
+	r = istate->repo ? istate->repo : the_repository;
+	prepare_repo_settings(r);
+	if (r->settings.command_requires_full_index || istate->split_index)
+		ensure_full_index(istate);
+}
+
 static void post_read_index_from(struct index_state *istate)
 {
 	check_ce_order(istate);
 	tweak_untracked_cache(istate);
 	tweak_split_index(istate);
 	tweak_fsmonitor(istate);
+	expand_sparse_index_if_needed(istate);
 }
 
 static size_t estimate_cache_size_from_compressed(unsigned int entries)
@@ -2385,6 +2438,7 @@ int discard_index(struct index_state *istate)
 	free_name_hash(istate);
 	cache_tree_free(&(istate->cache_tree));
 	istate->initialized = 0;
+	istate->sparse_index = 0;
 	istate->fsmonitor_has_run_once = 0;
 	FREE_AND_NULL(istate->fsmonitor_last_update);
 	FREE_AND_NULL(istate->cache);
@@ -3026,6 +3080,11 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 			return -1;
 	}
 
+	if (!strip_extensions && istate->sparse_index) {
+		if (write_index_ext_header(&c, &eoie_c, newfd, CACHE_EXT_SPARSE_DIRECTORIES, 0) < 0)
+			return -1;
+	}
+
 	/*
 	 * CACHE_EXT_ENDOFINDEXENTRIES must be written as the last entry before the SHA1
 	 * so that it can be found and processed before all the index entries are
@@ -3245,7 +3304,7 @@ static int too_many_not_shared_entries(struct index_state *istate)
 int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		       unsigned flags)
 {
-	int new_shared_index, ret;
+	int new_shared_index, ret, was_full;
 	struct split_index *si = istate->split_index;
 
 	if (git_env_bool("GIT_TEST_CHECK_CACHE_TREE", 0))
@@ -3257,6 +3316,10 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		return 0;
 	}
 
+	was_full = !istate->sparse_index;
+	if (convert_to_sparse(istate))
+		warning(_("failed to convert to a sparse-index"));
+
 	if (istate->fsmonitor_last_update)
 		fill_fsmonitor_bitmap(istate);
 
@@ -3312,6 +3375,12 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 out:
 	if (flags & COMMIT_LOCK)
 		rollback_lock_file(lock);
+	/*
+	 * The sparse directories only exist on disk unless the command
+	 * knows how to deal with them.
+	 */
+	if (was_full)
+		expand_sparse_index_if_needed(istate);
 	return ret;
 }
 
@@ -0,0 +1,1790 @@
+#include "../cache.h"
+#include "../config.h"
+#include "../refs.h"
+#include "refs-internal.h"
+#include "../iterator.h"
+#include "../object.h"
+#include "../reftable/stack.h"
+
+/*
+ * Flags used in ref_update::flags; they have the same meaning as in
+ * the files backend.
+ */
+#define REF_DELETING (1 << 5)
+#define REF_NEEDS_COMMIT (1 << 6)
+#define REF_UPDATE_VIA_HEAD (1 << 8)
+
+struct reftable_ref_store {
+	struct ref_store base;
+	unsigned int store_flags;
+
+	char *commondir;
+	struct reftable_write_options write_options;
+	int auto_compact;
+	long lock_timeout_ms;
+
+	/* the shared refs, and the per-worktree refs of the main worktree */
+	struct reftable_stack main_stack;
+	/* the per-worktree refs of a linked worktree */
+	struct reftable_stack *worktree_stack;
+	/* stacks of other worktrees, for "worktrees/<id>/<ref>" */
+	struct string_list other_stacks;
+};
+
+static struct ref_store *reftable_be_init(const char *gitdir,
+					  unsigned int flags)
+{
+	struct reftable_ref_store *refs = xcalloc(1, sizeof(*refs));
+	struct ref_store *ref_store = (struct ref_store *)refs;
+	struct strbuf sb = STRBUF_INIT;
+	unsigned long block_size;
+	int restart_interval, lock_timeout;
+	char *dir;
+
+	base_ref_store_init(ref_store, &refs_be_reftable);
+	ref_store->gitdir = absolute_pathdup(gitdir);
+	refs->store_flags = flags;
+
+	get_common_dir_noenv(&sb, ref_store->gitdir);
+	refs->commondir = strbuf_detach(&sb, NULL);
+
+	if (!git_config_get_ulong("reftable.blocksize", &block_size)) {
+		if (block_size < 256 || block_size >= (1 << 24))
+			die(_("reftable.blockSize must be between 256 and 16777215"));
+		refs->write_options.block_size = block_size;
+	}
+	if (!git_config_get_int("reftable.restartinterval", &restart_interval))
+		refs->write_options.restart_interval = restart_interval;
+	refs->auto_compact = 1;
+	git_config_get_bool("reftable.autocompact", &refs->auto_compact);
+	refs->lock_timeout_ms = 100;
+	if (!git_config_get_int("reftable.locktimeout", &lock_timeout))
+		refs->lock_timeout_ms = lock_timeout;
+
+	dir = xstrfmt("%s/reftable", refs->commondir);
+	reftable_stack_init(&refs->main_stack, dir, the_hash_algo,
+			    &refs->write_options);
+	free(dir);
+	refs->main_stack.disable_auto_compact = !refs->auto_compact;
+	refs->main_stack.lock_timeout_ms = refs->lock_timeout_ms;
+
+	if (strcmp(ref_store->gitdir, refs->commondir)) {
+		dir = xstrfmt("%s/reftable", ref_store->gitdir);
+		refs->worktree_stack = xmalloc(sizeof(*refs->worktree_stack));
+		reftable_stack_init(refs->worktree_stack, dir, the_hash_algo,
+				    &refs->write_options);
+		free(dir);
+		refs->worktree_stack->disable_auto_compact = !refs->auto_compact;
+		refs->worktree_stack->lock_timeout_ms = refs->lock_timeout_ms;
+	}
+	string_list_init(&refs->other_stacks, 1);
+
+	return ref_store;
+}
+
+/*
+ * Downcast ref_store to reftable_ref_store. Die if ref_store is not a
+ * reftable_ref_store or lacks the capabilities in 'required_flags'.
+ */
+static struct reftable_ref_store *reftable_downcast(struct ref_store *ref_store,
+						    unsigned int required_flags,
+						    const char *caller)
+{
+	struct reftable_ref_store *refs;
+
+	if (ref_store->be != &refs_be_reftable)
+		BUG("ref_store is type \"%s\" not \"reftable\" in %s",
+		    ref_store->be->name, caller);
+
+	refs = (struct reftable_ref_store *)ref_store;
+
+	if ((refs->store_flags & required_flags) != required_flags)
+		BUG("operation %s requires abilities 0x%x, but only have 0x%x",
+		    caller, required_flags, refs->store_flags);
+
+	return refs;
+}
+
+/*
+ * Return the stack that holds 'refname', and point 'name' at the name
+ * of the ref within that stack.
+ */
+static struct reftable_stack *stack_for(struct reftable_ref_store *refs,
+					const char *refname, const char **name)
+{
+	struct string_list_item *item;
+	const char *id, *slash;
+	char *key;
+
+	*name = refname;
+	switch (ref_type(refname)) {
+	case REF_TYPE_PER_WORKTREE:
+	case REF_TYPE_PSEUDOREF:
+		if (refs->worktree_stack)
+			return refs->worktree_stack;
+		return &refs->main_stack;
+	case REF_TYPE_MAIN_PSEUDOREF:
+		skip_prefix(refname, "main-worktree/", name);
+		return &refs->main_stack;
+	case REF_TYPE_OTHER_PSEUDOREF:
+		if (!skip_prefix(refname, "worktrees/", &id) ||
+		    !(slash = strchr(id, '/')))
+			BUG("ref %s is not a worktree pseudoref", refname);
+		*name = slash + 1;
+		key = xmemdupz(id, slash - id);
+		item = string_list_insert(&refs->other_stacks, key);
+		if (!item->util) {
+			struct reftable_stack *st = xmalloc(sizeof(*st));
+			char *dir = xstrfmt("%s/worktrees/%s/reftable",
+					    refs->commondir, key);
+
+			reftable_stack_init(st, dir, the_hash_algo,
+					    &refs->write_options);
+			st->disable_auto_compact = !refs->auto_compact;
+			st->lock_timeout_ms = refs->lock_timeout_ms;
+			item->util = st;
+			free(dir);
+		}
+		free(key);
+		return item->util;
+	default:
+		return &refs->main_stack;
+	}
+}
+
+static int reftable_be_init_db(struct ref_store *ref_store, struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "init_db");
+	struct reftable_stack *stacks[] = { &refs->main_stack, refs->worktree_stack };
+	struct strbuf sb = STRBUF_INIT;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(stacks); i++) {
+		if (!stacks[i])
+			continue;
+		safe_create_dir(stacks[i]->dir, 1);
+		if (access(stacks[i]->list_file, F_OK)) {
+			write_file_buf(stacks[i]->list_file, "", 0);
+			adjust_shared_perm(stacks[i]->list_file);
+		}
+	}
+
+	/*
+	 * Older versions of Git require HEAD and "refs/" to exist to
+	 * recognize a repository; make sure that they cannot mistake
+	 * this one for a repository using the "files" backend.
+	 */
+	strbuf_addf(&sb, "%s/HEAD", ref_store->gitdir);
+	if (access(sb.buf, F_OK))
+		write_file(sb.buf, "ref: refs/heads/.invalid");
+	strbuf_reset(&sb);
+	strbuf_addf(&sb, "%s/refs", ref_store->gitdir);
+	safe_create_dir(sb.buf, 1);
+	strbuf_addstr(&sb, "/heads");
+	if (access(sb.buf, F_OK))
+		write_file(sb.buf, "this repository uses the reftable format");
+
+	strbuf_release(&sb);
+	return 0;
+}
+
+/* Read 'name' from 'stack'; see reftable_stack_read_ref(). */
+static int read_ref_record(struct reftable_stack *stack, const char *name,
+			   struct reftable_record *rec)
+{
+	reftable_record_init(rec, REFTABLE_BLOCK_TYPE_REF);
+	return reftable_stack_read_ref(stack, name, rec);
+}
+
+static int reftable_be_read_raw_ref(struct ref_store *ref_store,
+				    const char *refname, struct object_id *oid,
+				    struct strbuf *referent, unsigned int *type)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "read_raw_ref");
+	struct reftable_record rec;
+	struct reftable_stack *stack;
+	const char *name;
+	int ret;
+
+	*type = 0;
+	stack = stack_for(refs, refname, &name);
+	ret = read_ref_record(stack, name, &rec);
+	if (ret < 0) {
+		errno = EIO;
+	} else if (ret > 0) {
+		errno = ENOENT;
+		ret = -1;
+	} else if (rec.u.ref.value_type == REFTABLE_REF_SYMREF) {
+		*type |= REF_ISSYMREF;
+		strbuf_reset(referent);
+		strbuf_addbuf(referent, &rec.u.ref.target);
+	} else {
+		oidcpy(oid, &rec.u.ref.value);
+	}
+	reftable_record_release(&rec);
+	return ret;
+}
+
+/*
+ * The ref and log records making up a new table; they are sorted
+ * before being written.
+ */
+struct table_contents {
+	struct reftable_record *refs;
+	size_t refs_nr, refs_alloc;
+	struct reftable_record *logs;
+	size_t logs_nr, logs_alloc;
+};
+
+#define TABLE_CONTENTS_INIT { 0 }
+
+static struct reftable_ref_record *add_ref_record(struct table_contents *tc,
+						  const char *refname,
+						  uint64_t update_index)
+{
+	struct reftable_record *rec;
+
+	ALLOC_GROW(tc->refs, tc->refs_nr + 1, tc->refs_alloc);
+	rec = &tc->refs[tc->refs_nr++];
+	reftable_record_init(rec, REFTABLE_BLOCK_TYPE_REF);
+	strbuf_addstr(&rec->u.ref.refname, refname);
+	rec->u.ref.update_index = update_index;
+	return &rec->u.ref;
+}
+
+static struct reftable_log_record *add_log_record(struct table_contents *tc,
+						  const char *refname,
+						  uint64_t update_index)
+{
+	struct reftable_record *rec;
+
+	ALLOC_GROW(tc->logs, tc->logs_nr + 1, tc->logs_alloc);
+	rec = &tc->logs[tc->logs_nr++];
+	reftable_record_init(rec, REFTABLE_BLOCK_TYPE_LOG);
+	strbuf_addstr(&rec->u.log.refname, refname);
+	rec->u.log.update_index = update_index;
+	return &rec->u.log;
+}
+
+/* Add a deletion for the log entry 'log', which is stored in the stack. */
+static void add_log_tombstone(struct table_contents *tc,
+			      const struct reftable_log_record *log)
+{
+	struct reftable_log_record *t;
+
+	t = add_log_record(tc, log->refname.buf, log->update_index);
+	t->value_type = REFTABLE_LOG_DELETION;
+}
+
+static void table_contents_release(struct table_contents *tc)
+{
+	size_t i;
+
+	for (i = 0; i < tc->refs_nr; i++)
+		reftable_record_release(&tc->refs[i]);
+	for (i = 0; i < tc->logs_nr; i++)
+		reftable_record_release(&tc->logs[i]);
+	FREE_AND_NULL(tc->refs);
+	FREE_AND_NULL(tc->logs);
+	tc->refs_nr = tc->refs_alloc = tc->logs_nr = tc->logs_alloc = 0;
+}
+
+static int ref_record_cmp(const void *va, const void *vb)
+{
+	const struct reftable_record *a = va, *b = vb;
+
+	return strbuf_cmp(&a->u.ref.refname, &b->u.ref.refname);
+}
+
+static int log_record_cmp(const void *va, const void *vb)
+{
+	const struct reftable_record *a = va, *b = vb;
+	int cmp = strcmp(a->u.log.refname.buf, b->u.log.refname.buf);
+
+	if (cmp)
+		return cmp;
+	if (a->u.log.update_index == b->u.log.update_index)
+		return 0;
+	return a->u.log.update_index > b->u.log.update_index ? -1 : 1;
+}
+
+static int write_table_contents(struct reftable_writer *w, void *cb_data)
+{
+	struct table_contents *tc = cb_data;
+	size_t i;
+
+	QSORT(tc->refs, tc->refs_nr, ref_record_cmp);
+	for (i = 0; i < tc->refs_nr; i++) {
+		if (i && !ref_record_cmp(&tc->refs[i - 1], &tc->refs[i]))
+			BUG("duplicate ref '%s' in reftable",
+			    tc->refs[i].u.ref.refname.buf);
+		if (reftable_writer_add_ref(w, &tc->refs[i].u.ref) < 0)
+			return -1;
+	}
+
+	QSORT(tc->logs, tc->logs_nr, log_record_cmp);
+	for (i = 0; i < tc->logs_nr; i++) {
+		if (i && !log_record_cmp(&tc->logs[i - 1], &tc->logs[i]))
+			BUG("duplicate log entry for '%s' in reftable",
+			    tc->logs[i].u.log.refname.buf);
+		if (reftable_writer_add_log(w, &tc->logs[i].u.log) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Write 'tc' as a new table of the locked stack and publish it.
+ * Consumes the addition.
+ */
+static int commit_table_contents(struct reftable_addition *add,
+				 struct table_contents *tc, struct strbuf *err)
+{
+	if (reftable_addition_add(add, write_table_contents, tc, err) < 0) {
+		reftable_addition_abort(add);
+		return -1;
+	}
+	return reftable_addition_commit(add, err);
+}
+
+/* Store the value of 'oid' in 'ref', together with its peeled value. */
+static void set_ref_value(struct reftable_ref_record *ref,
+			  const struct object_id *oid)
+{
+	oidcpy(&ref->value, oid);
+	if (peel_object(oid, &ref->peeled) == PEEL_PEELED)
+		ref->value_type = REFTABLE_REF_VAL2;
+	else
+		ref->value_type = REFTABLE_REF_VAL1;
+}
+
+/* Fill in a new reflog entry with the current committer identity. */
+static void fill_reflog_entry(struct reftable_log_record *log,
+			      const struct object_id *old_oid,
+			      const struct object_id *new_oid,
+			      const char *msg)
+{
+	const char *info = git_committer_info(0);
+	struct ident_split split;
+
+	log->value_type = REFTABLE_LOG_UPDATE;
+	oidcpy(&log->old_oid, old_oid);
+	oidcpy(&log->new_oid, new_oid);
+	if (!split_ident_line(&split, info, strlen(info))) {
+		strbuf_add(&log->name, split.name_begin,
+			   split.name_end - split.name_begin);
+		strbuf_add(&log->email, split.mail_begin,
+			   split.mail_end - split.mail_begin);
+		if (split.date_begin)
+			log->time = parse_timestamp(split.date_begin, NULL, 10);
+		if (split.tz_begin) {
+			long tz = strtol(split.tz_begin, NULL, 10);
+			int sign = tz < 0 ? -1 : 1;
+
+			tz = labs(tz);
+			log->tz_offset = sign * ((tz / 100) * 60 + tz % 100);
+		}
+	}
+	if (msg && *msg) {
+		strbuf_addstr(&log->message, msg);
+		strbuf_addch(&log->message, '\n');
+	}
+}
+
+/*
+ * create_reflog() records the existence of an empty reflog by an entry
+ * that goes from the null OID to the null OID; it is never shown.
+ */
+static int is_reflog_placeholder(const struct reftable_log_record *log)
+{
+	return is_null_oid(&log->old_oid) && is_null_oid(&log->new_oid);
+}
+
+/* Collect the reflog entries of 'name', newest first. */
+static int read_reflog(struct reftable_stack *stack, const char *name,
+		       struct table_contents *out)
+{
+	struct reftable_merged_iter mi;
+	struct reftable_record rec;
+	int ret;
+
+	reftable_record_init(&rec, REFTABLE_BLOCK_TYPE_LOG);
+	ret = reftable_stack_seek(stack, &mi, REFTABLE_BLOCK_TYPE_LOG, name);
+	while (!ret && !(ret = reftable_merged_iter_next(&mi, &rec))) {
+		if (strcmp(rec.u.log.refname.buf, name))
+			break;
+		ALLOC_GROW(out->logs, out->logs_nr + 1, out->logs_alloc);
+		reftable_record_init(&out->logs[out->logs_nr], REFTABLE_BLOCK_TYPE_LOG);
+		reftable_record_swap(&out->logs[out->logs_nr++], &rec);
+	}
+	reftable_merged_iter_release(&mi);
+	reftable_record_release(&rec);
+	return ret < 0 ? -1 : 0;
+}
+
+static int stack_reflog_exists(struct reftable_stack *stack, const char *name)
+{
+	struct reftable_merged_iter mi;
+	struct reftable_record rec;
+	int ret;
+
+	reftable_record_init(&rec, REFTABLE_BLOCK_TYPE_LOG);
+	ret = reftable_stack_seek(stack, &mi, REFTABLE_BLOCK_TYPE_LOG, name);
+	if (!ret)
+		ret = reftable_merged_iter_next(&mi, &rec);
+	ret = !ret && !strcmp(rec.u.log.refname.buf, name);
+	reftable_merged_iter_release(&mi);
+	reftable_record_release(&rec);
+	return ret;
+}
+
+static int should_write_log(struct reftable_stack *stack, const char *name,
+			    unsigned int flags)
+{
+	if (log_all_ref_updates == LOG_REFS_UNSET)
+		log_all_ref_updates = is_bare_repository() ? LOG_REFS_NONE : LOG_REFS_NORMAL;
+
+	if ((flags & REF_FORCE_CREATE_REFLOG) || should_autocreate_reflog(name))
+		return 1;
+	return stack_reflog_exists(stack, name);
+}
+
+/* Per-update state of a transaction. */
+struct reftable_update_state {
+	struct object_id old_oid;
+	const char *name;
+};
+
+/* The updates of a transaction that go to one stack. */
+struct transaction_stack {
+	struct reftable_ref_store *refs;
+	struct reftable_stack *stack;
+	struct reftable_addition add;
+	struct ref_update **updates;
+	size_t updates_nr, updates_alloc;
+};
+
+struct reftable_transaction_data {
+	struct transaction_stack *stacks;
+	size_t nr, alloc;
+};
+
+/* Lock 'stack' for the transaction unless it is locked already. */
+static struct transaction_stack *lock_transaction_stack(struct reftable_ref_store *refs,
+							struct reftable_transaction_data *tx,
+							struct reftable_stack *stack,
+							struct strbuf *err)
+{
+	struct transaction_stack *ts;
+	size_t i;
+
+	for (i = 0; i < tx->nr; i++)
+		if (tx->stacks[i].stack == stack)
+			return &tx->stacks[i];
+
+	ALLOC_GROW(tx->stacks, tx->nr + 1, tx->alloc);
+	ts = &tx->stacks[tx->nr];
+	memset(ts, 0, sizeof(*ts));
+	ts->refs = refs;
+	ts->stack = stack;
+	string_list_init(&ts->add.new_tables, 1);
+	if (reftable_addition_begin(&ts->add, stack, err) < 0)
+		return NULL;
+	tx->nr++;
+	return ts;
+}
+
+static void reftable_transaction_cleanup(struct ref_transaction *transaction)
+{
+	struct reftable_transaction_data *tx = transaction->backend_data;
+	size_t i;
+
+	for (i = 0; i < transaction->nr; i++)
+		FREE_AND_NULL(transaction->updates[i]->backend_data);
+
+	if (tx) {
+		for (i = 0; i < tx->nr; i++) {
+			reftable_addition_abort(&tx->stacks[i].add);
+			free(tx->stacks[i].updates);
+		}
+		free(tx->stacks);
+		FREE_AND_NULL(transaction->backend_data);
+	}
+	transaction->state = REF_TRANSACTION_CLOSED;
+}
+
+/*
+ * If update is a direct update of head_ref (the reference pointed to
+ * by HEAD), then add an extra REF_LOG_ONLY update for HEAD.
+ */
+static int split_head_update(struct ref_update *update,
+			     struct ref_transaction *transaction,
+			     const char *head_ref,
+			     struct string_list *affected_refnames,
+			     struct strbuf *err)
+{
+	struct string_list_item *item;
+	struct ref_update *new_update;
+
+	if ((update->flags & REF_LOG_ONLY) ||
+	    (update->flags & REF_UPDATE_VIA_HEAD))
+		return 0;
+
+	if (strcmp(update->refname, head_ref))
+		return 0;
+
+	if (string_list_has_string(affected_refnames, "HEAD")) {
+		strbuf_addf(err,
+			    "multiple updates for 'HEAD' (including one "
+			    "via its referent '%s') are not allowed",
+			    update->refname);
+		return TRANSACTION_NAME_CONFLICT;
+	}
+
+	new_update = ref_transaction_add_update(
+			transaction, "HEAD",
+			update->flags | REF_LOG_ONLY | REF_NO_DEREF,
+			&update->new_oid, &update->old_oid,
+			update->msg);
+
+	item = string_list_insert(affected_refnames, new_update->refname);
+	item->util = new_update;
+
+	return 0;
+}
+
+/*
+ * update is for a symref that points at referent and doesn't have
+ * REF_NO_DEREF set. Turn it into a REF_LOG_ONLY update and add a new
+ * update for the referent.
+ */
+static int split_symref_update(struct ref_update *update,
+			       const char *referent,
+			       struct ref_transaction *transaction,
+			       struct string_list *affected_refnames,
+			       struct strbuf *err)
+{
+	struct string_list_item *item;
+	struct ref_update *new_update;
+	unsigned int new_flags;
+
+	if (string_list_has_string(affected_refnames, referent)) {
+		strbuf_addf(err,
+			    "multiple updates for '%s' (including one "
+			    "via symref '%s') are not allowed",
+			    referent, update->refname);
+		return TRANSACTION_NAME_CONFLICT;
+	}
+
+	new_flags = update->flags;
+	if (!strcmp(update->refname, "HEAD"))
+		new_flags |= REF_UPDATE_VIA_HEAD;
+
+	new_update = ref_transaction_add_update(
+			transaction, referent, new_flags,
+			&update->new_oid, &update->old_oid,
+			update->msg);
+
+	new_update->parent_update = update;
+
+	update->flags |= REF_LOG_ONLY | REF_NO_DEREF;
+	update->flags &= ~REF_HAVE_OLD;
+
+	item = string_list_insert(affected_refnames, new_update->refname);
+	if (item->util)
+		BUG("%s unexpectedly found in affected_refnames",
+		    new_update->refname);
+	item->util = new_update;
+
+	return 0;
+}
+
+/*
+ * Return the refname under which update was originally requested.
+ */
+static const char *original_update_refname(struct ref_update *update)
+{
+	while (update->parent_update)
+		update = update->parent_update;
+
+	return update->refname;
+}
+
+static int check_old_oid(struct ref_update *update, struct object_id *oid,
+			 struct strbuf *err)
+{
+	if (!(update->flags & REF_HAVE_OLD) ||
+		   oideq(oid, &update->old_oid))
+		return 0;
+
+	if (is_null_oid(&update->old_oid))
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "reference already exists",
+			    original_update_refname(update));
+	else if (is_null_oid(oid))
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "reference is missing but expected %s",
+			    original_update_refname(update),
+			    oid_to_hex(&update->old_oid));
+	else
+		strbuf_addf(err, "cannot lock ref '%s': "
+			    "is at %s but expected %s",
+			    original_update_refname(update),
+			    oid_to_hex(oid),
+			    oid_to_hex(&update->old_oid));
+
+	return -1;
+}
+
+/* Refuse to store missing objects, and non-commits in branches. */
+static int check_new_oid(struct ref_update *update, struct strbuf *err)
+{
+	struct object *o = parse_object(the_repository, &update->new_oid);
+
+	if (!o) {
+		strbuf_addf(err,
+			    "cannot update ref '%s': "
+			    "trying to write ref '%s' with nonexistent object %s",
+			    update->refname, update->refname,
+			    oid_to_hex(&update->new_oid));
+		return -1;
+	}
+	if (o->type != OBJ_COMMIT && starts_with(update->refname, "refs/heads/")) {
+		strbuf_addf(err,
+			    "cannot update ref '%s': "
+			    "trying to write non-commit object %s to branch '%s'",
+			    update->refname, oid_to_hex(&update->new_oid),
+			    update->refname);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Lock the stack holding the ref, read its current value and verify
+ * the update against it, splitting symref and HEAD updates like the
+ * files backend does.
+ */
+static int prepare_update(struct reftable_ref_store *refs,
+			  struct reftable_transaction_data *tx,
+			  struct ref_update *update,
+			  struct ref_transaction *transaction,
+			  const char *head_ref,
+			  struct string_list *affected_refnames,
+			  struct strbuf *err)
+{
+	struct reftable_update_state *state;
+	struct transaction_stack *ts;
+	struct reftable_stack *stack;
+	struct reftable_record rec;
+	struct strbuf referent = STRBUF_INIT;
+	int mustexist = (update->flags & REF_HAVE_OLD) &&
+		!is_null_oid(&update->old_oid);
+	int ret = 0, found;
+	const char *name;
+
+	if ((update->flags & REF_HAVE_NEW) && is_null_oid(&update->new_oid))
+		update->flags |= REF_DELETING;
+
+	if (head_ref) {
+		ret = split_head_update(update, transaction, head_ref,
+					affected_refnames, err);
+		if (ret)
+			return ret;
+	}
+
+	stack = stack_for(refs, update->refname, &name);
+	ts = lock_transaction_stack(refs, tx, stack, &referent);
+	if (!ts) {
+		strbuf_addf(err, "cannot lock ref '%s': %s",
+			    original_update_refname(update), referent.buf);
+		strbuf_release(&referent);
+		return TRANSACTION_GENERIC_ERROR;
+	}
+	ALLOC_GROW(ts->updates, ts->updates_nr + 1, ts->updates_alloc);
+	ts->updates[ts->updates_nr++] = update;
+
+	CALLOC_ARRAY(state, 1);
+	state->name = name;
+	update->backend_data = state;
+
+	found = read_ref_record(stack, name, &rec);
+	if (found < 0) {
+		strbuf_addf(err, "cannot lock ref '%s': unable to read reftable",
+			    original_update_refname(update));
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto out;
+	} else if (found > 0) {
+		if (mustexist) {
+			strbuf_addf(err, "cannot lock ref '%s': "
+				    "unable to resolve reference '%s'",
+				    original_update_refname(update),
+				    update->refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+		if (refs_verify_refname_available(&refs->base, update->refname,
+						  affected_refnames, NULL,
+						  &referent)) {
+			strbuf_addf(err, "cannot lock ref '%s': %s",
+				    original_update_refname(update),
+				    referent.buf);
+			ret = TRANSACTION_NAME_CONFLICT;
+			goto out;
+		}
+		oidclr(&state->old_oid);
+	} else if (rec.u.ref.value_type == REFTABLE_REF_SYMREF) {
+		update->type |= REF_ISSYMREF;
+		strbuf_addbuf(&referent, &rec.u.ref.target);
+	} else {
+		oidcpy(&state->old_oid, &rec.u.ref.value);
+	}
+
+	if (update->type & REF_ISSYMREF) {
+		if (update->flags & REF_NO_DEREF) {
+			if (refs_read_ref_full(&refs->base, referent.buf, 0,
+					       &state->old_oid, NULL)) {
+				oidclr(&state->old_oid);
+				if (update->flags & REF_HAVE_OLD) {
+					strbuf_addf(err, "cannot lock ref '%s': "
+						    "error reading reference",
+						    original_update_refname(update));
+					ret = TRANSACTION_GENERIC_ERROR;
+					goto out;
+				}
+			} else if (check_old_oid(update, &state->old_oid, err)) {
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto out;
+			}
+		} else {
+			ret = split_symref_update(update, referent.buf,
+						  transaction,
+						  affected_refnames, err);
+			if (ret)
+				goto out;
+		}
+	} else {
+		struct ref_update *parent_update;
+
+		if (check_old_oid(update, &state->old_oid, err)) {
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		}
+
+		/*
+		 * If this update is happening indirectly because of a
+		 * symref update, record the old OID in the parent
+		 * update:
+		 */
+		for (parent_update = update->parent_update;
+		     parent_update;
+		     parent_update = parent_update->parent_update) {
+			struct reftable_update_state *parent_state =
+				parent_update->backend_data;
+			oidcpy(&parent_state->old_oid, &state->old_oid);
+		}
+	}
+
+	if (update->flags & REF_LOG_ONLY)
+		goto out;
+	if (update->flags & REF_DELETING) {
+		if (!found)
+			update->flags |= REF_NEEDS_COMMIT;
+	} else if (update->flags & REF_HAVE_NEW) {
+		if (!(update->type & REF_ISSYMREF) &&
+		    oideq(&state->old_oid, &update->new_oid)) {
+			/* The reference already has the desired value. */
+		} else if (check_new_oid(update, err)) {
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto out;
+		} else {
+			update->flags |= REF_NEEDS_COMMIT;
+		}
+	}
+
+out:
+	reftable_record_release(&rec);
+	strbuf_release(&referent);
+	return ret;
+}
+
+static int reftable_be_transaction_prepare(struct ref_store *ref_store,
+					   struct ref_transaction *transaction,
+					   struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE,
+				  "ref_transaction_prepare");
+	struct string_list affected_refnames = STRING_LIST_INIT_NODUP;
+	struct reftable_transaction_data *tx;
+	char *head_ref = NULL;
+	int head_type;
+	size_t i;
+	int ret = 0;
+
+	assert(err);
+
+	if (!transaction->nr)
+		goto cleanup;
+
+	CALLOC_ARRAY(tx, 1);
+	transaction->backend_data = tx;
+
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+		struct string_list_item *item =
+			string_list_append(&affected_refnames, update->refname);
+
+		item->util = update;
+	}
+	string_list_sort(&affected_refnames);
+	if (ref_update_reject_duplicates(&affected_refnames, err)) {
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto cleanup;
+	}
+
+	/*
+	 * If HEAD is a symref, updates of the ref it points to are
+	 * logged in the reflog of HEAD, too; see split_head_update().
+	 */
+	head_ref = refs_resolve_refdup(ref_store, "HEAD",
+				       RESOLVE_REF_NO_RECURSE,
+				       NULL, &head_type);
+	if (head_ref && !(head_type & REF_ISSYMREF))
+		FREE_AND_NULL(head_ref);
+
+	/* prepare_update() might append more updates to the transaction */
+	for (i = 0; i < transaction->nr; i++) {
+		ret = prepare_update(refs, tx, transaction->updates[i],
+				     transaction, head_ref,
+				     &affected_refnames, err);
+		if (ret)
+			goto cleanup;
+	}
+
+cleanup:
+	free(head_ref);
+	string_list_clear(&affected_refnames, 0);
+
+	if (ret)
+		reftable_transaction_cleanup(transaction);
+	else
+		transaction->state = REF_TRANSACTION_PREPARED;
+
+	return ret;
+}
+
+/*
+ * Write all updates of a transaction to one stack as a single table,
+ * whose ref records all share the same update index.
+ */
+static int write_transaction_table(struct reftable_writer *w, void *cb_data)
+{
+	struct transaction_stack *ts = cb_data;
+	uint64_t update_index = ts->add.next_update_index;
+	struct table_contents tc = TABLE_CONTENTS_INIT;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < ts->updates_nr; i++) {
+		struct ref_update *update = ts->updates[i];
+		struct reftable_update_state *state = update->backend_data;
+		struct reftable_ref_record *ref;
+
+		if (update->flags & REF_NEEDS_COMMIT) {
+			ref = add_ref_record(&tc, state->name, update_index);
+			if (update->flags & REF_DELETING) {
+				/* the reflog goes away with the ref */
+				struct table_contents logs = TABLE_CONTENTS_INIT;
+				size_t j;
+
+				ref->value_type = REFTABLE_REF_DELETION;
+				if (read_reflog(ts->stack, state->name, &logs) < 0) {
+					table_contents_release(&tc);
+					return -1;
+				}
+				for (j = 0; j < logs.logs_nr; j++)
+					add_log_tombstone(&tc, &logs.logs[j].u.log);
+				table_contents_release(&logs);
+				continue;
+			}
+			set_ref_value(ref, &update->new_oid);
+		} else if (!(update->flags & REF_LOG_ONLY)) {
+			continue;
+		}
+
+		if (should_write_log(ts->stack, state->name, update->flags))
+			fill_reflog_entry(add_log_record(&tc, state->name,
+							 update_index),
+					  &state->old_oid, &update->new_oid,
+					  update->msg);
+	}
+
+	ret = write_table_contents(w, &tc);
+	table_contents_release(&tc);
+	return ret;
+}
+
+static int reftable_be_transaction_finish(struct ref_store *ref_store,
+					  struct ref_transaction *transaction,
+					  struct strbuf *err)
+{
+	struct reftable_transaction_data *tx = transaction->backend_data;
+	size_t i;
+	int ret = 0;
+
+	reftable_downcast(ref_store, 0, "ref_transaction_finish");
+	for (i = 0; tx && i < tx->nr; i++) {
+		struct transaction_stack *ts = &tx->stacks[i];
+
+		if (reftable_addition_add(&ts->add, write_transaction_table,
+					  ts, err) < 0 ||
+		    reftable_addition_commit(&ts->add, err) < 0) {
+			ret = TRANSACTION_GENERIC_ERROR;
+			break;
+		}
+	}
+	reftable_transaction_cleanup(transaction);
+	return ret;
+}
+
+static int reftable_be_transaction_abort(struct ref_store *ref_store,
+					 struct ref_transaction *transaction,
+					 struct strbuf *err)
+{
+	reftable_downcast(ref_store, 0, "ref_transaction_abort");
+	reftable_transaction_cleanup(transaction);
+	return 0;
+}
+
+static int reftable_be_initial_transaction_commit(struct ref_store *ref_store,
+						  struct ref_transaction *transaction,
+						  struct strbuf *err)
+{
+	int ret = reftable_be_transaction_prepare(ref_store, transaction, err);
+
+	if (ret)
+		return ret;
+	return reftable_be_transaction_finish(ref_store, transaction, err);
+}
+
+static int reftable_be_pack_refs(struct ref_store *ref_store, unsigned int flags)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE | REF_STORE_ODB,
+				  "pack_refs");
+	struct strbuf err = STRBUF_INIT;
+	int ret;
+
+	ret = reftable_stack_compact_all(&refs->main_stack, &err);
+	if (!ret && refs->worktree_stack)
+		ret = reftable_stack_compact_all(refs->worktree_stack, &err);
+	if (ret)
+		error("%s", err.buf);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_be_create_symref(struct ref_store *ref_store,
+				     const char *refname, const char *target,
+				     const char *logmsg)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_symref");
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	struct table_contents tc = TABLE_CONTENTS_INIT;
+	struct reftable_stack *stack;
+	struct reftable_ref_record *ref;
+	struct strbuf err = STRBUF_INIT;
+	struct object_id old_oid, new_oid;
+	const char *name;
+	int ret = -1;
+
+	stack = stack_for(refs, refname, &name);
+	if (reftable_addition_begin(&add, stack, &err) < 0) {
+		error("%s", err.buf);
+		goto out;
+	}
+	if (refs_read_ref_full(&refs->base, refname, RESOLVE_REF_READING,
+			       &old_oid, NULL))
+		oidclr(&old_oid);
+	if (!refs_ref_exists(&refs->base, refname) &&
+	    refs_verify_refname_available(&refs->base, refname, NULL, NULL,
+					  &err)) {
+		error("%s", err.buf);
+		reftable_addition_abort(&add);
+		goto out;
+	}
+
+	ref = add_ref_record(&tc, name, add.next_update_index);
+	ref->value_type = REFTABLE_REF_SYMREF;
+	strbuf_addstr(&ref->target, target);
+
+	if (logmsg &&
+	    !refs_read_ref_full(&refs->base, target, RESOLVE_REF_READING,
+				&new_oid, NULL) &&
+	    should_write_log(stack, name, 0))
+		fill_reflog_entry(add_log_record(&tc, name, add.next_update_index),
+				  &old_oid, &new_oid, logmsg);
+
+	ret = commit_table_contents(&add, &tc, &err);
+	if (ret)
+		error(_("unable to write symref for %s: %s"), refname, err.buf);
+
+out:
+	table_contents_release(&tc);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_be_delete_refs(struct ref_store *ref_store, const char *msg,
+				   struct string_list *refnames, unsigned int flags)
+{
+	struct strbuf err = STRBUF_INIT;
+	struct ref_transaction *transaction;
+	struct string_list_item *item;
+	int ret;
+
+	reftable_downcast(ref_store, REF_STORE_WRITE, "delete_refs");
+
+	if (!refnames->nr)
+		return 0;
+
+	/*
+	 * Unlike the files backend, all deletions are a single
+	 * transaction; they go into one new table.
+	 */
+	transaction = ref_store_transaction_begin(ref_store, &err);
+	if (!transaction)
+		goto error;
+
+	for_each_string_list_item(item, refnames) {
+		if (ref_transaction_delete(transaction, item->string, NULL,
+					   flags, msg, &err)) {
+			warning(_("could not delete reference %s: %s"),
+				item->string, err.buf);
+			strbuf_reset(&err);
+		}
+	}
+
+	ret = ref_transaction_commit(transaction, &err);
+
+	if (ret) {
+		if (refnames->nr == 1)
+			error(_("could not delete reference %s: %s"),
+			      refnames->items[0].string, err.buf);
+		else
+			error(_("could not delete references: %s"), err.buf);
+	}
+
+	ref_transaction_free(transaction);
+	strbuf_release(&err);
+	return ret;
+
+error:
+	error("%s", err.buf);
+	strbuf_release(&err);
+	return -1;
+}
+
+static int reftable_be_copy_or_rename_ref(struct ref_store *ref_store,
+					  const char *oldrefname,
+					  const char *newrefname,
+					  const char *logmsg, int copy)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "rename_ref");
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	struct table_contents tc = TABLE_CONTENTS_INIT;
+	struct table_contents old_logs = TABLE_CONTENTS_INIT;
+	struct table_contents new_logs = TABLE_CONTENTS_INIT;
+	struct reftable_stack *stack;
+	struct reftable_record rec;
+	struct reftable_ref_record *ref;
+	struct strbuf err = STRBUF_INIT;
+	const char *oldname, *newname;
+	uint64_t update_index;
+	size_t i, j;
+	int ret = -1;
+
+	reftable_record_init(&rec, REFTABLE_BLOCK_TYPE_REF);
+	stack = stack_for(refs, oldrefname, &oldname);
+	if (stack != stack_for(refs, newrefname, &newname)) {
+		ret = error(_("cannot move '%s' to '%s' across worktrees"),
+			    oldrefname, newrefname);
+		goto out;
+	}
+	if (reftable_addition_begin(&add, stack, &err) < 0) {
+		ret = error("%s", err.buf);
+		goto out;
+	}
+	update_index = add.next_update_index;
+
+	reftable_record_release(&rec);
+	ret = read_ref_record(stack, oldname, &rec);
+	if (ret) {
+		ret = error("refname %s not found", oldrefname);
+		goto abort;
+	}
+	if (rec.u.ref.value_type == REFTABLE_REF_SYMREF) {
+		if (copy)
+			ret = error("refname %s is a symbolic ref, copying it is not supported",
+				    oldrefname);
+		else
+			ret = error("refname %s is a symbolic ref, renaming it is not supported",
+				    oldrefname);
+		goto abort;
+	}
+	/* a copy keeps the old ref, so it may not make way for the new one */
+	if (copy ? refs_verify_refname_available(&refs->base, newrefname,
+						 NULL, NULL, &err) :
+	    !refs_rename_ref_available(&refs->base, oldrefname, newrefname)) {
+		if (copy)
+			error("%s", err.buf);
+		ret = 1;
+		goto abort;
+	}
+
+	if (read_reflog(stack, oldname, &old_logs) < 0 ||
+	    read_reflog(stack, newname, &new_logs) < 0) {
+		ret = -1;
+		goto abort;
+	}
+
+	if (strcmp(oldname, newname)) {
+		ref = add_ref_record(&tc, newname, update_index);
+		ref->value_type = rec.u.ref.value_type;
+		oidcpy(&ref->value, &rec.u.ref.value);
+		oidcpy(&ref->peeled, &rec.u.ref.peeled);
+		if (!copy)
+			add_ref_record(&tc, oldname, update_index)->value_type =
+				REFTABLE_REF_DELETION;
+
+		/* the new ref takes over the reflog of the old one */
+		for (i = 0; i < old_logs.logs_nr; i++) {
+			struct reftable_log_record *src = &old_logs.logs[i].u.log;
+			struct reftable_log_record *dst =
+				add_log_record(&tc, newname, src->update_index);
+
+			dst->value_type = src->value_type;
+			oidcpy(&dst->old_oid, &src->old_oid);
+			oidcpy(&dst->new_oid, &src->new_oid);
+			strbuf_addbuf(&dst->name, &src->name);
+			strbuf_addbuf(&dst->email, &src->email);
+			dst->time = src->time;
+			dst->tz_offset = src->tz_offset;
+			strbuf_addbuf(&dst->message, &src->message);
+			if (!copy)
+				add_log_tombstone(&tc, src);
+		}
+		/* both lists are sorted newest first */
+		for (i = j = 0; i < new_logs.logs_nr; i++) {
+			uint64_t idx = new_logs.logs[i].u.log.update_index;
+
+			while (j < old_logs.logs_nr &&
+			       old_logs.logs[j].u.log.update_index > idx)
+				j++;
+			if (j < old_logs.logs_nr &&
+			    old_logs.logs[j].u.log.update_index == idx)
+				continue;
+			add_log_tombstone(&tc, &new_logs.logs[i].u.log);
+		}
+	}
+
+	if (old_logs.logs_nr || should_write_log(stack, newname, 0))
+		fill_reflog_entry(add_log_record(&tc, newname, update_index),
+				  &rec.u.ref.value, &rec.u.ref.value, logmsg);
+
+	ret = commit_table_contents(&add, &tc, &err);
+	if (ret) {
+		if (copy)
+			error("unable to copy '%s' to '%s': %s", oldrefname, newrefname, err.buf);
+		else
+			error("unable to rename '%s' to '%s': %s", oldrefname, newrefname, err.buf);
+	}
+	goto out;
+
+abort:
+	reftable_addition_abort(&add);
+out:
+	reftable_record_release(&rec);
+	table_contents_release(&tc);
+	table_contents_release(&old_logs);
+	table_contents_release(&new_logs);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_be_rename_ref(struct ref_store *ref_store,
+				  const char *oldrefname, const char *newrefname,
+				  const char *logmsg)
+{
+	return reftable_be_copy_or_rename_ref(ref_store, oldrefname, newrefname,
+					      logmsg, 0);
+}
+
+static int reftable_be_copy_ref(struct ref_store *ref_store,
+				const char *oldrefname, const char *newrefname,
+				const char *logmsg)
+{
+	return reftable_be_copy_or_rename_ref(ref_store, oldrefname, newrefname,
+					      logmsg, 1);
+}
+
+struct reftable_ref_iterator {
+	struct ref_iterator base;
+	struct reftable_ref_store *refs;
+	struct reftable_merged_iter mi;
+	struct reftable_record rec;
+	char *prefix;
+	unsigned int flags;
+	/* hide the per-worktree refs of the main worktree */
+	int shared_only;
+	struct object_id oid;
+	int err;
+};
+
+static int reftable_ref_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+	int ret = iter->err;
+
+	while (!ret && !(ret = reftable_merged_iter_next(&iter->mi, &iter->rec))) {
+		const char *refname = iter->rec.u.ref.refname.buf;
+		int flags = 0;
+
+		if (!starts_with(refname, iter->prefix)) {
+			ret = 1;
+			break;
+		}
+		/* like the files backend, only enumerate refs below "refs/" */
+		if (!starts_with(refname, "refs/"))
+			continue;
+		if (iter->shared_only &&
+		    ref_type(refname) == REF_TYPE_PER_WORKTREE)
+			continue;
+		if ((iter->flags & DO_FOR_EACH_PER_WORKTREE_ONLY) &&
+		    ref_type(refname) != REF_TYPE_PER_WORKTREE)
+			continue;
+
+		if (iter->rec.u.ref.value_type == REFTABLE_REF_SYMREF) {
+			if (!refs_resolve_ref_unsafe(&iter->refs->base, refname,
+						     RESOLVE_REF_READING,
+						     &iter->oid, &flags)) {
+				oidclr(&iter->oid);
+				flags |= REF_ISBROKEN;
+			} else if (is_null_oid(&iter->oid)) {
+				flags |= REF_ISBROKEN;
+			}
+		} else {
+			oidcpy(&iter->oid, &iter->rec.u.ref.value);
+		}
+
+		if (check_refname_format(refname, REFNAME_ALLOW_ONELEVEL)) {
+			if (!refname_is_safe(refname))
+				die(_("refname is dangerous: %s"), refname);
+			oidclr(&iter->oid);
+			flags |= REF_BAD_NAME | REF_ISBROKEN;
+		}
+
+		if (!(iter->flags & DO_FOR_EACH_INCLUDE_BROKEN) &&
+		    !ref_resolves_to_object(refname, &iter->oid, flags))
+			continue;
+
+		iter->base.refname = refname;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (ret < 0) {
+		ref_iterator_abort(ref_iterator);
+		return ITER_ERROR;
+	}
+	if (ref_iterator_abort(ref_iterator) != ITER_DONE)
+		return ITER_ERROR;
+	return ITER_DONE;
+}
+
+static int reftable_ref_iterator_peel(struct ref_iterator *ref_iterator,
+				      struct object_id *peeled)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	switch (iter->rec.u.ref.value_type) {
+	case REFTABLE_REF_VAL2:
+		oidcpy(peeled, &iter->rec.u.ref.peeled);
+		return 0;
+	case REFTABLE_REF_VAL1:
+		/* tags are always stored together with their peeled value */
+		return -1;
+	default:
+		return peel_object(&iter->oid, peeled) ? -1 : 0;
+	}
+}
+
+static int reftable_ref_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	reftable_merged_iter_release(&iter->mi);
+	reftable_record_release(&iter->rec);
+	free(iter->prefix);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_ref_iterator_vtable = {
+	reftable_ref_iterator_advance,
+	reftable_ref_iterator_peel,
+	reftable_ref_iterator_abort
+};
+
+static struct ref_iterator *ref_iterator_for_stack(struct reftable_ref_store *refs,
+						   struct reftable_stack *stack,
+						   const char *prefix,
+						   unsigned int flags,
+						   int shared_only)
+{
+	struct reftable_ref_iterator *iter = xcalloc(1, sizeof(*iter));
+	struct ref_iterator *ref_iterator = &iter->base;
+
+	base_ref_iterator_init(ref_iterator, &reftable_ref_iterator_vtable, 1);
+	iter->refs = refs;
+	iter->prefix = xstrdup(prefix ? prefix : "");
+	iter->flags = flags;
+	iter->shared_only = shared_only;
+	reftable_record_init(&iter->rec, REFTABLE_BLOCK_TYPE_REF);
+	if (reftable_stack_seek(stack, &iter->mi, REFTABLE_BLOCK_TYPE_REF,
+				iter->prefix) < 0)
+		iter->err = -1;
+	return ref_iterator;
+}
+
+static struct ref_iterator *reftable_be_iterator_begin(struct ref_store *ref_store,
+						       const char *prefix,
+						       unsigned int flags)
+{
+	struct reftable_ref_store *refs;
+	unsigned int required_flags = REF_STORE_READ;
+
+	if (!(flags & DO_FOR_EACH_INCLUDE_BROKEN))
+		required_flags |= REF_STORE_ODB;
+	refs = reftable_downcast(ref_store, required_flags, "ref_iterator_begin");
+
+	if (!refs->worktree_stack)
+		return ref_iterator_for_stack(refs, &refs->main_stack,
+					      prefix, flags, 0);
+	return overlay_ref_iterator_begin(
+			ref_iterator_for_stack(refs, refs->worktree_stack,
+					       prefix, flags, 0),
+			ref_iterator_for_stack(refs, &refs->main_stack,
+					       prefix, flags, 1));
+}
+
+struct reftable_reflog_iterator {
+	struct ref_iterator base;
+	struct reftable_ref_store *refs;
+	struct reftable_merged_iter mi;
+	struct reftable_record rec;
+	struct strbuf last_name;
+	/* hide the logs of the main worktree's per-worktree refs */
+	int shared_only;
+	struct object_id oid;
+	int err;
+};
+
+static int reftable_reflog_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+	int ret = iter->err;
+
+	while (!ret && !(ret = reftable_merged_iter_next(&iter->mi, &iter->rec))) {
+		const char *refname = iter->rec.u.log.refname.buf;
+		int flags;
+
+		if (!strcmp(refname, iter->last_name.buf))
+			continue;
+		strbuf_reset(&iter->last_name);
+		strbuf_addstr(&iter->last_name, refname);
+
+		if (iter->shared_only &&
+		    (ref_type(refname) == REF_TYPE_PER_WORKTREE ||
+		     ref_type(refname) == REF_TYPE_PSEUDOREF))
+			continue;
+
+		if (refs_read_ref_full(&iter->refs->base, refname, 0,
+				       &iter->oid, &flags)) {
+			error("bad ref for %s", refname);
+			continue;
+		}
+
+		iter->base.refname = iter->last_name.buf;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (ret < 0) {
+		ref_iterator_abort(ref_iterator);
+		return ITER_ERROR;
+	}
+	if (ref_iterator_abort(ref_iterator) != ITER_DONE)
+		return ITER_ERROR;
+	return ITER_DONE;
+}
+
+static int reftable_reflog_iterator_peel(struct ref_iterator *ref_iterator,
+					 struct object_id *peeled)
+{
+	BUG("ref_iterator_peel() called for reflog_iterator");
+}
+
+static int reftable_reflog_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+
+	reftable_merged_iter_release(&iter->mi);
+	reftable_record_release(&iter->rec);
+	strbuf_release(&iter->last_name);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_reflog_iterator_vtable = {
+	reftable_reflog_iterator_advance,
+	reftable_reflog_iterator_peel,
+	reftable_reflog_iterator_abort
+};
+
+static struct ref_iterator *reflog_iterator_for_stack(struct reftable_ref_store *refs,
+						      struct reftable_stack *stack,
+						      int shared_only)
+{
+	struct reftable_reflog_iterator *iter = xcalloc(1, sizeof(*iter));
+	struct ref_iterator *ref_iterator = &iter->base;
+
+	base_ref_iterator_init(ref_iterator, &reftable_reflog_iterator_vtable, 1);
+	iter->refs = refs;
+	iter->shared_only = shared_only;
+	strbuf_init(&iter->last_name, 0);
+	reftable_record_init(&iter->rec, REFTABLE_BLOCK_TYPE_LOG);
+	if (reftable_stack_seek(stack, &iter->mi, REFTABLE_BLOCK_TYPE_LOG, "") < 0)
+		iter->err = -1;
+	return ref_iterator;
+}
+
+static struct ref_iterator *reftable_be_reflog_iterator_begin(struct ref_store *ref_store)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "reflog_iterator_begin");
+
+	if (!refs->worktree_stack)
+		return reflog_iterator_for_stack(refs, &refs->main_stack, 0);
+	return overlay_ref_iterator_begin(
+			reflog_iterator_for_stack(refs, refs->worktree_stack, 0),
+			reflog_iterator_for_stack(refs, &refs->main_stack, 1));
+}
+
+/* Pass a log entry to an each_reflog_ent_fn like the files backend does. */
+static int call_reflog_fn(each_reflog_ent_fn fn,
+			  struct reftable_log_record *log,
+			  struct strbuf *committer, void *cb_data)
+{
+	int tz = log->tz_offset < 0 ? -log->tz_offset : log->tz_offset;
+	int sign = log->tz_offset < 0 ? -1 : 1;
+
+	strbuf_reset(committer);
+	strbuf_addf(committer, "%s <%s>", log->name.buf, log->email.buf);
+	return fn(&log->old_oid, &log->new_oid, committer->buf, log->time,
+		  sign * ((tz / 60) * 100 + tz % 60),
+		  log->message.len ? log->message.buf : "\n", cb_data);
+}
+
+static int reftable_be_for_each_reflog_ent_reverse(struct ref_store *ref_store,
+						   const char *refname,
+						   each_reflog_ent_fn fn,
+						   void *cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "for_each_reflog_ent_reverse");
+	struct strbuf committer = STRBUF_INIT;
+	struct reftable_merged_iter mi;
+	struct reftable_record rec;
+	struct reftable_stack *stack;
+	const char *name;
+	int ret;
+
+	reftable_record_init(&rec, REFTABLE_BLOCK_TYPE_LOG);
+	stack = stack_for(refs, refname, &name);
+	ret = reftable_stack_seek(stack, &mi, REFTABLE_BLOCK_TYPE_LOG, name);
+	while (!ret && !(ret = reftable_merged_iter_next(&mi, &rec))) {
+		if (strcmp(rec.u.log.refname.buf, name))
+			break;
+		if (is_reflog_placeholder(&rec.u.log))
+			continue;
+		ret = call_reflog_fn(fn, &rec.u.log, &committer, cb_data);
+		if (ret)
+			goto out;
+	}
+	if (ret > 0)
+		ret = 0;
+out:
+	reftable_merged_iter_release(&mi);
+	reftable_record_release(&rec);
+	strbuf_release(&committer);
+	return ret;
+}
+
+static int reftable_be_for_each_reflog_ent(struct ref_store *ref_store,
+					   const char *refname,
+					   each_reflog_ent_fn fn,
+					   void *cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ,
+				  "for_each_reflog_ent");
+	struct table_contents logs = TABLE_CONTENTS_INIT;
+	struct strbuf committer = STRBUF_INIT;
+	struct reftable_stack *stack;
+	const char *name;
+	size_t i;
+	int ret;
+
+	stack = stack_for(refs, refname, &name);
+	ret = read_reflog(stack, name, &logs);
+	for (i = logs.logs_nr; !ret && i--; ) {
+		if (is_reflog_placeholder(&logs.logs[i].u.log))
+			continue;
+		ret = call_reflog_fn(fn, &logs.logs[i].u.log, &committer,
+				     cb_data);
+	}
+	table_contents_release(&logs);
+	strbuf_release(&committer);
+	return ret;
+}
+
+static int reftable_be_reflog_exists(struct ref_store *ref_store,
+				     const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "reflog_exists");
+	const char *name;
+	struct reftable_stack *stack = stack_for(refs, refname, &name);
+
+	return stack_reflog_exists(stack, name);
+}
+
+static int reftable_be_create_reflog(struct ref_store *ref_store,
+				     const char *refname, int force_create,
+				     struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_reflog");
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	struct table_contents tc = TABLE_CONTENTS_INIT;
+	struct reftable_stack *stack;
+	const char *name;
+	int ret;
+
+	if (log_all_ref_updates == LOG_REFS_UNSET)
+		log_all_ref_updates = is_bare_repository() ? LOG_REFS_NONE : LOG_REFS_NORMAL;
+	if (!force_create && !should_autocreate_reflog(refname))
+		return 0;
+
+	stack = stack_for(refs, refname, &name);
+	if (reftable_addition_begin(&add, stack, err) < 0)
+		return -1;
+	if (stack_reflog_exists(stack, name)) {
+		reftable_addition_abort(&add);
+		return 0;
+	}
+	fill_reflog_entry(add_log_record(&tc, name, add.next_update_index),
+			  &null_oid, &null_oid, NULL);
+	ret = commit_table_contents(&add, &tc, err);
+	table_contents_release(&tc);
+	return ret;
+}
+
+static int reftable_be_delete_reflog(struct ref_store *ref_store,
+				     const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "delete_reflog");
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	struct table_contents logs = TABLE_CONTENTS_INIT;
+	struct table_contents tc = TABLE_CONTENTS_INIT;
+	struct reftable_stack *stack;
+	struct strbuf err = STRBUF_INIT;
+	const char *name;
+	size_t i;
+	int ret;
+
+	stack = stack_for(refs, refname, &name);
+	if (reftable_addition_begin(&add, stack, &err) < 0) {
+		ret = error("%s", err.buf);
+		goto out;
+	}
+	if (read_reflog(stack, name, &logs) < 0) {
+		reftable_addition_abort(&add);
+		ret = -1;
+		goto out;
+	}
+	for (i = 0; i < logs.logs_nr; i++)
+		add_log_tombstone(&tc, &logs.logs[i].u.log);
+	ret = commit_table_contents(&add, &tc, &err);
+	if (ret)
+		error("%s", err.buf);
+
+out:
+	table_contents_release(&logs);
+	table_contents_release(&tc);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int reftable_be_reflog_expire(struct ref_store *ref_store,
+				     const char *refname,
+				     const struct object_id *oid,
+				     unsigned int flags,
+				     reflog_expiry_prepare_fn prepare_fn,
+				     reflog_expiry_should_prune_fn should_prune_fn,
+				     reflog_expiry_cleanup_fn cleanup_fn,
+				     void *policy_cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "reflog_expire");
+	struct reftable_addition add = REFTABLE_ADDITION_INIT;
+	struct table_contents logs = TABLE_CONTENTS_INIT;
+	struct table_contents tc = TABLE_CONTENTS_INIT;
+	struct strbuf err = STRBUF_INIT, committer = STRBUF_INIT;
+	struct object_id last_kept_oid;
+	struct reftable_stack *stack;
+	struct reftable_record rec;
+	const char *name;
+	int ret = 0, is_symref = 0;
+	size_t i;
+
+	reftable_record_init(&rec, REFTABLE_BLOCK_TYPE_REF);
+	stack = stack_for(refs, refname, &name);
+	if (reftable_addition_begin(&add, stack, &err) < 0) {
+		ret = error("cannot lock ref '%s': %s", refname, err.buf);
+		goto out;
+	}
+
+	reftable_record_release(&rec);
+	if (!read_ref_record(stack, name, &rec))
+		is_symref = rec.u.ref.value_type == REFTABLE_REF_SYMREF;
+	if (read_reflog(stack, name, &logs) < 0 || !logs.logs_nr) {
+		reftable_addition_abort(&add);
+		goto out;
+	}
+
+	oidclr(&last_kept_oid);
+	(*prepare_fn)(refname, oid, policy_cb_data);
+	for (i = logs.logs_nr; i--; ) {
+		struct reftable_log_record *log = &logs.logs[i].u.log;
+		struct object_id *ooid = &log->old_oid;
+		const char *msg = log->message.len ? log->message.buf : "\n";
+		int tz = log->tz_offset < 0 ? -log->tz_offset : log->tz_offset;
+
+		if (is_reflog_placeholder(log))
+			continue;
+		if (flags & EXPIRE_REFLOGS_REWRITE)
+			ooid = &last_kept_oid;
+		strbuf_reset(&committer);
+		strbuf_addf(&committer, "%s <%s>", log->name.buf, log->email.buf);
+		tz = (log->tz_offset < 0 ? -1 : 1) * ((tz / 60) * 100 + tz % 60);
+
+		if ((*should_prune_fn)(ooid, &log->new_oid, committer.buf,
+				       log->time, tz, msg, policy_cb_data)) {
+			if (flags & EXPIRE_REFLOGS_DRY_RUN)
+				printf("would prune %s", msg);
+			else if (flags & EXPIRE_REFLOGS_VERBOSE)
+				printf("prune %s", msg);
+			add_log_tombstone(&tc, log);
+		} else {
+			if (!(flags & EXPIRE_REFLOGS_DRY_RUN)) {
+				if (!oideq(ooid, &log->old_oid)) {
+					struct reftable_log_record *copy =
+						add_log_record(&tc, name,
+							       log->update_index);
+
+					reftable_record_swap(&tc.logs[tc.logs_nr - 1],
+							     &logs.logs[i]);
+					oidcpy(&copy->old_oid, &last_kept_oid);
+					log = copy;
+				}
+				oidcpy(&last_kept_oid, &log->new_oid);
+			}
+			if (flags & EXPIRE_REFLOGS_VERBOSE)
+				printf("keep %s", msg);
+		}
+	}
+	(*cleanup_fn)(policy_cb_data);
+
+	if (flags & EXPIRE_REFLOGS_DRY_RUN) {
+		reftable_addition_abort(&add);
+		goto out;
+	}
+
+	/*
+	 * It doesn't make sense to adjust a reference pointed to by a
+	 * symbolic ref based on expiring entries in the symbolic
+	 * reference's reflog. Nor can we update a reference if there
+	 * are no remaining reflog entries.
+	 */
+	if ((flags & EXPIRE_REFLOGS_UPDATE_REF) && !is_symref &&
+	    !is_null_oid(&last_kept_oid))
+		set_ref_value(add_ref_record(&tc, name, add.next_update_index),
+			      &last_kept_oid);
+
+	ret = commit_table_contents(&add, &tc, &err);
+	if (ret)
+		error(_("unable to write reflog '%s': %s"), refname, err.buf);
+
+out:
+	reftable_record_release(&rec);
+	table_contents_release(&logs);
+	table_contents_release(&tc);
+	strbuf_release(&err);
+	strbuf_release(&committer);
+	return ret;
+}
+
+struct ref_storage_be refs_be_reftable = {
+	&refs_be_files,
+	"reftable",
+	reftable_be_init,
+	reftable_be_init_db,
+	reftable_be_transaction_prepare,
+	reftable_be_transaction_finish,
+	reftable_be_transaction_abort,
+	reftable_be_initial_transaction_commit,
+
+	reftable_be_pack_refs,
+	reftable_be_create_symref,
+	reftable_be_delete_refs,
+	reftable_be_rename_ref,
+	reftable_be_copy_ref,
+
+	reftable_be_iterator_begin,
+	reftable_be_read_raw_ref,
+
+	reftable_be_reflog_iterator_begin,
+	reftable_be_for_each_reflog_ent,
+	reftable_be_for_each_reflog_ent_reverse,
+	reftable_be_reflog_exists,
+	reftable_be_create_reflog,
+	reftable_be_delete_reflog,
+	reftable_be_reflog_expire
+};
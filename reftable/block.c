@@ -0,0 +1,332 @@
+#include "cache.h"
+#include "block.h"
+
+/* The block length is stored as a uint24. */
+#define MAX_BLOCK_LEN ((1U << 24) - 1)
+
+void block_writer_init(struct block_writer *bw, uint8_t type,
+		       uint32_t block_size, uint32_t header_off,
+		       int restart_interval, int hash_size,
+		       uint64_t min_update_index)
+{
+	if (!bw->buf.alloc) {
+		strbuf_init(&bw->buf, block_size);
+		strbuf_init(&bw->last_key, 0);
+		strbuf_init(&bw->key, 0);
+		strbuf_init(&bw->scratch, 0);
+	}
+	strbuf_reset(&bw->buf);
+	strbuf_addchars(&bw->buf, 0, header_off + 4);
+	strbuf_reset(&bw->last_key);
+	bw->type = type;
+	bw->header_off = header_off;
+	bw->block_size = block_size;
+	bw->restart_interval = restart_interval > 0 ? restart_interval : 16;
+	bw->hash_size = hash_size;
+	bw->min_update_index = min_update_index;
+	bw->restarts_nr = 0;
+	bw->entries = 0;
+}
+
+static size_t common_prefix(const struct strbuf *a, const struct strbuf *b)
+{
+	size_t i, len = a->len < b->len ? a->len : b->len;
+
+	for (i = 0; i < len; i++)
+		if (a->buf[i] != b->buf[i])
+			break;
+	return i;
+}
+
+int block_writer_add(struct block_writer *bw, const struct reftable_record *rec)
+{
+	struct strbuf *out = &bw->scratch;
+	size_t prefix = 0, trailer;
+	int restart;
+
+	if (rec->type != bw->type)
+		BUG("adding a '%c' record to a '%c' block", rec->type, bw->type);
+
+	reftable_record_key(rec, &bw->key);
+	restart = !(bw->entries % bw->restart_interval) &&
+		  bw->restarts_nr < 0xffff;
+	if (!restart)
+		prefix = common_prefix(&bw->last_key, &bw->key);
+
+	strbuf_reset(out);
+	reftable_put_varint(out, prefix);
+	reftable_put_varint(out, ((uint64_t)(bw->key.len - prefix) << 3) |
+				 reftable_record_val_type(rec));
+	strbuf_add(out, bw->key.buf + prefix, bw->key.len - prefix);
+	reftable_record_encode(rec, out, bw->hash_size, bw->min_update_index);
+
+	trailer = (bw->restarts_nr + restart) * 3 + 2;
+	if (bw->buf.len + out->len + trailer > MAX_BLOCK_LEN)
+		return bw->entries ? 1 : -1;
+	if (bw->block_size &&
+	    bw->buf.len + out->len + trailer > bw->block_size) {
+		if (bw->entries)
+			return 1;
+		if (bw->type != REFTABLE_BLOCK_TYPE_LOG)
+			return -1;
+	}
+
+	if (restart) {
+		ALLOC_GROW(bw->restarts, bw->restarts_nr + 1, bw->restarts_alloc);
+		bw->restarts[bw->restarts_nr++] = bw->buf.len;
+	}
+	strbuf_addbuf(&bw->buf, out);
+	strbuf_swap(&bw->last_key, &bw->key);
+	bw->entries++;
+	return 0;
+}
+
+static int deflate_block(struct block_writer *bw)
+{
+	size_t skip = bw->header_off + 4;
+	struct strbuf *out = &bw->scratch;
+	git_zstream stream;
+	int status;
+
+	memset(&stream, 0, sizeof(stream));
+	git_deflate_init(&stream, zlib_compression_level);
+	strbuf_reset(out);
+	strbuf_grow(out, skip + git_deflate_bound(&stream, bw->buf.len - skip));
+	strbuf_add(out, bw->buf.buf, skip);
+
+	stream.next_in = (unsigned char *)bw->buf.buf + skip;
+	stream.avail_in = bw->buf.len - skip;
+	stream.next_out = (unsigned char *)out->buf + skip;
+	stream.avail_out = out->alloc - skip - 1;
+	status = git_deflate(&stream, Z_FINISH);
+	if (status != Z_STREAM_END) {
+		git_deflate_abort(&stream);
+		return -1;
+	}
+	strbuf_setlen(out, skip + stream.total_out);
+	if (git_deflate_end_gently(&stream) != Z_OK)
+		return -1;
+	strbuf_swap(&bw->buf, out);
+	return 0;
+}
+
+int block_writer_finish(struct block_writer *bw)
+{
+	unsigned char be[3];
+	size_t i;
+
+	for (i = 0; i < bw->restarts_nr; i++) {
+		reftable_put_be24(be, bw->restarts[i]);
+		strbuf_add(&bw->buf, be, 3);
+	}
+	put_be16(be, bw->restarts_nr);
+	strbuf_add(&bw->buf, be, 2);
+	if (bw->buf.len > MAX_BLOCK_LEN)
+		return -1;
+
+	bw->buf.buf[bw->header_off] = bw->type;
+	reftable_put_be24((unsigned char *)bw->buf.buf + bw->header_off + 1,
+			  bw->buf.len);
+
+	if (bw->type == REFTABLE_BLOCK_TYPE_LOG)
+		return deflate_block(bw);
+	return 0;
+}
+
+void block_writer_release(struct block_writer *bw)
+{
+	strbuf_release(&bw->buf);
+	strbuf_release(&bw->last_key);
+	strbuf_release(&bw->key);
+	strbuf_release(&bw->scratch);
+	FREE_AND_NULL(bw->restarts);
+	bw->restarts_nr = bw->restarts_alloc = 0;
+}
+
+static int inflate_block(struct block_reader *br, const unsigned char *block,
+			 size_t avail)
+{
+	size_t skip = br->header_off + 4;
+	git_zstream stream;
+	int status;
+
+	br->inflated = xmalloc(br->block_len);
+	memcpy(br->inflated, block, skip);
+
+	memset(&stream, 0, sizeof(stream));
+	git_inflate_init(&stream);
+	stream.next_in = (unsigned char *)block + skip;
+	stream.avail_in = avail - skip;
+	stream.next_out = br->inflated + skip;
+	stream.avail_out = br->block_len - skip;
+	status = git_inflate(&stream, Z_FINISH);
+	if (status != Z_STREAM_END || stream.avail_out) {
+		git_inflate_end(&stream);
+		return -1;
+	}
+	br->full_len = skip + stream.total_in;
+	git_inflate_end(&stream);
+	br->data = br->inflated;
+	return 0;
+}
+
+int block_reader_init(struct block_reader *br, const unsigned char *block,
+		      size_t avail, uint32_t header_off, int hash_size,
+		      uint64_t min_update_index)
+{
+	memset(br, 0, sizeof(*br));
+	br->header_off = header_off;
+	br->hash_size = hash_size;
+	br->min_update_index = min_update_index;
+
+	if (avail < header_off + 4)
+		return -1;
+	br->type = block[header_off];
+	br->block_len = reftable_get_be24(block + header_off + 1);
+	if (br->block_len < header_off + 4 + 2)
+		return -1;
+
+	if (br->type == REFTABLE_BLOCK_TYPE_LOG) {
+		if (inflate_block(br, block, avail) < 0) {
+			block_reader_release(br);
+			return -1;
+		}
+	} else {
+		if (br->block_len > avail)
+			return -1;
+		br->data = block;
+		br->full_len = br->block_len;
+	}
+
+	br->restart_count = get_be16(br->data + br->block_len - 2);
+	if ((size_t)br->restart_count * 3 + 2 > br->block_len - header_off - 4) {
+		block_reader_release(br);
+		return -1;
+	}
+	br->restart_off = br->block_len - 2 - 3 * br->restart_count;
+	return 0;
+}
+
+void block_reader_release(struct block_reader *br)
+{
+	FREE_AND_NULL(br->inflated);
+	br->data = NULL;
+}
+
+void block_iter_start(struct block_iter *it, const struct block_reader *br)
+{
+	it->br = br;
+	it->next_off = br->header_off + 4;
+	strbuf_reset(&it->last_key);
+}
+
+static int decode_key(struct strbuf *key, uint8_t *val_type,
+		      const struct strbuf *last_key,
+		      const unsigned char **p, const unsigned char *end)
+{
+	uint64_t prefix, n, suffix;
+
+	if (reftable_get_varint(&prefix, p, end) || prefix > last_key->len ||
+	    reftable_get_varint(&n, p, end))
+		return -1;
+	suffix = n >> 3;
+	*val_type = n & 0x7;
+	if (suffix > end - *p)
+		return -1;
+	strbuf_reset(key);
+	strbuf_add(key, last_key->buf, prefix);
+	strbuf_add(key, *p, suffix);
+	*p += suffix;
+	return 0;
+}
+
+int block_iter_next(struct block_iter *it, struct reftable_record *rec)
+{
+	const struct block_reader *br = it->br;
+	const unsigned char *p = br->data + it->next_off;
+	const unsigned char *end = br->data + br->restart_off;
+	uint8_t val_type;
+
+	if (p >= end)
+		return 1;
+	if (rec->type != br->type)
+		BUG("reading a '%c' record from a '%c' block", rec->type, br->type);
+	if (decode_key(&it->key, &val_type, &it->last_key, &p, end) < 0 ||
+	    reftable_record_decode(rec, &it->key, val_type, &p, end,
+				   br->hash_size, br->min_update_index) < 0)
+		return -1;
+	strbuf_swap(&it->last_key, &it->key);
+	it->next_off = p - br->data;
+	return 0;
+}
+
+static int restart_key(const struct block_reader *br, size_t i,
+		       struct strbuf *key)
+{
+	static const struct strbuf empty = STRBUF_INIT;
+	uint32_t off = reftable_get_be24(br->data + br->restart_off + 3 * i);
+	const unsigned char *p = br->data + off;
+	uint8_t val_type;
+
+	if (off < br->header_off + 4 || off >= br->restart_off)
+		return -1;
+	return decode_key(key, &val_type, &empty, &p,
+			  br->data + br->restart_off);
+}
+
+int block_iter_seek(struct block_iter *it, const struct block_reader *br,
+		    const struct strbuf *want)
+{
+	struct strbuf key = STRBUF_INIT, saved_key = STRBUF_INIT;
+	struct reftable_record rec;
+	size_t lo = 0, hi = br->restart_count;
+	int ret = 0;
+
+	/* find the first restart point whose key sorts after 'want' */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (restart_key(br, mid, &key) < 0) {
+			strbuf_release(&key);
+			return -1;
+		}
+		if (strbuf_cmp(&key, want) > 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	strbuf_release(&key);
+
+	block_iter_start(it, br);
+	if (lo)
+		it->next_off = reftable_get_be24(br->data + br->restart_off +
+						 3 * (lo - 1));
+
+	reftable_record_init(&rec, br->type);
+	for (;;) {
+		uint32_t off = it->next_off;
+
+		strbuf_reset(&saved_key);
+		strbuf_addbuf(&saved_key, &it->last_key);
+		ret = block_iter_next(it, &rec);
+		if (ret) {
+			if (ret > 0)
+				ret = 0;
+			break;
+		}
+		if (strbuf_cmp(&it->last_key, want) >= 0) {
+			it->next_off = off;
+			strbuf_swap(&it->last_key, &saved_key);
+			break;
+		}
+	}
+	reftable_record_release(&rec);
+	strbuf_release(&saved_key);
+	return ret;
+}
+
+void block_iter_release(struct block_iter *it)
+{
+	strbuf_release(&it->last_key);
+	strbuf_release(&it->key);
+}
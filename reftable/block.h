@@ -0,0 +1,107 @@
+#ifndef REFTABLE_BLOCK_H
+#define REFTABLE_BLOCK_H
+
+#include "record.h"
+
+/*
+ * A block holds a sorted run of records of one type. Keys are prefix
+ * compressed against the previous key, except at restart points,
+ * whose offsets are listed at the end of the block so that readers
+ * can binary search them. Log blocks are zlib compressed after the
+ * four byte block header.
+ */
+
+struct block_writer {
+	struct strbuf buf;
+	uint8_t type;
+	uint32_t header_off;
+	uint32_t block_size;
+	int restart_interval;
+	int hash_size;
+	uint64_t min_update_index;
+
+	uint32_t *restarts;
+	size_t restarts_nr, restarts_alloc;
+	uint32_t entries;
+	struct strbuf last_key;
+	struct strbuf key, scratch;
+};
+
+/*
+ * Start a new block of 'type'. The first 'header_off' bytes of the
+ * block are reserved for the file header, which the caller fills in.
+ * A 'block_size' of zero does not limit the size of the block.
+ */
+void block_writer_init(struct block_writer *bw, uint8_t type,
+		       uint32_t block_size, uint32_t header_off,
+		       int restart_interval, int hash_size,
+		       uint64_t min_update_index);
+
+/*
+ * Append a record, whose key must sort after all keys already in the
+ * block. Returns 0 on success and 1 if the block is full. Returns -1
+ * if the record does not even fit into an empty block; log blocks
+ * accept an oversized record when they are empty.
+ */
+int block_writer_add(struct block_writer *bw, const struct reftable_record *rec);
+
+/*
+ * Write the restart table and the block header, and compress log
+ * blocks. The finished block is left in 'bw->buf'. Returns -1 if the
+ * block is too large to be represented.
+ */
+int block_writer_finish(struct block_writer *bw);
+
+void block_writer_release(struct block_writer *bw);
+
+struct block_reader {
+	uint8_t type;
+	uint32_t header_off;
+	const unsigned char *data;
+	unsigned char *inflated;
+	uint32_t block_len;
+	/* bytes the block takes up in the file, excluding padding */
+	uint32_t full_len;
+	uint32_t restart_off;
+	uint16_t restart_count;
+	int hash_size;
+	uint64_t min_update_index;
+};
+
+/*
+ * Parse the block starting at 'block', of which 'avail' bytes are
+ * accessible. Returns 0 on success and -1 if the block is corrupt.
+ */
+int block_reader_init(struct block_reader *br, const unsigned char *block,
+		      size_t avail, uint32_t header_off, int hash_size,
+		      uint64_t min_update_index);
+void block_reader_release(struct block_reader *br);
+
+struct block_iter {
+	const struct block_reader *br;
+	uint32_t next_off;
+	struct strbuf last_key;
+	struct strbuf key;
+};
+
+#define BLOCK_ITER_INIT { NULL, 0, STRBUF_INIT, STRBUF_INIT }
+
+/* Position the iterator before the first record of the block. */
+void block_iter_start(struct block_iter *it, const struct block_reader *br);
+
+/*
+ * Position the iterator before the first record whose key is not
+ * smaller than 'want'. Returns 0 on success and -1 on corruption.
+ */
+int block_iter_seek(struct block_iter *it, const struct block_reader *br,
+		    const struct strbuf *want);
+
+/*
+ * Read the next record. Returns 0 on success, 1 at the end of the
+ * block and -1 on corruption.
+ */
+int block_iter_next(struct block_iter *it, struct reftable_record *rec);
+
+void block_iter_release(struct block_iter *it);
+
+#endif /* REFTABLE_BLOCK_H */
@@ -0,0 +1,272 @@
+#include "cache.h"
+#include "reader.h"
+#include "writer.h"
+
+static int parse_table(struct reftable_table *t, int hash_size)
+{
+	const unsigned char *footer;
+	uint32_t footer_size;
+	uint64_t footer_off, obj_off, obj_index_off;
+	int algo = GIT_HASH_SHA1;
+
+	if (t->size < 24 + 68 || memcmp(t->map, "REFT", 4))
+		return error(_("'%s' is not a reftable"), t->name);
+
+	t->version = t->map[4];
+	if (t->version == 2)
+		algo = hash_algo_by_id(get_be32(t->map + 24));
+	else if (t->version != 1)
+		return error(_("reftable '%s' has unsupported version %d"),
+			     t->name, t->version);
+	if (algo == GIT_HASH_UNKNOWN || hash_algos[algo].rawsz != hash_size)
+		return error(_("reftable '%s' uses the wrong hash function"),
+			     t->name);
+	t->hash_size = hash_size;
+
+	t->header_size = reftable_header_size(t->version);
+	footer_size = reftable_footer_size(t->version);
+	if (t->size < t->header_size + footer_size)
+		return error(_("reftable '%s' is truncated"), t->name);
+	footer_off = t->size - footer_size;
+	footer = t->map + footer_off;
+	if (memcmp(footer, t->map, t->header_size) ||
+	    crc32(0, footer, footer_size - 4) !=
+	    get_be32(footer + footer_size - 4))
+		return error(_("reftable '%s' has a corrupt footer"), t->name);
+
+	t->block_size = reftable_get_be24(t->map + 5);
+	t->min_update_index = get_be64(t->map + 8);
+	t->max_update_index = get_be64(t->map + 16);
+
+	footer += t->header_size;
+	t->ref_index_off = get_be64(footer);
+	obj_off = get_be64(footer + 8) >> 5;
+	obj_index_off = get_be64(footer + 16);
+	t->log_off = get_be64(footer + 24);
+	t->log_index_off = get_be64(footer + 32);
+
+	if (t->ref_index_off >= footer_off || obj_off >= footer_off ||
+	    obj_index_off >= footer_off || t->log_off >= footer_off ||
+	    t->log_index_off >= footer_off)
+		return error(_("reftable '%s' has a corrupt footer"), t->name);
+
+	t->has_refs = footer_off > t->header_size &&
+		      t->map[t->header_size] == REFTABLE_BLOCK_TYPE_REF;
+	t->ref_end = footer_off;
+	if (t->ref_index_off && t->ref_index_off < t->ref_end)
+		t->ref_end = t->ref_index_off;
+	if (obj_off && obj_off < t->ref_end)
+		t->ref_end = obj_off;
+	if (t->log_off && t->log_off < t->ref_end)
+		t->ref_end = t->log_off;
+	t->log_end = t->log_index_off ? t->log_index_off : footer_off;
+	return 0;
+}
+
+int reftable_table_open(struct reftable_table **out, const char *path,
+			const char *name, int hash_size)
+{
+	struct reftable_table *t;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			error_errno(_("unable to open '%s'"), path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		error_errno(_("unable to stat '%s'"), path);
+		close(fd);
+		return -1;
+	}
+
+	CALLOC_ARRAY(t, 1);
+	t->refcount = 1;
+	t->name = xstrdup(name);
+	t->size = xsize_t(st.st_size);
+	if (t->size)
+		t->map = xmmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (parse_table(t, hash_size) < 0) {
+		reftable_table_close(t);
+		errno = EINVAL;
+		return -1;
+	}
+	*out = t;
+	return 0;
+}
+
+void reftable_table_close(struct reftable_table *t)
+{
+	if (!t || --t->refcount)
+		return;
+	if (t->map)
+		munmap(t->map, t->size);
+	free(t->name);
+	free(t);
+}
+
+static int read_block(struct reftable_table *t, uint64_t off,
+		      struct block_reader *br)
+{
+	uint64_t footer_off = t->size - reftable_footer_size(t->version);
+
+	if (off >= footer_off ||
+	    block_reader_init(br, t->map + off, footer_off - off,
+			      off ? 0 : t->header_size, t->hash_size,
+			      t->min_update_index) < 0)
+		return error(_("reftable '%s' has a corrupt block at %"PRIuMAX),
+			     t->name, (uintmax_t)off);
+	return 0;
+}
+
+static uint64_t section_end(const struct reftable_table_iter *ti)
+{
+	if (ti->type == REFTABLE_BLOCK_TYPE_REF)
+		return ti->t->ref_end;
+	return ti->t->log_end;
+}
+
+/*
+ * Move to the block following the current one, skipping the padding
+ * that aligns ref blocks. Returns 0 on success, 1 at the end of the
+ * section and -1 on corruption.
+ */
+static int next_block(struct reftable_table_iter *ti)
+{
+	struct reftable_table *t = ti->t;
+	uint64_t off = ti->block_off + ti->br.full_len;
+
+	block_reader_release(&ti->br);
+	if (off < section_end(ti) && !t->map[off] && t->block_size)
+		off = (off + t->block_size - 1) / t->block_size * t->block_size;
+	if (off >= section_end(ti)) {
+		ti->done = 1;
+		return 1;
+	}
+	if (read_block(t, off, &ti->br) < 0)
+		return -1;
+	if (ti->br.type != ti->type) {
+		block_reader_release(&ti->br);
+		ti->done = 1;
+		return 1;
+	}
+	ti->block_off = off;
+	block_iter_start(&ti->bi, &ti->br);
+	return 0;
+}
+
+static int seek_indexed(struct reftable_table_iter *ti, uint64_t off,
+			const struct strbuf *key)
+{
+	struct reftable_table *t = ti->t;
+	struct reftable_record rec;
+	int ret = 0;
+
+	reftable_record_init(&rec, REFTABLE_BLOCK_TYPE_INDEX);
+	for (;;) {
+		if (read_block(t, off, &ti->br) < 0) {
+			ret = -1;
+			break;
+		}
+		if (ti->br.type == ti->type) {
+			ti->block_off = off;
+			if (block_iter_seek(&ti->bi, &ti->br, key) < 0)
+				ret = error(_("reftable '%s' is corrupt"), t->name);
+			break;
+		}
+		if (ti->br.type != REFTABLE_BLOCK_TYPE_INDEX) {
+			ret = error(_("reftable '%s' has a corrupt index"), t->name);
+			break;
+		}
+
+		ret = block_iter_seek(&ti->bi, &ti->br, key);
+		if (!ret)
+			ret = block_iter_next(&ti->bi, &rec);
+		block_reader_release(&ti->br);
+		if (ret) {
+			/* every key in the table sorts before 'key' */
+			if (ret > 0)
+				ret = 0;
+			else
+				error(_("reftable '%s' has a corrupt index"), t->name);
+			ti->done = 1;
+			break;
+		}
+		off = rec.u.idx.offset;
+	}
+	reftable_record_release(&rec);
+	return ret;
+}
+
+int reftable_table_seek(struct reftable_table_iter *ti, struct reftable_table *t,
+			uint8_t type, const struct strbuf *key)
+{
+	uint64_t off, index_off;
+	int ret;
+
+	block_reader_release(&ti->br);
+	ti->t = t;
+	ti->type = type;
+	ti->done = 0;
+
+	if (type == REFTABLE_BLOCK_TYPE_REF) {
+		if (!t->has_refs) {
+			ti->done = 1;
+			return 0;
+		}
+		off = 0;
+		index_off = t->ref_index_off;
+	} else {
+		if (!t->log_off) {
+			ti->done = 1;
+			return 0;
+		}
+		off = t->log_off;
+		index_off = t->log_index_off;
+	}
+
+	if (index_off)
+		return seek_indexed(ti, index_off, key);
+
+	if (read_block(t, off, &ti->br) < 0)
+		return -1;
+	ti->block_off = off;
+	for (;;) {
+		if (block_iter_seek(&ti->bi, &ti->br, key) < 0)
+			return error(_("reftable '%s' is corrupt"), t->name);
+		if (ti->bi.next_off < ti->br.restart_off)
+			return 0;
+		ret = next_block(ti);
+		if (ret)
+			return ret > 0 ? 0 : -1;
+	}
+}
+
+int reftable_table_iter_next(struct reftable_table_iter *ti,
+			     struct reftable_record *rec)
+{
+	int ret;
+
+	for (;;) {
+		if (ti->done)
+			return 1;
+		ret = block_iter_next(&ti->bi, rec);
+		if (ret <= 0) {
+			if (ret < 0)
+				error(_("reftable '%s' is corrupt"), ti->t->name);
+			return ret;
+		}
+		if (next_block(ti) < 0)
+			return -1;
+	}
+}
+
+void reftable_table_iter_release(struct reftable_table_iter *ti)
+{
+	block_reader_release(&ti->br);
+	block_iter_release(&ti->bi);
+}
@@ -0,0 +1,73 @@
+#ifndef REFTABLE_READER_H
+#define REFTABLE_READER_H
+
+#include "block.h"
+
+/*
+ * A single reftable file, mapped into memory. Tables are reference
+ * counted so that iterators keep them alive while the stack reloads.
+ */
+struct reftable_table {
+	unsigned int refcount;
+	char *name;
+	unsigned char *map;
+	size_t size;
+
+	int version;
+	uint32_t block_size;
+	uint32_t header_size;
+	uint64_t min_update_index, max_update_index;
+	int hash_size;
+
+	int has_refs;
+	uint64_t ref_end;
+	uint64_t ref_index_off;
+	uint64_t log_off, log_end;
+	uint64_t log_index_off;
+};
+
+/*
+ * Map and validate the table at 'path'. Returns 0 on success, -1 with
+ * an error message if the table is corrupt, and -1 with errno set to
+ * ENOENT (without printing anything) if it does not exist.
+ */
+int reftable_table_open(struct reftable_table **out, const char *path,
+			const char *name, int hash_size);
+
+/* Take another reference to an open table. */
+static inline struct reftable_table *reftable_table_ref(struct reftable_table *t)
+{
+	t->refcount++;
+	return t;
+}
+
+/* Drop a reference, unmapping the table when it was the last one. */
+void reftable_table_close(struct reftable_table *t);
+
+/* Iterates over the ref or log records of one table in key order. */
+struct reftable_table_iter {
+	struct reftable_table *t;
+	uint8_t type;
+	uint64_t block_off;
+	struct block_reader br;
+	struct block_iter bi;
+	int done;
+};
+
+#define REFTABLE_TABLE_ITER_INIT { .bi = BLOCK_ITER_INIT }
+
+/*
+ * Position the iterator before the first record of 'type' whose key
+ * is not smaller than 'key'. Returns 0 on success and -1 if the table
+ * is corrupt.
+ */
+int reftable_table_seek(struct reftable_table_iter *ti, struct reftable_table *t,
+			uint8_t type, const struct strbuf *key);
+
+/* Returns 0 on success, 1 when exhausted and -1 on corruption. */
+int reftable_table_iter_next(struct reftable_table_iter *ti,
+			     struct reftable_record *rec);
+
+void reftable_table_iter_release(struct reftable_table_iter *ti);
+
+#endif /* REFTABLE_READER_H */
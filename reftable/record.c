@@ -0,0 +1,275 @@
+#include "cache.h"
+#include "record.h"
+
+void reftable_put_varint(struct strbuf *out, uint64_t val)
+{
+	unsigned char buf[16];
+	unsigned pos = sizeof(buf) - 1;
+
+	buf[pos] = val & 0x7f;
+	while (val >>= 7)
+		buf[--pos] = 0x80 | (--val & 0x7f);
+	strbuf_add(out, buf + pos, sizeof(buf) - pos);
+}
+
+int reftable_get_varint(uint64_t *val, const unsigned char **p,
+			const unsigned char *end)
+{
+	const unsigned char *ptr = *p;
+	unsigned char c;
+	uint64_t v;
+
+	if (ptr >= end)
+		return -1;
+	c = *ptr++;
+	v = c & 0x7f;
+	while (c & 0x80) {
+		v += 1;
+		if (!v || MSB(v, 7) || ptr >= end)
+			return -1;
+		c = *ptr++;
+		v = (v << 7) + (c & 0x7f);
+	}
+	*val = v;
+	*p = ptr;
+	return 0;
+}
+
+void reftable_record_init(struct reftable_record *rec, uint8_t type)
+{
+	memset(rec, 0, sizeof(*rec));
+	rec->type = type;
+	switch (type) {
+	case REFTABLE_BLOCK_TYPE_REF:
+		strbuf_init(&rec->u.ref.refname, 0);
+		strbuf_init(&rec->u.ref.target, 0);
+		break;
+	case REFTABLE_BLOCK_TYPE_LOG:
+		strbuf_init(&rec->u.log.refname, 0);
+		strbuf_init(&rec->u.log.name, 0);
+		strbuf_init(&rec->u.log.email, 0);
+		strbuf_init(&rec->u.log.message, 0);
+		break;
+	case REFTABLE_BLOCK_TYPE_INDEX:
+		strbuf_init(&rec->u.idx.last_key, 0);
+		break;
+	default:
+		BUG("unknown reftable record type '%c'", type);
+	}
+}
+
+void reftable_record_release(struct reftable_record *rec)
+{
+	switch (rec->type) {
+	case REFTABLE_BLOCK_TYPE_REF:
+		strbuf_release(&rec->u.ref.refname);
+		strbuf_release(&rec->u.ref.target);
+		break;
+	case REFTABLE_BLOCK_TYPE_LOG:
+		strbuf_release(&rec->u.log.refname);
+		strbuf_release(&rec->u.log.name);
+		strbuf_release(&rec->u.log.email);
+		strbuf_release(&rec->u.log.message);
+		break;
+	case REFTABLE_BLOCK_TYPE_INDEX:
+		strbuf_release(&rec->u.idx.last_key);
+		break;
+	}
+}
+
+void reftable_record_swap(struct reftable_record *a, struct reftable_record *b)
+{
+	struct reftable_record tmp;
+
+	if (a->type != b->type)
+		BUG("swapping reftable records of different types");
+	tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+void reftable_log_key(struct strbuf *key, const char *refname,
+		      uint64_t update_index)
+{
+	unsigned char ts[8];
+
+	strbuf_reset(key);
+	strbuf_addstr(key, refname);
+	strbuf_addch(key, '\0');
+	put_be64(ts, ~update_index);
+	strbuf_add(key, ts, sizeof(ts));
+}
+
+void reftable_record_key(const struct reftable_record *rec, struct strbuf *key)
+{
+	switch (rec->type) {
+	case REFTABLE_BLOCK_TYPE_REF:
+		strbuf_reset(key);
+		strbuf_addbuf(key, &rec->u.ref.refname);
+		break;
+	case REFTABLE_BLOCK_TYPE_LOG:
+		reftable_log_key(key, rec->u.log.refname.buf,
+				 rec->u.log.update_index);
+		break;
+	case REFTABLE_BLOCK_TYPE_INDEX:
+		strbuf_reset(key);
+		strbuf_addbuf(key, &rec->u.idx.last_key);
+		break;
+	}
+}
+
+int reftable_record_is_deletion(const struct reftable_record *rec)
+{
+	switch (rec->type) {
+	case REFTABLE_BLOCK_TYPE_REF:
+		return rec->u.ref.value_type == REFTABLE_REF_DELETION;
+	case REFTABLE_BLOCK_TYPE_LOG:
+		return rec->u.log.value_type == REFTABLE_LOG_DELETION;
+	}
+	return 0;
+}
+
+uint8_t reftable_record_val_type(const struct reftable_record *rec)
+{
+	switch (rec->type) {
+	case REFTABLE_BLOCK_TYPE_REF:
+		return rec->u.ref.value_type;
+	case REFTABLE_BLOCK_TYPE_LOG:
+		return rec->u.log.value_type;
+	}
+	return 0;
+}
+
+static void put_string(struct strbuf *out, const struct strbuf *s)
+{
+	reftable_put_varint(out, s->len);
+	strbuf_addbuf(out, s);
+}
+
+void reftable_record_encode(const struct reftable_record *rec,
+			    struct strbuf *out, int hash_size,
+			    uint64_t min_update_index)
+{
+	const struct reftable_ref_record *ref = &rec->u.ref;
+	const struct reftable_log_record *log = &rec->u.log;
+	unsigned char tz[2];
+
+	switch (rec->type) {
+	case REFTABLE_BLOCK_TYPE_REF:
+		if (ref->update_index < min_update_index)
+			BUG("ref update index below the table minimum");
+		reftable_put_varint(out, ref->update_index - min_update_index);
+		switch (ref->value_type) {
+		case REFTABLE_REF_VAL2:
+			strbuf_add(out, ref->value.hash, hash_size);
+			strbuf_add(out, ref->peeled.hash, hash_size);
+			break;
+		case REFTABLE_REF_VAL1:
+			strbuf_add(out, ref->value.hash, hash_size);
+			break;
+		case REFTABLE_REF_SYMREF:
+			put_string(out, &ref->target);
+			break;
+		}
+		break;
+	case REFTABLE_BLOCK_TYPE_LOG:
+		if (log->value_type == REFTABLE_LOG_DELETION)
+			break;
+		strbuf_add(out, log->old_oid.hash, hash_size);
+		strbuf_add(out, log->new_oid.hash, hash_size);
+		put_string(out, &log->name);
+		put_string(out, &log->email);
+		reftable_put_varint(out, log->time);
+		put_be16(tz, (uint16_t)log->tz_offset);
+		strbuf_add(out, tz, sizeof(tz));
+		put_string(out, &log->message);
+		break;
+	case REFTABLE_BLOCK_TYPE_INDEX:
+		reftable_put_varint(out, rec->u.idx.offset);
+		break;
+	}
+}
+
+static int get_string(struct strbuf *s, const unsigned char **p,
+		      const unsigned char *end)
+{
+	uint64_t len;
+
+	if (reftable_get_varint(&len, p, end) || len > end - *p)
+		return -1;
+	strbuf_reset(s);
+	strbuf_add(s, *p, len);
+	*p += len;
+	return 0;
+}
+
+static int get_hash(struct object_id *oid, int hash_size,
+		    const unsigned char **p, const unsigned char *end)
+{
+	if (end - *p < hash_size)
+		return -1;
+	oidclr(oid);
+	memcpy(oid->hash, *p, hash_size);
+	*p += hash_size;
+	return 0;
+}
+
+int reftable_record_decode(struct reftable_record *rec,
+			   const struct strbuf *key, uint8_t val_type,
+			   const unsigned char **p, const unsigned char *end,
+			   int hash_size, uint64_t min_update_index)
+{
+	struct reftable_ref_record *ref = &rec->u.ref;
+	struct reftable_log_record *log = &rec->u.log;
+	uint64_t v;
+
+	switch (rec->type) {
+	case REFTABLE_BLOCK_TYPE_REF:
+		strbuf_reset(&ref->refname);
+		strbuf_addbuf(&ref->refname, key);
+		if (reftable_get_varint(&v, p, end))
+			return -1;
+		ref->update_index = min_update_index + v;
+		ref->value_type = val_type;
+		switch (val_type) {
+		case REFTABLE_REF_DELETION:
+			break;
+		case REFTABLE_REF_VAL1:
+			return get_hash(&ref->value, hash_size, p, end);
+		case REFTABLE_REF_VAL2:
+			if (get_hash(&ref->value, hash_size, p, end))
+				return -1;
+			return get_hash(&ref->peeled, hash_size, p, end);
+		case REFTABLE_REF_SYMREF:
+			return get_string(&ref->target, p, end);
+		default:
+			return -1;
+		}
+		return 0;
+	case REFTABLE_BLOCK_TYPE_LOG:
+		if (key->len < 9 || key->buf[key->len - 9])
+			return -1;
+		strbuf_reset(&log->refname);
+		strbuf_add(&log->refname, key->buf, key->len - 9);
+		log->update_index = ~get_be64(key->buf + key->len - 8);
+		log->value_type = val_type;
+		if (val_type == REFTABLE_LOG_DELETION)
+			return 0;
+		if (val_type != REFTABLE_LOG_UPDATE ||
+		    get_hash(&log->old_oid, hash_size, p, end) ||
+		    get_hash(&log->new_oid, hash_size, p, end) ||
+		    get_string(&log->name, p, end) ||
+		    get_string(&log->email, p, end) ||
+		    reftable_get_varint(&log->time, p, end) ||
+		    end - *p < 2)
+			return -1;
+		log->tz_offset = (int16_t)get_be16(*p);
+		*p += 2;
+		return get_string(&log->message, p, end);
+	case REFTABLE_BLOCK_TYPE_INDEX:
+		strbuf_reset(&rec->u.idx.last_key);
+		strbuf_addbuf(&rec->u.idx.last_key, key);
+		return reftable_get_varint(&rec->u.idx.offset, p, end);
+	}
+	return -1;
+}
@@ -0,0 +1,126 @@
+#ifndef REFTABLE_RECORD_H
+#define REFTABLE_RECORD_H
+
+#include "hash.h"
+#include "strbuf.h"
+
+/*
+ * Records stored in the blocks of a reftable file; see
+ * Documentation/technical/reftable.txt for the on-disk format.
+ */
+
+#define REFTABLE_BLOCK_TYPE_REF 'r'
+#define REFTABLE_BLOCK_TYPE_LOG 'g'
+#define REFTABLE_BLOCK_TYPE_INDEX 'i'
+#define REFTABLE_BLOCK_TYPE_OBJ 'o'
+
+/* value types of a ref record */
+#define REFTABLE_REF_DELETION 0x0
+#define REFTABLE_REF_VAL1 0x1
+#define REFTABLE_REF_VAL2 0x2
+#define REFTABLE_REF_SYMREF 0x3
+
+/* value types of a log record */
+#define REFTABLE_LOG_DELETION 0x0
+#define REFTABLE_LOG_UPDATE 0x1
+
+struct reftable_ref_record {
+	struct strbuf refname;
+	uint64_t update_index;
+	uint8_t value_type;
+	struct object_id value;		/* VAL1 and VAL2 */
+	struct object_id peeled;	/* VAL2 */
+	struct strbuf target;		/* SYMREF */
+};
+
+struct reftable_log_record {
+	struct strbuf refname;
+	uint64_t update_index;
+	uint8_t value_type;
+	struct object_id old_oid;
+	struct object_id new_oid;
+	struct strbuf name;
+	struct strbuf email;
+	uint64_t time;
+	int16_t tz_offset;		/* in minutes */
+	struct strbuf message;
+};
+
+struct reftable_index_record {
+	struct strbuf last_key;
+	uint64_t offset;
+};
+
+/*
+ * A record of any of the block types; 'type' selects the member of
+ * the union that is in use.
+ */
+struct reftable_record {
+	uint8_t type;
+	union {
+		struct reftable_ref_record ref;
+		struct reftable_log_record log;
+		struct reftable_index_record idx;
+	} u;
+};
+
+void reftable_record_init(struct reftable_record *rec, uint8_t type);
+void reftable_record_release(struct reftable_record *rec);
+
+/* Exchange the contents of two records of the same type. */
+void reftable_record_swap(struct reftable_record *a, struct reftable_record *b);
+
+/* Replace 'key' by the sort key of the record. */
+void reftable_record_key(const struct reftable_record *rec, struct strbuf *key);
+
+/*
+ * Build the key of the log record for 'refname' at 'update_index';
+ * log keys sort by refname first and then by descending update index.
+ */
+void reftable_log_key(struct strbuf *key, const char *refname,
+		      uint64_t update_index);
+
+int reftable_record_is_deletion(const struct reftable_record *rec);
+
+/* The 3-bit value type stored next to the key of each record. */
+uint8_t reftable_record_val_type(const struct reftable_record *rec);
+
+/*
+ * Append the value of the record to 'out'. Ref records store their
+ * update index relative to 'min_update_index'.
+ */
+void reftable_record_encode(const struct reftable_record *rec,
+			    struct strbuf *out, int hash_size,
+			    uint64_t min_update_index);
+
+/*
+ * Fill the record from the 'key' and the value of type 'val_type'
+ * starting at '*p', advancing '*p' past the value. Returns 0 on
+ * success and -1 if the value is corrupt.
+ */
+int reftable_record_decode(struct reftable_record *rec,
+			   const struct strbuf *key, uint8_t val_type,
+			   const unsigned char **p, const unsigned char *end,
+			   int hash_size, uint64_t min_update_index);
+
+/*
+ * Variable-length integers use the same encoding as the offsets of
+ * OFS_DELTA objects in packfiles.
+ */
+void reftable_put_varint(struct strbuf *out, uint64_t val);
+int reftable_get_varint(uint64_t *val, const unsigned char **p,
+			const unsigned char *end);
+
+static inline void reftable_put_be24(unsigned char *out, uint32_t val)
+{
+	out[0] = (val >> 16) & 0xff;
+	out[1] = (val >> 8) & 0xff;
+	out[2] = val & 0xff;
+}
+
+static inline uint32_t reftable_get_be24(const unsigned char *in)
+{
+	return ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+}
+
+#endif /* REFTABLE_RECORD_H */
@@ -0,0 +1,634 @@
+#include "cache.h"
+#include "stack.h"
+#include "tempfile.h"
+
+/* How often to retry reading a list that changes underneath us. */
+#define RELOAD_ATTEMPTS 16
+
+void reftable_stack_init(struct reftable_stack *st, const char *dir,
+			 const struct git_hash_algo *algo,
+			 const struct reftable_write_options *opts)
+{
+	memset(st, 0, sizeof(*st));
+	st->dir = xstrdup(dir);
+	st->list_file = xstrfmt("%s/tables.list", dir);
+	st->algo = algo;
+	st->opts = *opts;
+	st->lock_timeout_ms = 100;
+}
+
+static void close_tables(struct reftable_table **tables, size_t nr)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++)
+		reftable_table_close(tables[i]);
+}
+
+void reftable_stack_release(struct reftable_stack *st)
+{
+	close_tables(st->tables, st->tables_nr);
+	FREE_AND_NULL(st->tables);
+	st->tables_nr = st->tables_alloc = 0;
+	FREE_AND_NULL(st->dir);
+	FREE_AND_NULL(st->list_file);
+}
+
+static struct reftable_table *find_table(struct reftable_stack *st,
+					 const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < st->tables_nr; i++)
+		if (st->tables[i] && !strcmp(st->tables[i]->name, name))
+			return st->tables[i];
+	return NULL;
+}
+
+/*
+ * Read "tables.list" and open the tables it names, reusing the tables
+ * we already have open. Returns 0 on success, 1 if a table vanished
+ * because the list was rewritten concurrently, and -1 on error.
+ */
+static int reload_once(struct reftable_stack *st)
+{
+	struct strbuf list = STRBUF_INIT, path = STRBUF_INIT;
+	struct string_list names = STRING_LIST_INIT_NODUP;
+	struct reftable_table **tables;
+	size_t i;
+	int fd, ret = 0;
+
+	fd = open(st->list_file, O_RDONLY);
+	if (fd < 0 && errno != ENOENT)
+		return error_errno(_("unable to open '%s'"), st->list_file);
+	if (fd >= 0) {
+		if (strbuf_read(&list, fd, 0) < 0) {
+			error_errno(_("unable to read '%s'"), st->list_file);
+			close(fd);
+			strbuf_release(&list);
+			return -1;
+		}
+		close(fd);
+	}
+	string_list_split_in_place(&names, list.buf, '\n', -1);
+	if (names.nr && !*names.items[names.nr - 1].string)
+		names.nr--;
+
+	CALLOC_ARRAY(tables, names.nr);
+	for (i = 0; !ret && i < names.nr; i++) {
+		const char *name = names.items[i].string;
+
+		tables[i] = find_table(st, name);
+		if (tables[i])
+			continue;
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/%s", st->dir, name);
+		if (reftable_table_open(&tables[i], path.buf, name,
+					st->algo->rawsz) < 0)
+			ret = errno == ENOENT ? 1 : -1;
+	}
+
+	if (ret) {
+		/* close what we opened; the others are still in the stack */
+		while (i--)
+			if (tables[i] && tables[i] != find_table(st, tables[i]->name))
+				reftable_table_close(tables[i]);
+		free(tables);
+	} else {
+		for (i = 0; i < st->tables_nr; i++) {
+			size_t j;
+
+			for (j = 0; j < names.nr; j++)
+				if (tables[j] == st->tables[i])
+					break;
+			if (j == names.nr)
+				reftable_table_close(st->tables[i]);
+		}
+		free(st->tables);
+		st->tables = tables;
+		st->tables_nr = st->tables_alloc = names.nr;
+		st->loaded = 1;
+	}
+
+	string_list_clear(&names, 0);
+	strbuf_release(&list);
+	strbuf_release(&path);
+	return ret;
+}
+
+int reftable_stack_reload(struct reftable_stack *st)
+{
+	int i, ret = 1;
+
+	for (i = 0; ret > 0 && i < RELOAD_ATTEMPTS; i++)
+		ret = reload_once(st);
+	if (ret > 0)
+		return error(_("reftable stack '%s' keeps changing"), st->dir);
+	return ret;
+}
+
+uint64_t reftable_stack_next_update_index(struct reftable_stack *st)
+{
+	if (!st->tables_nr)
+		return 1;
+	return st->tables[st->tables_nr - 1]->max_update_index + 1;
+}
+
+int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
+			    struct reftable_record *rec)
+{
+	struct reftable_table_iter ti = REFTABLE_TABLE_ITER_INIT;
+	struct strbuf key = STRBUF_INIT;
+	size_t i;
+	int ret = 1;
+
+	if (reftable_stack_reload(st) < 0)
+		return -1;
+
+	strbuf_addstr(&key, refname);
+	for (i = st->tables_nr; i--; ) {
+		int r;
+
+		if (reftable_table_seek(&ti, st->tables[i],
+					REFTABLE_BLOCK_TYPE_REF, &key) < 0) {
+			ret = -1;
+			break;
+		}
+		r = reftable_table_iter_next(&ti, rec);
+		if (r < 0) {
+			ret = -1;
+			break;
+		}
+		if (!r && !strcmp(rec->u.ref.refname.buf, refname)) {
+			ret = reftable_record_is_deletion(rec) ? 1 : 0;
+			break;
+		}
+	}
+	reftable_table_iter_release(&ti);
+	strbuf_release(&key);
+	return ret;
+}
+
+static int merged_iter_advance(struct reftable_merged_iter *mi, size_t i)
+{
+	int ret = reftable_table_iter_next(&mi->subs[i], &mi->recs[i]);
+
+	if (ret < 0)
+		return -1;
+	mi->live[i] = !ret;
+	if (mi->live[i])
+		reftable_record_key(&mi->recs[i], &mi->keys[i]);
+	return 0;
+}
+
+int reftable_merged_iter_init(struct reftable_merged_iter *mi,
+			      struct reftable_table **tables, size_t nr,
+			      uint8_t type, const struct strbuf *key,
+			      int suppress_deletions)
+{
+	size_t i;
+
+	memset(mi, 0, sizeof(*mi));
+	mi->nr = nr;
+	mi->type = type;
+	mi->suppress_deletions = suppress_deletions;
+	strbuf_init(&mi->key, 0);
+	ALLOC_ARRAY(mi->tables, nr);
+	CALLOC_ARRAY(mi->subs, nr);
+	CALLOC_ARRAY(mi->recs, nr);
+	CALLOC_ARRAY(mi->keys, nr);
+	CALLOC_ARRAY(mi->live, nr);
+
+	for (i = 0; i < nr; i++) {
+		mi->tables[i] = reftable_table_ref(tables[i]);
+		strbuf_init(&mi->subs[i].bi.last_key, 0);
+		strbuf_init(&mi->subs[i].bi.key, 0);
+		reftable_record_init(&mi->recs[i], type);
+		strbuf_init(&mi->keys[i], 0);
+	}
+	for (i = 0; i < nr; i++)
+		if (reftable_table_seek(&mi->subs[i], tables[i], type, key) < 0 ||
+		    merged_iter_advance(mi, i) < 0)
+			return -1;
+	return 0;
+}
+
+int reftable_stack_seek(struct reftable_stack *st,
+			struct reftable_merged_iter *mi,
+			uint8_t type, const char *key)
+{
+	struct strbuf want = STRBUF_INIT;
+	int ret;
+
+	if (reftable_stack_reload(st) < 0) {
+		reftable_merged_iter_init(mi, NULL, 0, type, &want, 1);
+		return -1;
+	}
+	strbuf_addstr(&want, key);
+	ret = reftable_merged_iter_init(mi, st->tables, st->tables_nr,
+					type, &want, 1);
+	strbuf_release(&want);
+	return ret;
+}
+
+int reftable_merged_iter_next(struct reftable_merged_iter *mi,
+			      struct reftable_record *rec)
+{
+	for (;;) {
+		size_t i, best = mi->nr;
+
+		/* tables are ordered oldest first; the newest record wins */
+		for (i = 0; i < mi->nr; i++) {
+			if (!mi->live[i])
+				continue;
+			if (best == mi->nr ||
+			    strbuf_cmp(&mi->keys[i], &mi->keys[best]) <= 0)
+				best = i;
+		}
+		if (best == mi->nr)
+			return 1;
+
+		reftable_record_swap(rec, &mi->recs[best]);
+		strbuf_swap(&mi->key, &mi->keys[best]);
+		for (i = 0; i < mi->nr; i++)
+			if (i != best && mi->live[i] &&
+			    !strbuf_cmp(&mi->keys[i], &mi->key) &&
+			    merged_iter_advance(mi, i) < 0)
+				return -1;
+		if (merged_iter_advance(mi, best) < 0)
+			return -1;
+
+		if (mi->suppress_deletions && reftable_record_is_deletion(rec))
+			continue;
+		return 0;
+	}
+}
+
+void reftable_merged_iter_release(struct reftable_merged_iter *mi)
+{
+	size_t i;
+
+	for (i = 0; i < mi->nr; i++) {
+		reftable_table_iter_release(&mi->subs[i]);
+		reftable_record_release(&mi->recs[i]);
+		strbuf_release(&mi->keys[i]);
+		reftable_table_close(mi->tables[i]);
+	}
+	FREE_AND_NULL(mi->tables);
+	FREE_AND_NULL(mi->subs);
+	FREE_AND_NULL(mi->recs);
+	FREE_AND_NULL(mi->keys);
+	FREE_AND_NULL(mi->live);
+	strbuf_release(&mi->key);
+	mi->nr = 0;
+}
+
+static int lock_stack(struct reftable_stack *st, struct lock_file *lock,
+		      long timeout_ms, struct strbuf *err)
+{
+	if (mkdir(st->dir, 0777) < 0) {
+		if (errno != EEXIST) {
+			strbuf_addf(err, _("unable to create '%s': %s"),
+				    st->dir, strerror(errno));
+			return -1;
+		}
+	} else if (adjust_shared_perm(st->dir) < 0) {
+		strbuf_addf(err, _("unable to set permissions on '%s'"), st->dir);
+		return -1;
+	}
+
+	if (hold_lock_file_for_update_timeout(lock, st->list_file, 0,
+					      timeout_ms) < 0) {
+		unable_to_lock_message(st->list_file, errno, err);
+		return -1;
+	}
+	if (reftable_stack_reload(st) < 0) {
+		rollback_lock_file(lock);
+		strbuf_addf(err, _("unable to read reftable stack '%s'"),
+			    st->dir);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Write a table covering [min, max] to a temporary file and move it
+ * into place, storing its name in 'name'. Returns 1 without creating
+ * a table if 'write_fn' wrote no records and 'keep_empty' is unset.
+ */
+static int write_table(struct reftable_stack *st, uint64_t min, uint64_t max,
+		       reftable_write_fn *write_fn, void *cb_data,
+		       int keep_empty, struct strbuf *name, struct strbuf *err)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct reftable_writer w;
+	struct tempfile *tmp;
+	const char *suffix;
+	int ret;
+
+	strbuf_addf(&path, "%s/tmp_table_XXXXXX", st->dir);
+	tmp = mks_tempfile_m(path.buf, 0666);
+	if (!tmp) {
+		strbuf_addf(err, _("unable to create '%s': %s"), path.buf,
+			    strerror(errno));
+		strbuf_release(&path);
+		return -1;
+	}
+	if (adjust_shared_perm(get_tempfile_path(tmp)) < 0) {
+		strbuf_addf(err, _("unable to set permissions on '%s'"),
+			    get_tempfile_path(tmp));
+		delete_tempfile(&tmp);
+		strbuf_release(&path);
+		return -1;
+	}
+
+	reftable_writer_init(&w, get_tempfile_fd(tmp), &st->opts, st->algo,
+			     min, max);
+	ret = write_fn(&w, cb_data);
+	if (!ret)
+		ret = reftable_writer_close(&w);
+	if (!ret)
+		ret = close_tempfile_gently(tmp);
+	if (ret) {
+		strbuf_addstr(err, _("unable to write new reftable"));
+		delete_tempfile(&tmp);
+		ret = -1;
+	} else if (!keep_empty && !w.refs && !w.logs) {
+		delete_tempfile(&tmp);
+		ret = 1;
+	} else {
+		suffix = get_tempfile_path(tmp) + path.len - 6;
+		strbuf_reset(name);
+		strbuf_addf(name, "0x%012"PRIx64"-0x%012"PRIx64"-%s.ref",
+			    min, max, suffix);
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/%s", st->dir, name->buf);
+		if (rename_tempfile(&tmp, path.buf) < 0) {
+			strbuf_addf(err, _("unable to rename to '%s': %s"),
+				    path.buf, strerror(errno));
+			ret = -1;
+		}
+	}
+	reftable_writer_release(&w);
+	strbuf_release(&path);
+	return ret;
+}
+
+static int write_list(struct reftable_stack *st, struct lock_file *lock,
+		      const struct string_list *names, struct strbuf *err)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct string_list_item *item;
+	int fd = get_lock_file_fd(lock);
+
+	for_each_string_list_item(item, names)
+		strbuf_addf(&buf, "%s\n", item->string);
+	if (write_in_full(fd, buf.buf, buf.len) < 0 ||
+	    commit_lock_file(lock) < 0) {
+		strbuf_addf(err, _("unable to write '%s': %s"),
+			    st->list_file, strerror(errno));
+		rollback_lock_file(lock);
+		strbuf_release(&buf);
+		return -1;
+	}
+	strbuf_release(&buf);
+	return 0;
+}
+
+int reftable_addition_begin(struct reftable_addition *add,
+			    struct reftable_stack *st, struct strbuf *err)
+{
+	add->st = st;
+	if (lock_stack(st, &add->lock, st->lock_timeout_ms, err) < 0)
+		return -1;
+	add->next_update_index = reftable_stack_next_update_index(st);
+	return 0;
+}
+
+int reftable_addition_add(struct reftable_addition *add,
+			  reftable_write_fn *write_fn, void *cb_data,
+			  struct strbuf *err)
+{
+	struct strbuf name = STRBUF_INIT;
+	int ret;
+
+	ret = write_table(add->st, add->next_update_index,
+			  add->next_update_index, write_fn, cb_data, 0,
+			  &name, err);
+	if (!ret) {
+		string_list_append(&add->new_tables, name.buf);
+		add->next_update_index++;
+	}
+	strbuf_release(&name);
+	return ret < 0 ? -1 : 0;
+}
+
+int reftable_addition_commit(struct reftable_addition *add, struct strbuf *err)
+{
+	struct reftable_stack *st = add->st;
+	struct string_list names = STRING_LIST_INIT_NODUP;
+	struct string_list_item *item;
+	size_t i;
+	int ret;
+
+	if (!add->new_tables.nr) {
+		rollback_lock_file(&add->lock);
+		return 0;
+	}
+
+	for (i = 0; i < st->tables_nr; i++)
+		string_list_append(&names, st->tables[i]->name);
+	for_each_string_list_item(item, &add->new_tables)
+		string_list_append(&names, item->string);
+	ret = write_list(st, &add->lock, &names, err);
+	string_list_clear(&names, 0);
+	if (ret < 0) {
+		reftable_addition_abort(add);
+		return -1;
+	}
+	string_list_clear(&add->new_tables, 0);
+
+	if (reftable_stack_reload(st) < 0)
+		return -1;
+	if (!st->disable_auto_compact)
+		reftable_stack_auto_compact(st);
+	return 0;
+}
+
+void reftable_addition_abort(struct reftable_addition *add)
+{
+	struct string_list_item *item;
+	struct strbuf path = STRBUF_INIT;
+
+	for_each_string_list_item(item, &add->new_tables) {
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/%s", add->st->dir, item->string);
+		unlink_or_warn(path.buf);
+	}
+	string_list_clear(&add->new_tables, 0);
+	rollback_lock_file(&add->lock);
+	strbuf_release(&path);
+}
+
+struct compaction {
+	struct reftable_table **tables;
+	size_t nr;
+	int drop_deletions;
+};
+
+static int write_compacted(struct reftable_writer *w, void *cb_data)
+{
+	struct compaction *c = cb_data;
+	struct reftable_merged_iter mi;
+	struct reftable_record rec;
+	struct strbuf empty = STRBUF_INIT;
+	int ret = 0;
+
+	reftable_record_init(&rec, REFTABLE_BLOCK_TYPE_REF);
+	if (reftable_merged_iter_init(&mi, c->tables, c->nr,
+				      REFTABLE_BLOCK_TYPE_REF, &empty,
+				      c->drop_deletions) < 0)
+		ret = -1;
+	while (!ret && !(ret = reftable_merged_iter_next(&mi, &rec)))
+		ret = reftable_writer_add_ref(w, &rec.u.ref);
+	reftable_merged_iter_release(&mi);
+	reftable_record_release(&rec);
+	if (ret < 0)
+		return -1;
+
+	reftable_record_init(&rec, REFTABLE_BLOCK_TYPE_LOG);
+	ret = 0;
+	if (reftable_merged_iter_init(&mi, c->tables, c->nr,
+				      REFTABLE_BLOCK_TYPE_LOG, &empty,
+				      c->drop_deletions) < 0)
+		ret = -1;
+	while (!ret && !(ret = reftable_merged_iter_next(&mi, &rec)))
+		ret = reftable_writer_add_log(w, &rec.u.log);
+	reftable_merged_iter_release(&mi);
+	reftable_record_release(&rec);
+	return ret < 0 ? -1 : 0;
+}
+
+/*
+ * Replace the tables [first, last] of the locked stack by a single
+ * table. Deletions only need to be kept if there are older tables
+ * whose records they might shadow.
+ */
+static int compact_range(struct reftable_stack *st, struct lock_file *lock,
+			 size_t first, size_t last, struct strbuf *err)
+{
+	struct string_list names = STRING_LIST_INIT_DUP;
+	struct string_list old = STRING_LIST_INIT_DUP;
+	struct strbuf name = STRBUF_INIT, path = STRBUF_INIT;
+	struct compaction c;
+	size_t i;
+	int ret;
+
+	c.tables = st->tables + first;
+	c.nr = last - first + 1;
+	c.drop_deletions = !first;
+
+	trace2_region_enter("reftable", "compact", the_repository);
+	ret = write_table(st, st->tables[first]->min_update_index,
+			  st->tables[last]->max_update_index,
+			  write_compacted, &c, 1, &name, err);
+	if (ret < 0) {
+		rollback_lock_file(lock);
+		goto done;
+	}
+
+	for (i = 0; i < st->tables_nr; i++) {
+		if (i < first || i > last)
+			string_list_append(&names, st->tables[i]->name);
+		else
+			string_list_append(&old, st->tables[i]->name);
+		if (i == last)
+			string_list_append(&names, name.buf);
+	}
+	ret = write_list(st, lock, &names, err);
+	if (ret < 0) {
+		strbuf_addf(&path, "%s/%s", st->dir, name.buf);
+		unlink_or_warn(path.buf);
+		goto done;
+	}
+
+	for (i = 0; i < old.nr; i++) {
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/%s", st->dir, old.items[i].string);
+		unlink_or_warn(path.buf);
+	}
+	ret = reftable_stack_reload(st);
+
+done:
+	trace2_region_leave("reftable", "compact", the_repository);
+	string_list_clear(&names, 0);
+	string_list_clear(&old, 0);
+	strbuf_release(&name);
+	strbuf_release(&path);
+	return ret;
+}
+
+static uint64_t table_payload(const struct reftable_table *t)
+{
+	return t->size - t->header_size - reftable_footer_size(t->version);
+}
+
+/*
+ * Find the longest run of newest tables in which each table is at
+ * most twice as large as all the newer ones combined, and return the
+ * index of its oldest table.
+ */
+static size_t compaction_start(struct reftable_stack *st)
+{
+	size_t first = st->tables_nr - 1;
+	uint64_t sum = table_payload(st->tables[first]);
+
+	while (first > 0 && table_payload(st->tables[first - 1]) <= 2 * sum) {
+		first--;
+		sum += table_payload(st->tables[first]);
+	}
+	return first;
+}
+
+int reftable_stack_auto_compact(struct reftable_stack *st)
+{
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf err = STRBUF_INIT;
+	int ret;
+
+	if (st->tables_nr < 2 ||
+	    compaction_start(st) == st->tables_nr - 1)
+		return 0;
+
+	/* somebody else is updating the stack; let them compact it */
+	if (lock_stack(st, &lock, 0, &err) < 0) {
+		strbuf_release(&err);
+		return 0;
+	}
+	if (st->tables_nr < 2 ||
+	    compaction_start(st) == st->tables_nr - 1) {
+		rollback_lock_file(&lock);
+		strbuf_release(&err);
+		return 0;
+	}
+
+	ret = compact_range(st, &lock, compaction_start(st),
+			    st->tables_nr - 1, &err);
+	if (ret < 0)
+		warning("%s", err.buf);
+	strbuf_release(&err);
+	return ret;
+}
+
+int reftable_stack_compact_all(struct reftable_stack *st, struct strbuf *err)
+{
+	struct lock_file lock = LOCK_INIT;
+
+	if (lock_stack(st, &lock, st->lock_timeout_ms, err) < 0)
+		return -1;
+	if (st->tables_nr < 2) {
+		rollback_lock_file(&lock);
+		return 0;
+	}
+	return compact_range(st, &lock, 0, st->tables_nr - 1, err);
+}
@@ -0,0 +1,142 @@
+#ifndef REFTABLE_STACK_H
+#define REFTABLE_STACK_H
+
+#include "lockfile.h"
+#include "string-list.h"
+#include "reader.h"
+#include "writer.h"
+
+/*
+ * A stack of reftables in one directory. The file "tables.list" names
+ * the tables from oldest to newest; records in newer tables shadow
+ * records with the same key in older ones. Writers take
+ * "tables.list.lock", add a new table and rewrite the list, so that
+ * readers always see a consistent set of tables.
+ */
+struct reftable_stack {
+	char *dir;
+	char *list_file;
+	const struct git_hash_algo *algo;
+	struct reftable_write_options opts;
+	int disable_auto_compact;
+	long lock_timeout_ms;
+
+	int loaded;
+	struct reftable_table **tables;
+	size_t tables_nr, tables_alloc;
+};
+
+void reftable_stack_init(struct reftable_stack *st, const char *dir,
+			 const struct git_hash_algo *algo,
+			 const struct reftable_write_options *opts);
+void reftable_stack_release(struct reftable_stack *st);
+
+/*
+ * Make sure the stack reflects "tables.list" on disk. Tables that are
+ * still listed stay open, so this only costs reading the list when it
+ * has not changed since the last call. Checking the list's stat data
+ * instead is not enough: a rewritten list can have the same size, mtime
+ * and even inode as the one it replaces.
+ */
+int reftable_stack_reload(struct reftable_stack *st);
+
+/* The update index to use for the next table added to the stack. */
+uint64_t reftable_stack_next_update_index(struct reftable_stack *st);
+
+/*
+ * Look up 'refname' and store it in 'rec', an initialized ref record.
+ * Returns 0 if a live ref was found, 1 if the ref does not exist and
+ * -1 on error.
+ */
+int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
+			    struct reftable_record *rec);
+
+/* Iterates over the merged view of a range of tables. */
+struct reftable_merged_iter {
+	struct reftable_table **tables;
+	struct reftable_table_iter *subs;
+	struct reftable_record *recs;
+	struct strbuf *keys;
+	int *live;
+	size_t nr;
+	uint8_t type;
+	int suppress_deletions;
+	struct strbuf key;
+};
+
+/*
+ * Iterate over the records of 'type' in the 'nr' tables starting at
+ * 'tables', beginning at the first key not smaller than 'key'. When
+ * 'suppress_deletions' is set, deletion records are skipped together
+ * with the records they shadow.
+ */
+int reftable_merged_iter_init(struct reftable_merged_iter *mi,
+			      struct reftable_table **tables, size_t nr,
+			      uint8_t type, const struct strbuf *key,
+			      int suppress_deletions);
+
+/* Iterate over all live records of the stack. */
+int reftable_stack_seek(struct reftable_stack *st,
+			struct reftable_merged_iter *mi,
+			uint8_t type, const char *key);
+
+/* Returns 0 on success, 1 when exhausted and -1 on error. */
+int reftable_merged_iter_next(struct reftable_merged_iter *mi,
+			      struct reftable_record *rec);
+void reftable_merged_iter_release(struct reftable_merged_iter *mi);
+
+/*
+ * An addition of new tables to the stack, performed while holding the
+ * lock on "tables.list".
+ */
+struct reftable_addition {
+	struct reftable_stack *st;
+	struct lock_file lock;
+	uint64_t next_update_index;
+	struct string_list new_tables;
+};
+
+#define REFTABLE_ADDITION_INIT { \
+	.lock = LOCK_INIT, \
+	.new_tables = STRING_LIST_INIT_DUP, \
+}
+
+/*
+ * Lock the stack and reload it, so that the caller can verify its
+ * preconditions against the latest state. Returns -1 with a message
+ * in 'err' if the stack cannot be locked.
+ */
+int reftable_addition_begin(struct reftable_addition *add,
+			    struct reftable_stack *st, struct strbuf *err);
+
+typedef int reftable_write_fn(struct reftable_writer *w, void *cb_data);
+
+/*
+ * Write a new table using 'write_fn'; all ref records it writes must
+ * use 'add->next_update_index'. A table without any records is
+ * discarded.
+ */
+int reftable_addition_add(struct reftable_addition *add,
+			  reftable_write_fn *write_fn, void *cb_data,
+			  struct strbuf *err);
+
+/*
+ * Publish the new tables and release the lock; afterwards the stack
+ * may be compacted.
+ */
+int reftable_addition_commit(struct reftable_addition *add, struct strbuf *err);
+
+/* Release the lock and discard any tables written so far. */
+void reftable_addition_abort(struct reftable_addition *add);
+
+/*
+ * Merge the newest tables of the stack whenever they would otherwise
+ * stop forming a geometric sequence of sizes. Does nothing if another
+ * process holds the lock.
+ */
+int reftable_stack_auto_compact(struct reftable_stack *st);
+
+/* Merge all tables of the stack into a single one. */
+int reftable_stack_compact_all(struct reftable_stack *st, struct strbuf *err);
+
+#endif /* REFTABLE_STACK_H */
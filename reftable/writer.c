@@ -0,0 +1,317 @@
+#include "cache.h"
+#include "writer.h"
+
+static int table_version(const struct reftable_writer *w)
+{
+	return w->algo->format_id == hash_algos[GIT_HASH_SHA1].format_id ? 1 : 2;
+}
+
+void reftable_writer_init(struct reftable_writer *w, int fd,
+			  const struct reftable_write_options *opts,
+			  const struct git_hash_algo *algo,
+			  uint64_t min_update_index,
+			  uint64_t max_update_index)
+{
+	memset(w, 0, sizeof(*w));
+	w->fd = fd;
+	w->opts = *opts;
+	if (!w->opts.block_size)
+		w->opts.block_size = 4096;
+	if (w->opts.restart_interval <= 0)
+		w->opts.restart_interval = 16;
+	w->algo = algo;
+	w->min_update_index = min_update_index;
+	w->max_update_index = max_update_index;
+	strbuf_init(&w->last_key, 0);
+}
+
+static void put_header(const struct reftable_writer *w, unsigned char *out)
+{
+	int version = table_version(w);
+
+	memcpy(out, "REFT", 4);
+	out[4] = version;
+	reftable_put_be24(out + 5, w->opts.block_size);
+	put_be64(out + 8, w->min_update_index);
+	put_be64(out + 16, w->max_update_index);
+	if (version == 2)
+		put_be32(out + 24, w->algo->format_id);
+}
+
+static int write_bytes(struct reftable_writer *w, const void *buf, size_t len)
+{
+	if (write_in_full(w->fd, buf, len) < 0)
+		return error_errno(_("unable to write reftable"));
+	w->pos += len;
+	return 0;
+}
+
+static int write_header(struct reftable_writer *w)
+{
+	unsigned char header[28];
+
+	put_header(w, header);
+	return write_bytes(w, header, reftable_header_size(table_version(w)));
+}
+
+static void start_block(struct reftable_writer *w, uint8_t type)
+{
+	uint32_t header_off = 0;
+
+	if (!w->pos)
+		header_off = reftable_header_size(table_version(w));
+	block_writer_init(&w->bw, type, w->opts.block_size, header_off,
+			  w->opts.restart_interval, w->algo->rawsz,
+			  w->min_update_index);
+}
+
+static void append_index_entry(struct reftable_index_record **list,
+			       size_t *nr, size_t *alloc,
+			       const struct strbuf *key, uint64_t offset)
+{
+	struct reftable_index_record *idx;
+
+	ALLOC_GROW(*list, *nr + 1, *alloc);
+	idx = &(*list)[(*nr)++];
+	strbuf_init(&idx->last_key, key->len);
+	strbuf_addbuf(&idx->last_key, key);
+	idx->offset = offset;
+}
+
+static void clear_index_list(struct reftable_index_record **list,
+			     size_t *nr, size_t *alloc)
+{
+	size_t i;
+
+	for (i = 0; i < *nr; i++)
+		strbuf_release(&(*list)[i].last_key);
+	FREE_AND_NULL(*list);
+	*nr = *alloc = 0;
+}
+
+/*
+ * Write out the current block and record its last key in the given
+ * index list. Ref blocks are padded to the block size so that readers
+ * can find them without consulting an index.
+ */
+static int flush_block(struct reftable_writer *w,
+		       struct reftable_index_record **list,
+		       size_t *nr, size_t *alloc)
+{
+	struct block_writer *bw = &w->bw;
+	uint64_t off = w->pos;
+
+	if (!bw->entries)
+		return 0;
+	if (block_writer_finish(bw) < 0)
+		return error(_("reftable block is too large"));
+	if (bw->header_off)
+		put_header(w, (unsigned char *)bw->buf.buf);
+	if (bw->type == REFTABLE_BLOCK_TYPE_REF &&
+	    bw->buf.len < w->opts.block_size)
+		strbuf_addchars(&bw->buf, 0, w->opts.block_size - bw->buf.len);
+
+	append_index_entry(list, nr, alloc, &bw->last_key, off);
+
+	switch (bw->type) {
+	case REFTABLE_BLOCK_TYPE_REF:
+		w->ref_blocks++;
+		break;
+	case REFTABLE_BLOCK_TYPE_LOG:
+		w->log_blocks++;
+		break;
+	case REFTABLE_BLOCK_TYPE_INDEX:
+		w->index_blocks++;
+		break;
+	}
+
+	bw->entries = 0;
+	return write_bytes(w, bw->buf.buf, bw->buf.len);
+}
+
+static int add_record(struct reftable_writer *w,
+		      const struct reftable_record *rec,
+		      struct reftable_index_record **list,
+		      size_t *nr, size_t *alloc)
+{
+	int ret = block_writer_add(&w->bw, rec);
+
+	if (ret > 0) {
+		if (flush_block(w, list, nr, alloc) < 0)
+			return -1;
+		start_block(w, rec->type);
+		ret = block_writer_add(&w->bw, rec);
+	}
+	if (ret)
+		return error(_("reftable record does not fit into a block"));
+	return 0;
+}
+
+/*
+ * Write a (possibly multi-level) index over the blocks recorded in
+ * 'w->index' and return the offset of its root block.
+ */
+static int write_index(struct reftable_writer *w, uint64_t *root)
+{
+	struct reftable_index_record *cur = w->index, *next = NULL;
+	size_t cur_nr = w->index_nr, cur_alloc = w->index_alloc;
+	size_t next_nr = 0, next_alloc = 0;
+	int ret = 0;
+
+	w->index = NULL;
+	w->index_nr = w->index_alloc = 0;
+
+	for (;;) {
+		struct reftable_record rec;
+		size_t i;
+
+		rec.type = REFTABLE_BLOCK_TYPE_INDEX;
+		start_block(w, REFTABLE_BLOCK_TYPE_INDEX);
+		for (i = 0; !ret && i < cur_nr; i++) {
+			rec.u.idx = cur[i];
+			ret = add_record(w, &rec, &next, &next_nr, &next_alloc);
+		}
+		if (!ret)
+			ret = flush_block(w, &next, &next_nr, &next_alloc);
+		clear_index_list(&cur, &cur_nr, &cur_alloc);
+		if (ret)
+			break;
+
+		if (next_nr == 1) {
+			*root = next[0].offset;
+			break;
+		}
+		cur = next;
+		cur_nr = next_nr;
+		cur_alloc = next_alloc;
+		next = NULL;
+		next_nr = next_alloc = 0;
+	}
+	clear_index_list(&next, &next_nr, &next_alloc);
+	return ret;
+}
+
+/*
+ * Flush the last block of the current section and write its index if
+ * the section is large enough to benefit from one.
+ */
+static int finish_section(struct reftable_writer *w)
+{
+	size_t threshold;
+	uint64_t root = 0;
+
+	if (!w->section)
+		return 0;
+	if (flush_block(w, &w->index, &w->index_nr, &w->index_alloc) < 0)
+		return -1;
+
+	threshold = w->section == REFTABLE_BLOCK_TYPE_REF ? 4 : 2;
+	if (w->index_nr >= threshold) {
+		if (write_index(w, &root) < 0)
+			return -1;
+		if (w->section == REFTABLE_BLOCK_TYPE_REF)
+			w->ref_index_off = root;
+		else
+			w->log_index_off = root;
+	}
+	clear_index_list(&w->index, &w->index_nr, &w->index_alloc);
+	strbuf_reset(&w->last_key);
+	w->section = 0;
+	return 0;
+}
+
+int reftable_writer_add_ref(struct reftable_writer *w,
+			    const struct reftable_ref_record *ref)
+{
+	struct reftable_record rec;
+
+	if (w->log_off)
+		BUG("ref record added after log records");
+	if (ref->update_index < w->min_update_index ||
+	    ref->update_index > w->max_update_index)
+		return error(_("update index of '%s' is out of range"),
+			     ref->refname.buf);
+	if (w->refs && strbuf_cmp(&ref->refname, &w->last_key) <= 0)
+		return error(_("reftable refs are not sorted at '%s'"),
+			     ref->refname.buf);
+
+	if (!w->section) {
+		w->section = REFTABLE_BLOCK_TYPE_REF;
+		start_block(w, REFTABLE_BLOCK_TYPE_REF);
+	}
+	rec.type = REFTABLE_BLOCK_TYPE_REF;
+	rec.u.ref = *ref;
+	if (add_record(w, &rec, &w->index, &w->index_nr, &w->index_alloc) < 0)
+		return -1;
+
+	strbuf_reset(&w->last_key);
+	strbuf_addbuf(&w->last_key, &ref->refname);
+	w->refs++;
+	return 0;
+}
+
+int reftable_writer_add_log(struct reftable_writer *w,
+			    const struct reftable_log_record *log)
+{
+	struct reftable_record rec;
+	struct strbuf key = STRBUF_INIT;
+
+	rec.type = REFTABLE_BLOCK_TYPE_LOG;
+	rec.u.log = *log;
+	reftable_record_key(&rec, &key);
+	if (w->logs && strbuf_cmp(&key, &w->last_key) <= 0) {
+		error(_("reftable logs are not sorted at '%s'"),
+		      log->refname.buf);
+		goto fail;
+	}
+
+	if (w->section != REFTABLE_BLOCK_TYPE_LOG) {
+		if (finish_section(w) < 0)
+			goto fail;
+		if (!w->pos && write_header(w) < 0)
+			goto fail;
+		w->section = REFTABLE_BLOCK_TYPE_LOG;
+		w->log_off = w->pos;
+		start_block(w, REFTABLE_BLOCK_TYPE_LOG);
+	}
+	if (add_record(w, &rec, &w->index, &w->index_nr, &w->index_alloc) < 0)
+		goto fail;
+
+	strbuf_swap(&w->last_key, &key);
+	strbuf_release(&key);
+	w->logs++;
+	return 0;
+
+fail:
+	strbuf_release(&key);
+	return -1;
+}
+
+int reftable_writer_close(struct reftable_writer *w)
+{
+	unsigned char footer[72];
+	int version = table_version(w);
+	uint32_t off = reftable_header_size(version);
+	uint32_t footer_size = reftable_footer_size(version);
+
+	if (finish_section(w) < 0)
+		return -1;
+	if (!w->pos && write_header(w) < 0)
+		return -1;
+
+	put_header(w, footer);
+	put_be64(footer + off, w->ref_index_off);
+	put_be64(footer + off + 8, 0);	/* no obj blocks */
+	put_be64(footer + off + 16, 0);
+	put_be64(footer + off + 24, w->log_off);
+	put_be64(footer + off + 32, w->log_index_off);
+	put_be32(footer + off + 40, crc32(0, footer, footer_size - 4));
+	return write_bytes(w, footer, footer_size);
+}
+
+void reftable_writer_release(struct reftable_writer *w)
+{
+	block_writer_release(&w->bw);
+	clear_index_list(&w->index, &w->index_nr, &w->index_alloc);
+	strbuf_release(&w->last_key);
+}
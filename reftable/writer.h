@@ -0,0 +1,74 @@
+#ifndef REFTABLE_WRITER_H
+#define REFTABLE_WRITER_H
+
+#include "block.h"
+
+struct git_hash_algo;
+
+struct reftable_write_options {
+	/* size of ref and index blocks; defaults to 4096 */
+	uint32_t block_size;
+	/* number of records between restart points; defaults to 16 */
+	int restart_interval;
+};
+
+struct reftable_writer {
+	int fd;
+	uint64_t pos;
+	struct reftable_write_options opts;
+	const struct git_hash_algo *algo;
+	uint64_t min_update_index, max_update_index;
+
+	struct block_writer bw;
+	uint8_t section;
+	struct strbuf last_key;
+	struct reftable_index_record *index;
+	size_t index_nr, index_alloc;
+
+	uint64_t ref_index_off;
+	uint64_t log_off;
+	uint64_t log_index_off;
+
+	/* statistics */
+	uint64_t refs, logs;
+	uint64_t ref_blocks, log_blocks, index_blocks;
+};
+
+/*
+ * Prepare to write a table to 'fd'. The update indices of all ref
+ * records written must lie within [min_update_index, max_update_index].
+ */
+void reftable_writer_init(struct reftable_writer *w, int fd,
+			  const struct reftable_write_options *opts,
+			  const struct git_hash_algo *algo,
+			  uint64_t min_update_index,
+			  uint64_t max_update_index);
+
+/*
+ * Add records to the table. All ref records must be added before the
+ * first log record, and each kind in key order. Return 0 on success
+ * and -1 with an error message on failure.
+ */
+int reftable_writer_add_ref(struct reftable_writer *w,
+			    const struct reftable_ref_record *ref);
+int reftable_writer_add_log(struct reftable_writer *w,
+			    const struct reftable_log_record *log);
+
+/* Write out pending blocks, the indices and the footer. */
+int reftable_writer_close(struct reftable_writer *w);
+
+void reftable_writer_release(struct reftable_writer *w);
+
+/* Size of the file header for the given format version. */
+static inline uint32_t reftable_header_size(int version)
+{
+	return version == 1 ? 24 : 28;
+}
+
+/* Size of the file footer for the given format version. */
+static inline uint32_t reftable_footer_size(int version)
+{
+	return version == 1 ? 68 : 72;
+}
+
+#endif /* REFTABLE_WRITER_H */
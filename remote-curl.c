@@ -1390,6 +1390,23 @@ static void parse_push(struct strbuf *buf)
 	strvec_clear(&specs);
 }
 
+static void parse_get(const char *arg)
+{
+	struct strbuf url = STRBUF_INIT;
+	const char *space = strchr(arg, ' ');
+
+	if (!space)
+		die(_("protocol error: expected '<url> <path>', missing space"));
+
+	strbuf_add(&url, arg, space - arg);
+	if (http_get_file(url.buf, space + 1, NULL) != HTTP_OK)
+		die(_("failed to download file at URL '%s'"), url.buf);
+
+	strbuf_release(&url);
+	printf("\n");
+	fflush(stdout);
+}
+
 static int stateless_connect(const char *service_name)
 {
 	struct discovery *discover;
@@ -1543,6 +1560,9 @@ int cmd_main(int argc, const char **argv)
 				printf("unsupported\n");
 			fflush(stdout);
 
+		} else if (skip_prefix(buf.buf, "get ", &arg)) {
+			parse_get(arg);
+
 		} else if (!strcmp(buf.buf, "capabilities")) {
 			printf("stateless-connect\n");
 			printf("fetch\n");
@@ -1550,6 +1570,7 @@ int cmd_main(int argc, const char **argv)
 			printf("push\n");
 			printf("check-connectivity\n");
 			printf("object-format\n");
+			printf("get\n");
 			printf("\n");
 			fflush(stdout);
 		} else if (skip_prefix(buf.buf, "stateless-connect ", &arg)) {
@@ -59,6 +59,19 @@ void prepare_repo_settings(struct repository *r)
 		r->settings.core_multi_pack_index = value;
 	UPDATE_DEFAULT_BOOL(r->settings.core_multi_pack_index, 1);
 
+	value = git_env_bool("GIT_TEST_SPARSE_INDEX", 0);
+	if (value || !repo_config_get_bool(r, "index.sparse", &value))
+		r->settings.sparse_index = value;
+	UPDATE_DEFAULT_BOOL(r->settings.sparse_index, 0);
+
+	/*
+	 * This setting guards all index reads to require a full index
+	 * over a sparse index. After suitable guards are placed in the
+	 * codebase around uses of the index, this setting will be
+	 * removed.
+	 */
+	r->settings.command_requires_full_index = 1;
+
 	if (!repo_config_get_bool(r, "core.usebuiltinfsmonitor", &value) && value)
 		r->settings.use_builtin_fsmonitor = 1;
 
@@ -43,6 +43,9 @@ struct repo_settings {
 	int core_multi_pack_index;
 
 	int use_builtin_fsmonitor;
+
+	int sparse_index;
+	int command_requires_full_index;
 };
 
 struct repository {
@@ -132,6 +135,12 @@ struct repository {
 	/* Repository's current hash algorithm, as serialized on disk. */
 	const struct git_hash_algo *hash_algo;
 
+	/*
+	 * Name of the backend storing the repository's refs, as given by
+	 * "extensions.refStorage"; NULL means "files".
+	 */
+	char *ref_storage_format;
+
 	/* A unique-id for tracing purposes. */
 	int trace2_repo_id;
 
@@ -162,6 +171,7 @@ void repo_set_gitdir(struct repository *repo, const char *root,
 		     const struct set_gitdir_args *extra_args);
 void repo_set_worktree(struct repository *repo, const char *path);
 void repo_set_hash_algo(struct repository *repo, int algo);
+void repo_set_ref_storage_format(struct repository *repo, const char *format);
 void initialize_the_repository(void);
 int repo_init(struct repository *r, const char *gitdir, const char *worktree);
 
@@ -645,27 +645,56 @@ static void trace2_bloom_filter_statistics_atexit(void)
 	jw_release(&jw);
 }
 
+static void register_bloom_filter_statistics(void)
+{
+	if (trace2_is_enabled() && !bloom_filter_atexit_registered) {
+		atexit(trace2_bloom_filter_statistics_atexit);
+		bloom_filter_atexit_registered = 1;
+	}
+}
+
 static int forbid_bloom_filters(struct pathspec *spec)
 {
-	if (spec->has_wildcard)
-		return 1;
+	unsigned allowed = PATHSPEC_LITERAL | PATHSPEC_GLOB;
+
 	if (spec->nr > 1)
 		return 1;
-	if (spec->magic & ~PATHSPEC_LITERAL)
+	if (spec->magic & ~allowed)
 		return 1;
-	if (spec->nr && (spec->items[0].magic & ~PATHSPEC_LITERAL))
+	if (spec->nr && (spec->items[0].magic & ~allowed))
 		return 1;
 
 	return 0;
 }
 
+/*
+ * The filters only know about paths, so a wildcard pathspec is tested by
+ * the longest leading directory without a wildcard in it: a commit that
+ * did not touch "src" did not touch anything matching "src/main*.c".
+ * Returns 0 when there is no such directory and all of the tree could
+ * match.
+ */
+static size_t bloom_filter_path_len(const struct pathspec_item *pi)
+{
+	size_t len = pi->len;
+
+	if (pi->nowildcard_len < pi->len) {
+		len = pi->nowildcard_len;
+		while (len && pi->match[len - 1] != '/')
+			len--;
+	}
+
+	/* remove single trailing slash from path, if needed */
+	if (len && pi->match[len - 1] == '/')
+		len--;
+
+	return len;
+}
+
 static void prepare_to_use_bloom_filter(struct rev_info *revs)
 {
 	struct pathspec_item *pi;
-	char *path_alloc = NULL;
-	const char *path, *p;
 	size_t len;
-	int path_component_nr = 1;
 
 	if (!revs->commits)
 		return;
@@ -683,62 +712,23 @@ static void prepare_to_use_bloom_filter(struct rev_info *revs)
 		return;
 
 	pi = &revs->pruning.pathspec.items[0];
-
-	/* remove single trailing slash from path, if needed */
-	if (pi->len > 0 && pi->match[pi->len - 1] == '/') {
-		path_alloc = xmemdupz(pi->match, pi->len - 1);
-		path = path_alloc;
-	} else
-		path = pi->match;
-
-	len = strlen(path);
+	len = bloom_filter_path_len(pi);
 	if (!len) {
 		revs->bloom_filter_settings = NULL;
-		free(path_alloc);
 		return;
 	}
 
-	p = path;
-	while (*p) {
-		/*
-		 * At this point, the path is normalized to use Unix-style
-		 * path separators. This is required due to how the
-		 * changed-path Bloom filters store the paths.
-		 */
-		if (*p == '/')
-			path_component_nr++;
-		p++;
-	}
-
-	revs->bloom_keys_nr = path_component_nr;
-	ALLOC_ARRAY(revs->bloom_keys, revs->bloom_keys_nr);
-
-	fill_bloom_key(path, len, &revs->bloom_keys[0],
-		       revs->bloom_filter_settings);
-	path_component_nr = 1;
-
-	p = path + len - 1;
-	while (p > path) {
-		if (*p == '/')
-			fill_bloom_key(path, p - path,
-				       &revs->bloom_keys[path_component_nr++],
-				       revs->bloom_filter_settings);
-		p--;
-	}
-
-	if (trace2_is_enabled() && !bloom_filter_atexit_registered) {
-		atexit(trace2_bloom_filter_statistics_atexit);
-		bloom_filter_atexit_registered = 1;
-	}
+	revs->bloom_keyvec = bloom_keyvec_new(pi->match, len,
+					      revs->bloom_filter_settings);
 
-	free(path_alloc);
+	register_bloom_filter_statistics();
 }
 
-static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
-						 struct commit *commit)
+int bloom_filter_maybe_changed(struct rev_info *revs, struct commit *commit,
+			       struct bloom_keyvec **vecs, int nr)
 {
 	struct bloom_filter *filter;
-	int result = 1, j;
+	int result = 0, i;
 
 	if (!revs->repo->objects->commit_graph)
 		return -1;
@@ -746,6 +736,8 @@ static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
 	if (commit_graph_generation(commit) == GENERATION_NUMBER_INFINITY)
 		return -1;
 
+	register_bloom_filter_statistics();
+
 	filter = get_bloom_filter(revs->repo, commit);
 
 	if (!filter) {
@@ -753,18 +745,22 @@ static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
 		return -1;
 	}
 
-	for (j = 0; result && j < revs->bloom_keys_nr; j++) {
-		result = bloom_filter_contains(filter,
-					       &revs->bloom_keys[j],
-					       revs->bloom_filter_settings);
-	}
+	for (i = 0; !result && i < nr; i++)
+		result = bloom_filter_contains_vec(filter, vecs[i],
+						   revs->bloom_filter_settings);
 
 	if (result)
 		count_bloom_filter_maybe++;
 	else
 		count_bloom_filter_definitely_not++;
 
-	return result;
+	return !!result;
+}
+
+void count_bloom_filter_result(int changed)
+{
+	if (!changed)
+		count_bloom_filter_false_positive++;
 }
 
 static int rev_compare_tree(struct rev_info *revs,
@@ -797,8 +793,9 @@ static int rev_compare_tree(struct rev_info *revs,
 			return REV_TREE_SAME;
 	}
 
-	if (revs->bloom_keys_nr && !nth_parent) {
-		bloom_ret = check_maybe_different_in_bloom_filter(revs, commit);
+	if (revs->bloom_keyvec && !nth_parent) {
+		bloom_ret = bloom_filter_maybe_changed(revs, commit,
+						       &revs->bloom_keyvec, 1);
 
 		if (bloom_ret == 0)
 			return REV_TREE_SAME;
@@ -808,9 +805,8 @@ static int rev_compare_tree(struct rev_info *revs,
 	revs->pruning.flags.has_changes = 0;
 	diff_tree_oid(&t1->object.oid, &t2->object.oid, "", &revs->pruning);
 
-	if (!nth_parent)
-		if (bloom_ret == 1 && tree_difference == REV_TREE_SAME)
-			count_bloom_filter_false_positive++;
+	if (!nth_parent && bloom_ret == 1)
+		count_bloom_filter_result(tree_difference != REV_TREE_SAME);
 
 	return tree_difference;
 }
@@ -3795,6 +3791,9 @@ enum commit_action get_commit_action(struct rev_info *revs, struct commit *commi
 		return commit_ignore;
 	if (revs->unpacked && has_object_pack(&commit->object.oid))
 		return commit_ignore;
+	if (revs->no_kept_objects &&
+	    has_object_kept_pack(&commit->object.oid, revs->kept_pack_flags))
+		return commit_ignore;
 	if (commit->object.flags & UNINTERESTING)
 		return commit_ignore;
 	if (revs->line_level_traverse && !want_ancestry(revs)) {
@@ -60,8 +60,8 @@ struct repository;
 struct rev_info;
 struct string_list;
 struct saved_parents;
-struct bloom_key;
 struct bloom_filter_settings;
+struct bloom_keyvec;
 define_shared_commit_slab(revision_sources, char *);
 
 struct rev_cmdline_info {
@@ -148,6 +148,7 @@ struct rev_info {
 			edge_hint_aggressive:1,
 			limited:1,
 			unpacked:1,
+			no_kept_objects:1,
 			boundary:2,
 			count:1,
 			left_right:1,
@@ -184,6 +185,12 @@ struct rev_info {
 			/* for internal use only */
 			exclude_promisor_objects:1;
 
+	/*
+	 * With no_kept_objects, commits found in these kinds of kept packs
+	 * (ON_DISK_KEEP_PACKS and/or IN_CORE_KEEP_PACKS) are not shown.
+	 */
+	unsigned int	kept_pack_flags;
+
 	/* Diff flags */
 	unsigned int	diff:1,
 			full_diff:1,
@@ -308,9 +315,8 @@ struct rev_info {
 	struct topo_walk_info *topo_walk_info;
 
 	/* Commit graph bloom filter fields */
-	/* The bloom filter key(s) for the pathspec */
-	struct bloom_key *bloom_keys;
-	int bloom_keys_nr;
+	/* The bloom filter keys for the pathspec */
+	struct bloom_keyvec *bloom_keyvec;
 
 	/*
 	 * The bloom filter settings used to generate the key.
@@ -451,6 +457,18 @@ int rewrite_parents(struct rev_info *revs,
 		    struct commit *commit,
 		    rewrite_parent_fn_t rewrite_parent);
 
+/*
+ * Ask the changed-path Bloom filter of `commit` whether any of the `nr`
+ * paths in `vecs` may differ from its first parent.  Returns -1 if there
+ * is no filter to ask, 0 if none of them changed, and 1 if some may have;
+ * in the last case the caller should report with
+ * count_bloom_filter_result() whether one really did.  Both feed the
+ * "bloom/statistics" trace2 data.
+ */
+int bloom_filter_maybe_changed(struct rev_info *revs, struct commit *commit,
+			       struct bloom_keyvec **vecs, int nr);
+void count_bloom_filter_result(int changed);
+
 /*
  * The log machinery saves the original parent list so that
  * get_saved_parents() can later tell what the real parents of the
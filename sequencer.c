@@ -336,6 +336,13 @@ int sequencer_remove_state(struct replay_opts *opts)
 		free(opts->xopts[i]);
 	free(opts->xopts);
 	strbuf_release(&opts->current_fixups);
+	if (opts->ort_result) {
+		struct merge_options o;
+
+		memset(&o, 0, sizeof(o));
+		merge_finalize(&o, opts->ort_result);
+		FREE_AND_NULL(opts->ort_result);
+	}
 
 	strbuf_reset(&buf);
 	strbuf_addstr(&buf, get_dir(opts));
@@ -609,7 +616,6 @@ static int do_recursive_merge(struct repository *r,
 			      struct replay_opts *opts)
 {
 	struct merge_options o;
-	struct merge_result result;
 	struct tree *next_tree, *base_tree, *head_tree;
 	int clean, show_output;
 	int i;
@@ -636,10 +642,13 @@ static int do_recursive_merge(struct repository *r,
 		parse_merge_opt(&o, opts->xopts[i]);
 
 	if (opts->strategy && !strcmp(opts->strategy, "ort")) {
-		memset(&result, 0, sizeof(result));
+		struct merge_result *result = opts->ort_result;
+
+		if (!result)
+			result = opts->ort_result = xcalloc(1, sizeof(*result));
 		merge_incore_nonrecursive(&o, base_tree, head_tree, next_tree,
-					    &result);
-		show_output = !is_rebase_i(opts) || !result.clean;
+					  result);
+		show_output = !is_rebase_i(opts) || !result->clean;
 		/*
 		 * TODO: merge_switch_to_result will update index/working tree;
 		 * we only really want to do that if !result.clean || this is
@@ -648,8 +657,21 @@ static int do_recursive_merge(struct repository *r,
 		 * to be replace with the tree the index matched before we
 		 * started doing any picks.
 		 */
-		merge_switch_to_result(&o, head_tree, &result, 1, show_output);
-		clean = result.clean;
+		if (result->clean > 0) {
+			/*
+			 * Keep the renames found by this pick around; the
+			 * next one can reuse them if it builds on our result.
+			 */
+			merge_switch_to_result_keeping_renames(&o, head_tree,
+							       result, 1,
+							       show_output);
+		} else {
+			merge_switch_to_result(&o, head_tree, result, 1,
+					       show_output);
+		}
+		clean = result->clean;
+		if (clean <= 0)
+			FREE_AND_NULL(opts->ort_result);
 	} else {
 		clean = merge_trees(&o, head_tree, next_tree, base_tree);
 		if (is_rebase_i(opts) && clean <= 0)
@@ -6,6 +6,7 @@
 #include "wt-status.h"
 
 struct commit;
+struct merge_result;
 struct repository;
 
 const char *git_path_commit_editmsg(void);
@@ -70,6 +71,9 @@ struct replay_opts {
 
 	/* Only used by REPLAY_NONE */
 	struct rev_info *revs;
+
+	/* Only used by the "ort" strategy, to reuse renames between picks */
+	struct merge_result *ort_result;
 };
 #define REPLAY_OPTS_INIT { .action = -1, .current_fixups = STRBUF_INIT }
 
@@ -7,6 +7,8 @@
 #include "ls-refs.h"
 #include "serve.h"
 #include "upload-pack.h"
+#include "bundle-uri.h"
+#include "protocol-caps.h"
 
 static int advertise_sid;
 
@@ -78,6 +80,8 @@ static struct protocol_capability capabilities[] = {
 	{ "server-option", always_advertise, NULL },
 	{ "object-format", object_format_advertise, NULL },
 	{ "session-id", session_id_advertise, NULL },
+	{ "bundle-uri", bundle_uri_advertise, bundle_uri_command },
+	{ "object-info", cap_object_info_advertise, cap_object_info },
 };
 
 static void advertise_capabilities(void)
@@ -0,0 +1,362 @@
+#include "cache.h"
+#include "repository.h"
+#include "sparse-index.h"
+#include "tree.h"
+#include "pathspec.h"
+#include "trace2.h"
+#include "cache-tree.h"
+#include "config.h"
+#include "dir.h"
+
+static struct cache_entry *construct_sparse_dir_entry(
+				struct index_state *istate,
+				const char *sparse_dir,
+				struct cache_tree *tree)
+{
+	struct cache_entry *de;
+
+	de = make_cache_entry(istate, S_IFDIR, &tree->oid, sparse_dir, 0, 0);
+
+	de->ce_flags |= CE_SKIP_WORKTREE;
+	return de;
+}
+
+/*
+ * Walk the index entries in [start, end) that are covered by the
+ * cache-tree node 'ct' for the directory 'ct_path', replacing every
+ * maximal directory that can be collapsed by a sparse directory entry.
+ * The surviving entries are compacted to the front of istate->cache,
+ * starting at 'num_converted'.
+ *
+ * Returns the number of entries "inserted" into the index.
+ */
+static int convert_to_sparse_rec(struct index_state *istate,
+				 struct pattern_list *pl,
+				 int num_converted,
+				 int start, int end,
+				 const char *ct_path, size_t ct_pathlen,
+				 struct cache_tree *ct)
+{
+	int i, can_convert = 1;
+	int start_converted = num_converted;
+	enum pattern_match_result match;
+	int dtype = DT_UNKNOWN;
+	struct strbuf child_path = STRBUF_INIT;
+
+	/*
+	 * Is the current path outside of the sparse cone?
+	 * Then check if the region can be replaced by a sparse
+	 * directory entry (everything is sparse and merged).
+	 */
+	match = path_matches_pattern_list(ct_path, ct_pathlen,
+					  NULL, &dtype, pl, istate);
+	if (match != NOT_MATCHED)
+		can_convert = 0;
+
+	for (i = start; can_convert && i < end; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		if (ce_stage(ce) ||
+		    S_ISGITLINK(ce->ce_mode) ||
+		    !(ce->ce_flags & CE_SKIP_WORKTREE))
+			can_convert = 0;
+	}
+
+	if (can_convert) {
+		struct cache_entry *se;
+		se = construct_sparse_dir_entry(istate, ct_path, ct);
+
+		istate->cache[num_converted++] = se;
+		return 1;
+	}
+
+	for (i = start; i < end; ) {
+		int count, span, pos = -1;
+		const char *base, *slash;
+		struct cache_entry *ce = istate->cache[i];
+
+		/*
+		 * Detect if this is a normal entry outside of any subtree
+		 * entry.
+		 */
+		base = ce->name + ct_pathlen;
+		slash = strchr(base, '/');
+
+		if (slash)
+			pos = cache_tree_subtree_pos(ct, base, slash - base);
+
+		if (pos < 0) {
+			istate->cache[num_converted++] = ce;
+			i++;
+			continue;
+		}
+
+		strbuf_setlen(&child_path, 0);
+		strbuf_add(&child_path, ce->name, slash - ce->name + 1);
+
+		span = ct->down[pos]->cache_tree->entry_count;
+		count = convert_to_sparse_rec(istate, pl,
+					      num_converted, i, i + span,
+					      child_path.buf, child_path.len,
+					      ct->down[pos]->cache_tree);
+		num_converted += count;
+		i += span;
+	}
+
+	strbuf_release(&child_path);
+	return num_converted - start_converted;
+}
+
+int set_sparse_index_config(struct repository *repo, int enable)
+{
+	int res;
+	char *config_path = repo_git_path(repo, "config.worktree");
+	res = git_config_set_in_file_gently(config_path,
+					    "index.sparse",
+					    enable ? "true" : NULL);
+	free(config_path);
+
+	prepare_repo_settings(repo);
+	repo->settings.sparse_index = enable;
+	return res;
+}
+
+/*
+ * Sparse directory entries cannot represent conflicts, and the span of
+ * a cache-tree node only matches the index entries when nothing is
+ * about to be removed from the index.
+ */
+static int index_has_unconvertible_entries(struct index_state *istate)
+{
+	int i;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		if (ce_stage(ce) || (ce->ce_flags & CE_REMOVE))
+			return 1;
+	}
+	return 0;
+}
+
+int convert_to_sparse(struct index_state *istate)
+{
+	struct pattern_list own_pl, *pl;
+	int ret = 0;
+
+	if (istate->split_index || !core_apply_sparse_checkout ||
+	    !core_sparse_checkout_cone)
+		return 0;
+
+	if (!istate->repo)
+		istate->repo = the_repository;
+
+	/*
+	 * Only convert to sparse if index.sparse is set.
+	 */
+	prepare_repo_settings(istate->repo);
+	if (!istate->repo->settings.sparse_index)
+		return 0;
+
+	if (index_has_unconvertible_entries(istate))
+		return 0;
+
+	if (istate->sparse_checkout_patterns) {
+		pl = istate->sparse_checkout_patterns;
+	} else {
+		memset(&own_pl, 0, sizeof(own_pl));
+		if (get_sparse_checkout_patterns(&own_pl) < 0)
+			return 0;
+		pl = &own_pl;
+	}
+
+	if (!pl->use_cone_patterns) {
+		warning(_("attempting to use sparse-index without cone mode"));
+		ret = -1;
+		goto done;
+	}
+
+	/*
+	 * Silently return if there is a problem with the cache tree
+	 * update, which might just be due to a conflict state in some
+	 * entry.  Intent-to-add entries also leave parts of the
+	 * cache-tree invalid, and we need every node to know how many
+	 * entries it spans.
+	 *
+	 * This might create new tree objects, so be sure to use
+	 * WRITE_TREE_MISSING_OK.
+	 */
+	if (cache_tree_update(istate, WRITE_TREE_MISSING_OK) ||
+	    !cache_tree_fully_valid(istate->cache_tree))
+		goto done;
+
+	trace2_region_enter("index", "convert_to_sparse", istate->repo);
+	istate->cache_nr = convert_to_sparse_rec(istate, pl,
+						 0, 0, istate->cache_nr,
+						 "", 0, istate->cache_tree);
+
+	/*
+	 * The entry counts of the cache-tree no longer match, so
+	 * recompute it from scratch.
+	 */
+	cache_tree_free(&istate->cache_tree);
+	cache_tree_update(istate, 0);
+
+	istate->sparse_index = 1;
+	trace2_region_leave("index", "convert_to_sparse", istate->repo);
+
+done:
+	if (pl == &own_pl)
+		clear_pattern_list(&own_pl);
+	return ret;
+}
+
+static void set_index_entry(struct index_state *istate, int nr, struct cache_entry *ce)
+{
+	ALLOC_GROW(istate->cache, nr + 1, istate->cache_alloc);
+
+	istate->cache[nr] = ce;
+	add_name_hash(istate, ce);
+}
+
+static int add_path_to_index(const struct object_id *oid,
+			     struct strbuf *base, const char *path,
+			     unsigned int mode, int stage, void *context)
+{
+	struct index_state *istate = (struct index_state *)context;
+	struct cache_entry *ce;
+	size_t len = base->len;
+
+	if (S_ISDIR(mode))
+		return READ_TREE_RECURSIVE;
+
+	strbuf_addstr(base, path);
+
+	ce = make_cache_entry(istate, mode, oid, base->buf, 0, 0);
+	ce->ce_flags |= CE_SKIP_WORKTREE | CE_EXTENDED;
+	set_index_entry(istate, istate->cache_nr++, ce);
+
+	strbuf_setlen(base, len);
+	return 0;
+}
+
+void ensure_full_index(struct index_state *istate)
+{
+	int i;
+	struct index_state *full;
+	struct pathspec ps;
+
+	if (!istate || !istate->sparse_index)
+		return;
+
+	if (!istate->repo)
+		istate->repo = the_repository;
+
+	trace2_region_enter("index", "ensure_full_index", istate->repo);
+
+	/* initialize basics of new index */
+	full = xcalloc(1, sizeof(struct index_state));
+	memcpy(full, istate, sizeof(struct index_state));
+
+	/* then change the necessary things */
+	full->sparse_index = 0;
+	full->cache_alloc = (3 * istate->cache_alloc) / 2;
+	full->cache_nr = 0;
+	ALLOC_ARRAY(full->cache, full->cache_alloc);
+
+	memset(&ps, 0, sizeof(ps));
+	ps.recursive = 1;
+	ps.has_wildcard = 1;
+	ps.max_depth = -1;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+		struct tree *tree;
+
+		if (!S_ISSPARSEDIR(ce->ce_mode)) {
+			set_index_entry(full, full->cache_nr++, ce);
+			continue;
+		}
+		if (!(ce->ce_flags & CE_SKIP_WORKTREE))
+			warning(_("index entry is a directory, but not sparse (%08x)"),
+				ce->ce_flags);
+
+		/* recursively walk into ce->name */
+		tree = lookup_tree(istate->repo, &ce->oid);
+		if (!tree || read_tree_recursive(istate->repo, tree,
+						 ce->name, ce_namelen(ce), 0,
+						 &ps, add_path_to_index, full))
+			die(_("unable to expand sparse directory '%s'"),
+			    ce->name);
+
+		/* free directory entries. full entries are re-used */
+		discard_cache_entry(ce);
+	}
+
+	/* Copy back into original index. */
+	memcpy(&istate->name_hash, &full->name_hash, sizeof(full->name_hash));
+	memcpy(&istate->dir_hash, &full->dir_hash, sizeof(full->dir_hash));
+	istate->sparse_index = 0;
+	free(istate->cache);
+	istate->cache = full->cache;
+	istate->cache_nr = full->cache_nr;
+	istate->cache_alloc = full->cache_alloc;
+
+	free(full);
+
+	/* Clear and recompute the cache-tree */
+	cache_tree_free(&istate->cache_tree);
+	cache_tree_update(istate, 0);
+
+	trace2_region_leave("index", "ensure_full_index", istate->repo);
+}
+
+/*
+ * Could 'item' match a path below the sparse directory entry 'ce', but
+ * not the directory entry itself?
+ */
+static int pathspec_item_reaches_into(const struct pathspec_item *item,
+				      const struct cache_entry *ce)
+{
+	int namelen = ce_namelen(ce);
+
+	/* A path inside of the sparse directory. */
+	if (item->nowildcard_len > namelen)
+		return !strncmp(item->match, ce->name, namelen);
+
+	/* A wildcard whose literal prefix leads into the directory. */
+	if (item->nowildcard_len < item->len)
+		return !strncmp(item->match, ce->name, item->nowildcard_len);
+
+	return 0;
+}
+
+void ensure_full_index_for_pathspec(struct index_state *istate,
+				    const struct pathspec *pathspec)
+{
+	int i, j;
+
+	if (!istate || !istate->sparse_index || !pathspec->nr)
+		return;
+
+	for (i = 0; i < pathspec->nr; i++) {
+		const struct pathspec_item *item = &pathspec->items[i];
+
+		if (item->magic & PATHSPEC_EXCLUDE)
+			continue;
+		if (item->magic & (PATHSPEC_ICASE | PATHSPEC_ATTR)) {
+			ensure_full_index(istate);
+			return;
+		}
+
+		for (j = 0; j < istate->cache_nr; j++) {
+			const struct cache_entry *ce = istate->cache[j];
+
+			if (S_ISSPARSEDIR(ce->ce_mode) &&
+			    pathspec_item_reaches_into(item, ce)) {
+				ensure_full_index(istate);
+				return;
+			}
+		}
+	}
+}
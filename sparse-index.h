@@ -0,0 +1,39 @@
+#ifndef SPARSE_INDEX_H__
+#define SPARSE_INDEX_H__
+
+struct index_state;
+struct pathspec;
+struct repository;
+
+/*
+ * Collapse every directory that is outside of the sparse-checkout cone
+ * (and whose entries are all skip-worktree and merged) into a single
+ * sparse directory entry pointing at its tree.  This is a no-op unless
+ * cone-mode sparse-checkout and "index.sparse" are both enabled.
+ *
+ * Returns 0 on success (including when the index stays full), and -1 if
+ * the index could not be converted.
+ */
+int convert_to_sparse(struct index_state *istate);
+
+/*
+ * Replace every sparse directory entry with the entries of the tree it
+ * points at, so that callers can assume one entry per tracked file.
+ */
+void ensure_full_index(struct index_state *istate);
+
+/*
+ * Expand the index if any item of the pathspec could match a path that
+ * is hidden inside one of its sparse directory entries.
+ */
+void ensure_full_index_for_pathspec(struct index_state *istate,
+				    const struct pathspec *pathspec);
+
+/*
+ * Record whether the sparse index should be used in the worktree
+ * configuration of the repository, and update the in-core setting to
+ * match.
+ */
+int set_sparse_index_config(struct repository *repo, int enable);
+
+#endif
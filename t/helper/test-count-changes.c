@@ -0,0 +1,131 @@
+/*
+ * test-count-changes.c: exercise and time diffcore_count_changes(), the
+ * similarity estimate behind rename and break detection.
+ */
+
+#include "test-tool.h"
+#include "cache.h"
+#include "diff.h"
+#include "diffcore.h"
+#include "parse-options.h"
+#include "xdiff-interface.h"
+
+static const char * const count_changes_usage[] = {
+	"test-tool count-changes [--count=<n>] <src-file> <dst-file>",
+	"test-tool count-changes [--count=<n>] --synthetic=<bytes>",
+	NULL
+};
+
+static struct diff_filespec *filespec_from_buf(const char *name,
+					       struct strbuf *buf)
+{
+	struct diff_filespec *spec = alloc_filespec(name);
+
+	spec->size = buf->len;
+	spec->data = strbuf_detach(buf, NULL);
+	spec->should_free = 1;
+	spec->is_binary = buffer_is_binary(spec->data, spec->size);
+	return spec;
+}
+
+static struct diff_filespec *filespec_from_file(const char *prefix,
+						const char *arg)
+{
+	struct strbuf buf = STRBUF_INIT;
+	char *path = prefix_filename(prefix, arg);
+	struct diff_filespec *spec;
+
+	if (strbuf_read_file(&buf, path, 0) < 0)
+		die_errno("unable to read '%s'", arg);
+	spec = filespec_from_buf(arg, &buf);
+	free(path);
+	return spec;
+}
+
+/*
+ * Generate about 'size' bytes of source-code-like lines, and a copy with
+ * every seventh line changed and every thirteenth line dropped.
+ */
+static void synthesize(size_t size, struct diff_filespec **src,
+		       struct diff_filespec **dst)
+{
+	struct strbuf a = STRBUF_INIT, b = STRBUF_INIT;
+	uint32_t rand = 1;
+	int line;
+
+	for (line = 0; a.len < size; line++) {
+		struct strbuf l = STRBUF_INIT;
+		int words = 1 + line % 9, i;
+
+		strbuf_addchars(&l, '\t', line % 4);
+		for (i = 0; i < words; i++) {
+			rand = rand * 1103515245 + 12345;
+			strbuf_addf(&l, "%sident_%u", i ? " " : "",
+				    (rand >> 16) % 2048);
+		}
+		strbuf_addch(&l, '\n');
+
+		strbuf_addbuf(&a, &l);
+		if (line % 13 == 12)
+			; /* dropped */
+		else if (line % 7 == 6)
+			strbuf_addf(&b, "changed %d\n", line);
+		else
+			strbuf_addbuf(&b, &l);
+		strbuf_release(&l);
+	}
+
+	*src = filespec_from_buf("src", &a);
+	*dst = filespec_from_buf("dst", &b);
+}
+
+int cmd__count_changes(int argc, const char **argv)
+{
+	struct diff_filespec *src, *dst;
+	const char *prefix;
+	unsigned long src_copied = 0, literal_added = 0;
+	uint64_t t0, elapsed;
+	unsigned long synthetic = 0;
+	int count = 1, i;
+	struct option options[] = {
+		OPT_INTEGER(0, "count", &count,
+			    N_("number of times to compare the files")),
+		OPT_MAGNITUDE(0, "synthetic", &synthetic,
+			      N_("compare generated data of about this size")),
+		OPT_END()
+	};
+
+	prefix = setup_git_directory_gently(NULL);
+	argc = parse_options(argc, argv, prefix, options,
+			     count_changes_usage, 0);
+	if (count < 1 || (synthetic ? argc != 0 : argc != 2))
+		usage_with_options(count_changes_usage, options);
+
+	if (synthetic)
+		synthesize(synthetic, &src, &dst);
+	else {
+		src = filespec_from_file(prefix, argv[0]);
+		dst = filespec_from_file(prefix, argv[1]);
+	}
+
+	/*
+	 * Do not cache the hashed spans between runs, so that each run
+	 * includes hashing both sides as well as comparing them.
+	 */
+	t0 = getnanotime();
+	for (i = 0; i < count; i++)
+		if (diffcore_count_changes(the_repository, src, dst,
+					   NULL, NULL,
+					   &src_copied, &literal_added))
+			die("diffcore_count_changes failed");
+	elapsed = getnanotime() - t0;
+
+	printf("%lu %lu\n", src_copied, literal_added);
+	if (count > 1)
+		fprintf(stderr, "avg %f\n",
+			(double)elapsed / count / 1000000000);
+
+	free_filespec(src);
+	free_filespec(dst);
+	return 0;
+}
@@ -3,8 +3,9 @@
 #include "midx.h"
 #include "repository.h"
 #include "object-store.h"
+#include "packfile.h"
 
-static int read_midx_file(const char *object_dir)
+static int read_midx_file(const char *object_dir, int show_objects)
 {
 	uint32_t i;
 	struct multi_pack_index *m;
@@ -34,6 +35,8 @@ static int read_midx_file(const char *object_dir)
 		printf(" object-offsets");
 	if (m->chunk_large_offsets)
 		printf(" large-offsets");
+	if (m->chunk_revindex)
+		printf(" revindex");
 
 	printf("\nnum_objects: %d\n", m->num_objects);
 
@@ -43,13 +46,44 @@ static int read_midx_file(const char *object_dir)
 
 	printf("object-dir: %s\n", m->object_dir);
 
+	if (show_objects) {
+		struct object_id oid;
+		struct pack_entry e;
+
+		for (i = 0; i < m->num_objects; i++) {
+			nth_midxed_object_oid(&oid, m, i);
+			fill_midx_entry(the_repository, &oid, &e, m);
+
+			printf("%s %"PRIu64"\t%s\n",
+			       oid_to_hex(&oid), e.offset, e.p->pack_name);
+		}
+	}
+
+	return 0;
+}
+
+static int read_midx_checksum(const char *object_dir)
+{
+	struct multi_pack_index *m;
+
+	setup_git_directory();
+	m = load_multi_pack_index(object_dir, 1);
+	if (!m)
+		return 1;
+	printf("%s\n", hash_to_hex(get_midx_checksum(m)));
 	return 0;
 }
 
 int cmd__read_midx(int argc, const char **argv)
 {
-	if (argc != 2)
-		usage("read-midx <object-dir>");
+	if (!(argc == 2 || argc == 3))
+		usage("read-midx [--show-objects|--checksum] <object-dir>");
 
-	return read_midx_file(argv[1]);
+	if (argc == 2)
+		return read_midx_file(argv[1], 0);
+	if (!strcmp(argv[1], "--show-objects"))
+		return read_midx_file(argv[2], 1);
+	if (!strcmp(argv[1], "--checksum"))
+		return read_midx_checksum(argv[2]);
+	usage("read-midx [--show-objects|--checksum] <object-dir>");
 }
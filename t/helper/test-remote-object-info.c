@@ -0,0 +1,56 @@
+#include "test-tool.h"
+#include "cache.h"
+#include "fetch-pack.h"
+#include "object.h"
+#include "oid-array.h"
+#include "remote.h"
+#include "transport.h"
+
+/*
+ * Print "<oid> <type> <size>" for each object as the remote knows it, or
+ * "<oid> missing" if the remote does not have it.
+ */
+int cmd__remote_object_info(int argc, const char **argv)
+{
+	struct oid_array oids = OID_ARRAY_INIT;
+	struct remote_object_info *info;
+	struct transport *transport;
+	struct remote *remote;
+	int i;
+
+	if (argc < 3)
+		die("usage: test-tool remote-object-info <remote> <object>...");
+
+	setup_git_directory();
+	for (i = 2; i < argc; i++) {
+		struct object_id oid;
+
+		if (get_oid_hex(argv[i], &oid))
+			die("not a hexadecimal oid: %s", argv[i]);
+		oid_array_append(&oids, &oid);
+	}
+
+	remote = remote_get(argv[1]);
+	if (!remote)
+		die("no such remote: %s", argv[1]);
+	transport = transport_get(remote, NULL);
+
+	CALLOC_ARRAY(info, oids.nr);
+	if (transport_get_object_info(transport, &oids, info)) {
+		transport_disconnect(transport);
+		die("remote does not support object-info");
+	}
+
+	for (i = 0; i < oids.nr; i++) {
+		if (info[i].type < 0)
+			printf("%s missing\n", oid_to_hex(&oids.oid[i]));
+		else
+			printf("%s %s %lu\n", oid_to_hex(&oids.oid[i]),
+			       type_name(info[i].type), info[i].size);
+	}
+
+	transport_disconnect(transport);
+	free(info);
+	oid_array_clear(&oids);
+	return 0;
+}
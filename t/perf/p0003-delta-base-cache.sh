@@ -14,6 +14,9 @@ depth of 50.
 The setting of core.deltaBaseCacheLimit in the source repository is also
 relevant (depending on the size of your test repo), so be sure it is consistent
 between runs.
+
+"grep" over a tree reads blobs from several threads at once, which exercises
+concurrent access to the cache.
 '
 . ./perf-lib.sh
 
@@ -28,4 +31,16 @@ test_perf 'log -S' '
 	git log --raw -Sfoo >/dev/null
 '
 
+# puts blobs, which may be bigger than any share of the cache, into it
+test_perf 'log -p' '
+	git log -p -n 1000 >/dev/null
+'
+
+for threads in 1 4 8
+do
+	test_perf "grep HEAD~10 (threads=$threads)" "
+		git grep --threads=$threads -c foo HEAD~10 >/dev/null || :
+	"
+done
+
 test_done
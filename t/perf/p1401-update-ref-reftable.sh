@@ -0,0 +1,56 @@
+#!/bin/sh
+
+test_description="Tests performance of update-ref with the reftable backend"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success "setup" '
+	rm -rf .git &&
+	git init -q --ref-format=reftable &&
+	test_commit PRE &&
+	test_commit POST &&
+	for i in $(test_seq 5000)
+	do
+		printf "start\ncreate refs/heads/%d PRE\ncommit\n" $i &&
+		printf "start\nupdate refs/heads/%d POST PRE\ncommit\n" $i &&
+		printf "start\ndelete refs/heads/%d POST\ncommit\n" $i
+	done >instructions &&
+	for i in $(test_seq 100000)
+	do
+		printf "create refs/pull/%d/head PRE\n" $i
+	done >many-refs
+'
+
+test_perf "update-ref" '
+	for i in $(test_seq 1000)
+	do
+		git update-ref refs/heads/branch PRE &&
+		git update-ref refs/heads/branch POST PRE &&
+		git update-ref -d refs/heads/branch
+	done
+'
+
+test_perf "update-ref --stdin" '
+	git update-ref --stdin <instructions >/dev/null
+'
+
+test_expect_success "create many refs" '
+	git update-ref --stdin <many-refs
+'
+
+test_perf "update-ref with many refs" '
+	for i in $(test_seq 1000)
+	do
+		git update-ref refs/heads/branch PRE &&
+		git update-ref refs/heads/branch POST PRE &&
+		git update-ref -d refs/heads/branch
+	done
+'
+
+test_perf "update-ref --stdin with many refs" '
+	git update-ref --stdin <instructions >/dev/null
+'
+
+test_done
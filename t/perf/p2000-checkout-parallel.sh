@@ -0,0 +1,26 @@
+#!/bin/sh
+#
+# This test measures the performance of populating the working tree
+# with parallel checkout, using different numbers of workers.  Unlike
+# p0006, it is primarily interested in the cost of writing out files.
+
+test_description="Tests performance of parallel checkout"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'setup' '
+	git rev-parse --verify HEAD^{tree} &&
+	git config checkout.thresholdForParallelism 0
+'
+
+for workers in 1 4 16
+do
+	test_perf "checkout with $workers worker(s)" "
+		rm -rf -- * &&
+		git -c checkout.workers=$workers reset --hard -q HEAD
+	"
+done
+
+test_done
@@ -26,4 +26,17 @@ test_perf 'log -p -3000 --patience' '
 	git log -p -3000 --patience >/dev/null
 '
 
+test_expect_success 'setup large generated files' '
+	test_seq 500000 | awk "{ print \$1 % 5000, \$1 % 13, \$1 % 97 }" >big1 &&
+	awk "NR % 500 >= 20 { print; next } { print \"changed\", NR }" big1 >big2
+'
+
+for algo in myers patience
+do
+	test_perf "diff --no-index of large generated files ($algo)" "
+		test_expect_code 1 git diff --no-index \
+			--diff-algorithm=$algo big1 big2 >/dev/null
+	"
+done
+
 test_done
@@ -0,0 +1,39 @@
+#!/bin/sh
+
+test_description="Test inexact rename detection performance"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+test_checkout_worktree
+
+test_expect_success 'setup: move and edit many files' '
+	git ls-files -s | grep "^100644" | cut -f2 | head -n 1000 >files &&
+	mkdir moved &&
+	while read f
+	do
+		n=$(echo "$f" | tr / _) &&
+		git show "HEAD:$f" >"moved/$n.renamed" &&
+		echo edited >>"moved/$n.renamed" || return 1
+	done <files &&
+	git rm -q --cached --pathspec-from-file=files &&
+	git add moved &&
+	git commit -q -m "move and edit"
+'
+
+for threads in 1 4
+do
+	test_perf "diff-tree -M, 1000 inexact renames (threads=$threads)" "
+		git -c diff.renameThreads=$threads diff-tree -r -M -l0 \
+			--name-status HEAD^ HEAD >/dev/null
+	"
+done
+
+for size in 100k 1m 10m
+do
+	test_perf "similarity estimate of $size files" "
+		test-tool count-changes --count=10 --synthetic=$size >/dev/null
+	"
+done
+
+test_done
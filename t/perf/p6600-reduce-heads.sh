@@ -0,0 +1,45 @@
+#!/bin/sh
+
+test_description='Tests reduce_heads() and merge-base --independent
+
+Reduce every branch and tag tip, and a sample of the first-parent
+history, to the independent ones, with and without generation numbers
+from a commit-graph.  Also reduce 20000 commits from all over the
+history, which is about as many tips as a busy server repository has.
+'
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'setup' '
+	{
+		git rev-list --no-walk --all &&
+		git rev-list --first-parent HEAD | awk "NR % 20 == 0"
+	} | sed "s/^/X:/" >input &&
+	git rev-list --all | awk "NR % 3 == 0" | head -n 20000 |
+		sed "s/^/X:/" >input-20k &&
+	git commit-graph write --reachable
+'
+
+test_perf 'reduce_heads with commit-graph' '
+	test-tool reach reduce_heads <input >/dev/null
+'
+
+test_perf 'reduce_heads of 20000 commits with commit-graph' '
+	test-tool reach reduce_heads <input-20k >/dev/null
+'
+
+test_expect_success 'disable commit-graph' '
+	git config core.commitGraph false
+'
+
+test_perf 'reduce_heads without commit-graph' '
+	test-tool reach reduce_heads <input >/dev/null
+'
+
+test_perf 'reduce_heads of 20000 commits without commit-graph' '
+	test-tool reach reduce_heads <input-20k >/dev/null
+'
+
+test_done
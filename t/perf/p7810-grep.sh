@@ -20,4 +20,11 @@ test_perf 'grep --cached, expensive regex' '
 	git grep --cached "^.* *some_nonexistent_string$" || :
 '
 
+for threads in 1 4
+do
+	test_perf "grep HEAD~10, cheap regex (threads=$threads)" "
+		git grep --threads=$threads some_nonexistent_string HEAD~10 || :
+	"
+done
+
 test_done
@@ -0,0 +1,281 @@
+#!/bin/sh
+
+test_description='reftable reference storage backend'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+INVALID_OID=$(test_oid 001)
+
+tables () {
+	cat "${1:-.git}/reftable/tables.list"
+}
+
+test_expect_success 'init --ref-format=reftable' '
+	rm -rf .git &&
+	git init --ref-format=reftable &&
+	test_path_is_file .git/reftable/tables.list &&
+	echo 1 >expect &&
+	git config core.repositoryformatversion >actual &&
+	test_cmp expect actual &&
+	echo reftable >expect &&
+	git config extensions.refstorage >actual &&
+	test_cmp expect actual &&
+	echo refs/heads/main >expect &&
+	git symbolic-ref HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'GIT_DEFAULT_REF_FORMAT selects the backend' '
+	GIT_DEFAULT_REF_FORMAT=reftable git init env &&
+	test_path_is_file env/.git/reftable/tables.list &&
+	git -C env config extensions.refstorage
+'
+
+test_expect_success 'unknown ref storage format is rejected' '
+	test_must_fail git init --ref-format=bogus bogus 2>err &&
+	test_i18ngrep "unknown ref storage format" err
+'
+
+test_expect_success 'reinitializing with a different format fails' '
+	test_must_fail git init --ref-format=files 2>err &&
+	test_i18ngrep "different reference storage format" err &&
+	git init --ref-format=reftable
+'
+
+test_expect_success 'basic ref updates' '
+	test_commit A &&
+	test_commit B &&
+	git rev-parse A >expect &&
+	git update-ref refs/heads/topic A &&
+	git rev-parse topic >actual &&
+	test_cmp expect actual &&
+	git update-ref refs/heads/topic B A &&
+	git rev-parse B >expect &&
+	git rev-parse topic >actual &&
+	test_cmp expect actual &&
+	git update-ref -d refs/heads/topic B &&
+	test_must_fail git rev-parse --verify -q topic
+'
+
+test_expect_success 'compare-and-swap failures are reported' '
+	git update-ref refs/heads/topic A &&
+	test_must_fail git update-ref refs/heads/topic B B 2>err &&
+	test_i18ngrep "cannot lock ref .refs/heads/topic.: is at $(git rev-parse A) but expected $(git rev-parse B)" err &&
+	test_must_fail git update-ref refs/heads/topic B $ZERO_OID 2>err &&
+	test_i18ngrep "reference already exists" err &&
+	test_must_fail git update-ref refs/heads/missing B A 2>err &&
+	test_i18ngrep "unable to resolve reference" err
+'
+
+test_expect_success 'nonexistent objects are rejected' '
+	test_must_fail git update-ref refs/heads/bad $INVALID_OID 2>err &&
+	test_i18ngrep "nonexistent object" err
+'
+
+test_expect_success 'directory/file conflicts are detected' '
+	git update-ref refs/heads/dir/file A &&
+	test_must_fail git update-ref refs/heads/dir A 2>err &&
+	test_i18ngrep "cannot lock ref .refs/heads/dir." err &&
+	test_must_fail git update-ref refs/heads/topic/sub A 2>err &&
+	test_i18ngrep "cannot lock ref .refs/heads/topic/sub." err &&
+	git update-ref -d refs/heads/dir/file &&
+	git update-ref refs/heads/dir A
+'
+
+test_expect_success 'transactions are atomic' '
+	git for-each-ref >expect &&
+	cat >in <<-EOF &&
+	start
+	create refs/heads/new1 A
+	update refs/heads/topic B B
+	commit
+	EOF
+	test_must_fail git update-ref --stdin <in &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'each transaction adds one table' '
+	test_config reftable.autoCompact false &&
+	tables >before &&
+	cat >in <<-EOF &&
+	create refs/heads/new1 A
+	create refs/heads/new2 B
+	delete refs/heads/dir
+	EOF
+	git update-ref --stdin <in &&
+	tables >after &&
+	test_line_count = $(($(wc -l <before) + 1)) after &&
+	git rev-parse A >expect &&
+	git rev-parse new1 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'no-op updates do not add a table' '
+	test_config reftable.autoCompact false &&
+	tables >before &&
+	git update-ref refs/heads/new1 A &&
+	tables >after &&
+	test_cmp before after
+'
+
+test_expect_success 'pack-refs compacts the stack into one table' '
+	git pack-refs &&
+	test_line_count = 1 .git/reftable/tables.list &&
+	test_path_is_missing .git/reftable/tables.list.lock &&
+	ls .git/reftable >actual &&
+	test_line_count = 2 actual &&
+	git rev-parse A >expect &&
+	git rev-parse new1 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'auto-compaction keeps the stack small' '
+	for i in $(test_seq 64)
+	do
+		git update-ref refs/heads/auto-$i A || return 1
+	done &&
+	test $(tables | wc -l) -le 7 &&
+	git for-each-ref refs/heads/auto-* >actual &&
+	test_line_count = 64 actual
+'
+
+test_expect_success 'locked stack is reported and leaves refs readable' '
+	>.git/reftable/tables.list.lock &&
+	test_when_finished "rm -f .git/reftable/tables.list.lock" &&
+	test_must_fail git update-ref refs/heads/locked A 2>err &&
+	test_i18ngrep "cannot lock ref .refs/heads/locked." err &&
+	git rev-parse A >expect &&
+	git rev-parse new1 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'symbolic refs' '
+	git symbolic-ref refs/heads/sym refs/heads/new2 &&
+	echo refs/heads/new2 >expect &&
+	git symbolic-ref refs/heads/sym >actual &&
+	test_cmp expect actual &&
+	git rev-parse B >expect &&
+	git rev-parse sym >actual &&
+	test_cmp expect actual &&
+	git update-ref refs/heads/sym A &&
+	git rev-parse A >expect &&
+	git rev-parse new2 >actual &&
+	test_cmp expect actual &&
+	git update-ref --no-deref -d refs/heads/sym &&
+	git rev-parse new2
+'
+
+test_expect_success 'annotated tags are stored peeled' '
+	git tag -a -m "annotated" annotated A &&
+	git pack-refs &&
+	git rev-parse A >expect &&
+	git for-each-ref --format="%(*objectname)" refs/tags/annotated >actual &&
+	test_cmp expect actual &&
+	git show-ref -d annotated >actual &&
+	test_line_count = 2 actual
+'
+
+test_expect_success 'many refs with a small block size' '
+	test_config reftable.blockSize 256 &&
+	for i in $(test_seq 500)
+	do
+		echo "create refs/heads/many/$i A" || return 1
+	done >in &&
+	git update-ref --stdin <in &&
+	git pack-refs &&
+	git for-each-ref refs/heads/many/ >actual &&
+	test_line_count = 500 actual &&
+	git rev-parse A >expect &&
+	git rev-parse many/1 many/250 many/500 >actual &&
+	sort -u actual >actual.sorted &&
+	test_cmp expect actual.sorted &&
+	git for-each-ref --format="%(refname)" refs/heads/many/49 >actual &&
+	echo refs/heads/many/49 >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'reflogs are written' '
+	git checkout -b logged &&
+	test_commit C &&
+	git reflog show logged >actual &&
+	test_line_count = 2 actual &&
+	grep "commit: C" actual &&
+	git reflog show HEAD >actual &&
+	grep "checkout: moving from main to logged" actual &&
+	git log -g --format=%gs -1 HEAD >actual &&
+	echo "commit: C" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'reflog of deleted branch goes away' '
+	git branch doomed &&
+	git reflog exists refs/heads/doomed &&
+	git branch -D doomed &&
+	test_must_fail git reflog exists refs/heads/doomed
+'
+
+test_expect_success 'renaming a branch moves its reflog' '
+	git branch -m logged renamed &&
+	test_must_fail git reflog exists refs/heads/logged &&
+	git reflog show renamed >actual &&
+	test_line_count = 3 actual &&
+	grep "renamed refs/heads/logged to refs/heads/renamed" actual &&
+	echo refs/heads/renamed >expect &&
+	git symbolic-ref HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'copying a branch copies its reflog' '
+	git branch -c renamed copied &&
+	git reflog show renamed >expect &&
+	git reflog show copied >actual &&
+	test_line_count = 4 actual &&
+	test_must_fail git branch -c renamed renamed/sub 2>err &&
+	test_i18ngrep "exists; cannot create" err
+'
+
+test_expect_success 'reflog expire and delete' '
+	git reflog expire --expire=now refs/heads/copied &&
+	git reflog show copied >actual &&
+	test_must_be_empty actual &&
+	git reflog delete renamed@{0} &&
+	git reflog show renamed >actual &&
+	test_line_count = 2 actual
+'
+
+test_expect_success 'per-worktree refs' '
+	git worktree add wt-dir &&
+	test_path_is_file .git/worktrees/wt-dir/reftable/tables.list &&
+	git -C wt-dir update-ref refs/bisect/wt-only A &&
+	git update-ref refs/bisect/main-only B &&
+	git -C wt-dir rev-parse refs/bisect/wt-only &&
+	test_must_fail git rev-parse --verify -q refs/bisect/wt-only &&
+	test_must_fail git -C wt-dir rev-parse --verify -q refs/bisect/main-only &&
+	git -C wt-dir rev-parse HEAD >expect &&
+	git rev-parse worktrees/wt-dir/HEAD >actual &&
+	test_cmp expect actual &&
+	git rev-parse HEAD >expect &&
+	git -C wt-dir rev-parse main-worktree/HEAD >actual &&
+	test_cmp expect actual &&
+	echo refs/heads/wt-dir >expect &&
+	git -C wt-dir symbolic-ref HEAD >actual &&
+	test_cmp expect actual &&
+	echo refs/heads/renamed >expect &&
+	git symbolic-ref HEAD >actual &&
+	test_cmp expect actual &&
+	git -C wt-dir for-each-ref --format="%(refname)" refs/bisect >actual &&
+	echo refs/bisect/wt-only >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'repository stays consistent' '
+	git fsck &&
+	git gc &&
+	git rev-parse A B C
+'
+
+test_done
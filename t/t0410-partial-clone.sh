@@ -285,6 +285,38 @@ test_expect_success 'fetching of missing blobs works' '
 	git -C repo cat-file -p $(cat blobhash)
 '
 
+test_expect_success 'missing blobs are fetched in batches by parallel fetches' '
+	rm -rf server repo trace &&
+	test_create_repo server &&
+	for i in 1 2 3 4 5
+	do
+		test_commit -C server file$i || return 1
+	done &&
+	git -C server config uploadpack.allowanysha1inwant 1 &&
+	git -C server config uploadpack.allowfilter 1 &&
+
+	git clone --no-checkout --filter=blob:none "file://$(pwd)/server" repo &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git -C repo \
+		-c promisor.fetchBatchSize=2 -c promisor.fetchJobs=2 \
+		reset --hard &&
+	grep "\"event\":\"child_start\".*\"fetch\",\"origin\"" trace >fetches &&
+	test_line_count = 3 fetches &&
+	for i in 1 2 3 4 5
+	do
+		test_cmp server/file$i.t repo/file$i.t || return 1
+	done &&
+
+	# without a batch size, the objects are shared among the jobs
+	rm -rf repo trace &&
+	git clone --no-checkout --filter=blob:none "file://$(pwd)/server" repo &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git -C repo \
+		-c promisor.fetchJobs=2 reset --hard &&
+	grep "\"event\":\"child_start\".*\"fetch\",\"origin\"" trace >fetches &&
+	test_line_count = 2 fetches &&
+	git -C repo status --porcelain >status &&
+	test_must_be_empty status
+'
+
 test_expect_success 'fetching of missing trees does not fetch blobs' '
 	rm -rf server repo &&
 	test_create_repo server &&
@@ -4,6 +4,10 @@ test_description='compare full workdir to sparse workdir'
 
 . ./test-lib.sh
 
+# The sparse-index repository is configured explicitly below, and the
+# full and sparse-checkout repositories must keep using a full index.
+sane_unset GIT_TEST_SPARSE_INDEX
+
 test_expect_success 'setup' '
 	git init initial-repo &&
 	(
@@ -87,16 +91,26 @@ init_repos () {
 
 	cp -r initial-repo sparse-checkout &&
 	git -C sparse-checkout reset --hard &&
-	git -C sparse-checkout sparse-checkout init --cone &&
+
+	cp -r initial-repo sparse-index &&
+	git -C sparse-index reset --hard &&
 
 	# initialize sparse-checkout definitions
-	git -C sparse-checkout sparse-checkout set deep
+	git -C sparse-checkout sparse-checkout init --cone &&
+	git -C sparse-checkout sparse-checkout set deep &&
+	git -C sparse-index sparse-checkout init --cone --sparse-index &&
+	test_cmp_config -C sparse-index true index.sparse &&
+	git -C sparse-index sparse-checkout set deep
 }
 
 run_on_sparse () {
 	(
 		cd sparse-checkout &&
 		$* >../sparse-checkout-out 2>../sparse-checkout-err
+	) &&
+	(
+		cd sparse-index &&
+		$* >../sparse-index-out 2>../sparse-index-err
 	)
 }
 
@@ -111,9 +125,61 @@ run_on_all () {
 test_all_match () {
 	run_on_all $* &&
 	test_cmp full-checkout-out sparse-checkout-out &&
-	test_cmp full-checkout-err sparse-checkout-err
+	test_cmp full-checkout-out sparse-index-out &&
+	test_cmp full-checkout-err sparse-checkout-err &&
+	test_cmp full-checkout-err sparse-index-err
 }
 
+test_sparse_match () {
+	run_on_sparse $* &&
+	test_cmp sparse-checkout-out sparse-index-out &&
+	test_cmp sparse-checkout-err sparse-index-err
+}
+
+test_expect_success 'sparse-index contents' '
+	init_repos &&
+
+	test-tool -C sparse-index read-cache --table >cache &&
+	for dir in folder1 folder2 x
+	do
+		TREE=$(git -C sparse-index rev-parse HEAD:$dir) &&
+		grep "040000 tree $TREE	$dir/" cache \
+			|| return 1
+	done &&
+
+	git -C sparse-index sparse-checkout set folder1 &&
+
+	test-tool -C sparse-index read-cache --table >cache &&
+	for dir in deep folder2 x
+	do
+		TREE=$(git -C sparse-index rev-parse HEAD:$dir) &&
+		grep "040000 tree $TREE	$dir/" cache \
+			|| return 1
+	done &&
+
+	git -C sparse-index sparse-checkout set deep/deeper1 &&
+
+	test-tool -C sparse-index read-cache --table >cache &&
+	for dir in deep/deeper2 folder1 folder2 x
+	do
+		TREE=$(git -C sparse-index rev-parse HEAD:$dir) &&
+		grep "040000 tree $TREE	$dir/" cache \
+			|| return 1
+	done &&
+
+	# Disabling the sparse-index removes tree entries with full ones
+	git -C sparse-index sparse-checkout init --no-sparse-index &&
+
+	test-tool -C sparse-index read-cache --table >cache &&
+	! grep "040000 tree" cache &&
+	test_sparse_match test-tool read-cache --table
+'
+
+test_expect_success 'expanded in-memory index matches full index' '
+	init_repos &&
+	test_sparse_match test-tool read-cache --expand --table
+'
+
 test_expect_success 'status with options' '
 	init_repos &&
 	test_all_match git status --porcelain=v2 &&
@@ -274,6 +340,69 @@ test_expect_success 'merge with outside renames' '
 	done
 '
 
+test_expect_success 'sparse-index is expanded and converted back' '
+	init_repos &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index reset --hard &&
+	test_region index convert_to_sparse trace2.txt &&
+	test_region index ensure_full_index trace2.txt
+'
+
+ensure_not_expanded () {
+	rm -f trace2.txt &&
+	echo >>sparse-index/untracked.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" GIT_TRACE2_EVENT_NESTING=10 \
+		git -C sparse-index "$@" &&
+	test_region ! index ensure_full_index trace2.txt
+}
+
+test_expect_success 'sparse-index is not expanded' '
+	init_repos &&
+
+	ensure_not_expanded status &&
+	ensure_not_expanded commit --allow-empty -m empty &&
+	echo >>sparse-index/a &&
+	ensure_not_expanded commit -a -m a &&
+	echo >>sparse-index/a &&
+	ensure_not_expanded add a &&
+	echo >>sparse-index/deep/a &&
+	ensure_not_expanded add deep &&
+	ensure_not_expanded commit -m "deep/a" &&
+
+	ensure_not_expanded checkout HEAD~1 &&
+	ensure_not_expanded checkout - &&
+	ensure_not_expanded checkout rename-out-to-out &&
+	ensure_not_expanded checkout -f update-folder1 &&
+	ensure_not_expanded checkout -f update-deep &&
+	ensure_not_expanded checkout -f rename-in-to-out
+'
+
+test_expect_success 'status compares sparse directories against HEAD' '
+	init_repos &&
+
+	# Leave folder1/ and deep/ staged against an older HEAD.
+	test_all_match git checkout -b staged update-deep &&
+	test_all_match git merge -m "folder1" update-folder1 &&
+	test_all_match git reset --soft base &&
+	test_all_match git status --porcelain=v2 &&
+	ensure_not_expanded status &&
+	test_all_match git diff --cached --name-status &&
+	test_all_match git commit -m folder1-and-deep &&
+	test_all_match git rev-parse HEAD^{tree}
+'
+
+test_expect_success 'pathspecs reaching into sparse directories expand the index' '
+	init_repos &&
+
+	test_all_match git status --porcelain=v2 -- folder1/a &&
+	test_all_match git ls-files -- folder1 &&
+	test_all_match git checkout update-folder1 -- folder1/a &&
+	test_all_match git status --porcelain=v2 &&
+	test_all_match git commit -m restore-folder1 -- folder1/a &&
+	test_all_match git rev-parse HEAD^{tree}
+'
+
 test_expect_success 'clean' '
 	init_repos &&
 
@@ -0,0 +1,159 @@
+#!/bin/sh
+
+test_description='parallel-checkout basics
+
+Ensure that parallel-checkout basically works on clone and checkout,
+spawning the required number of workers and correctly populating both
+the index and the working tree.
+'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+# These tests exercise the configuration knobs themselves, so do not let
+# a GIT_TEST_CHECKOUT_WORKERS from the environment override them.
+sane_unset GIT_TEST_CHECKOUT_WORKERS
+
+# Count the number of checkout workers spawned according to the
+# trace2 event file given as argument.
+workers_in_trace () {
+	grep -c "\[\"git\",\"checkout--worker\"\]" "$1"
+}
+
+# Verify that the files in the working tree of $1 have the same contents
+# as the ones in $2, and that the index of $1 has clean stat data.
+verify_checkout () {
+	git -C "$1" diff-files --quiet &&
+	git -C "$1" diff-index --quiet HEAD -- &&
+	git -C "$1" ls-files >files &&
+	while read f
+	do
+		test_cmp "$2/$f" "$1/$f" || return 1
+	done <files
+}
+
+test_expect_success 'setup repo for checkout with various types of changes' '
+	git init src &&
+	(
+		cd src &&
+		git checkout -b B1 &&
+		mkdir -p d/e &&
+		for f in a b c d/x d/y d/e/z
+		do
+			echo "$f" >$f || return 1
+		done &&
+		echo exec >executable &&
+		chmod +x executable &&
+		git add . &&
+		git update-index --chmod=+x executable &&
+		git commit -m B1 &&
+
+		git checkout -b B2 &&
+		echo modified >a &&
+		git rm -q b &&
+		echo new >new &&
+		mkdir -p newdir/sub &&
+		echo deep >newdir/sub/file &&
+		git add . &&
+		git commit -m B2 &&
+
+		git checkout -b B3 B1 &&
+		printf "line1\nline2\n" >crlf &&
+		printf "\$Id\$\n" >ident &&
+		printf "smudged\n" >filtered &&
+		cat >.gitattributes <<-\EOF &&
+		crlf text eol=crlf
+		ident ident
+		filtered filter=upper
+		EOF
+		git add . &&
+		git commit -m B3
+	)
+'
+
+test_expect_success 'sequential clone' '
+	git clone -b B1 src serial &&
+	git -C serial checkout B2
+'
+
+test_expect_success 'parallel clone spawns workers' '
+	GIT_TRACE2_EVENT="$(pwd)/trace-clone" git \
+		-c checkout.workers=2 -c checkout.thresholdForParallelism=0 \
+		clone -b B1 src parallel &&
+	test "$(workers_in_trace trace-clone)" = 2 &&
+	git -C serial checkout B1 &&
+	verify_checkout parallel serial
+'
+
+test_expect_success 'parallel checkout when switching branches' '
+	GIT_TRACE2_EVENT="$(pwd)/trace-switch" git -C parallel \
+		-c checkout.workers=2 -c checkout.thresholdForParallelism=0 \
+		checkout B2 &&
+	test "$(workers_in_trace trace-switch)" = 2 &&
+	git -C serial checkout B2 &&
+	verify_checkout parallel serial &&
+	test_path_is_missing parallel/b
+'
+
+test_expect_success 'no more workers than entries to update' '
+	GIT_TRACE2_EVENT="$(pwd)/trace-few" git -C parallel \
+		-c checkout.workers=8 -c checkout.thresholdForParallelism=0 \
+		checkout B1 &&
+	# B2 -> B1 updates "a" and restores "b"
+	test "$(workers_in_trace trace-few)" = 2 &&
+	git -C serial checkout B1 &&
+	verify_checkout parallel serial
+'
+
+test_expect_success 'threshold avoids spawning workers' '
+	GIT_TRACE2_EVENT="$(pwd)/trace-threshold" git -C parallel \
+		-c checkout.workers=2 -c checkout.thresholdForParallelism=100 \
+		checkout B2 &&
+	test "$(workers_in_trace trace-threshold)" = 0 &&
+	git -C serial checkout B2 &&
+	verify_checkout parallel serial
+'
+
+test_expect_success POSIXPERM 'parallel checkout keeps executable bit' '
+	test -x parallel/executable
+'
+
+test_expect_success 'conversions and filters with parallel checkout' '
+	git config --global filter.upper.smudge "tr a-z A-Z" &&
+	git config --global filter.upper.clean "tr A-Z a-z" &&
+	git -C serial checkout B3 &&
+	GIT_TRACE2_EVENT="$(pwd)/trace-conv" git -C parallel \
+		-c checkout.workers=2 -c checkout.thresholdForParallelism=0 \
+		checkout B3 &&
+	test "$(workers_in_trace trace-conv)" = 2 &&
+	verify_checkout parallel serial &&
+	printf "line1\r\nline2\r\n" >expect.crlf &&
+	test_cmp expect.crlf parallel/crlf &&
+	echo SMUDGED >expect.filtered &&
+	test_cmp expect.filtered parallel/filtered &&
+	grep "\\\$Id: [0-9a-f]* \\\$" parallel/ident
+'
+
+test_expect_success 'progress is reported as workers write the entries' '
+	rm -rf progress &&
+	GIT_PROGRESS_DELAY=0 git -c checkout.workers=2 \
+		-c checkout.thresholdForParallelism=0 \
+		clone --progress -b B1 src progress 2>err.raw &&
+	tr "\r" "\n" <err.raw >err &&
+	n=$(git -C progress ls-files | wc -l) &&
+	grep "Updating files: 100% ($n/$n), done" err &&
+	! grep "Updating files: .*($((n + 1))/" err
+'
+
+test_expect_success 'GIT_TEST_CHECKOUT_WORKERS overrides the config' '
+	rm -rf env &&
+	GIT_TEST_CHECKOUT_WORKERS=2 GIT_TRACE2_EVENT="$(pwd)/trace-env" \
+		git -c checkout.workers=1 clone -b B1 src env &&
+	test "$(workers_in_trace trace-env)" = 2 &&
+	git -C serial checkout B1 &&
+	verify_checkout env serial
+'
+
+test_done
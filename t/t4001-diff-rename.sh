@@ -286,4 +286,39 @@ test_expect_success 'basename similarity vs best similarity' '
 	test_cmp expected actual
 '
 
+test_expect_success 'inexact renames do not depend on diff.renameThreads' '
+	mkdir threads &&
+	for i in $(test_seq 1 12)
+	do
+		test_seq 1 40 | sed -e "s/^/file $i, line /" >threads/src-$i ||
+		return 1
+	done &&
+	git add threads &&
+	git commit -m "rename sources" &&
+
+	for i in $(test_seq 1 12)
+	do
+		git rm -q threads/src-$i &&
+		test_seq 1 37 | sed -e "s/^/file $i, line /" >threads/dst-$i &&
+		test_seq 5 40 | sed -e "s/^/file $i, line /" >threads/other-$i ||
+		return 1
+	done &&
+	git add threads &&
+	git commit -m "renamed and edited, with distractors" &&
+
+	git -c diff.renameThreads=1 diff-tree -r -M --name-status \
+		HEAD^ HEAD >expect &&
+	grep "^R" expect >renames &&
+	test_line_count = 12 renames &&
+	grep "threads/src-1	threads/dst-1$" renames &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git -c diff.renameThreads=3 diff-tree -r -M --name-status \
+		HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	grep "inexact_renames/threads\",\"value\":\"3\"" trace.event &&
+	git -c diff.renameThreads=0 diff-tree -r -M --name-status \
+		HEAD^ HEAD >actual &&
+	test_cmp expect actual
+'
+
 test_done
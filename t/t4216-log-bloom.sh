@@ -138,6 +138,34 @@ test_expect_success 'git log with wildcard that resolves to a multiple paths doe
 	test_bloom_filters_not_used "-- file*"
 '
 
+# The shell leaves these patterns alone, as nothing in the worktree
+# matches them, but git does match them against the history.
+test_expect_success 'git log with wildcard uses Bloom filters for its leading directory' '
+	test_bloom_filters_used "-- A/*/fi?e3" &&
+	test_bloom_filters_used "-- A/B/**3" &&
+	test_bloom_filters_used "-- :(glob)A/**/file2" &&
+	test_bloom_filters_used "-- :(glob)A/B/C/*"
+'
+
+test_expect_success 'git log with wildcard and unsupported magic does not use Bloom filters' '
+	test_bloom_filters_not_used "-- :(icase)a/*/fi?e3" &&
+	test_bloom_filters_not_used "-- :(glob)**/file2"
+'
+
+test_expect_success 'git log -L uses Bloom filters' '
+	test_bloom_filters_used "-L 1,1:A/file1" &&
+	test_bloom_filters_used "-L 1,1:A/B/C/file3 -L 1,1:file4" &&
+	test_bloom_filters_used "-L 1,1:file5_renamed" &&
+	test_config commitgraph.readChangedPaths false &&
+	test_bloom_filters_not_used "-L 1,1:A/file1"
+'
+
+test_expect_success 'git log -L counts Bloom filter false positives' '
+	setup "-L 1,1:A/B/file2" &&
+	grep "statistics:.*\"false_positive\":0" trace.perf &&
+	grep "statistics:.*\"definitely_not\":[1-9]" trace.perf
+'
+
 test_expect_success 'setup - add commit-graph to the chain without Bloom filters' '
 	test_commit c14 A/anotherFile2 &&
 	test_commit c15 A/B/anotherFile2 &&
@@ -206,6 +234,10 @@ test_filter_trunc_large () {
 	grep "\"key\":\"filter-trunc-large\",\"value\":\"$1\"" $2
 }
 
+test_filter_reused () {
+	grep "\"key\":\"filter-reused\",\"value\":\"$1\"" $2
+}
+
 test_expect_success 'correctly report changes over limit' '
 	git init limits &&
 	(
@@ -405,4 +437,66 @@ test_expect_success 'Bloom generation backfills empty commits' '
 	)
 '
 
+
+test_expect_success 'Bloom filters do not depend on commitGraph.threads' '
+	git init threads &&
+	(
+		cd threads &&
+		mkdir -p a/b c &&
+		for i in $(test_seq 1 40)
+		do
+			echo $i >a/b/file$((i % 7)) &&
+			echo $i >c/file$((i % 5)) &&
+			echo $i >file$((i % 3)) &&
+			git add . &&
+			git commit -q -m "commit $i" || return 1
+		done &&
+
+		GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=4 \
+			git -c commitGraph.threads=1 commit-graph write \
+				--reachable --changed-paths &&
+		mv .git/objects/info/commit-graph expect &&
+		GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=4 \
+			GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git -c commitGraph.threads=4 commit-graph write \
+				--reachable --changed-paths &&
+		test_filter_computed 40 trace.event &&
+		test_cmp_bin expect .git/objects/info/commit-graph &&
+
+		for path in a a/b c file0 a/b/file3 c/file4
+		do
+			git -c commitGraph.readChangedPaths=false log \
+				-- $path >expect &&
+			git log -- $path >actual &&
+			test_cmp expect actual || return 1
+		done &&
+
+		test_must_fail git -c commitGraph.threads=-1 commit-graph write \
+			--reachable --changed-paths
+	)
+'
+
+test_expect_success 'merging split layers reuses their Bloom filters' '
+	git init merge-layers &&
+	test_when_finished "rm -fr merge-layers" &&
+	(
+		cd merge-layers &&
+		for i in $(test_seq 1 3)
+		do
+			test_commit $i.1 &&
+			test_commit $i.2 &&
+			git commit-graph write --reachable --changed-paths \
+				--split=no-merge || return 1
+		done &&
+		test_line_count = 3 .git/objects/info/commit-graphs/commit-graph-chain &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git commit-graph write --reachable --changed-paths \
+				--split=replace &&
+		test_line_count = 1 .git/objects/info/commit-graphs/commit-graph-chain &&
+		test_filter_computed 0 trace.event &&
+		test_filter_reused 6 trace.event
+	)
+'
+
 test_done
@@ -461,6 +461,42 @@ test_expect_success 'truncated bitmap fails gracefully (cache)' '
 	test_i18ngrep corrupted.bitmap.index stderr
 '
 
+test_expect_success 'full repack writes a lookup table' '
+	git config pack.writeBitmapLookupTable true &&
+	git repack -ad &&
+	blob=$(git rev-parse tagged-blob) &&
+	rm -f trace &&
+	GIT_TEST_READ_COMMIT_TABLE=1 GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git rev-list --test-bitmap HEAD &&
+	grep "\"key\":\"lookup_table_entries\"" trace
+'
+
+rev_list_tests 'lookup table'
+
+test_expect_success 'lookup table gives the same results as eager loading' '
+	git rev-list --use-bitmap-index --objects --all >expect &&
+	rm -f trace &&
+	GIT_TEST_READ_COMMIT_TABLE=0 GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git rev-list --use-bitmap-index --objects --all >actual &&
+	! grep "\"key\":\"lookup_table_entries\"" trace &&
+	test_cmp expect actual
+'
+
+test_expect_success 'truncated lookup table fails gracefully' '
+	git rev-list --use-bitmap-index --count --all >expect &&
+	bitmap=$(ls .git/objects/pack/*.bitmap) &&
+	test_when_finished "rm -f $bitmap" &&
+	test_copy_bytes 512 <$bitmap >$bitmap.tmp &&
+	mv -f $bitmap.tmp $bitmap &&
+	git rev-list --use-bitmap-index --count --all >actual 2>stderr &&
+	test_cmp expect actual &&
+	test_i18ngrep corrupted.bitmap.index stderr
+'
+
+test_expect_success 'disable the lookup table' '
+	git config --unset pack.writeBitmapLookupTable
+'
+
 # have_delta <obj> <expected_base>
 #
 # Note that because this relies on cat-file, it might find _any_ copy of an
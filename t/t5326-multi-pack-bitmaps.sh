@@ -0,0 +1,194 @@
+#!/bin/sh
+
+test_description='exercise basic multi-pack bitmap functionality'
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+. "$TEST_DIRECTORY"/lib-bitmap.sh
+
+# We'll be writing our own midx and bitmaps, so avoid getting confused by the
+# automatic ones.
+GIT_TEST_MULTI_PACK_INDEX=0
+export GIT_TEST_MULTI_PACK_INDEX
+
+midx_checksum () {
+	test-tool read-midx --checksum "${1:-.git/objects}"
+}
+
+midx_pack_source () {
+	test-tool read-midx --show-objects .git/objects |
+	grep "^$OID_REGEX " | cut -f2
+}
+
+test_expect_success 'setup' '
+	test_commit_bulk --id=base 10 &&
+	git repack -d &&
+	git checkout -b other HEAD~5 &&
+	test_commit_bulk --id=other 10 &&
+	git repack -d &&
+	git checkout main &&
+	git merge -m merge other &&
+	test_commit_bulk --id=tip 10 &&
+	git repack -d &&
+	blob=$(echo tagged-blob | git hash-object -w --stdin) &&
+	git tag tagged-blob $blob &&
+	git repack -d &&
+	ls .git/objects/pack/*.pack >packs &&
+	test_line_count -gt 1 packs
+'
+
+test_expect_success 'write multi-pack bitmap' '
+	git multi-pack-index write --bitmap &&
+
+	ls .git/objects/pack/ | grep bitmap >bitmaps &&
+	echo "multi-pack-index-$(midx_checksum).bitmap" >expect &&
+	test_cmp expect bitmaps &&
+
+	test-tool read-midx .git/objects >midx &&
+	grep "^chunks: .* revindex" midx
+'
+
+test_expect_success 'rev-list --test-bitmap verifies multi-pack bitmaps' '
+	GIT_TRACE2_EVENT="$(pwd)/trace" git rev-list --test-bitmap HEAD &&
+	grep "opened bitmap file.*multi-pack-index-" trace
+'
+
+rev_list_tests () {
+	test_expect_success "counting commits via bitmap ($1)" '
+		git rev-list --count main >expect &&
+		git rev-list --use-bitmap-index --count main >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "counting partial commits via bitmap ($1)" '
+		git rev-list --count other..main >expect &&
+		git rev-list --use-bitmap-index --count other..main >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "counting objects via bitmap ($1)" '
+		git rev-list --count --objects main >expect &&
+		git rev-list --use-bitmap-index --count --objects main >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "enumerate --objects ($1)" '
+		git rev-list --objects --use-bitmap-index main tagged-blob >actual &&
+		git rev-list --objects main tagged-blob >expect &&
+		test_bitmap_traversal expect actual
+	'
+
+	test_expect_success "enumerate --objects with a filter ($1)" '
+		git rev-list --objects --no-object-names --use-bitmap-index \
+			--filter=blob:none main >actual &&
+		git rev-list --objects --no-object-names \
+			--filter=blob:none main >expect &&
+		test_bitmap_traversal --no-confirm-bitmaps expect actual
+	'
+
+	test_expect_success "disk usage via bitmap ($1)" '
+		git rev-list --objects --disk-usage main >expect &&
+		git rev-list --objects --disk-usage --use-bitmap-index main >actual &&
+		test_cmp expect actual
+	'
+}
+
+rev_list_tests 'full bitmap'
+
+test_expect_success 'clone from multi-pack bitmapped repository' '
+	git clone --no-local --bare . clone.git &&
+	git rev-parse HEAD >expect &&
+	git --git-dir=clone.git rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	git --git-dir=clone.git fsck
+'
+
+test_expect_success 'setup further non-bitmapped commits' '
+	test_commit_bulk --id=further 10
+'
+
+rev_list_tests 'partial bitmap'
+
+test_expect_success 'fetch (partial bitmap)' '
+	git --git-dir=clone.git fetch origin main:main &&
+	git rev-parse HEAD >expect &&
+	git --git-dir=clone.git rev-parse main >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'writing a MIDX without a bitmap removes stale bitmaps' '
+	git repack -d &&
+	git multi-pack-index write &&
+	ls .git/objects/pack/ >files &&
+	! grep bitmap files &&
+	test-tool read-midx .git/objects >midx &&
+	! grep revindex midx
+'
+
+test_expect_success 'an updated bitmap replaces the stale one' '
+	git multi-pack-index write --bitmap &&
+	test_commit again &&
+	git repack -d &&
+	git multi-pack-index write --bitmap &&
+	ls .git/objects/pack/ | grep bitmap >bitmaps &&
+	echo "multi-pack-index-$(midx_checksum).bitmap" >expect &&
+	test_cmp expect bitmaps &&
+	git rev-list --test-bitmap HEAD
+'
+
+test_expect_success 'preferred pack wins duplicate objects' '
+	git rev-list --objects --no-object-names --all >objects &&
+	pack=$(git pack-objects .git/objects/pack/pack <objects) &&
+
+	git multi-pack-index write --bitmap --preferred-pack=pack-$pack.pack &&
+	git rev-list --test-bitmap HEAD &&
+	midx_pack_source >sources &&
+	sort -u sources >uniq &&
+	echo ".git/objects/pack/pack-$pack.pack" >expect &&
+	test_cmp expect uniq
+'
+
+test_expect_success 'pack-objects reuses objects from the preferred pack' '
+	git pack-objects --stdout --all --use-bitmap-index --progress \
+		</dev/null >out.pack 2>err &&
+	grep "pack-reused [1-9]" err &&
+	git index-pack --strict out.pack &&
+	git show-index <out.idx >index &&
+	cut -d" " -f2 index | sort >actual &&
+	git rev-list --objects --no-object-names --all | sort >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'unknown preferred pack is an error' '
+	test_must_fail git multi-pack-index write --bitmap \
+		--preferred-pack=pack-missing.pack 2>err &&
+	test_i18ngrep "unknown preferred pack" err
+'
+
+test_expect_success '--bitmap is only for the write subcommand' '
+	test_must_fail git multi-pack-index verify --bitmap 2>err &&
+	test_i18ngrep "only for .write. subcommand" err
+'
+
+test_expect_success 'multi-pack bitmap with a lookup table' '
+	test_config pack.writeBitmapLookupTable true &&
+	rm -f .git/objects/pack/multi-pack-index-*.bitmap &&
+	git multi-pack-index write --bitmap &&
+	GIT_TEST_READ_COMMIT_TABLE=1 GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git rev-list --test-bitmap HEAD &&
+	grep "\"key\":\"lookup_table_entries\"" trace &&
+	git rev-list --objects --no-object-names --all >expect.raw &&
+	git rev-list --objects --no-object-names --use-bitmap-index --all >actual.raw &&
+	sort expect.raw >expect &&
+	sort actual.raw >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'clearing the MIDX removes its bitmap' '
+	git repack -ad --no-write-bitmap-index &&
+	ls .git/objects/pack/ >files &&
+	! grep multi-pack-index files
+'
+
+test_done
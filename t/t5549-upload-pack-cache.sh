@@ -0,0 +1,207 @@
+#!/bin/sh
+
+test_description='upload-pack shares pack-objects output between identical requests'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+# clone from the current repository into "dst", and leave the cache
+# states upload-pack reported in "states"
+clone () {
+	rm -rf dst trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone --no-local "$@" . dst &&
+	sed -n "s/.*\"key\":\"pack-objects-cache\",\"value\":\"\([a-z]*\)\".*/\1/p" \
+		trace >states
+}
+
+expect_states () {
+	test_write_lines "$@" >expect.states &&
+	test_cmp expect.states states
+}
+
+# run the command until it succeeds, giving up after a minute
+retry () {
+	for i in $(test_seq 60)
+	do
+		"$@" && return 0
+		sleep 1
+	done
+	return 1
+}
+
+upload_pack_follows () {
+	grep "\"value\":\"follow\"" trace >/dev/null 2>&1
+}
+
+# leave the names of the entries in "entries", if none of them is locked
+entries_are_finished () {
+	ls .git/pack-objects-cache/* >entries &&
+	! grep "\.lock$" entries
+}
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	git checkout -b side one &&
+	test_commit three &&
+	git checkout main
+'
+
+test_expect_success 'no cache by default' '
+	clone &&
+	test_must_be_empty states &&
+	test_path_is_missing .git/pack-objects-cache
+'
+
+test_expect_success 'first request produces an entry' '
+	git config uploadpack.packObjectsCache true &&
+	clone &&
+	expect_states produce &&
+	ls .git/pack-objects-cache >entries &&
+	test_line_count = 1 entries &&
+	git -C dst fsck &&
+	git rev-parse main side >expect &&
+	git -C dst rev-parse origin/main origin/side >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'identical requests are served from the cache' '
+	clone &&
+	expect_states hit &&
+	git -C dst fsck &&
+	git -C dst rev-parse origin/main origin/side >actual &&
+	test_cmp expect actual &&
+
+	# neither the protocol nor progress are part of the request
+	clone -q &&
+	expect_states hit &&
+	clone -c protocol.version=0 &&
+	expect_states hit &&
+	ls .git/pack-objects-cache >entries &&
+	test_line_count = 1 entries
+'
+
+test_expect_success 'different requests get different entries' '
+	clone --single-branch --branch side &&
+	expect_states produce &&
+	git -C dst fsck &&
+	ls .git/pack-objects-cache >entries &&
+	test_line_count = 2 entries
+'
+
+test_expect_success 'old entries are not used' '
+	test-tool chmtime =-700 .git/pack-objects-cache/* &&
+	clone &&
+	expect_states produce &&
+	git -C dst fsck
+'
+
+test_expect_success 'cache is trimmed to maxSize' '
+	test_config uploadpack.packObjectsCacheMaxSize 1 &&
+	clone --single-branch --branch side &&
+	expect_states produce &&
+	ls .git/pack-objects-cache >entries &&
+	test_line_count = 1 entries &&
+	clone --single-branch --branch side &&
+	expect_states hit
+'
+
+test_expect_success 'request for an entry being produced follows it' '
+	clone --single-branch --branch side &&
+	expect_states hit &&
+	entry=$(ls .git/pack-objects-cache) &&
+	mv .git/pack-objects-cache/$entry .git/pack-objects-cache/$entry.lock &&
+	touch .git/pack-objects-cache/$entry.lock &&
+	{
+		# finish the entry only once upload-pack is waiting for it
+		retry upload_pack_follows &&
+		mv .git/pack-objects-cache/$entry.lock \
+		   .git/pack-objects-cache/$entry &
+	} &&
+	clone --single-branch --branch side &&
+	wait &&
+	expect_states follow &&
+	git -C dst fsck &&
+	git rev-parse side >expect &&
+	git -C dst rev-parse origin/side >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'stale locks are broken' '
+	entry=$(ls .git/pack-objects-cache) &&
+	mv .git/pack-objects-cache/$entry .git/pack-objects-cache/$entry.lock &&
+	test-tool chmtime =-60 .git/pack-objects-cache/$entry.lock &&
+	clone --single-branch --branch side &&
+	expect_states produce &&
+	git -C dst fsck &&
+	ls .git/pack-objects-cache >entries &&
+	echo $entry >expect &&
+	test_cmp expect entries
+'
+
+test_expect_success 'stateless-rpc requests are served from the cache' '
+	test-tool pkt-line pack >in <<-EOF &&
+	command=fetch
+	object-format=$(test_oid algo)
+	0001
+	no-progress
+	want $(git rev-parse main)
+	done
+	0000
+	EOF
+
+	rm -rf .git/pack-objects-cache trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" GIT_PROTOCOL=version=2 \
+		git upload-pack --stateless-rpc . <in >out.produce &&
+	sed -n "s/.*\"key\":\"pack-objects-cache\",\"value\":\"\([a-z]*\)\".*/\1/p" \
+		trace >states &&
+	expect_states produce &&
+
+	rm trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" GIT_PROTOCOL=version=2 \
+		git upload-pack --stateless-rpc . <in >out.hit &&
+	sed -n "s/.*\"key\":\"pack-objects-cache\",\"value\":\"\([a-z]*\)\".*/\1/p" \
+		trace >states &&
+	expect_states hit &&
+	cmp out.produce out.hit
+'
+
+test_expect_success 'entry is finished after the first request goes away' '
+	rm -rf .git/pack-objects-cache trace started &&
+	test_when_finished ">release" &&
+	write_script .git/hook <<-EOF &&
+	>"$(pwd)/started"
+	while ! test -f "$(pwd)/release"
+	do
+		sleep 1
+	done
+	exec "\$@"
+	EOF
+	{
+		GIT_PROTOCOL=version=2 \
+		git -c uploadpack.packObjectsHook=./hook \
+			upload-pack --stateless-rpc . <in >out.gone &
+	} &&
+	pid=$! &&
+	# the producer has all of its input once it runs the hook
+	retry test -f started &&
+	kill $pid &&
+	{ wait $pid || :; } &&
+
+	>release &&
+	retry entries_are_finished &&
+	test_line_count = 1 entries &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace" GIT_PROTOCOL=version=2 \
+		git -c uploadpack.packObjectsHook=./hook \
+		upload-pack --stateless-rpc . <in >out.hit &&
+	sed -n "s/.*\"key\":\"pack-objects-cache\",\"value\":\"\([a-z]*\)\".*/\1/p" \
+		trace >states &&
+	expect_states hit &&
+	cp "$(cat entries)" entry.pack &&
+	git index-pack entry.pack
+'
+
+test_done
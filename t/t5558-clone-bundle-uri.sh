@@ -0,0 +1,136 @@
+#!/bin/sh
+
+test_description='test fetching bundles with --bundle-uri and the bundle-uri capability'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git init server &&
+	test_commit -C server one &&
+	test_commit -C server two &&
+	git -C server branch base &&
+	test_commit -C server three &&
+	git -C server bundle create ../base.bundle base &&
+	git -C server bundle create ../incr.bundle base..main &&
+	base=$(git -C server rev-parse base) &&
+	main=$(git -C server rev-parse main)
+'
+
+test_expect_success 'clone with --bundle-uri' '
+	GIT_TRACE_PACKET="$(pwd)/packet" git clone \
+		--bundle-uri="file://$(pwd)/base.bundle" \
+		"file://$(pwd)/server" with-uri &&
+	echo $base >expect &&
+	git -C with-uri rev-parse refs/bundles/heads/base >actual &&
+	test_cmp expect actual &&
+	echo $main >expect &&
+	git -C with-uri rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	git -C with-uri fsck &&
+
+	# the fetch told the server about the bundle
+	grep "> have $base" packet
+'
+
+test_expect_success 'clone with --bundle-uri as a path' '
+	git clone --bundle-uri="$(pwd)/base.bundle" \
+		"file://$(pwd)/server" with-path &&
+	echo $base >expect &&
+	git -C with-path rev-parse refs/bundles/heads/base >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'clone with an unusable --bundle-uri still works' '
+	git clone --bundle-uri="$(pwd)/missing.bundle" \
+		"file://$(pwd)/server" missing 2>err &&
+	test_i18ngrep "failed to fetch objects from bundle URI" err &&
+	git -C missing fsck &&
+
+	# incr.bundle needs objects we do not have
+	git clone --bundle-uri="$(pwd)/incr.bundle" \
+		"file://$(pwd)/server" prereq 2>err &&
+	test_i18ngrep "failed to fetch objects from bundle URI" err &&
+	test_must_fail git -C prereq rev-parse --verify refs/bundles/heads/main &&
+	git -C prereq fsck
+'
+
+test_expect_success 'advertised bundle URIs are used only with transfer.bundleURI' '
+	git -C server config uploadpack.bundleURI "file://$(pwd)/base.bundle" &&
+	git -C server config --add uploadpack.bundleURI "file://$(pwd)/incr.bundle" &&
+
+	git clone "file://$(pwd)/server" not-enabled &&
+	test_must_fail git -C not-enabled rev-parse --verify refs/bundles/heads/base &&
+
+	git -c transfer.bundleURI=true clone "file://$(pwd)/server" advertised &&
+	echo $base >expect &&
+	git -C advertised rev-parse refs/bundles/heads/base >actual &&
+	test_cmp expect actual &&
+	echo $main >expect &&
+	git -C advertised rev-parse refs/bundles/heads/main >actual &&
+	test_cmp expect actual &&
+	git -C advertised fsck
+'
+
+test_expect_success 'advertised bundle URIs need protocol v2' '
+	git -c transfer.bundleURI=true -c protocol.version=0 \
+		clone "file://$(pwd)/server" v0 &&
+	test_must_fail git -C v0 rev-parse --verify refs/bundles/heads/base
+'
+
+test_expect_success 'advertised bundle URIs follow protocol.allow' '
+	git -C server config --replace-all uploadpack.bundleURI \
+		"foo://example.com/base.bundle" &&
+	git -c transfer.bundleURI=true clone "file://$(pwd)/server" \
+		disallowed 2>err &&
+	test_i18ngrep "not allowed" err &&
+	git -C disallowed fsck
+'
+
+test_expect_success 'fetch with --bundle-uri' '
+	git clone "file://$(pwd)/server" fetcher &&
+	test_commit -C server four &&
+	git -C server branch -f base &&
+	git -C server bundle create ../four.bundle main~1..base &&
+	git -C fetcher fetch --bundle-uri="$(pwd)/four.bundle" &&
+	git -C server rev-parse base >expect &&
+	git -C fetcher rev-parse refs/bundles/heads/base >actual &&
+	test_cmp expect actual &&
+	git -C fetcher rev-parse origin/main >actual &&
+	test_cmp expect actual
+'
+
+#########################################################################
+# HTTP tests begin here
+
+. "$TEST_DIRECTORY"/lib-httpd.sh
+start_httpd
+
+test_expect_success 'clone with --bundle-uri over HTTP' '
+	cp base.bundle "$HTTPD_DOCUMENT_ROOT_PATH/base.bundle" &&
+	git clone --bundle-uri="$HTTPD_URL/base.bundle" \
+		"file://$(pwd)/server" http-uri &&
+	git -C http-uri rev-parse refs/bundles/heads/base &&
+	git -C http-uri fsck
+'
+
+test_expect_success 'clone with a missing --bundle-uri over HTTP' '
+	git clone --bundle-uri="$HTTPD_URL/missing.bundle" \
+		"file://$(pwd)/server" http-missing 2>err &&
+	test_i18ngrep "failed to fetch objects from bundle URI" err &&
+	git -C http-missing fsck
+'
+
+test_expect_success 'clone with bundle URIs advertised over HTTP' '
+	git clone --bare server "$HTTPD_DOCUMENT_ROOT_PATH/server.git" &&
+	git -C "$HTTPD_DOCUMENT_ROOT_PATH/server.git" \
+		config uploadpack.bundleURI "$HTTPD_URL/base.bundle" &&
+	git -c transfer.bundleURI=true \
+		clone "$HTTPD_URL/smart/server.git" http-advertised &&
+	git -C http-advertised rev-parse refs/bundles/heads/base &&
+	git -C http-advertised fsck
+'
+
+test_done
@@ -207,4 +207,99 @@ test_expect_success FAKENC 'hostname interpolation works after LF-stripping' '
 	test_cmp expect actual
 '
 
+stop_git_daemon
+GIT_TRACE2_EVENT="$(pwd)/pool-trace" &&
+export GIT_TRACE2_EVENT &&
+start_git_daemon --worker-pool=2 --worker-max-requests=4 &&
+sane_unset GIT_TRACE2_EVENT
+
+test_expect_success 'clone and fetch through a worker pool' '
+	>"$GIT_DAEMON_DOCUMENT_ROOT_PATH/repo.git/git-daemon-export-ok" &&
+	git clone "$GIT_DAEMON_URL/repo.git" pool-clone &&
+	test_cmp file pool-clone/file &&
+	echo content >>file &&
+	git commit -a -m three &&
+	git push public &&
+	git -C pool-clone -c protocol.version=2 pull &&
+	test_cmp file pool-clone/file
+'
+
+test_expect_success 'pool workers keep repositories warm' '
+	for i in 1 2 3 4 5 6
+	do
+		git ls-remote "$GIT_DAEMON_URL/repo.git" || return 1
+	done &&
+	grep "\"warm-repository\",\"value\":\"hit\"" pool-trace
+'
+
+test_expect_success 'warm repositories notice repacks' '
+	echo content >>file &&
+	git commit -a -m four &&
+	git push public &&
+	git -C "$GIT_DAEMON_DOCUMENT_ROOT_PATH/repo.git" repack -a -d &&
+	for i in 1 2 3
+	do
+		rm -rf pool-repacked &&
+		git clone "$GIT_DAEMON_URL/repo.git" pool-repacked &&
+		git -C pool-repacked fsck &&
+		test_cmp file pool-repacked/file || return 1
+	done
+'
+
+test_expect_success 'pool workers check access like the daemon' "
+	test_remote_error -n 'access denied or repository not exported' \\
+		fetch repo.git
+"
+
+# With a single worker that is never restarted, whether a connection
+# reuses the warm repository only depends on what changed on disk.
+stop_git_daemon
+GIT_TRACE2_EVENT="$(pwd)/graph-trace" &&
+export GIT_TRACE2_EVENT &&
+start_git_daemon --worker-pool=1 &&
+sane_unset GIT_TRACE2_EVENT
+
+last_warm_repository () {
+	grep "\"warm-repository\"" graph-trace | sed -n "\$p"
+}
+
+# Connect until the worker has warmed up repo.git, run "git commit-graph
+# write" with the given options there, and check that the next
+# connection does not reuse the stale warm repository.
+rewrite_commit_graph () {
+	repo="$GIT_DAEMON_DOCUMENT_ROOT_PATH/repo.git" &&
+	test-tool chmtime =-60 "$repo/objects/info" &&
+	if test -d "$repo/objects/info/commit-graphs"
+	then
+		test-tool chmtime =-60 "$repo/objects/info/commit-graphs"
+	fi &&
+	for i in $(test_seq 10)
+	do
+		git ls-remote "$GIT_DAEMON_URL/repo.git" &&
+		if last_warm_repository | grep "\"value\":\"hit\""
+		then
+			break
+		fi || return 1
+	done &&
+	last_warm_repository | grep "\"value\":\"hit\"" &&
+	git -C "$repo" commit-graph write --reachable "$@" &&
+	git ls-remote "$GIT_DAEMON_URL/repo.git" &&
+	last_warm_repository | grep "\"value\":\"miss\""
+}
+
+test_expect_success 'warm repositories notice rewritten commit-graphs' '
+	>"$GIT_DAEMON_DOCUMENT_ROOT_PATH/repo.git/git-daemon-export-ok" &&
+	git -C "$GIT_DAEMON_DOCUMENT_ROOT_PATH/repo.git" \
+		commit-graph write --reachable &&
+	rewrite_commit_graph &&
+	echo content >>file &&
+	git commit -a -m five &&
+	git push public &&
+	rewrite_commit_graph --split &&
+	rm -rf pool-graph &&
+	git clone "$GIT_DAEMON_URL/repo.git" pool-graph &&
+	git -C pool-graph fsck &&
+	test_cmp file pool-graph/file
+'
+
 test_done
@@ -240,4 +240,130 @@ test_expect_success 'unexpected lines are not allowed in fetch request' '
 	grep "unexpected line: .this-is-not-a-command." err
 '
 
+test_expect_success 'bundle-uri lists uploadpack.bundleURI' '
+	test_config uploadpack.bundleURI https://example.com/a.bundle &&
+	git config --add uploadpack.bundleURI file:///srv/b.bundle &&
+
+	GIT_TEST_SIDEBAND_ALL=0 test-tool serve-v2 \
+		--advertise-capabilities >out &&
+	test-tool pkt-line unpack <out >actual &&
+	grep "^bundle-uri$" actual &&
+
+	test-tool pkt-line pack >in <<-EOF &&
+	command=bundle-uri
+	object-format=$(test_oid algo)
+	0000
+	EOF
+
+	cat >expect <<-EOF &&
+	https://example.com/a.bundle
+	file:///srv/b.bundle
+	0000
+	EOF
+
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'bundle-uri is not a command without uploadpack.bundleURI' '
+	test-tool pkt-line pack >in <<-EOF &&
+	command=bundle-uri
+	object-format=$(test_oid algo)
+	0000
+	EOF
+	test_must_fail test-tool serve-v2 --stateless-rpc 2>err <in &&
+	test_i18ngrep "invalid command" err
+'
+
+test_expect_success 'object-info is advertised only with transfer.advertiseObjectInfo' '
+	GIT_TEST_SIDEBAND_ALL=0 test-tool serve-v2 \
+		--advertise-capabilities >out &&
+	test-tool pkt-line unpack <out >actual &&
+	! grep "^object-info" actual &&
+
+	test_config transfer.advertiseObjectInfo true &&
+	GIT_TEST_SIDEBAND_ALL=0 test-tool serve-v2 \
+		--advertise-capabilities >out &&
+	test-tool pkt-line unpack <out >actual &&
+	grep "^object-info$" actual
+'
+
+test_expect_success 'basics of object-info' '
+	test_config transfer.advertiseObjectInfo true &&
+	missing=$(test_oid deadbeef) &&
+	test-tool pkt-line pack >in <<-EOF &&
+	command=object-info
+	object-format=$(test_oid algo)
+	0001
+	size
+	type
+	oid $(git rev-parse two:two.t)
+	oid $(git rev-parse two)
+	oid $missing
+	0000
+	EOF
+
+	cat >expect <<-EOF &&
+	size type
+	$(git rev-parse two:two.t) $(wc -c <two.t | tr -d " ") blob
+	$(git rev-parse two) $(git cat-file -s two) commit
+	$missing
+	0000
+	EOF
+
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'object-info sends only the requested attributes' '
+	test_config transfer.advertiseObjectInfo true &&
+	test-tool pkt-line pack >in <<-EOF &&
+	command=object-info
+	object-format=$(test_oid algo)
+	0001
+	size
+	oid $(git rev-parse two:two.t)
+	0000
+	EOF
+
+	cat >expect <<-EOF &&
+	size
+	$(git rev-parse two:two.t) $(wc -c <two.t | tr -d " ")
+	0000
+	EOF
+
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'unexpected lines are not allowed in object-info request' '
+	test_config transfer.advertiseObjectInfo true &&
+	test-tool pkt-line pack >in <<-EOF &&
+	command=object-info
+	object-format=$(test_oid algo)
+	0001
+	size
+	want $(git rev-parse two)
+	0000
+	EOF
+	test_must_fail test-tool serve-v2 --stateless-rpc 2>err <in &&
+	grep "unexpected line: .want" err
+'
+
+test_expect_success 'object-info is not a command without transfer.advertiseObjectInfo' '
+	test-tool pkt-line pack >in <<-EOF &&
+	command=object-info
+	object-format=$(test_oid algo)
+	0001
+	size
+	oid $(git rev-parse two)
+	0000
+	EOF
+	test_must_fail test-tool serve-v2 --stateless-rpc 2>err <in &&
+	test_i18ngrep "invalid command" err
+'
+
 test_done
@@ -585,6 +585,39 @@ test_expect_success 'deepen-relative' '
 	test_cmp expected actual
 '
 
+test_expect_success 'object-info with file:// using protocol v2' '
+	rm -rf server client &&
+
+	git init server &&
+	test_commit -C server one &&
+	git -C server config transfer.advertiseObjectInfo true &&
+	git init client &&
+	git -C client remote add origin "file://$(pwd)/server" &&
+
+	blob=$(git -C server rev-parse one:one.t) &&
+	commit=$(git -C server rev-parse one) &&
+	missing=$(test_oid deadbeef) &&
+	cat >expect <<-EOF &&
+	$blob blob $(git -C server cat-file -s $blob)
+	$commit commit $(git -C server cat-file -s $commit)
+	$missing missing
+	EOF
+	GIT_TRACE_PACKET="$(pwd)/trace" test-tool -C client \
+		remote-object-info origin $blob $commit $missing >actual &&
+	test_cmp expect actual &&
+
+	# no object was fetched
+	test_must_fail git -C client cat-file -e $blob &&
+	grep "git> command=object-info" trace
+'
+
+test_expect_success 'object-info needs transfer.advertiseObjectInfo on the server' '
+	git -C server config transfer.advertiseObjectInfo false &&
+	test_must_fail test-tool -C client remote-object-info origin \
+		$(git -C server rev-parse one) 2>err &&
+	grep "does not support object-info" err
+'
+
 # Test protocol v2 with 'http://' transport
 #
 . "$TEST_DIRECTORY"/lib-httpd.sh
@@ -752,6 +785,20 @@ test_expect_success 'ls-remote with v2 http sends only one POST' '
 	test_line_count = 1 posts
 '
 
+test_expect_success 'object-info with http:// using protocol v2' '
+	git -C "$HTTPD_DOCUMENT_ROOT_PATH/http_parent" \
+		config transfer.advertiseObjectInfo true &&
+	rm -rf http_object_info &&
+	git init http_object_info &&
+
+	blob=$(git -C "$HTTPD_DOCUMENT_ROOT_PATH/http_parent" rev-parse one:one.t) &&
+	echo "$blob blob $(git -C "$HTTPD_DOCUMENT_ROOT_PATH/http_parent" cat-file -s $blob)" >expect &&
+	test-tool -C http_object_info remote-object-info \
+		"$HTTPD_URL/smart/http_parent" $blob >actual &&
+	test_cmp expect actual &&
+	test_must_fail git -C http_object_info cat-file -e $blob
+'
+
 test_expect_success 'push with http:// and a config of v2 does not request v2' '
 	test_when_finished "rm -f log" &&
 	# Till v2 for push is designed, make sure that if a client has
@@ -0,0 +1,233 @@
+#!/bin/sh
+
+test_description="remember renames in a sequence of merges"
+
+. ./test-lib.sh
+
+#
+# NOTE 1: this testfile tends to not only rename files, but modify on both
+#         sides; without modifying on both sides, optimizations can kick in
+#         which make rename detection irrelevant or trivial.  We want to make
+#         sure that we are triggering rename caching rather than rename
+#         bypassing.
+#
+# NOTE 2: this testfile uses 'test-tool fast-rebase' and 'git cherry-pick',
+#         both of which replay several commits in one process so that the
+#         merges for later commits can use the renames found for earlier ones.
+#
+
+test_expect_success 'caching renames does not preclude finding new ones' '
+	test_create_repo caching-renames-and-new-renames &&
+	(
+		cd caching-renames-and-new-renames &&
+
+		test_seq 2 10 >numbers &&
+		test_seq 12 20 >values &&
+		git add numbers values &&
+		git commit -m orig &&
+
+		git branch upstream &&
+		git branch topic &&
+
+		git switch upstream &&
+		test_seq 1 10 >numbers &&
+		test_seq 11 20 >values &&
+		git add numbers values &&
+		git commit -m "Tweaked both files" &&
+
+		git mv numbers sequence &&
+		test_seq 1 11 >sequence &&
+		git add sequence &&
+		git commit -m "Renamed numbers -> sequence" &&
+
+		git mv values progression &&
+		test_seq 11 21 >progression &&
+		git add progression &&
+		git commit -m "Renamed values -> progression" &&
+
+		git switch topic &&
+
+		sed -e "s/^6$/six/" numbers >tmp &&
+		mv tmp numbers &&
+		git add numbers &&
+		git commit -m "Spelled out six in numbers" &&
+
+		sed -e "s/^15$/fifteen/" values >tmp &&
+		mv tmp values &&
+		git add values &&
+		git commit -m "Spelled out fifteen in values" &&
+
+		git switch upstream &&
+
+		GIT_TRACE2_PERF="$(pwd)/trace.output" &&
+		export GIT_TRACE2_PERF &&
+
+		test-tool fast-rebase --onto HEAD upstream~3 topic &&
+
+		git ls-files >tracked-files &&
+		test_line_count = 2 tracked-files &&
+		test_seq 1 11 | sed -e "s/^6$/six/" >expect &&
+		test_cmp expect sequence &&
+		test_seq 11 21 | sed -e "s/^15$/fifteen/" >expect &&
+		test_cmp expect progression &&
+
+		grep "renames/cache_hits" trace.output >hits &&
+		test_line_count = 1 hits
+	)
+'
+
+test_expect_success 'cherry-pick of a series reuses renames' '
+	test_create_repo cherry-pick-series &&
+	(
+		cd cherry-pick-series &&
+
+		for i in $(test_seq 1 5)
+		do
+			test_seq 1 $((i * 10)) >file-$i || return 1
+		done &&
+		git add . &&
+		git commit -m orig &&
+
+		git branch upstream &&
+		git branch topic &&
+
+		git switch upstream &&
+		mkdir dir &&
+		for i in $(test_seq 1 5)
+		do
+			git mv file-$i dir/file-$i &&
+			echo upstream >>dir/file-$i || return 1
+		done &&
+		git add dir &&
+		git commit -m "Move files into dir" &&
+
+		git switch topic &&
+		for i in $(test_seq 1 5)
+		do
+			sed -e "s/^1$/one/" file-$i >tmp &&
+			mv tmp file-$i &&
+			git commit -a -m "Tweak file-$i" || return 1
+		done &&
+
+		git switch upstream &&
+
+		GIT_TRACE2_PERF="$(pwd)/trace.output" \
+			git cherry-pick --strategy=ort upstream..topic &&
+
+		git ls-files >actual &&
+		test_write_lines dir/file-1 dir/file-2 dir/file-3 dir/file-4 \
+			dir/file-5 >expect &&
+		test_cmp expect actual &&
+		for i in $(test_seq 1 5)
+		do
+			head -n 1 dir/file-$i >actual &&
+			echo one >expect &&
+			test_cmp expect actual &&
+			tail -n 1 dir/file-$i >actual &&
+			echo upstream >expect &&
+			test_cmp expect actual || return 1
+		done &&
+
+		# The first pick finds the renames; the other four reuse them.
+		grep "renames/cache_hits" trace.output >hits &&
+		test_line_count = 4 hits
+	)
+'
+
+test_expect_success 'renames are not reused when picks do not build on each other' '
+	test_create_repo unrelated-picks &&
+	(
+		cd unrelated-picks &&
+
+		test_seq 1 20 >file &&
+		git add file &&
+		git commit -m orig &&
+
+		git branch upstream &&
+		git branch topic &&
+		git branch other &&
+
+		git switch upstream &&
+		git mv file renamed &&
+		echo upstream >>renamed &&
+		git add renamed &&
+		git commit -m "Rename file" &&
+
+		git switch topic &&
+		sed -e "s/^1$/one/" file >tmp &&
+		mv tmp file &&
+		git commit -a -m "Tweak first line" &&
+
+		git switch other &&
+		sed -e "s/^10$/ten/" file >tmp &&
+		mv tmp file &&
+		git commit -a -m "Tweak tenth line" &&
+
+		git switch upstream &&
+		GIT_TRACE2_PERF="$(pwd)/trace.output" \
+			git cherry-pick --strategy=ort topic other &&
+
+		git ls-files >actual &&
+		echo renamed >expect &&
+		test_cmp expect actual &&
+		grep -x one renamed &&
+		grep -x ten renamed &&
+		! grep "renames/cache_hits" trace.output
+	)
+'
+
+test_expect_success 'directories nothing needs to look into are not recursed' '
+	test_create_repo skip-unneeded-dirs &&
+	(
+		cd skip-unneeded-dirs &&
+
+		mkdir dir docs &&
+		test_seq 1 20 >numbers &&
+		echo a >dir/a &&
+		echo readme >docs/README &&
+		git add . &&
+		git commit -m orig &&
+
+		git branch upstream &&
+		git branch topic &&
+
+		git switch upstream &&
+		git mv numbers dir/numbers &&
+		echo upstream >>dir/numbers &&
+		echo more >>dir/a &&
+		echo more docs >>docs/README &&
+		echo new >docs/new &&
+		git add . &&
+		git commit -m "Move numbers into dir, update docs" &&
+
+		git switch topic &&
+		sed -e "s/^1$/one/" numbers >tmp &&
+		mv tmp numbers &&
+		git commit -a -m "Spell out one" &&
+		sed -e "s/^10$/ten/" numbers >tmp &&
+		mv tmp numbers &&
+		git commit -a -m "Spell out ten" &&
+
+		git switch upstream &&
+		GIT_TRACE2_PERF="$(pwd)/trace.output" \
+			git cherry-pick --strategy=ort upstream..topic &&
+
+		git ls-files >actual &&
+		test_write_lines dir/a dir/numbers docs/README docs/new >expect &&
+		test_cmp expect actual &&
+		test_seq 1 20 | sed -e "s/^1$/one/" -e "s/^10$/ten/" >expect &&
+		echo upstream >>expect &&
+		test_cmp expect dir/numbers &&
+		git rev-parse upstream:docs >expect &&
+		git rev-parse HEAD:docs >actual &&
+		test_cmp expect actual &&
+
+		# The first pick has to look everywhere for where numbers
+		# went; the second knows, and can take docs/ as is.
+		grep "trivial_directory_merges:" trace.output >trivial &&
+		test_line_count = 1 trivial &&
+		grep "trivial_directory_merges:1$" trivial
+	)
+'
+
+test_done
@@ -205,6 +205,72 @@ test_expect_success 'reduce_heads' '
 	test_all_modes reduce_heads
 '
 
+test_expect_success 'reduce_heads with many commits' '
+	for i in $(test_seq 1 10)
+	do
+		echo "X:commit-$i-$((11 - $i))" &&
+		if test $i -lt 10
+		then
+			echo "X:commit-$i-$((10 - $i))"
+		fi || return 1
+	done >input &&
+	{
+		echo "reduce_heads(X):" &&
+		for i in $(test_seq 1 10)
+		do
+			git rev-parse commit-$i-$((11 - $i)) || return 1
+		done | sort
+	} >expect &&
+	test_all_modes reduce_heads &&
+
+	sed -n "s/^X:/refs\/heads\//p" input >args &&
+	sed 1d expect >expect.independent &&
+	git merge-base --independent $(cat args) | sort >actual &&
+	test_cmp expect.independent actual &&
+	git -c core.commitGraph=false merge-base --independent $(cat args) |
+		sort >actual &&
+	test_cmp expect.independent actual
+'
+
+test_expect_success 'reduce_heads with many commits of the same date' '
+	git init same-date &&
+	(
+		cd same-date &&
+		GIT_COMMITTER_DATE="1112911993 -0700" &&
+		GIT_AUTHOR_DATE="1112911993 -0700" &&
+		export GIT_COMMITTER_DATE GIT_AUTHOR_DATE &&
+		for i in $(test_seq 1 40)
+		do
+			git commit --allow-empty -m $i &&
+			if test $((i % 2)) = 0
+			then
+				git rev-parse HEAD >>../same-date.heads
+			fi || return 1
+		done &&
+		git rev-parse HEAD >../expect &&
+		git -c core.commitGraph=false merge-base --independent \
+			$(cat ../same-date.heads) >../actual
+	) &&
+	test_cmp expect actual
+'
+
+test_expect_success 'reduce_heads with more than a thousand commits' '
+	git init many-heads &&
+	(
+		cd many-heads &&
+		test_commit_bulk --id=base 600 &&
+		git branch one &&
+		git branch two &&
+		test_commit_bulk --ref=refs/heads/one --id=one 300 &&
+		test_commit_bulk --ref=refs/heads/two --id=two 300 &&
+		git rev-parse one two | sort >../expect &&
+		git -c core.commitGraph=false merge-base --independent \
+			$(git rev-list --all) >actual &&
+		sort actual >../actual
+	) &&
+	test_cmp expect actual
+'
+
 test_expect_success 'can_all_from_reach:hit' '
 	cat >input <<-\EOF &&
 	X:commit-2-10
@@ -361,6 +361,28 @@ test_expect_success 'rename directory' '
 	grep "^event: dirrenamed/*$"  .git/trace
 '
 
+test_expect_success 'create populated directory' '
+	test_when_finished "clean_up_repo_and_stop_daemon" &&
+
+	(
+		GIT_TRACE_FSMONITOR="$PWD/.git/trace" &&
+		export GIT_TRACE_FSMONITOR &&
+
+		start_daemon
+	) &&
+
+	# the daemon may not be watching "newdir" (or "newdir/sub") yet
+	# by the time that "file" is created in it, but it must still
+	# report it.
+	mkdir -p newdir/sub &&
+	echo 1 >newdir/sub/file &&
+
+	git fsmonitor--daemon --query 0 >/dev/null 2>&1 &&
+
+	grep "^event: newdir/*$"          .git/trace &&
+	grep "^event: newdir/sub/file$"   .git/trace
+'
+
 test_expect_success 'file changes to directory' '
 	test_when_finished "clean_up_repo_and_stop_daemon" &&
 
@@ -0,0 +1,250 @@
+#!/bin/sh
+
+test_description='git repack --geometric works correctly'
+
+. ./test-lib.sh
+
+GIT_TEST_MULTI_PACK_INDEX=0
+
+objdir=.git/objects
+midx=$objdir/pack/multi-pack-index
+
+test_expect_success '--geometric with no packs' '
+	git init geometric &&
+	test_when_finished "rm -fr geometric" &&
+	(
+		cd geometric &&
+
+		git repack --geometric 2 >out &&
+		test_i18ngrep "Nothing new to pack" out
+	)
+'
+
+test_expect_success '--geometric with an intact progression' '
+	git init geometric &&
+	test_when_finished "rm -fr geometric" &&
+	(
+		cd geometric &&
+
+		# These packs already form a geometric progression.
+		test_commit_bulk --start=1 1 && # 3 objects
+		test_commit_bulk --start=2 2 && # 6 objects
+		test_commit_bulk --start=4 4 && # 12 objects
+
+		find $objdir/pack -name "*.pack" | sort >expect &&
+		git repack --geometric 2 -d &&
+		find $objdir/pack -name "*.pack" | sort >actual &&
+
+		test_cmp expect actual
+	)
+'
+
+test_expect_success '--geometric with loose objects' '
+	git init geometric &&
+	test_when_finished "rm -fr geometric" &&
+	(
+		cd geometric &&
+
+		# These packs already form a geometric progression.
+		test_commit_bulk --start=1 1 && # 3 objects
+		test_commit_bulk --start=2 2 && # 6 objects
+		# The loose objects are packed together, breaking the
+		# progression.
+		test_commit loose && # 3 objects
+
+		find $objdir/pack -name "*.pack" | sort >before &&
+		git repack --geometric 2 -d &&
+		find $objdir/pack -name "*.pack" | sort >after &&
+
+		comm -13 before after >new &&
+		comm -23 before after >removed &&
+
+		test_line_count = 1 new &&
+		test_must_be_empty removed &&
+
+		git repack --geometric 2 -d &&
+		find $objdir/pack -name "*.pack" | sort >after &&
+
+		# The progression (3, 3, 6) is combined into one new pack.
+		test_line_count = 1 after
+	)
+'
+
+test_expect_success '--geometric with small-pack rollup' '
+	git init geometric &&
+	test_when_finished "rm -fr geometric" &&
+	(
+		cd geometric &&
+
+		test_commit_bulk --start=1 1 && # 3 objects
+		test_commit_bulk --start=2 1 && # 3 objects
+		find $objdir/pack -name "*.pack" | sort >small &&
+		test_commit_bulk --start=3 4 && # 12 objects
+		test_commit_bulk --start=7 8 && # 24 objects
+		find $objdir/pack -name "*.pack" | sort >before &&
+
+		git repack --geometric 2 -d &&
+
+		# Three packs in total; two of the existing large ones, and
+		# one new one.
+		find $objdir/pack -name "*.pack" | sort >after &&
+		comm -12 small before >removed &&
+		test_line_count = 3 after &&
+		comm -13 before after >new &&
+		test_line_count = 1 new &&
+		comm -23 before after >gone &&
+		test_cmp removed gone
+	)
+'
+
+test_expect_success '--geometric with small- and large-pack rollup' '
+	git init geometric &&
+	test_when_finished "rm -fr geometric" &&
+	(
+		cd geometric &&
+
+		# size(small1) + size(small2) > size(medium) / 2
+		test_commit_bulk --start=1 1 && # 3 objects
+		test_commit_bulk --start=2 1 && # 3 objects
+		test_commit_bulk --start=2 3 && # 7 objects
+		test_commit_bulk --start=6 9 && # 27 objects &&
+
+		find $objdir/pack -name "*.pack" | sort >before &&
+
+		git repack --geometric 2 -d &&
+
+		find $objdir/pack -name "*.pack" | sort >after &&
+		comm -12 before after >untouched &&
+
+		# Two packs in total; the largest pack from before running
+		# "git repack", and one new one.
+		test_line_count = 1 untouched &&
+		test_line_count = 2 after
+	)
+'
+
+test_expect_success '--geometric ignores kept packs' '
+	git init geometric &&
+	test_when_finished "rm -fr geometric" &&
+	(
+		cd geometric &&
+
+		test_commit kept && # 3 objects
+		test_commit pack && # 3 objects
+
+		KEPT=$(git pack-objects --revs $objdir/pack/pack <<-EOF
+		refs/tags/kept
+		EOF
+		) &&
+		PACK=$(git pack-objects --revs $objdir/pack/pack <<-EOF
+		refs/tags/pack
+		^refs/tags/kept
+		EOF
+		) &&
+
+		# neither pack contains more than twice the number of
+		# objects in the other, so they would normally be combined.
+		# But, marking one as .kept on disk will "freeze" it, so
+		# the pack structure should remain the same.
+		touch $objdir/pack/pack-$KEPT.keep &&
+
+		find $objdir/pack -name "*.pack" | sort >before &&
+		git repack --geometric 2 -d &&
+		find $objdir/pack -name "*.pack" | sort >after &&
+
+		test_cmp before after
+	)
+'
+
+test_expect_success '--geometric --write-midx -b leaves kept packs alone' '
+	git init geometric &&
+	test_when_finished "rm -fr geometric" &&
+	(
+		cd geometric &&
+
+		test_commit kept && # 3 objects
+		test_commit small && # 3 objects
+		test_commit loose && # 3 objects
+
+		KEPT=$(git pack-objects --revs $objdir/pack/pack <<-EOF
+		refs/tags/kept
+		EOF
+		) &&
+		git pack-objects --revs $objdir/pack/pack <<-EOF &&
+		refs/tags/small
+		^refs/tags/kept
+		EOF
+		touch $objdir/pack/pack-$KEPT.keep &&
+
+		# -b implies --pack-kept-objects, which must not roll up
+		# (and delete) the kept pack.
+		git repack --geometric 2 -d --write-midx -b &&
+
+		test_path_is_file $objdir/pack/pack-$KEPT.pack &&
+		test_path_is_file $objdir/pack/pack-$KEPT.idx &&
+		test_path_is_file $objdir/pack/pack-$KEPT.keep &&
+		test_path_is_file $midx &&
+		git fsck
+	)
+'
+
+test_expect_success '--geometric keeps all reachable objects' '
+	git init geometric &&
+	test_when_finished "rm -fr geometric" &&
+	(
+		cd geometric &&
+
+		for i in $(test_seq 8)
+		do
+			test_commit "$i" &&
+			git repack -d || return 1
+		done &&
+		git rev-list --objects --all | cut -d" " -f1 | sort >expect &&
+
+		git repack --geometric 2 -d &&
+		git fsck &&
+
+		for idx in $objdir/pack/*.idx
+		do
+			git show-index <$idx | cut -d" " -f2 || return 1
+		done | sort -u >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success '--geometric --write-midx writes a bitmap of the result' '
+	git init geometric &&
+	test_when_finished "rm -fr geometric" &&
+	(
+		cd geometric &&
+		test_commit_bulk --start=1 1 &&
+		test_commit_bulk --start=2 4 &&
+		test_commit_bulk --start=6 20 &&
+		largest=$(ls -S $objdir/pack/*.pack | head -n 1) &&
+
+		test_commit loose &&
+		git repack --geometric 2 -d --write-midx --write-bitmap-index &&
+
+		test_path_is_file $midx &&
+		test_path_is_file $objdir/pack/multi-pack-index-*.bitmap &&
+		test_path_is_file $largest &&
+		git multi-pack-index verify &&
+		git rev-list --objects --all --use-bitmap-index >actual &&
+		git rev-list --objects --all >expect &&
+		cut -d" " -f1 <actual | sort >actual.sorted &&
+		cut -d" " -f1 <expect | sort >expect.sorted &&
+		test_cmp expect.sorted actual.sorted
+	)
+'
+
+test_expect_success '--geometric with -A' '
+	test_must_fail git repack --geometric 2 -A 2>err &&
+	test_i18ngrep "incompatible" err
+'
+
+test_expect_success '--geometric with an invalid factor' '
+	test_must_fail git repack --geometric 1 2>err &&
+	test_i18ngrep "must be at least 2" err
+'
+
+test_done
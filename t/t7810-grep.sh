@@ -969,6 +969,52 @@ do
 	"
 done
 
+test_expect_success PTHREADS 'threaded grep resolves deltas from a packed tree' '
+	git init delta-grep &&
+	(
+		cd delta-grep &&
+		for i in $(test_seq 30)
+		do
+			test_seq $i 300 >file-$i &&
+			test_seq $i 300 >>file-1 || return 1
+		done &&
+		git add . &&
+		git commit -q -m one &&
+		test_seq 10 >>file-1 &&
+		git commit -q -a -m two &&
+		git repack -adf --depth=50 &&
+		git grep --threads=1 -c 1 HEAD HEAD~ >expect &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git grep --threads=8 -c 1 HEAD HEAD~ >actual &&
+		test_cmp expect actual &&
+		grep "\"category\":\"delta_base_cache\",\"key\":\"statistics\"" trace.event
+	)
+'
+
+test_expect_success PTHREADS 'threaded grep reads loose objects from alternates' '
+	git init loose-grep &&
+	(
+		cd loose-grep &&
+		for i in $(test_seq 20)
+		do
+			test_seq $i 100 >file-$i || return 1
+		done &&
+		git add . &&
+		git commit -q -m one &&
+		git clone -q -s . ../loose-grep-alt
+	) &&
+	(
+		cd loose-grep-alt &&
+		echo 17 >local &&
+		git add local &&
+		git commit -q -m local &&
+		git grep --threads=1 -c 17 HEAD >expect &&
+		git grep --threads=8 -c 17 HEAD >actual &&
+		test_cmp expect actual &&
+		test_line_count = 18 actual
+	)
+'
+
 test_expect_success !PTHREADS 'grep --threads=N or pack.threads=N warns when no pthreads' '
 	git grep --threads=2 Hello hello_world 2>err &&
 	grep ^warning: err >warnings &&
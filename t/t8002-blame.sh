@@ -140,4 +140,30 @@ test_expect_success 'blame with uncommitted edits in partial clone does not cras
 	git -C client blame file.txt
 '
 
+test_expect_success 'blame in partial clone fetches the blobs of all parents at once' '
+	rm -rf server client trace &&
+	git init server &&
+	test_write_lines 1 2 3 4 5 6 >server/file.txt &&
+	git -C server add file.txt &&
+	git -C server commit -m base &&
+	git -C server checkout -b side &&
+	test_write_lines 1 2 3 4 5 side >server/file.txt &&
+	git -C server commit -a -m side &&
+	git -C server checkout - &&
+	test_write_lines main 2 3 4 5 6 >server/file.txt &&
+	git -C server commit -a -m main &&
+	git -C server merge side &&
+	git -C server config uploadpack.allowanysha1inwant 1 &&
+	git -C server config uploadpack.allowfilter 1 &&
+
+	git clone --filter=blob:none "file://$(pwd)/server" client &&
+	GIT_TRACE_PACKET="$(pwd)/trace" git -C client blame file.txt >actual &&
+	git -C server blame file.txt >expect &&
+	test_cmp expect actual &&
+
+	# one fetch for both parents of the merge, then one for the base
+	grep "fetch> done" trace >done_lines &&
+	test_line_count = 2 done_lines
+'
+
 test_done
@@ -114,6 +114,36 @@ test_expect_success 'append with -C -C -C' '
 
 '
 
+test_expect_success 'blame -C -C -C does not depend on --threads' '
+	for i in 1 2 3 4 5 6 7 8
+	do
+		test_write_lines "$i one" "$i two" "$i three" "$i four" >part$i ||
+		return 1
+	done &&
+	git add part? &&
+	test_tick &&
+	GIT_AUTHOR_NAME=Parts git commit -m Parts &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		cat part$i &&
+		echo "new $i" || return 1
+	done >whole &&
+	git add whole &&
+	test_tick &&
+	GIT_AUTHOR_NAME=Whole git commit -m Whole &&
+
+	git blame -f -C -C -C1 --threads=1 whole | sed -e "$pick_fc" >expect &&
+	git blame -f -C -C -C1 --threads=3 whole | sed -e "$pick_fc" >actual &&
+	test_cmp expect actual &&
+	grep -c "^part[1-8]-Parts$" actual >count &&
+	echo 32 >expect &&
+	test_cmp expect count &&
+	grep -c "^whole-Whole$" actual >count &&
+	echo 8 >expect &&
+	test_cmp expect count &&
+	git reset --hard HEAD~2
+'
+
 test_expect_success 'blame wholesale copy' '
 
 	git blame -f -C -C1 HEAD^ -- cow | sed -e "$pick_fc" >current &&
@@ -0,0 +1,220 @@
+#!/bin/sh
+
+test_description='git blame --cache'
+. ./test-lib.sh
+
+# Print the number of blame results taken from the cache, as reported
+# to trace2 in the event file "$1".
+cache_hits () {
+	sed -n -e 's/.*"cache\/hits","value":"\([0-9]*\)".*/\1/p' "$1"
+}
+
+test_expect_success setup '
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 11 12 >file &&
+	git add file &&
+	test_tick &&
+	git commit -m initial &&
+	git tag initial &&
+
+	sed -e "s/^3$/three/" file >tmp && mv tmp file &&
+	test_tick &&
+	git commit -a -m three &&
+	git tag three &&
+
+	git mv file moved &&
+	test_tick &&
+	git commit -m move &&
+
+	sed -e "s/^7$/seven/" moved >tmp && mv tmp moved &&
+	test_tick &&
+	git commit -a -m seven &&
+	git tag seven &&
+
+	sed -e "s/^11$/  11/" -e "s/^12$/twelve/" moved >tmp && mv tmp moved &&
+	test_tick &&
+	git commit -a -m eleven &&
+	git tag eleven
+'
+
+test_expect_success 'blame --cache records the result' '
+	git blame --line-porcelain three -- file >expect &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git blame --cache --line-porcelain three -- file >actual &&
+	test_cmp expect actual &&
+	test 0 = "$(cache_hits trace)" &&
+	test_path_is_dir .git/blame-cache &&
+
+	rm trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git blame --cache --line-porcelain three -- file >actual &&
+	test_cmp expect actual &&
+	test 1 = "$(cache_hits trace)"
+'
+
+test_expect_success 'blaming a descendant reuses the cached ancestor' '
+	git blame --line-porcelain seven -- moved >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git blame --cache --line-porcelain seven -- moved >actual &&
+	test_cmp expect actual &&
+	test 1 = "$(cache_hits trace)"
+'
+
+test_expect_success 'blame.cache config, and other output formats' '
+	git blame -n -f eleven -- moved >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -c blame.cache=true blame -n -f eleven -- moved >actual &&
+	test_cmp expect actual &&
+	test 1 = "$(cache_hits trace)" &&
+
+	git blame --porcelain -L 8,12 eleven -- moved >expect &&
+	git blame --cache --porcelain -L 8,12 eleven -- moved >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the working tree is blamed on top of the cache' '
+	git reset --hard eleven &&
+	echo thirteen >>moved &&
+	git blame -s moved >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git blame --cache -s moved >actual &&
+	test_cmp expect actual &&
+	test 1 = "$(cache_hits trace)" &&
+	git checkout moved
+'
+
+test_expect_success 'results are not shared between different options' '
+	git blame -w seven -- moved >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git blame --cache -w seven -- moved >actual &&
+	test_cmp expect actual &&
+	test 0 = "$(cache_hits trace)"
+'
+
+test_expect_success '-M, -C and --ignore-rev only reuse exact matches' '
+	for opt in -M -C "--ignore-rev three"
+	do
+		git blame $opt three -- file >expect &&
+		git blame --cache $opt three -- file >actual &&
+		test_cmp expect actual &&
+
+		git blame $opt seven -- moved >expect &&
+		rm -f trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+			git blame --cache $opt seven -- moved >actual &&
+		test_cmp expect actual &&
+		test 0 = "$(cache_hits trace)" &&
+
+		rm trace &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" \
+			git blame --cache $opt seven -- moved >actual &&
+		test_cmp expect actual &&
+		test 1 = "$(cache_hits trace)" || return 1
+	done
+'
+
+test_expect_success 'a cached result for a different blob is not used' '
+	rm -rf .git/blame-cache &&
+	git blame --cache seven -- moved &&
+	find .git/blame-cache -type f >cached &&
+	test_line_count = 1 cached &&
+	file=$(cat cached) &&
+	blob=$(git rev-parse three:file) &&
+	sed -e "1s/.*/blob $blob/" "$file" >tmp &&
+	mv tmp "$file" &&
+
+	git blame eleven -- moved >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git blame --cache eleven -- moved >actual &&
+	test_cmp expect actual &&
+	test 0 = "$(cache_hits trace)"
+'
+
+test_expect_success 'a cached result naming a missing commit is dropped' '
+	rm -rf .git/blame-cache &&
+	git blame --cache seven -- moved &&
+	file=$(find .git/blame-cache -type f) &&
+	three=$(git rev-parse three) &&
+	missing=$(test_oid deadbeef) &&
+	sed -e "s/$three/$missing/" "$file" >tmp &&
+	mv tmp "$file" &&
+	grep $missing "$file" &&
+
+	git blame eleven -- moved >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git blame --cache eleven -- moved >actual &&
+	test_cmp expect actual &&
+	test 0 = "$(cache_hits trace)" &&
+	test_path_is_missing "$file"
+'
+
+test_expect_success 'no cache in a shallow repository' '
+	test_create_repo deep &&
+	(
+		cd deep &&
+		test_write_lines a b >f &&
+		git add f &&
+		test_tick &&
+		git commit -m A &&
+		test_write_lines a b c >f &&
+		test_tick &&
+		git commit -a -m B &&
+		test_write_lines a b c d >f &&
+		test_tick &&
+		git commit -a -m C
+	) &&
+	git clone --depth 2 "file://$(pwd)/deep" shallow &&
+	(
+		cd shallow &&
+		git blame --cache HEAD~1 -- f &&
+		test_path_is_missing .git/blame-cache &&
+		git fetch --unshallow &&
+		git blame f >expect &&
+		git blame --cache f >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'no cache with replace refs or grafts' '
+	rm -rf .git/blame-cache &&
+	git replace --graft seven three &&
+	git blame --cache eleven -- moved &&
+	test_path_is_missing .git/blame-cache &&
+	git replace -d seven &&
+
+	echo $(git rev-parse seven) $(git rev-parse three) >.git/info/grafts &&
+	git blame --cache eleven -- moved 2>err &&
+	test_path_is_missing .git/blame-cache &&
+	rm .git/info/grafts
+'
+
+test_expect_success 'gc removes old cached results' '
+	rm -rf .git/blame-cache &&
+	git blame --cache seven -- moved &&
+	git blame --cache eleven -- moved &&
+	find .git/blame-cache -type f >cached &&
+	test_line_count = 2 cached &&
+	git gc &&
+	find .git/blame-cache -type f >cached &&
+	test_line_count = 2 cached &&
+	test-tool chmtime -1209700 $(head -n 1 cached) &&
+	git gc &&
+	find .git/blame-cache -type f >cached &&
+	test_line_count = 1 cached &&
+	git -c gc.blameCacheExpire=now gc &&
+	test_path_is_missing .git/blame-cache/*
+'
+
+test_expect_success 'no cache with a bottom commit or --reverse' '
+	rm -rf .git/blame-cache &&
+	git blame --cache three..eleven -- moved &&
+	git blame --cache --reverse three..eleven -- file &&
+	test_path_is_missing .git/blame-cache
+'
+
+test_done
@@ -1275,13 +1275,29 @@ static struct ref *get_refs_list_using_list(struct transport *transport,
 	return ret;
 }
 
+static int get_object_info(struct transport *transport,
+			   const struct oid_array *oids,
+			   struct remote_object_info *info)
+{
+	get_helper(transport);
+
+	if (process_connect(transport, 0)) {
+		do_take_over(transport);
+		return transport->vtable->get_object_info(transport, oids,
+							  info);
+	}
+	return -1;
+}
+
 static struct transport_vtable vtable = {
 	set_helper_option,
 	get_refs_list,
 	fetch,
 	push_refs,
 	connect_helper,
-	release_helper
+	release_helper,
+	NULL,
+	get_object_info
 };
 
 int transport_helper_init(struct transport *transport, const char *name)
@@ -4,6 +4,9 @@
 struct ref;
 struct transport;
 struct strvec;
+struct string_list;
+struct oid_array;
+struct remote_object_info;
 struct transport_ls_refs_options;
 
 struct transport_vtable {
@@ -59,6 +62,22 @@ struct transport_vtable {
 	 * use. disconnect() releases these resources.
 	 **/
 	int (*disconnect)(struct transport *connection);
+
+	/**
+	 * Add the URIs of the bundles the remote side offers to `uris`.
+	 * Returns -1 if the remote side cannot offer bundles.
+	 **/
+	int (*get_bundle_uri)(struct transport *transport,
+			      struct string_list *uris);
+
+	/**
+	 * Fill in info[i] with the type and size of oids->oid[i] as
+	 * known to the remote side, without fetching the objects.
+	 * Returns -1 if the remote side cannot tell.
+	 **/
+	int (*get_object_info)(struct transport *transport,
+			       const struct oid_array *oids,
+			       struct remote_object_info *info);
 };
 
 #endif
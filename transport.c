@@ -853,13 +853,58 @@ static int disconnect_git(struct transport *transport)
 	return 0;
 }
 
+static int get_bundle_uri_via_connect(struct transport *transport,
+				      struct string_list *uris)
+{
+	struct git_transport_data *data = transport->data;
+	struct packet_reader reader;
+
+	if (!data->got_remote_heads || data->version != protocol_v2 ||
+	    !server_supports_v2("bundle-uri", 0))
+		return -1;
+
+	packet_reader_init(&reader, data->fd[0], NULL, 0,
+			   PACKET_READ_CHOMP_NEWLINE |
+			   PACKET_READ_GENTLE_ON_EOF |
+			   PACKET_READ_DIE_ON_ERR_PACKET);
+	get_remote_bundle_uri(data->fd[1], &reader, uris,
+			      transport->server_options,
+			      transport->stateless_rpc);
+	return 0;
+}
+
+static int get_object_info_via_connect(struct transport *transport,
+				       const struct oid_array *oids,
+				       struct remote_object_info *info)
+{
+	struct git_transport_data *data = transport->data;
+	struct packet_reader reader;
+
+	if (!data->got_remote_heads)
+		free_refs(handshake(transport, 0, NULL, 0));
+	if (data->version != protocol_v2 ||
+	    !server_supports_v2("object-info", 0))
+		return -1;
+
+	packet_reader_init(&reader, data->fd[0], NULL, 0,
+			   PACKET_READ_CHOMP_NEWLINE |
+			   PACKET_READ_GENTLE_ON_EOF |
+			   PACKET_READ_DIE_ON_ERR_PACKET);
+	fetch_object_info(data->fd[1], &reader, oids, info,
+			  transport->server_options,
+			  transport->stateless_rpc);
+	return 0;
+}
+
 static struct transport_vtable taken_over_vtable = {
 	NULL,
 	get_refs_via_connect,
 	fetch_refs_via_pack,
 	git_transport_push,
 	NULL,
-	disconnect_git
+	disconnect_git,
+	get_bundle_uri_via_connect,
+	get_object_info_via_connect
 };
 
 void transport_take_over(struct transport *transport,
@@ -1017,7 +1062,9 @@ static struct transport_vtable builtin_smart_vtable = {
 	fetch_refs_via_pack,
 	git_transport_push,
 	connect_git,
-	disconnect_git
+	disconnect_git,
+	get_bundle_uri_via_connect,
+	get_object_info_via_connect
 };
 
 struct transport *transport_get(struct remote *remote, const char *url)
@@ -1393,6 +1440,23 @@ const struct ref *transport_get_remote_refs(struct transport *transport,
 	return transport->remote_refs;
 }
 
+int transport_get_remote_bundle_uri(struct transport *transport,
+				    struct string_list *uris)
+{
+	if (!transport->vtable->get_bundle_uri)
+		return -1;
+	return transport->vtable->get_bundle_uri(transport, uris);
+}
+
+int transport_get_object_info(struct transport *transport,
+			      const struct oid_array *oids,
+			      struct remote_object_info *info)
+{
+	if (!transport->vtable->get_object_info)
+		return -1;
+	return transport->vtable->get_object_info(transport, oids, info);
+}
+
 int transport_fetch_refs(struct transport *transport, struct ref *refs)
 {
 	int rc;
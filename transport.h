@@ -7,6 +7,8 @@
 #include "list-objects-filter-options.h"
 #include "string-list.h"
 
+struct remote_object_info;
+
 struct git_transport_options {
 	unsigned thin : 1;
 	unsigned keep : 1;
@@ -266,6 +268,25 @@ const struct ref *transport_get_remote_refs(struct transport *transport,
  * This can only be called after fetching the remote refs.
  */
 const struct git_hash_algo *transport_get_hash_algo(struct transport *transport);
+
+/*
+ * Add the URIs of the bundles the remote offers to `uris`; see
+ * bundle-uri.h.  This can only be called after fetching the remote refs.
+ * Returns -1 if the remote offers no bundles.
+ */
+int transport_get_remote_bundle_uri(struct transport *transport,
+				    struct string_list *uris);
+
+/*
+ * Fill in info[i] with the type and size of oids->oid[i] on the remote
+ * (see fetch_object_info()), without fetching the objects.  Returns -1
+ * if the remote cannot tell, which needs protocol v2 and a server with
+ * transfer.advertiseObjectInfo set.
+ */
+int transport_get_object_info(struct transport *transport,
+			      const struct oid_array *oids,
+			      struct remote_object_info *info);
+
 int transport_fetch_refs(struct transport *transport, struct ref *refs);
 void transport_unlock_pack(struct transport *transport);
 int transport_disconnect(struct transport *transport);
@@ -16,6 +16,8 @@
 #include "fsmonitor.h"
 #include "object-store.h"
 #include "promisor-remote.h"
+#include "parallel-checkout.h"
+#include "sparse-index.h"
 
 /*
  * Error messages expected by scripts out of plumbing commands such as
@@ -397,7 +399,8 @@ static int check_updates(struct unpack_trees_options *o,
 	int errs = 0;
 	struct progress *progress;
 	struct checkout state = CHECKOUT_INIT;
-	int i;
+	int i, pc_workers, pc_threshold;
+	size_t last_pc_queue_size = 0;
 
 	trace_performance_enter();
 	state.force = 1;
@@ -453,16 +456,16 @@ static int check_updates(struct unpack_trees_options *o,
 			if (!(ce->ce_flags & CE_UPDATE) ||
 			    S_ISGITLINK(ce->ce_mode))
 				continue;
-			if (!oid_object_info_extended(the_repository, &ce->oid,
-						      NULL,
-						      OBJECT_INFO_FOR_PREFETCH))
-				continue;
-			oid_array_append(&to_fetch, &ce->oid);
+			promisor_remote_prefetch_add(the_repository, &to_fetch,
+						     &ce->oid);
 		}
-		promisor_remote_get_direct(the_repository,
-					   to_fetch.oid, to_fetch.nr);
-		oid_array_clear(&to_fetch);
+		promisor_remote_prefetch(the_repository, &to_fetch);
 	}
+
+	get_parallel_checkout_configs(&pc_workers, &pc_threshold);
+
+	if (pc_workers > 1)
+		init_parallel_checkout();
 	for (i = 0; i < index->cache_nr; i++) {
 		struct cache_entry *ce = index->cache[i];
 
@@ -470,11 +473,21 @@ static int check_updates(struct unpack_trees_options *o,
 			if (ce->ce_flags & CE_WT_REMOVE)
 				BUG("both update and delete flags are set on %s",
 				    ce->name);
-			display_progress(progress, ++cnt);
 			ce->ce_flags &= ~CE_UPDATE;
 			errs |= checkout_entry(ce, &state, NULL, NULL);
+
+			/*
+			 * Entries queued for parallel checkout are counted
+			 * by run_parallel_checkout() as they are written.
+			 */
+			if (last_pc_queue_size == pc_queue_size())
+				display_progress(progress, ++cnt);
+			last_pc_queue_size = pc_queue_size();
 		}
 	}
+	if (pc_workers > 1)
+		errs |= run_parallel_checkout(&state, pc_workers, pc_threshold,
+					      progress, &cnt);
 	stop_progress(&progress);
 	errs |= finish_delayed_checkout(&state, NULL);
 	git_attr_set_direction(GIT_ATTR_CHECKIN);
@@ -989,6 +1002,16 @@ static int compare_entry(const struct cache_entry *ce, const struct traverse_inf
 	if (cmp)
 		return cmp;
 
+	/*
+	 * At this point, we know that we have a prefix match. If ce
+	 * is a sparse directory, then allow an exact match. This only
+	 * works when the input name is a directory, since ce->name
+	 * ends in a directory separator.
+	 */
+	if (S_ISSPARSEDIR(ce->ce_mode) &&
+	    ce->ce_namelen == traverse_path_len(info, tree_entry_len(n)) + 1)
+		return 0;
+
 	/*
 	 * Even if the beginning compared identically, the ce should
 	 * compare as bigger than a directory leading up to it!
@@ -1015,13 +1038,15 @@ static struct cache_entry *create_ce_entry(const struct traverse_info *info,
 	const struct name_entry *n,
 	int stage,
 	struct index_state *istate,
-	int is_transient)
+	int is_transient,
+	int is_sparse_directory)
 {
 	size_t len = traverse_path_len(info, tree_entry_len(n));
+	size_t alloc_len = is_sparse_directory ? len + 1 : len;
 	struct cache_entry *ce =
 		is_transient ?
-		make_empty_transient_cache_entry(len) :
-		make_empty_cache_entry(istate, len);
+		make_empty_transient_cache_entry(alloc_len) :
+		make_empty_cache_entry(istate, alloc_len);
 
 	ce->ce_mode = create_ce_mode(n->mode);
 	ce->ce_flags = create_ce_flags(stage);
@@ -1030,6 +1055,13 @@ static struct cache_entry *create_ce_entry(const struct traverse_info *info,
 	/* len+1 because the cache_entry allocates space for NUL */
 	make_traverse_path(ce->name, len + 1, info, n->path, n->pathlen);
 
+	if (is_sparse_directory) {
+		ce->name[len] = '/';
+		ce->name[len + 1] = '\0';
+		ce->ce_namelen++;
+		ce->ce_flags |= CE_SKIP_WORKTREE;
+	}
+
 	return ce;
 }
 
@@ -1052,6 +1084,14 @@ static int unpack_nondirectories(int n, unsigned long mask,
 	if (mask == dirmask && !src[0])
 		return 0;
 
+	/*
+	 * When we have a sparse directory entry for src[0],
+	 * then this isn't necessarily a directory-file conflict.
+	 */
+	if (mask == dirmask && src[0] &&
+	    S_ISSPARSEDIR(src[0]->ce_mode))
+		conflicts = 0;
+
 	/*
 	 * Ok, we've filled in up to any potential index entry in src[0],
 	 * now do the rest.
@@ -1081,7 +1121,9 @@ static int unpack_nondirectories(int n, unsigned long mask,
 		 * not stored in the index.  otherwise construct the
 		 * cache entry from the index aware logic.
 		 */
-		src[i + o->merge] = create_ce_entry(info, names + i, stage, &o->result, o->merge);
+		src[i + o->merge] = create_ce_entry(info, names + i, stage,
+						    &o->result, o->merge,
+						    bit & dirmask);
 	}
 
 	if (o->merge) {
@@ -1188,13 +1230,27 @@ static int find_cache_pos(struct traverse_info *info,
 static struct cache_entry *find_cache_entry(struct traverse_info *info,
 					    const struct name_entry *p)
 {
+	struct cache_entry *ce;
 	int pos = find_cache_pos(info, p->path, p->pathlen);
 	struct unpack_trees_options *o = info->data;
 
 	if (0 <= pos)
 		return o->src_index->cache[pos];
-	else
-		return NULL;
+
+	/*
+	 * find_cache_pos() reports a directory whose first entry lives
+	 * under "path/" as -2 - pos.  If that first entry is a sparse
+	 * directory entry for exactly "path/", it stands for the whole
+	 * tree and is returned as the match.
+	 */
+	if (pos < -1 && S_ISDIR(p->mode)) {
+		ce = o->src_index->cache[-2 - pos];
+		if (S_ISSPARSEDIR(ce->ce_mode) &&
+		    ce_namelen(ce) == info->pathlen + p->pathlen + 1)
+			return ce;
+	}
+
+	return NULL;
 }
 
 static void debug_path(struct traverse_info *info)
@@ -1297,6 +1353,14 @@ static int unpack_callback(int n, unsigned long mask, unsigned long dirmask, str
 
 	/* Now handle any directories.. */
 	if (dirmask) {
+		/*
+		 * A sparse directory entry covers the whole tree; it has
+		 * been merged as a unit above, so there is nothing left
+		 * to descend into.
+		 */
+		if (src[0] && S_ISSPARSEDIR(src[0]->ce_mode))
+			return mask;
+
 		/* special case: "diff-index --cached" looking at a tree */
 		if (o->diff_index_cached &&
 		    n == 1 && dirmask == 1 && S_ISDIR(names->mode)) {
@@ -1561,6 +1625,42 @@ static void populate_from_existing_patterns(struct unpack_trees_options *o,
 }
 
 
+/*
+ * Can this unpack operation work directly on the sparse directory
+ * entries of the source index?  That is only the case for callers that
+ * opted in, for simple one- and two-way traversals from the top level,
+ * and when every sparse directory stays outside the sparse-checkout
+ * cone; otherwise the index has to be expanded first.
+ */
+static int unpack_needs_full_index(unsigned len,
+				   struct unpack_trees_options *o)
+{
+	int i;
+
+	if (!o->src_index->sparse_index)
+		return 0;
+
+	if (!o->sparse_directories || o->prefix || len > 2 ||
+	    !core_apply_sparse_checkout)
+		return 1;
+
+	if (o->skip_sparse_checkout || !o->pl)
+		return 0;
+
+	for (i = 0; i < o->src_index->cache_nr; i++) {
+		struct cache_entry *ce = o->src_index->cache[i];
+		int dtype = DT_DIR;
+
+		if (!S_ISSPARSEDIR(ce->ce_mode))
+			continue;
+		if (path_matches_pattern_list(ce->name, ce_namelen(ce), NULL,
+					      &dtype, o->pl,
+					      o->src_index) != NOT_MATCHED)
+			return 1;
+	}
+	return 0;
+}
+
 static int verify_absent(const struct cache_entry *,
 			 enum unpack_trees_error_types,
 			 struct unpack_trees_options *);
@@ -1591,11 +1691,15 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 		populate_from_existing_patterns(o, &pl);
 	}
 
+	if (unpack_needs_full_index(len, o))
+		ensure_full_index(o->src_index);
+
 	memset(&o->result, 0, sizeof(o->result));
 	o->result.initialized = 1;
 	o->result.timestamp.sec = o->src_index->timestamp.sec;
 	o->result.timestamp.nsec = o->src_index->timestamp.nsec;
 	o->result.version = o->src_index->version;
+	o->result.sparse_index = o->src_index->sparse_index;
 	if (!o->src_index->split_index) {
 		o->result.split_index = NULL;
 	} else if (o->src_index == o->dst_index) {
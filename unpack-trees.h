@@ -63,7 +63,8 @@ struct unpack_trees_options {
 		     quiet,
 		     exiting_early,
 		     show_all_errors,
-		     dry_run;
+		     dry_run,
+		     sparse_directories;
 	const char *prefix;
 	int cache_bottom;
 	struct dir_struct *dir;
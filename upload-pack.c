@@ -27,6 +27,7 @@
 #include "commit-graph.h"
 #include "commit-reach.h"
 #include "shallow.h"
+#include "pack-objects-cache.h"
 
 /* Remember to update object flag allocation in object.h */
 #define THEY_HAVE	(1u << 11)
@@ -93,6 +94,7 @@ struct upload_pack_data {
 	struct packet_writer writer;
 
 	const char *pack_objects_hook;
+	struct pack_objects_cache pack_objects_cache;
 
 	unsigned stateless_rpc : 1;				/* v0 only */
 	unsigned no_done : 1;					/* v0 only */
@@ -125,6 +127,7 @@ static void upload_pack_data_init(struct upload_pack_data *data)
 	struct string_list uri_protocols = STRING_LIST_INIT_DUP;
 	struct object_array extra_edge_obj = OBJECT_ARRAY_INIT;
 	struct string_list allowed_filters = STRING_LIST_INIT_DUP;
+	struct pack_objects_cache pack_objects_cache = PACK_OBJECTS_CACHE_INIT;
 
 	memset(data, 0, sizeof(*data));
 	data->symref = symref;
@@ -137,6 +140,7 @@ static void upload_pack_data_init(struct upload_pack_data *data)
 	data->uri_protocols = uri_protocols;
 	data->extra_edge_obj = extra_edge_obj;
 	data->allowed_filters = allowed_filters;
+	data->pack_objects_cache = pack_objects_cache;
 	data->allow_filter_fallback = 1;
 	data->tree_filter_max_depth = ULONG_MAX;
 	packet_writer_init(&data->writer, 1);
@@ -186,9 +190,9 @@ static void send_client_data(int fd, const char *data, ssize_t sz,
 
 static int write_one_shallow(const struct commit_graft *graft, void *cb_data)
 {
-	FILE *fp = cb_data;
+	struct strbuf *out = cb_data;
 	if (graft->nr_parent == -1)
-		fprintf(fp, "--shallow %s\n", oid_to_hex(&graft->oid));
+		strbuf_addf(out, "--shallow %s\n", oid_to_hex(&graft->oid));
 	return 0;
 }
 
@@ -264,17 +268,272 @@ static int relay_pack_data(int pack_objects_out, struct output_state *os,
 	return readsz;
 }
 
+static void send_keepalive(void)
+{
+	static const char buf[] = "0005\1";
+	write_or_die(1, buf, 5);
+}
+
+static void flush_pack_data(struct upload_pack_data *pack_data,
+			    struct output_state *os)
+{
+	/* flush the data */
+	if (os->used > 0) {
+		send_client_data(1, os->buffer, os->used,
+				 pack_data->use_sideband);
+		fprintf(stderr, "flushed.\n");
+	}
+	if (pack_data->use_sideband)
+		packet_flush(1);
+}
+
+static NORETURN void abort_pack_data(struct upload_pack_data *pack_data)
+{
+	char abort_msg[] = "aborting due to possible repository "
+		"corruption on the remote side.";
+
+	send_client_data(3, abort_msg, sizeof(abort_msg),
+			 pack_data->use_sideband);
+	die("git upload-pack: %s", abort_msg);
+}
+
+static int hash_oid(const struct object_id *oid, void *ctx)
+{
+	the_hash_algo->update_fn(ctx, oid->hash, the_hash_algo->rawsz);
+	return 0;
+}
+
+static int hash_tag_ref(const char *refname, const struct object_id *oid,
+			int flag, void *ctx)
+{
+	the_hash_algo->update_fn(ctx, refname, strlen(refname) + 1);
+	return hash_oid(oid, ctx);
+}
+
+/*
+ * Name the pack-objects cache entry for a request after everything that
+ * goes into pack-objects, except for whether it shows progress, and
+ * with the wants and the haves in a canonical order.  With --include-tag
+ * the tags pack-objects would look at count too.
+ */
+static char *pack_objects_cache_key(struct upload_pack_data *pack_data,
+				    const struct strvec *args,
+				    const char *shallows, size_t shallows_len)
+{
+	struct oid_array wants = OID_ARRAY_INIT;
+	struct oid_array haves = OID_ARRAY_INIT;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	git_hash_ctx ctx;
+	int i;
+
+	the_hash_algo->init_fn(&ctx);
+	for (i = 0; i < args->nr; i++)
+		if (strcmp(args->v[i], "--progress"))
+			the_hash_algo->update_fn(&ctx, args->v[i],
+						 strlen(args->v[i]) + 1);
+	the_hash_algo->update_fn(&ctx, shallows, shallows_len);
+	the_hash_algo->update_fn(&ctx, "", 1);
+
+	for (i = 0; i < pack_data->want_obj.nr; i++)
+		oid_array_append(&wants,
+				 &pack_data->want_obj.objects[i].item->oid);
+	for (i = 0; i < pack_data->have_obj.nr; i++)
+		oid_array_append(&haves,
+				 &pack_data->have_obj.objects[i].item->oid);
+	for (i = 0; i < pack_data->extra_edge_obj.nr; i++)
+		oid_array_append(&haves,
+				 &pack_data->extra_edge_obj.objects[i].item->oid);
+	oid_array_for_each_unique(&wants, hash_oid, &ctx);
+	the_hash_algo->update_fn(&ctx, "--not", 6);
+	oid_array_for_each_unique(&haves, hash_oid, &ctx);
+	if (pack_data->use_include_tag)
+		for_each_tag_ref(hash_tag_ref, &ctx);
+	the_hash_algo->final_fn(hash, &ctx);
+
+	oid_array_clear(&wants);
+	oid_array_clear(&haves);
+	return xstrdup(hash_to_hex(hash));
+}
+
+/*
+ * The entry is complete, so the producer only has the last of the
+ * progress to pass on before it exits.
+ */
+static void finish_cache_producer(struct upload_pack_data *pack_data,
+				  struct child_process *producer)
+{
+	char progress[128];
+	ssize_t sz;
+
+	if (producer->err < 0)
+		return;
+	while ((sz = xread(producer->err, progress, sizeof(progress))) > 0)
+		send_client_data(2, progress, sz, pack_data->use_sideband);
+	close(producer->err);
+	producer->err = -1;
+	finish_command(producer);
+}
+
+/* Stop listening to the producer, and let it finish without us. */
+static void leave_cache_producer(struct child_process *producer)
+{
+	if (producer->err < 0)
+		return;
+	close(producer->err);
+	producer->err = -1;
+	child_process_clear(producer);
+}
+
+/*
+ * Send the pack from the pack-objects cache, starting a producer to fill
+ * the entry with `pack_objects` if nobody else has made it or is making
+ * it.  Returns -1, having sent nothing, if the cache is of no use for this
+ * request; `pack_objects` is then still unused.
+ */
+static int send_cached_pack(struct upload_pack_data *pack_data,
+			    struct child_process *pack_objects,
+			    const struct strbuf *input, const char *key,
+			    const struct string_list *uri_protocols)
+{
+	static const char *state_name[] = {
+		[PACK_OBJECTS_CACHE_UNUSED] = "unused",
+		[PACK_OBJECTS_CACHE_HIT] = "hit",
+		[PACK_OBJECTS_CACHE_FOLLOW] = "follow",
+		[PACK_OBJECTS_CACHE_PRODUCE] = "produce",
+	};
+	struct pack_objects_cache_entry entry;
+	struct child_process producer = CHILD_PROCESS_INIT;
+	struct output_state output_state = { { 0 } };
+	char progress[128];
+	uint64_t keepalive_ns, last_sent;
+	int sent = 0, wait_ms = 0;
+
+	pack_objects_cache_open(the_repository, &pack_data->pack_objects_cache,
+				key, &entry);
+	trace2_data_string("upload-pack", the_repository, "pack-objects-cache",
+			   state_name[entry.state]);
+	if (entry.state == PACK_OBJECTS_CACHE_UNUSED) {
+		pack_objects_cache_entry_release(&entry);
+		return -1;
+	}
+
+	if (entry.state == PACK_OBJECTS_CACHE_PRODUCE) {
+		/*
+		 * The producer is an "upload-pack" of its own, which runs
+		 * pack-objects into the entry and publishes it even if we
+		 * (or our client) are gone by then.
+		 */
+		producer.git_cmd = 1;
+		strvec_pushl(&producer.args, "upload-pack", "--strict", NULL);
+		strvec_pushf(&producer.args, "--pack-objects-cache-producer=%s",
+			     key);
+		strvec_pushl(&producer.args, ".", "--", NULL);
+		strvec_pushv(&producer.args, pack_objects->args.v);
+		producer.in = -1;
+		producer.err = -1;
+		if (pack_objects_cache_start_producer(&entry, &producer)) {
+			pack_objects_cache_entry_release(&entry);
+			return -1;
+		}
+		write_in_full(producer.in, input->buf, input->len);
+		close(producer.in);
+	} else {
+		/* not started; there is no progress to relay or child to reap */
+		producer.err = -1;
+	}
+
+	/*
+	 * The producer writes the entry by itself, so we only pick up its
+	 * progress here, and otherwise check on the entry now and then.
+	 * Only wait for progress when the entry has nothing new for us;
+	 * without --progress, none may come until pack-objects is done.
+	 */
+	keepalive_ns = pack_data->keepalive < 0
+		? 0
+		: pack_data->keepalive * (uint64_t)1000000000;
+	last_sent = getnanotime();
+	while (1) {
+		reset_timeout(pack_data->timeout);
+
+		if (0 <= producer.err) {
+			struct pollfd pfd;
+			ssize_t sz;
+
+			pfd.fd = producer.err;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, wait_ms) > 0) {
+				sz = xread(producer.err, progress,
+					   sizeof(progress));
+				if (0 < sz) {
+					send_client_data(2, progress, sz,
+							 pack_data->use_sideband);
+					last_sent = getnanotime();
+					continue;
+				}
+				/* the entry tells whether it succeeded */
+				if (sz < 0) {
+					leave_cache_producer(&producer);
+				} else {
+					close(producer.err);
+					producer.err = -1;
+					finish_command(&producer);
+				}
+			}
+		}
+
+		switch (pack_objects_cache_poll(&entry)) {
+		case PACK_OBJECTS_CACHE_DATA:
+			if (relay_pack_data(entry.fd, &output_state,
+					    pack_data->use_sideband,
+					    !!uri_protocols) < 0)
+				goto fail;
+			sent = 1;
+			last_sent = getnanotime();
+			wait_ms = 0;
+			continue;
+		case PACK_OBJECTS_CACHE_DONE:
+			finish_cache_producer(pack_data, &producer);
+			flush_pack_data(pack_data, &output_state);
+			pack_objects_cache_entry_release(&entry);
+			return 0;
+		case PACK_OBJECTS_CACHE_ABANDONED:
+			/* whoever was producing it, we can do it ourselves */
+			if (!sent) {
+				leave_cache_producer(&producer);
+				pack_objects_cache_entry_release(&entry);
+				return -1;
+			}
+			goto fail;
+		case PACK_OBJECTS_CACHE_WAIT:
+			wait_ms = 100;
+			break;
+		}
+
+		if (producer.err < 0)
+			sleep_millisec(100);
+		if (keepalive_ns && pack_data->use_sideband &&
+		    getnanotime() - last_sent >= keepalive_ns) {
+			send_keepalive();
+			last_sent = getnanotime();
+		}
+	}
+
+ fail:
+	leave_cache_producer(&producer);
+	pack_objects_cache_entry_release(&entry);
+	abort_pack_data(pack_data);
+}
+
 static void create_pack_file(struct upload_pack_data *pack_data,
 			     const struct string_list *uri_protocols)
 {
 	struct child_process pack_objects = CHILD_PROCESS_INIT;
 	struct output_state output_state = { { 0 } };
+	struct strbuf input = STRBUF_INIT;
+	size_t shallows_len;
 	char progress[128];
-	char abort_msg[] = "aborting due to possible repository "
-		"corruption on the remote side.";
 	ssize_t sz;
 	int i;
-	FILE *pipe_fd;
 
 	if (!pack_data->pack_objects_hook)
 		pack_objects.git_cmd = 1;
@@ -313,6 +572,35 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 					 uri_protocols->items[i].string);
 	}
 
+	if (pack_data->shallow_nr)
+		for_each_commit_graft(write_one_shallow, &input);
+	shallows_len = input.len;
+
+	for (i = 0; i < pack_data->want_obj.nr; i++)
+		strbuf_addf(&input, "%s\n",
+			    oid_to_hex(&pack_data->want_obj.objects[i].item->oid));
+	strbuf_addstr(&input, "--not\n");
+	for (i = 0; i < pack_data->have_obj.nr; i++)
+		strbuf_addf(&input, "%s\n",
+			    oid_to_hex(&pack_data->have_obj.objects[i].item->oid));
+	for (i = 0; i < pack_data->extra_edge_obj.nr; i++)
+		strbuf_addf(&input, "%s\n",
+			    oid_to_hex(&pack_data->extra_edge_obj.objects[i].item->oid));
+	strbuf_addch(&input, '\n');
+
+	if (pack_data->pack_objects_cache.enabled) {
+		char *key = pack_objects_cache_key(pack_data, &pack_objects.args,
+						   input.buf, shallows_len);
+		int ret = send_cached_pack(pack_data, &pack_objects, &input,
+					   key, uri_protocols);
+
+		free(key);
+		if (!ret) {
+			strbuf_release(&input);
+			return;
+		}
+	}
+
 	pack_objects.in = -1;
 	pack_objects.out = -1;
 	pack_objects.err = -1;
@@ -321,24 +609,9 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 	if (start_command(&pack_objects))
 		die("git upload-pack: unable to fork git-pack-objects");
 
-	pipe_fd = xfdopen(pack_objects.in, "w");
-
-	if (pack_data->shallow_nr)
-		for_each_commit_graft(write_one_shallow, pipe_fd);
-
-	for (i = 0; i < pack_data->want_obj.nr; i++)
-		fprintf(pipe_fd, "%s\n",
-			oid_to_hex(&pack_data->want_obj.objects[i].item->oid));
-	fprintf(pipe_fd, "--not\n");
-	for (i = 0; i < pack_data->have_obj.nr; i++)
-		fprintf(pipe_fd, "%s\n",
-			oid_to_hex(&pack_data->have_obj.objects[i].item->oid));
-	for (i = 0; i < pack_data->extra_edge_obj.nr; i++)
-		fprintf(pipe_fd, "%s\n",
-			oid_to_hex(&pack_data->extra_edge_obj.objects[i].item->oid));
-	fprintf(pipe_fd, "\n");
-	fflush(pipe_fd);
-	fclose(pipe_fd);
+	write_in_full(pack_objects.in, input.buf, input.len);
+	close(pack_objects.in);
+	strbuf_release(&input);
 
 	/* We read from pack_objects.err to capture stderr output for
 	 * progress bar, and pack_objects.out to capture the pack data.
@@ -425,10 +698,8 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 		 * protocol to say anything, so those clients are just out of
 		 * luck.
 		 */
-		if (!ret && pack_data->use_sideband) {
-			static const char buf[] = "0005\1";
-			write_or_die(1, buf, 5);
-		}
+		if (!ret && pack_data->use_sideband)
+			send_keepalive();
 	}
 
 	if (finish_command(&pack_objects)) {
@@ -436,20 +707,11 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 		goto fail;
 	}
 
-	/* flush the data */
-	if (output_state.used > 0) {
-		send_client_data(1, output_state.buffer, output_state.used,
-				 pack_data->use_sideband);
-		fprintf(stderr, "flushed.\n");
-	}
-	if (pack_data->use_sideband)
-		packet_flush(1);
+	flush_pack_data(pack_data, &output_state);
 	return;
 
  fail:
-	send_client_data(3, abort_msg, sizeof(abort_msg),
-			 pack_data->use_sideband);
-	die("git upload-pack: %s", abort_msg);
+	abort_pack_data(pack_data);
 }
 
 static int do_got_oid(struct upload_pack_data *data, const struct object_id *oid)
@@ -1304,6 +1566,12 @@ static int upload_pack_config(const char *var, const char *value, void *cb_data)
 		data->keepalive = git_config_int(var, value);
 		if (!data->keepalive)
 			data->keepalive = -1;
+	} else if (!strcmp("uploadpack.packobjectscache", var)) {
+		data->pack_objects_cache.enabled = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.packobjectscachemaxsize", var)) {
+		data->pack_objects_cache.max_size = git_config_ulong(var, value);
+	} else if (!strcmp("uploadpack.packobjectscachemaxage", var)) {
+		data->pack_objects_cache.max_age = git_config_ulong(var, value);
 	} else if (!strcmp("uploadpack.allowfilter", var)) {
 		data->allow_filter = git_config_bool(var, value);
 	} else if (!strcmp("uploadpack.allowrefinwant", var)) {
@@ -1380,6 +1648,56 @@ void upload_pack(struct upload_pack_options *options)
 	upload_pack_data_clear(&data);
 }
 
+int produce_pack_objects_cache_entry(const char *key, const char **argv)
+{
+	struct child_process pack_objects = CHILD_PROCESS_INIT;
+	struct upload_pack_data data;
+	int ret;
+
+	upload_pack_data_init(&data);
+	git_config(upload_pack_config, &data);
+
+	/* as create_pack_file() would have run it */
+	if (data.pack_objects_hook)
+		pack_objects.use_shell = 1;
+	else
+		pack_objects.git_cmd = 1;
+	strvec_pushv(&pack_objects.args, argv);
+
+	ret = pack_objects_cache_produce(the_repository,
+					 &data.pack_objects_cache, key,
+					 &pack_objects);
+	upload_pack_data_clear(&data);
+	return ret;
+}
+
+void serve_upload_pack(struct upload_pack_options *options)
+{
+	struct serve_options serve_opts = SERVE_OPTIONS_INIT;
+
+	switch (determine_protocol_version_server()) {
+	case protocol_v2:
+		serve_opts.advertise_capabilities = options->advertise_refs;
+		serve_opts.stateless_rpc = options->stateless_rpc;
+		serve(&serve_opts);
+		break;
+	case protocol_v1:
+		/*
+		 * v1 is just the original protocol with a version string,
+		 * so just fall through after writing the version string.
+		 */
+		if (options->advertise_refs || !options->stateless_rpc)
+			packet_write_fmt(1, "version 1\n");
+
+		/* fallthrough */
+	case protocol_v0:
+		upload_pack(options);
+		break;
+	case protocol_unknown_version:
+		BUG("unknown protocol version");
+	}
+}
+
 static int parse_want(struct packet_writer *writer, const char *line,
 		      struct object_array *want_obj)
 {
@@ -10,6 +10,20 @@ struct upload_pack_options {
 
 void upload_pack(struct upload_pack_options *options);
 
+/*
+ * Serve an upload-pack request on stdin and stdout in the repository we
+ * are in, using the protocol version the client asked for.
+ */
+void serve_upload_pack(struct upload_pack_options *options);
+
+/*
+ * Fill the pack-objects cache entry `key`, whose lock is our standard
+ * output, by running the pack-objects command line `argv` on our standard
+ * input.  This is the producer that another upload-pack starts when it
+ * is the first to ask for the entry.
+ */
+int produce_pack_objects_cache_entry(const char *key, const char **argv);
+
 struct repository;
 struct strvec;
 struct packet_reader;
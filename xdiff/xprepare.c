@@ -31,7 +31,6 @@
 
 
 typedef struct s_xdlclass {
-	struct s_xdlclass *next;
 	unsigned long ha;
 	char const *line;
 	long size;
@@ -39,12 +38,16 @@ typedef struct s_xdlclass {
 	long len1, len2;
 } xdlclass_t;
 
+/*
+ * The classes live in one array, rcrecs[], indexed by class number;
+ * rchash[] is an open-addressed (linear probing) table of class
+ * number + 1, with 0 marking a free slot.  It is kept at most half full.
+ */
 typedef struct s_xdlclassifier {
 	unsigned int hbits;
 	long hsize;
-	xdlclass_t **rchash;
-	chastore_t ncha;
-	xdlclass_t **rcrecs;
+	long *rchash;
+	xdlclass_t *rcrecs;
 	long alloc;
 	long count;
 	long flags;
@@ -55,6 +58,7 @@ typedef struct s_xdlclassifier {
 
 static int xdl_init_classifier(xdlclassifier_t *cf, long size, long flags);
 static void xdl_free_classifier(xdlclassifier_t *cf);
+static int xdl_grow_classifier(xdlclassifier_t *cf);
 static int xdl_classify_record(unsigned int pass, xdlclassifier_t *cf, xrecord_t **rhash,
 			       unsigned int hbits, xrecord_t *rec);
 static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_t const *xpp,
@@ -71,25 +75,19 @@ static int xdl_optimize_ctxs(xdlclassifier_t *cf, xdfile_t *xdf1, xdfile_t *xdf2
 static int xdl_init_classifier(xdlclassifier_t *cf, long size, long flags) {
 	cf->flags = flags;
 
-	cf->hbits = xdl_hashbits((unsigned int) size);
+	cf->hbits = xdl_hashbits((unsigned int) size) + 1;
 	cf->hsize = 1 << cf->hbits;
 
-	if (xdl_cha_init(&cf->ncha, sizeof(xdlclass_t), size / 4 + 1) < 0) {
-
-		return -1;
-	}
-	if (!(cf->rchash = (xdlclass_t **) xdl_malloc(cf->hsize * sizeof(xdlclass_t *)))) {
+	if (!(cf->rchash = (long *) xdl_malloc(cf->hsize * sizeof(long)))) {
 
-		xdl_cha_free(&cf->ncha);
 		return -1;
 	}
-	memset(cf->rchash, 0, cf->hsize * sizeof(xdlclass_t *));
+	memset(cf->rchash, 0, cf->hsize * sizeof(long));
 
 	cf->alloc = size;
-	if (!(cf->rcrecs = (xdlclass_t **) xdl_malloc(cf->alloc * sizeof(xdlclass_t *)))) {
+	if (!(cf->rcrecs = (xdlclass_t *) xdl_malloc(cf->alloc * sizeof(xdlclass_t)))) {
 
 		xdl_free(cf->rchash);
-		xdl_cha_free(&cf->ncha);
 		return -1;
 	}
 
@@ -103,7 +101,33 @@ static void xdl_free_classifier(xdlclassifier_t *cf) {
 
 	xdl_free(cf->rcrecs);
 	xdl_free(cf->rchash);
-	xdl_cha_free(&cf->ncha);
+}
+
+
+static int xdl_grow_classifier(xdlclassifier_t *cf) {
+	unsigned int hbits = cf->hbits + 1;
+	long hsize = 1 << hbits, i, hi;
+	long *rchash;
+
+	if (!(rchash = (long *) xdl_malloc(hsize * sizeof(long)))) {
+
+		return -1;
+	}
+	memset(rchash, 0, hsize * sizeof(long));
+
+	for (i = 0; i < cf->count; i++) {
+		hi = (long) XDL_HASHLONG(cf->rcrecs[i].ha, hbits);
+		while (rchash[hi])
+			hi = (hi + 1) & (hsize - 1);
+		rchash[hi] = i + 1;
+	}
+
+	xdl_free(cf->rchash);
+	cf->rchash = rchash;
+	cf->hbits = hbits;
+	cf->hsize = hsize;
+
+	return 0;
 }
 
 
@@ -112,37 +136,37 @@ static int xdl_classify_record(unsigned int pass, xdlclassifier_t *cf, xrecord_t
 	long hi;
 	char const *line;
 	xdlclass_t *rcrec;
-	xdlclass_t **rcrecs;
+	xdlclass_t *rcrecs;
 
 	line = rec->ptr;
 	hi = (long) XDL_HASHLONG(rec->ha, cf->hbits);
-	for (rcrec = cf->rchash[hi]; rcrec; rcrec = rcrec->next)
+	for (; cf->rchash[hi]; hi = (hi + 1) & (cf->hsize - 1)) {
+		rcrec = &cf->rcrecs[cf->rchash[hi] - 1];
 		if (rcrec->ha == rec->ha &&
 				xdl_recmatch(rcrec->line, rcrec->size,
 					rec->ptr, rec->size, cf->flags))
 			break;
+	}
 
-	if (!rcrec) {
-		if (!(rcrec = xdl_cha_alloc(&cf->ncha))) {
-
-			return -1;
-		}
-		rcrec->idx = cf->count++;
-		if (cf->count > cf->alloc) {
+	if (!cf->rchash[hi]) {
+		if (cf->count >= cf->alloc) {
 			cf->alloc *= 2;
-			if (!(rcrecs = (xdlclass_t **) xdl_realloc(cf->rcrecs, cf->alloc * sizeof(xdlclass_t *)))) {
+			if (!(rcrecs = (xdlclass_t *) xdl_realloc(cf->rcrecs, cf->alloc * sizeof(xdlclass_t)))) {
 
 				return -1;
 			}
 			cf->rcrecs = rcrecs;
 		}
-		cf->rcrecs[rcrec->idx] = rcrec;
+		rcrec = &cf->rcrecs[cf->count];
+		rcrec->idx = cf->count++;
 		rcrec->line = line;
 		rcrec->size = rec->size;
 		rcrec->ha = rec->ha;
 		rcrec->len1 = rcrec->len2 = 0;
-		rcrec->next = cf->rchash[hi];
-		cf->rchash[hi] = rcrec;
+		cf->rchash[hi] = cf->count;
+
+		if (2 * cf->count > cf->hsize && xdl_grow_classifier(cf) < 0)
+			return -1;
 	}
 
 	(pass == 1) ? rcrec->len1++ : rcrec->len2++;
@@ -171,8 +195,6 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 	long *rindex;
 
 	ha = NULL;
-	rindex = NULL;
-	rchg = NULL;
 	rhash = NULL;
 	recs = NULL;
 
@@ -215,15 +237,19 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 		}
 	}
 
-	if (!(rchg = (char *) xdl_malloc((nrec + 2) * sizeof(char))))
+	/*
+	 * ha[], rindex[] and rchg[] are sized by nrec alike and live as
+	 * long as the context does, so carve them out of one allocation,
+	 * owned by ha.
+	 */
+	if (!(ha = (unsigned long *) xdl_malloc((nrec + 1) * sizeof(unsigned long) +
+						(nrec + 1) * sizeof(long) +
+						(nrec + 2) * sizeof(char))))
 		goto abort;
+	rindex = (long *) (ha + nrec + 1);
+	rchg = (char *) (rindex + nrec + 1);
 	memset(rchg, 0, (nrec + 2) * sizeof(char));
 
-	if (!(rindex = (long *) xdl_malloc((nrec + 1) * sizeof(long))))
-		goto abort;
-	if (!(ha = (unsigned long *) xdl_malloc((nrec + 1) * sizeof(unsigned long))))
-		goto abort;
-
 	xdf->nrec = nrec;
 	xdf->recs = recs;
 	xdf->hbits = hbits;
@@ -239,8 +265,6 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 
 abort:
 	xdl_free(ha);
-	xdl_free(rindex);
-	xdl_free(rchg);
 	xdl_free(rhash);
 	xdl_free(recs);
 	xdl_cha_free(&xdf->rcha);
@@ -251,8 +275,6 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 static void xdl_free_ctx(xdfile_t *xdf) {
 
 	xdl_free(xdf->rhash);
-	xdl_free(xdf->rindex);
-	xdl_free(xdf->rchg - 1);
 	xdl_free(xdf->ha);
 	xdl_free(xdf->recs);
 	xdl_cha_free(&xdf->rcha);
@@ -399,16 +421,16 @@ static int xdl_cleanup_records(xdlclassifier_t *cf, xdfile_t *xdf1, xdfile_t *xd
 	if ((mlim = xdl_bogosqrt(xdf1->nrec)) > XDL_MAX_EQLIMIT)
 		mlim = XDL_MAX_EQLIMIT;
 	for (i = xdf1->dstart, recs = &xdf1->recs[xdf1->dstart]; i <= xdf1->dend; i++, recs++) {
-		rcrec = cf->rcrecs[(*recs)->ha];
-		nm = rcrec ? rcrec->len2 : 0;
+		rcrec = &cf->rcrecs[(*recs)->ha];
+		nm = rcrec->len2;
 		dis1[i] = (nm == 0) ? 0: (nm >= mlim) ? 2: 1;
 	}
 
 	if ((mlim = xdl_bogosqrt(xdf2->nrec)) > XDL_MAX_EQLIMIT)
 		mlim = XDL_MAX_EQLIMIT;
 	for (i = xdf2->dstart, recs = &xdf2->recs[xdf2->dstart]; i <= xdf2->dend; i++, recs++) {
-		rcrec = cf->rcrecs[(*recs)->ha];
-		nm = rcrec ? rcrec->len1 : 0;
+		rcrec = &cf->rcrecs[(*recs)->ha];
+		nm = rcrec->len1;
 		dis2[i] = (nm == 0) ? 0: (nm >= mlim) ? 2: 1;
 	}
 
@@ -297,15 +297,22 @@ static unsigned long xdl_hash_record_with_whitespace(char const **data,
 unsigned long xdl_hash_record(char const **data, char const *top, long flags) {
 	unsigned long ha = 5381;
 	char const *ptr = *data;
+	char const *eol;
 
 	if (flags & XDF_WHITESPACE_FLAGS)
 		return xdl_hash_record_with_whitespace(data, top, flags);
 
-	for (; ptr < top && *ptr != '\n'; ptr++) {
+	/*
+	 * Let memchr(), which the C library vectorizes, find the end of
+	 * the line, so that the loop below only has to do the hashing.
+	 */
+	if (!(eol = memchr(ptr, '\n', top - ptr)))
+		eol = top;
+	for (; ptr < eol; ptr++) {
 		ha += (ha << 5);
 		ha ^= (unsigned long) *ptr;
 	}
-	*data = ptr < top ? ptr + 1: ptr;
+	*data = eol < top ? eol + 1: eol;
 
 	return ha;
 }